@@ -0,0 +1,237 @@
+/* Basic AVL-Tree implementation - Flat combining module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the flat combining module of the AVL-Tree implementation.
+ * It lets many threads share one tree. Every thread posts its
+ * operations to its own publication slot; whichever thread gets
+ * hold of the combiner lock applies all pending operations in one
+ * pass, sorted by key so that consecutive descents share their
+ * cache-warm paths, and hands the results back through the slots.
+ * The tree itself must only be accessed through the combiner while
+ * it is shared.
+ * This module provides:
+ *     - Search, insertion and deletion from any number of threads,
+ *       up to the number of slots given on creation.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_combining.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <assert.h>
+
+#define FC_SPINS 64 // Polls of the own slot between lock attempts.
+
+/*
+ * Function: make_flat_combiner
+ * ----------------------------
+ * Description:
+ * Create a flat combiner for a tree.
+ *
+ * Arguments: tree    - The tree to share.
+ *            n_slots - The maximum number of threads.
+ *
+ * Returns: Pointer to the newly created flat combiner.
+ */
+FlatCombiner * make_flat_combiner(AvlTree *tree, int n_slots){
+  // Check arguments.
+  assert(tree != NULL && n_slots > 0);
+
+  // Allocate memory, with the slots aligned to cache lines.
+  FlatCombiner *fc = (FlatCombiner *)malloc(sizeof(FlatCombiner));
+  void *slots = NULL;
+  int *batch = (int *)malloc(n_slots * sizeof(int));
+  if(fc == NULL || batch == NULL
+     || posix_memalign(&slots, FC_CACHE_LINE, n_slots * sizeof(FcSlot))){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating a flat combiner.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  memset(slots, 0, n_slots * sizeof(FcSlot));
+
+  fc->tree = tree;
+  fc->slots = (FcSlot *)slots;
+  fc->n_slots = n_slots;
+  fc->registered = 0;
+  fc->locked = 0;
+  fc->batch = batch;
+  fc->passes = fc->combined = 0;
+  return fc;
+}
+
+/*
+ * Function: free_flat_combiner
+ * ----------------------------
+ * Description:
+ * Free a flat combiner. The tree is not freed.
+ *
+ * Arguments: fc - The flat combiner to free.
+ *
+ * Returns: void
+ */
+void free_flat_combiner(FlatCombiner *fc){
+  // Check arguments.
+  assert(fc != NULL);
+
+  free(fc->slots);
+  free(fc->batch);
+  free(fc);
+}
+
+/*
+ * Function: fc_register
+ * ---------------------
+ * Description:
+ * Hand out a publication slot to the calling thread. Every
+ * thread has to register once, before its first operation.
+ *
+ * Arguments: fc - The flat combiner.
+ *
+ * Returns: The slot of the thread, -1 if all are taken.
+ */
+int fc_register(FlatCombiner *fc){
+  // Check arguments.
+  assert(fc != NULL);
+
+  int slot = __atomic_fetch_add(&fc->registered, 1, __ATOMIC_RELAXED);
+  return (slot < fc->n_slots) ? slot : -1;
+}
+
+/*
+ * Function: sort_batch
+ * --------------------
+ * Description:
+ * Internal helper. Sort the pending slots of a pass by key,
+ * and by slot on equal keys. Batches are at most as long as
+ * the number of threads, so insertion sort does.
+ *
+ * Arguments: fc - The flat combiner.
+ *            n  - The number of pending slots.
+ *
+ * Returns: void
+ */
+static void sort_batch(FlatCombiner *fc, int n){
+  int *batch = fc->batch;
+  for(int i = 1; i < n; i++){
+    int slot = batch[i], key = fc->slots[slot].key;
+    int j = i - 1;
+    while(j >= 0 && fc->slots[batch[j]].key > key){
+      batch[j + 1] = batch[j];
+      j--;
+    }
+    batch[j + 1] = slot;
+  }
+}
+
+/*
+ * Function: combine
+ * -----------------
+ * Description:
+ * Internal helper. Apply all pending operations in key order
+ * and publish their results. Called with the combiner lock
+ * held. Insertions start at the finger, the previous insertion
+ * point, which is close by in a sorted batch.
+ *
+ * Arguments: fc - The flat combiner.
+ *
+ * Returns: void
+ */
+static void combine(FlatCombiner *fc){
+  int n = 0, slots = fc->n_slots;
+  for(int i = 0; i < slots; i++){
+    if(__atomic_load_n(&fc->slots[i].pending, __ATOMIC_ACQUIRE)){
+      fc->batch[n++] = i;
+    }
+  }
+  sort_batch(fc, n);
+
+  AvlTree *tree = fc->tree;
+  for(int i = 0; i < n; i++){
+    FcSlot *slot = &fc->slots[fc->batch[i]];
+    Node *node = NULL;
+    switch(slot->op){
+    case FC_SEARCH:
+      slot->result = search_by_key(slot->key, tree, &node);
+      slot->data = slot->result ? node->data : NULL;
+      break;
+    case FC_INSERT:
+      slot->result = avl_insert_hint(tree, slot->key, NULL);
+      break;
+    case FC_DELETE:
+      slot->result = key_delete(slot->key, tree);
+      break;
+    }
+    __atomic_store_n(&slot->pending, 0, __ATOMIC_RELEASE);
+  }
+  fc->passes++;
+  fc->combined += n;
+}
+
+/*
+ * Function: fc_apply
+ * ------------------
+ * Description:
+ * Post an operation and wait for its result, combining the
+ * pending operations of all threads if the combiner lock is
+ * free.
+ *
+ * Arguments: fc   - The flat combiner.
+ *            slot - The slot of the calling thread.
+ *            op   - The operation.
+ *            key  - The key of the operation.
+ *            data - Receives the data of the node found by a
+ *                   search. May be NULL.
+ *
+ * Returns: The result of the operation, as returned by
+ *          search_by_key, key_insert_new or key_delete.
+ */
+int fc_apply(FlatCombiner *fc, int slot, FcOp op, int key, void **data){
+  // Check arguments.
+  assert(fc != NULL && slot >= 0 && slot < fc->n_slots);
+
+  // Post the request.
+  FcSlot *own = &fc->slots[slot];
+  own->op = op;
+  own->key = key;
+  __atomic_store_n(&own->pending, 1, __ATOMIC_RELEASE);
+
+  for(;;){
+    // Become the combiner if nobody else is.
+    if(!__atomic_load_n(&fc->locked, __ATOMIC_RELAXED)
+       && !__atomic_exchange_n(&fc->locked, 1, __ATOMIC_ACQUIRE)){
+      combine(fc);
+      __atomic_store_n(&fc->locked, 0, __ATOMIC_RELEASE);
+    }
+
+    // Otherwise wait for a combiner to serve the request.
+    for(int spin = 0; spin < FC_SPINS; spin++){
+      if(!__atomic_load_n(&own->pending, __ATOMIC_ACQUIRE)){
+	if(data) *data = own->data;
+	return own->result;
+      }
+    }
+    sched_yield();
+  }
+}
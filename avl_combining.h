@@ -0,0 +1,170 @@
+/* Basic AVL-Tree implementation - Flat combining module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the flat combining module of the AVL-Tree implementation.
+ * It lets many threads share one tree. Every thread posts its
+ * operations to its own publication slot; whichever thread gets
+ * hold of the combiner lock applies all pending operations in one
+ * pass, sorted by key so that consecutive descents share their
+ * cache-warm paths, and hands the results back through the slots.
+ * The tree itself must only be accessed through the combiner while
+ * it is shared.
+ * This module provides:
+ *     - Search, insertion and deletion from any number of threads,
+ *       up to the number of slots given on creation.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_COMBINING_H_
+#define __AVL_COMBINING_H_
+
+#include "avl_core.h"
+
+#define FC_CACHE_LINE 64 // Size of a publication slot, to avoid false sharing.
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Enum: fc_op_e
+ * -------------
+ * Description:
+ * The operations that can be posted to a flat combiner.
+ */
+typedef enum fc_op_e {
+  FC_SEARCH,
+  FC_INSERT,
+  FC_DELETE
+} FcOp;
+
+/*
+ * Structure: fc_slot_s
+ * --------------------
+ * Description:
+ * The publication slot of one thread, alone on its cache line.
+ *
+ * Fields: op - The posted operation.
+ *         key - The key of the operation.
+ *         result - The result of the operation.
+ *         data - Data of the node found by a search.
+ *         pending - Set by the owner when posting, cleared by
+ *                   the combiner once the result is stored.
+ */
+typedef struct fc_slot_s {
+  int op, key;
+  int result;
+  int pending;
+  void *data;
+  char padding[FC_CACHE_LINE - 4 * sizeof(int) - sizeof(void *)];
+} FcSlot;
+
+/*
+ * Structure: flat_combiner_s
+ * --------------------------
+ * Description:
+ * A flat combining front end of a tree.
+ *
+ * Fields: tree - The shared tree.
+ *         slots - The publication slots.
+ *         n_slots - The number of slots.
+ *         registered - The number of slots handed out.
+ *         locked - The combiner lock.
+ *         batch - Scratch list of the pending slots, used by
+ *                 the combiner.
+ *         passes - Number of combining passes so far.
+ *         combined - Number of operations applied so far.
+ */
+typedef struct flat_combiner_s {
+  AvlTree *tree;
+  FcSlot *slots;
+  int n_slots, registered;
+  int locked;
+  int *batch;
+  long passes, combined;
+} FlatCombiner;
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: make_flat_combiner
+ * ----------------------------
+ * Description:
+ * Create a flat combiner for a tree.
+ *
+ * Arguments: tree    - The tree to share.
+ *            n_slots - The maximum number of threads.
+ *
+ * Returns: Pointer to the newly created flat combiner.
+ */
+extern FlatCombiner * make_flat_combiner(AvlTree *tree, int n_slots);
+
+/*
+ * Function: free_flat_combiner
+ * ----------------------------
+ * Description:
+ * Free a flat combiner. The tree is not freed.
+ *
+ * Arguments: fc - The flat combiner to free.
+ *
+ * Returns: void
+ */
+extern void free_flat_combiner(FlatCombiner *fc);
+
+/*
+ * Function: fc_register
+ * ---------------------
+ * Description:
+ * Hand out a publication slot to the calling thread. Every
+ * thread has to register once, before its first operation.
+ *
+ * Arguments: fc - The flat combiner.
+ *
+ * Returns: The slot of the thread, -1 if all are taken.
+ */
+extern int fc_register(FlatCombiner *fc);
+
+/*
+ * Function: fc_apply
+ * ------------------
+ * Description:
+ * Post an operation and wait for its result, combining the
+ * pending operations of all threads if the combiner lock is
+ * free.
+ *
+ * Arguments: fc   - The flat combiner.
+ *            slot - The slot of the calling thread.
+ *            op   - The operation.
+ *            key  - The key of the operation.
+ *            data - Receives the data of the node found by a
+ *                   search. May be NULL.
+ *
+ * Returns: The result of the operation, as returned by
+ *          search_by_key, key_insert_new or key_delete.
+ */
+extern int fc_apply(FlatCombiner *fc, int slot, FcOp op, int key,
+		    void **data);
+
+#endif /* __AVL_COMBINING_H_ */
@@ -26,678 +26,4870 @@
  *     > 2:  Critical Error in core functions. 
  */
 
+#define _POSIX_C_SOURCE 200112L
+
+// Instances for other key types are declared by the including file.
+#ifndef AVL_PREFIX
 #include "avl_core.h"
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 
 /*
- * Function: make_tree_from_node
- * -----------------------------
+ * The key type and three way comparator of the core. Without
+ * AVL_PREFIX it is built for int keys, together with the
+ * features that hash the keys or compute with them. The
+ * instances for other key types define all three and include
+ * this file (see avl_typed.h).
+ */
+#ifndef AVL_PREFIX
+#define AVL_KEY_T int
+#define AVL_KEY_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+#endif
+#include "avl_names.h"
+
+/*
+ * ------------------------------
+ * -- Augmentation primitives. --
+ * ------------------------------
+ */
+
+// Per-node value and subtree aggregate of an augmented tree.
+#define AUG_VALUE(tree, node) \
+  ((char *)AVL_NODE_EXT(node, (tree)->augment_offset))
+#define AUG_AGGREGATE(tree, node) \
+  (AUG_VALUE(tree, node) + (tree)->augment->size)
+
+// The operators of the built-in int64 augmentations.
+#define I64_SUM(a, b) ((a) + (b))
+#define I64_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define I64_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+/*
+ * Macro: DEFINE_I64_AUGMENT
+ * -------------------------
  * Description:
- * Creates a new tree from a pre-existing node.
+ * Generate the node update function of a built-in int64
+ * augmentation, with the operator inlined. The aggregate of
+ * a node is OP(OP(left aggregate, value), right aggregate).
+ *
+ * Arguments: name - Suffix of the generated function.
+ *            OP   - The (associative) operator.
+ */
+#define DEFINE_I64_AUGMENT(name, OP)					\
+  static inline void augment_##name(Node *node, size_t offset){	\
+    long long *val = (long long *)AVL_NODE_EXT(node, offset);		\
+    long long agg = val[0];						\
+    if(node->left_child){						\
+      agg = OP(((long long *)AVL_NODE_EXT(node->left_child, offset))[1], agg); \
+    }									\
+    if(node->right_child){						\
+      agg = OP(agg, ((long long *)AVL_NODE_EXT(node->right_child, offset))[1]); \
+    }									\
+    val[1] = agg;							\
+  }
+
+DEFINE_I64_AUGMENT(sum_i64, I64_SUM)
+DEFINE_I64_AUGMENT(min_i64, I64_MIN)
+DEFINE_I64_AUGMENT(max_i64, I64_MAX)
+
+/*
+ * Function: augment_merkle
+ * ------------------------
+ * Description:
+ * Internal helper. The node update of the Merkle augmentation:
+ * the aggregate is the sum of the entry hashes in the subtree,
+ * wrapping modulo 2^64.
+ *
+ * Arguments: node   - The node to update.
+ *            offset - Offset of the augmentation in the node.
+ *
+ * Returns: void
+ */
+static inline void augment_merkle(Node *node, size_t offset){
+  unsigned long long *val = (unsigned long long *)AVL_NODE_EXT(node, offset);
+  unsigned long long agg = val[0];
+  if(node->left_child){
+    agg += ((unsigned long long *)AVL_NODE_EXT(node->left_child, offset))[1];
+  }
+  if(node->right_child){
+    agg += ((unsigned long long *)AVL_NODE_EXT(node->right_child, offset))[1];
+  }
+  val[1] = agg;
+}
+
+// Descriptors of the built-in augmentations, shared by all key types.
+#ifndef AVL_PREFIX
+const AvlAugment avl_augment_sum_i64 = {AVL_AUG_SUM_I64, sizeof(long long), NULL, NULL};
+const AvlAugment avl_augment_min_i64 = {AVL_AUG_MIN_I64, sizeof(long long), NULL, NULL};
+const AvlAugment avl_augment_max_i64 = {AVL_AUG_MAX_I64, sizeof(long long), NULL, NULL};
+const AvlAugment avl_augment_merkle = {AVL_AUG_MERKLE, sizeof(unsigned long long), NULL, NULL};
+#endif
+
+/*
+ * Function: augment_combine
+ * -------------------------
+ * Description:
+ * Internal helper. Combine two aggregates of the tree's
+ * augmentation: out = a (+) b. out may alias a or b.
+ *
+ * Arguments: tree - The augmented tree.
+ *            out  - Receives the combined aggregate.
+ *            a    - The left operand.
+ *            b    - The right operand.
+ *
+ * Returns: void
+ */
+static inline void augment_combine(AvlTree *tree, void *out,
+				   const void *a, const void *b){
+  const AvlAugment *aug = tree->augment;
+  long long x, y;
+
+  switch(aug->kind){
+  case AVL_AUG_SUM_I64:
+    x = *(const long long *)a; y = *(const long long *)b;
+    *(long long *)out = I64_SUM(x, y);
+    break;
+  case AVL_AUG_MIN_I64:
+    x = *(const long long *)a; y = *(const long long *)b;
+    *(long long *)out = I64_MIN(x, y);
+    break;
+  case AVL_AUG_MAX_I64:
+    x = *(const long long *)a; y = *(const long long *)b;
+    *(long long *)out = I64_MAX(x, y);
+    break;
+  case AVL_AUG_MERKLE:
+    *(unsigned long long *)out =
+      *(const unsigned long long *)a + *(const unsigned long long *)b;
+    break;
+  default:
+    aug->combine(out, a, b, aug->ctx);
+  }
+}
+
+/*
+ * Function: augment_node
+ * ----------------------
+ * Description:
+ * Internal helper. Recompute the subtree aggregate of a node
+ * from its value and the aggregates of its children. Has to
+ * be called whenever the children of a node change.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The node to update.
+ *
+ * Returns: void
+ */
+static inline void augment_node(AvlTree *tree, Node *node){
+  switch(tree->augment->kind){
+  case AVL_AUG_SUM_I64:
+    augment_sum_i64(node, tree->augment_offset);
+    break;
+  case AVL_AUG_MIN_I64:
+    augment_min_i64(node, tree->augment_offset);
+    break;
+  case AVL_AUG_MAX_I64:
+    augment_max_i64(node, tree->augment_offset);
+    break;
+  case AVL_AUG_MERKLE:
+    augment_merkle(node, tree->augment_offset);
+    break;
+  default:{
+    // Generic case through the user supplied combine function.
+    char *agg = AUG_AGGREGATE(tree, node);
+    if(node->left_child){
+      augment_combine(tree, agg, AUG_AGGREGATE(tree, node->left_child),
+		      AUG_VALUE(tree, node));
+    }else{
+      memcpy(agg, AUG_VALUE(tree, node), tree->augment->size);
+    }
+    if(node->right_child){
+      augment_combine(tree, agg, agg, AUG_AGGREGATE(tree, node->right_child));
+    }
+  }
+  }
+}
+
+/*
+ * Function: augment_path
+ * ----------------------
+ * Description:
+ * Internal helper. Recompute the aggregates of a node and
+ * all of its ancestors.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The lowest node to update.
+ *
+ * Returns: void
+ */
+static void augment_path(AvlTree *tree, Node *node){
+  for(; node; node = node->parent){
+    augment_node(tree, node);
+  }
+}
+
+/*
+ * Function: leftmost
+ * ------------------
+ * Description:
+ * Internal helper. Walk down the left spine of a subtree.
+ *
+ * Arguments: node - The root of the subtree.
+ *
+ * Returns: The node with the smallest key in the subtree.
+ */
+static Node * leftmost(Node *node){
+  while(node->left_child) node = node->left_child;
+  return node;
+}
+
+/*
+ * Function: rightmost
+ * -------------------
+ * Description:
+ * Internal helper. Walk down the right spine of a subtree.
+ *
+ * Arguments: node - The root of the subtree.
+ *
+ * Returns: The node with the largest key in the subtree.
+ */
+static Node * rightmost(Node *node){
+  while(node->right_child) node = node->right_child;
+  return node;
+}
+
+/*
+ * -------------------------
+ * -- Memory accounting. --
+ * -------------------------
+ */
+
+// Bytes of n nodes, split in to the node and its extension area.
+#define NODE_BYTES(n) ((n) * sizeof(Node))
+#define PAYLOAD_BYTES(tree, n) ((n) * ((tree)->node_size - sizeof(Node)))
+
+/*
+ * Function: memory_charge
+ * -----------------------
+ * Description:
+ * Internal helper. Account for memory a tree is about to
+ * allocate. Allocations for insertions are refused if they
+ * would take the tree beyond its memory limit.
+ *
+ * Arguments: tree    - The tree allocating.
+ *            nodes   - Bytes of nodes.
+ *            payload - Bytes of node extension areas.
+ *            aux     - Bytes of auxiliary structures.
+ *            limited - Whether the limit applies.
+ *
+ * Returns: 1 - The memory was accounted for.
+ *          0 - The limit would be exceeded, nothing changed.
+ */
+static int memory_charge(AvlTree *tree, size_t nodes, size_t payload,
+			 size_t aux, int limited){
+  size_t bytes = nodes + payload + aux;
+  if(limited && tree->limit && tree->memory.total + bytes > tree->limit){
+    return 0;
+  }
+
+  tree->memory.nodes += nodes;
+  tree->memory.payload += payload;
+  tree->memory.aux += aux;
+  tree->memory.total += bytes;
+  return 1;
+}
+
+/*
+ * Function: memory_discharge
+ * --------------------------
+ * Description:
+ * Internal helper. Account for memory a tree freed, and
+ * re-arm the budget callback once the tree is back within
+ * its budget.
+ *
+ * Arguments: tree    - The tree freeing.
+ *            nodes   - Bytes of nodes.
+ *            payload - Bytes of node extension areas.
+ *            aux     - Bytes of auxiliary structures.
+ *
+ * Returns: void
+ */
+static void memory_discharge(AvlTree *tree, size_t nodes, size_t payload,
+			     size_t aux){
+  tree->memory.nodes -= nodes;
+  tree->memory.payload -= payload;
+  tree->memory.aux -= aux;
+  tree->memory.total -= nodes + payload + aux;
+  if(tree->over_budget && tree->memory.total <= tree->budget){
+    tree->over_budget = 0;
+  }
+}
+
+/*
+ * Function: memory_check
+ * ----------------------
+ * Description:
+ * Internal helper. Call the budget callback if the tree just
+ * grew past its budget. Only called at the end of operations,
+ * when the tree is consistent.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
+ */
+static void memory_check(AvlTree *tree){
+  if(tree->budget == 0 || tree->over_budget) return;
+  if(tree->memory.total <= tree->budget) return;
+
+  tree->over_budget = 1;
+  if(tree->on_budget){
+    tree->on_budget(tree, tree->memory.total, tree->budget_ctx);
+  }
+}
+
+/*
+ * -----------------
+ * -- Node blocks. --
+ * -----------------
+ */
+
+/*
+ * Structure: avl_node_block_s
+ * ---------------------------
+ * Description:
+ * A block of nodes, filled front to back. Its memory is a run
+ * of AVL_CHUNK_SIZE aligned chunks, each starting with a
+ * pointer back to the block, so the block of a node is found
+ * from the node's address alone. The block belongs to no
+ * tree: every live node holds a reference to it, whichever
+ * tree the node is in, so nodes can move between trees (see
+ * avl_seq_split). Slots of deleted nodes are not reused; the
+ * block is freed once its last reference is dropped.
+ *
+ * Fields: memory - The first chunk.
+ *         size - Number of node slots.
+ *         used - Number of node slots handed out.
+ *         refs - Number of live nodes in the block, plus one
+ *                while a compaction is filling it. Updated
+ *                atomically, as the trees sharing the block
+ *                may be used by different threads.
+ */
+struct avl_node_block_s {
+  char *memory;
+  size_t size, used;
+  int refs;
+};
+
+// The first node slot of a block.
+#define BLOCK_SLOTS(block) ((Node *)((block)->memory + AVL_CHUNK_HEADER))
+
+/*
+ * Function: node_block
+ * --------------------
+ * Description:
+ * Internal helper. The block of a node living in one, read
+ * from the header of the node's chunk. O(1).
+ *
+ * Arguments: node - The node, with in_block set.
+ *
+ * Returns: Pointer to the block.
+ */
+static inline AvlNodeBlock * node_block(Node *node){
+  uintptr_t chunk = (uintptr_t)node & ~(uintptr_t)(AVL_CHUNK_SIZE - 1);
+  return *(AvlNodeBlock **)chunk;
+}
+
+/*
+ * Function: alloc_block
+ * ---------------------
+ * Description:
+ * Internal helper. Allocate a node block for a given number
+ * of nodes of a tree's layout.
+ *
+ * Arguments: tree - The tree the nodes are for.
+ *            n    - The number of node slots, at least 1.
+ *
+ * Returns: Pointer to the new, empty block without references,
+ *          NULL if memory ran out.
+ */
+static AvlNodeBlock * alloc_block(AvlTree *tree, size_t n){
+  // The last chunk only holds the remaining slots.
+  size_t chunks = (n + AVL_CHUNK_SLOTS(tree) - 1) / AVL_CHUNK_SLOTS(tree);
+  size_t tail = n - (chunks - 1) * AVL_CHUNK_SLOTS(tree);
+  size_t bytes = (chunks - 1) * AVL_CHUNK_SIZE + AVL_CHUNK_HEADER +
+    tail * tree->node_size;
+
+  AvlNodeBlock *block = (AvlNodeBlock *)malloc(sizeof(AvlNodeBlock));
+  void *memory = NULL;
+  if(block == NULL || posix_memalign(&memory, AVL_CHUNK_SIZE, bytes) != 0){
+    free(block);
+    return NULL;
+  }
+
+  block->memory = (char *)memory;
+  for(size_t i = 0; i < chunks; i++){
+    *(AvlNodeBlock **)(block->memory + i * AVL_CHUNK_SIZE) = block;
+  }
+  block->size = n;
+  block->used = 0;
+  block->refs = 0;
+  return block;
+}
+
+/*
+ * Function: block_take
+ * --------------------
+ * Description:
+ * Internal helper. Hand out the next unused slot of a block
+ * to a tree, which is charged for the node.
+ *
+ * Arguments: tree  - The tree the node is for.
+ *            block - The block, which must not be full.
+ *
+ * Returns: Pointer to the node slot.
+ */
+static Node * block_take(AvlTree *tree, AvlNodeBlock *block){
+  assert(block->used < block->size);
+  Node *node = AVL_NODE_SLOT(tree, BLOCK_SLOTS(block), block->used);
+  block->used++;
+  __atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+  memory_charge(tree, NODE_BYTES(1), PAYLOAD_BYTES(tree, 1), 0, 0);
+  return node;
+}
+
+/*
+ * Function: block_unref
+ * ---------------------
+ * Description:
+ * Internal helper. Drop references to a block, freeing it if
+ * they were the last ones.
+ *
+ * Arguments: block - The block.
+ *            n     - The number of references dropped.
+ *
+ * Returns: void
+ */
+static void block_unref(AvlNodeBlock *block, int n){
+  if(__atomic_sub_fetch(&block->refs, n, __ATOMIC_ACQ_REL) > 0) return;
+
+  free(block->memory);
+  free(block);
+}
+
+/*
+ * Function: release_node
+ * ----------------------
+ * Description:
+ * Internal helper. Free the memory of an unlinked node,
+ * which was either allocated on its own or lives in a node
+ * block, and discharge the tree. O(1).
+ *
+ * Arguments: tree - The tree the node belonged to.
+ *            node - The node to release.
+ *
+ * Returns: void
+ */
+static void release_node(AvlTree *tree, Node *node){
+  memory_discharge(tree, NODE_BYTES(1), PAYLOAD_BYTES(tree, 1), 0);
+  if(node->in_block){
+    block_unref(node_block(node), 1);
+  }else{
+    free(node);
+  }
+}
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * ---------------------
+ * -- Hot-key caching. --
+ * ---------------------
+ */
+
+#define CACHE_WAYS 4 // Entries per set, one cache line of entries.
+
+/*
+ * Structure: avl_cache_entry_s
+ * ----------------------------
+ * Description:
+ * An entry of a hot-key cache. Empty if node is NULL.
+ *
+ * Fields: key - The cached key.
+ *         node - The node holding the key.
+ */
+typedef struct avl_cache_entry_s {
+  int key;
+  Node *node;
+} AvlCacheEntry;
+
+/*
+ * Structure: avl_cache_s
+ * ----------------------
+ * Description:
+ * A set-associative cache mapping keys to their nodes. Each
+ * set holds CACHE_WAYS entries, most recently used first.
+ * Lookups reorder the sets and count, so they write unless
+ * the cache is frozen (see avl_cache_freeze).
+ *
+ * Fields: entries - The sets, one after the other.
+ *         set_bits - log2 of the number of sets.
+ *         frozen - Whether lookups leave the cache untouched.
+ *         stats - The hit, miss and eviction counters.
+ */
+struct avl_cache_s {
+  AvlCacheEntry *entries;
+  int set_bits;
+  int frozen;
+  AvlCacheStats stats;
+};
+
+/*
+ * Function: cache_set
+ * -------------------
+ * Description:
+ * Internal helper. The set a key maps to, chosen by
+ * multiplicative hashing.
+ *
+ * Arguments: cache - The cache.
+ *            key   - The key.
+ *
+ * Returns: Pointer to the first entry of the set.
+ */
+static inline AvlCacheEntry * cache_set(AvlCache *cache, int key){
+  unsigned hash = (unsigned)key * 0x9E3779B1u;
+  unsigned set = cache->set_bits ? hash >> (32 - cache->set_bits) : 0;
+  return cache->entries + set * CACHE_WAYS;
+}
+
+/*
+ * Function: cache_lookup
+ * ----------------------
+ * Description:
+ * Internal helper. Look a key up in the cache, moving a hit
+ * to the front of its set. A frozen cache is only read.
+ *
+ * Arguments: cache - The cache.
+ *            key   - The key.
+ *
+ * Returns: The cached node, NULL on a miss.
+ */
+static Node * cache_lookup(AvlCache *cache, int key){
+  AvlCacheEntry *set = cache_set(cache, key);
+  for(int way = 0; way < CACHE_WAYS && set[way].node; way++){
+    if(set[way].key == key){
+      if(cache->frozen) return set[way].node;
+      AvlCacheEntry hit = set[way];
+      memmove(set + 1, set, way * sizeof(AvlCacheEntry));
+      set[0] = hit;
+      cache->stats.hits++;
+      return hit.node;
+    }
+  }
+  if(!cache->frozen) cache->stats.misses++;
+  return NULL;
+}
+
+/*
+ * Function: cache_fill
+ * --------------------
+ * Description:
+ * Internal helper. Put a node at the front of its set,
+ * evicting the least recently used entry of a full set.
+ *
+ * Arguments: cache - The cache.
+ *            node  - The node, not yet cached.
+ *
+ * Returns: void
+ */
+static void cache_fill(AvlCache *cache, Node *node){
+  AvlCacheEntry *set = cache_set(cache, node->key);
+  if(set[CACHE_WAYS - 1].node) cache->stats.evictions++;
+  memmove(set + 1, set, (CACHE_WAYS - 1) * sizeof(AvlCacheEntry));
+  set[0].key = node->key;
+  set[0].node = node;
+}
+
+/*
+ * Function: cache_update
+ * ----------------------
+ * Description:
+ * Internal helper. Point the entry of a key to a new node,
+ * or drop it if node is NULL.
+ *
+ * Arguments: cache - The cache.
+ *            key   - The key.
+ *            node  - The new node of the key, or NULL.
+ *
+ * Returns: void
+ */
+static void cache_update(AvlCache *cache, int key, Node *node){
+  AvlCacheEntry *set = cache_set(cache, key);
+  for(int way = 0; way < CACHE_WAYS && set[way].node; way++){
+    if(set[way].key == key){
+      if(node){
+	set[way].node = node;
+      }else{
+	memmove(set + way, set + way + 1,
+		(CACHE_WAYS - 1 - way) * sizeof(AvlCacheEntry));
+	set[CACHE_WAYS - 1].node = NULL;
+      }
+      return;
+    }
+  }
+}
+
+/*
+ * ----------------------------
+ * -- Negative lookup filter. --
+ * ----------------------------
+ */
+
+#define FILTER_BLOCK_BITS 512 // Bits per filter block, one cache line.
+#define FILTER_MAX_PROBES 16 // Upper bound on the bits set per key.
+
+/*
+ * Structure: avl_filter_s
+ * -----------------------
+ * Description:
+ * A blocked Bloom filter over the keys of a tree. All bits of
+ * a key lie in one cache line sized block. Deleted keys stay
+ * in the filter until it is rebuilt from the tree, which
+ * happens once the deletions reach a quarter of the keys it
+ * was built from, or once the tree outgrows its capacity.
+ *
+ * Fields: memory - The allocation holding the blocks.
+ *         blocks - The blocks, aligned to 64 bytes.
+ *         n_blocks - The number of blocks.
+ *         probes - The number of bits set per key.
+ *         bits_per_key - The number of filter bits per key.
+ *         capacity - The number of keys the filter is sized for.
+ *         built_keys - Number of keys at the last rebuild.
+ *         deletes - Deletions since the last rebuild.
+ *         stats - The filter counters.
+ */
+struct avl_filter_s {
+  void *memory;
+  uint64_t *blocks;
+  size_t n_blocks;
+  int probes, bits_per_key;
+  int capacity, built_keys, deletes;
+  AvlFilterStats stats;
+};
+
+/*
+ * Function: hash_key
+ * ------------------
+ * Description:
+ * Internal helper. Mix a key in to a 64 bit hash (the
+ * splitmix64 finalizer). Used by the filter and the Merkle
+ * augmentation.
+ *
+ * Arguments: key - The key.
+ *
+ * Returns: The hash.
+ */
+static inline uint64_t hash_key(int key){
+  uint64_t h = (uint64_t)(unsigned)key + 0x9E3779B97F4A7C15ull;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+/*
+ * Function: merkle_hash
+ * ---------------------
+ * Description:
+ * Internal helper. The hash of an entry of a Merkle augmented
+ * tree: the key hash, with the payload bytes (FNV-1a) mixed
+ * in if there are any.
+ *
+ * Arguments: key     - The key.
+ *            payload - The payload bytes, or NULL.
+ *            len     - Length of the payload.
+ *
+ * Returns: The hash.
+ */
+static uint64_t merkle_hash(int key, const void *payload, size_t len){
+  uint64_t h = hash_key(key);
+  if(payload == NULL || len == 0) return h;
+
+  uint64_t fnv = 0xCBF29CE484222325ull;
+  for(size_t i = 0; i < len; i++){
+    fnv = (fnv ^ ((const unsigned char *)payload)[i]) * 0x100000001B3ull;
+  }
+  h ^= fnv;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
+}
+
+/*
+ * Function: filter_probe
+ * ----------------------
+ * Description:
+ * Internal helper. Test the bits of a key, or set them. The
+ * upper half of the hash selects the block, the lower half
+ * derives the bit positions by double hashing.
+ *
+ * Arguments: filter - The filter.
+ *            key    - The key.
+ *            set    - Set the bits instead of testing them.
+ *
+ * Returns: 1 - All bits of the key are set.
+ *          0 - The key is certainly not in the tree.
+ */
+static int filter_probe(AvlFilter *filter, int key, int set){
+  uint64_t h = hash_key(key);
+  uint64_t *block = filter->blocks
+    + ((h >> 32) * filter->n_blocks >> 32) * (FILTER_BLOCK_BITS / 64);
+  uint32_t a = (uint32_t)h, b = (uint32_t)(h >> 17) | 1;
+
+  for(int i = 0; i < filter->probes; i++){
+    uint32_t bit = (a + i * b) % FILTER_BLOCK_BITS;
+    uint64_t mask = (uint64_t)1 << (bit % 64);
+    if(set){
+      block[bit / 64] |= mask;
+    }else if(!(block[bit / 64] & mask)){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Function: filter_rebuild
+ * ------------------------
+ * Description:
+ * Internal helper. Size the filter for its capacity and fill
+ * it with the keys of the tree, dropping deleted keys. O(n).
+ * If there is no memory for the new size, the filter is left
+ * as it was.
+ *
+ * Arguments: tree - The tree, with a filter attached.
+ *
+ * Returns: 1 - The filter was rebuilt.
+ *          0 - Memory allocation failed.
+ */
+static int filter_rebuild(AvlTree *tree){
+  AvlFilter *filter = tree->filter;
+  size_t bits = (size_t)filter->capacity * filter->bits_per_key;
+  size_t n_blocks = (bits + FILTER_BLOCK_BITS - 1) / FILTER_BLOCK_BITS;
+  if(n_blocks == 0) n_blocks = 1;
+
+  // Over-allocate to align the blocks to cache lines.
+  size_t size = n_blocks * (FILTER_BLOCK_BITS / 8);
+  void *memory = realloc(filter->memory, size + 63);
+  if(memory == NULL) return 0;
+  if(filter->memory){
+    memory_discharge(tree, 0, 0, filter->n_blocks * (FILTER_BLOCK_BITS / 8)
+		     + 63);
+  }
+  memory_charge(tree, 0, 0, size + 63, 0);
+  filter->memory = memory;
+  filter->blocks = (uint64_t *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+  filter->n_blocks = n_blocks;
+  memset(filter->blocks, 0, size);
+
+  for(Node *node = tree->min_node; node; node = avl_next(node)){
+    filter_probe(filter, node->key, 1);
+  }
+  filter->built_keys = tree->number_of_nodes;
+  filter->deletes = 0;
+  filter->stats.rebuilds++;
+  return 1;
+}
+
+/*
+ * Function: filter_insert
+ * -----------------------
+ * Description:
+ * Internal helper. Add a new key to the filter, doubling its
+ * capacity if the tree outgrew it.
+ *
+ * Arguments: tree - The tree, with a filter attached.
+ *            key  - The inserted key.
+ *
+ * Returns: void
+ */
+static void filter_insert(AvlTree *tree, int key){
+  AvlFilter *filter = tree->filter;
+  if(tree->number_of_nodes > filter->capacity){
+    // Without memory to grow, the filter just gets less selective.
+    filter->capacity *= 2;
+    if(!filter_rebuild(tree)) filter->capacity /= 2;
+  }
+  // The cached minimum may not include the new node yet, so set
+  // its bits explicitly.
+  filter_probe(filter, key, 1);
+}
+
+/*
+ * Function: filter_delete
+ * -----------------------
+ * Description:
+ * Internal helper. Account for a deleted key, rebuilding the
+ * filter once too many deleted keys linger in it. Called after
+ * the node has been unlinked.
+ *
+ * Arguments: tree - The tree, with a filter attached.
+ *
+ * Returns: void
+ */
+static void filter_delete(AvlTree *tree){
+  AvlFilter *filter = tree->filter;
+  filter->deletes++;
+  if(filter->deletes > filter->built_keys / 4 && filter->deletes > 64){
+    // A failed rebuild keeps the deleted keys, which is still correct.
+    filter_rebuild(tree);
+  }
+}
+#endif
+
+/*
+ * -----------------------
+ * -- Expiring entries. --
+ * -----------------------
+ */
+
+/*
+ * Structure: expiry_entry_s
+ * -------------------------
+ * Description:
+ * The expiry state kept in the extension area of every node
+ * of an expiring tree.
+ *
+ * Fields: deadline - When the node expires, AVL_NO_DEADLINE if
+ *                    never.
+ *         slot - Position of the node in the deadline heap, -1
+ *                if it has no deadline.
+ */
+typedef struct expiry_entry_s {
+  long long deadline;
+  int slot;
+} ExpiryEntry;
+
+/*
+ * Structure: avl_expiry_s
+ * -----------------------
+ * Description:
+ * The deadlines of an expiring tree: a binary min-heap of the
+ * nodes that have one, ordered by deadline. Each node knows
+ * its heap slot, so it can leave the heap in O(log n) when it
+ * is deleted or its deadline changes.
+ *
+ * Fields: heap - The nodes with a deadline, earliest first.
+ *         size - Number of nodes in the heap.
+ *         capacity - Number of slots of the heap.
+ *         offset - Offset of the ExpiryEntry in the extension area.
+ *         now - The current time, as last set.
+ *         hide - Whether lookups treat expired nodes as absent.
+ */
+struct avl_expiry_s {
+  Node **heap;
+  int size, capacity;
+  size_t offset;
+  long long now;
+  int hide;
+};
+
+// The expiry state of a node of an expiring tree.
+#define EXPIRY_ENTRY(tree, node) \
+  ((ExpiryEntry *)AVL_NODE_EXT(node, (tree)->expiry->offset))
+
+/*
+ * Function: expiry_place
+ * ----------------------
+ * Description:
+ * Internal helper. Put a node in to a heap slot.
+ *
+ * Arguments: tree - The expiring tree.
+ *            node - The node.
+ *            slot - The heap slot.
+ *
+ * Returns: void
+ */
+static inline void expiry_place(AvlTree *tree, Node *node, int slot){
+  tree->expiry->heap[slot] = node;
+  EXPIRY_ENTRY(tree, node)->slot = slot;
+}
+
+/*
+ * Function: expiry_sift
+ * ---------------------
+ * Description:
+ * Internal helper. Restore the heap order around a slot whose
+ * deadline changed, moving its node up or down.
+ *
+ * Arguments: tree - The expiring tree.
+ *            slot - The changed slot.
+ *
+ * Returns: void
+ */
+static void expiry_sift(AvlTree *tree, int slot){
+  AvlExpiry *expiry = tree->expiry;
+  Node *node = expiry->heap[slot];
+  long long deadline = EXPIRY_ENTRY(tree, node)->deadline;
+
+  // Up, while the parent expires later.
+  while(slot > 0){
+    Node *parent = expiry->heap[(slot - 1) / 2];
+    if(EXPIRY_ENTRY(tree, parent)->deadline <= deadline) break;
+    expiry_place(tree, parent, slot);
+    slot = (slot - 1) / 2;
+  }
+
+  // Down, while a child expires earlier.
+  while(2 * slot + 1 < expiry->size){
+    int child = 2 * slot + 1;
+    if(child + 1 < expiry->size
+       && EXPIRY_ENTRY(tree, expiry->heap[child + 1])->deadline
+       < EXPIRY_ENTRY(tree, expiry->heap[child])->deadline){
+      child++;
+    }
+    if(EXPIRY_ENTRY(tree, expiry->heap[child])->deadline >= deadline) break;
+    expiry_place(tree, expiry->heap[child], slot);
+    slot = child;
+  }
+  expiry_place(tree, node, slot);
+}
+
+/*
+ * Function: expiry_reserve
+ * ------------------------
+ * Description:
+ * Internal helper. Make room in the heap for one more node,
+ * doubling it if it is full.
+ *
+ * Arguments: tree - The expiring tree.
+ *
+ * Returns: 1 - There is room.
+ *          0 - Memory ran out or the tree reached its memory
+ *              limit. The heap is unchanged.
+ */
+static int expiry_reserve(AvlTree *tree){
+  AvlExpiry *expiry = tree->expiry;
+  if(expiry->size < expiry->capacity) return 1;
+
+  int capacity = expiry->capacity ? 2 * expiry->capacity : 64;
+  size_t grown = (capacity - expiry->capacity) * sizeof(Node *);
+  if(!memory_charge(tree, 0, 0, grown, 1)) return 0;
+  Node **heap = (Node **)realloc(expiry->heap, capacity * sizeof(Node *));
+  if(heap == NULL){
+    memory_discharge(tree, 0, 0, grown);
+    return 0;
+  }
+  expiry->heap = heap;
+  expiry->capacity = capacity;
+  return 1;
+}
+
+/*
+ * Function: expiry_schedule
+ * -------------------------
+ * Description:
+ * Internal helper. Set the deadline of a node, entering it in
+ * to the heap, moving it there or taking it out.
+ *
+ * Arguments: tree     - The expiring tree.
+ *            node     - The node.
+ *            deadline - The new deadline, AVL_NO_DEADLINE for none.
+ *
+ * Returns: 1 - On success.
+ *          0 - If the heap could not grow (see expiry_reserve).
+ */
+static int expiry_schedule(AvlTree *tree, Node *node, long long deadline){
+  AvlExpiry *expiry = tree->expiry;
+  ExpiryEntry *entry = EXPIRY_ENTRY(tree, node);
+
+  if(entry->slot < 0){
+    if(deadline == AVL_NO_DEADLINE) return 1;
+    if(!expiry_reserve(tree)) return 0;
+    entry->deadline = deadline;
+    expiry_place(tree, node, expiry->size++);
+    expiry_sift(tree, entry->slot);
+  }else if(deadline != AVL_NO_DEADLINE){
+    entry->deadline = deadline;
+    expiry_sift(tree, entry->slot);
+  }else{
+    // Take the node out, filling its slot with the last node.
+    int slot = entry->slot;
+    Node *last = expiry->heap[--expiry->size];
+    entry->deadline = AVL_NO_DEADLINE;
+    entry->slot = -1;
+    if(last != node){
+      expiry_place(tree, last, slot);
+      expiry_sift(tree, slot);
+    }
+  }
+  return 1;
+}
+
+/*
+ * Function: expiry_hidden
+ * -----------------------
+ * Description:
+ * Internal helper. Whether lookups treat a node as absent: it
+ * expired, but was not deleted yet.
+ *
+ * Arguments: tree - The tree.
+ *            node - The node found.
+ *
+ * Returns: 1 if the node is hidden, 0 otherwise.
+ */
+static inline int expiry_hidden(AvlTree *tree, Node *node){
+  return tree->expiry && tree->expiry->hide
+    && EXPIRY_ENTRY(tree, node)->deadline <= tree->expiry->now;
+}
+
+/*
+ * Function: make_tree_from_node
+ * -----------------------------
+ * Description:
+ * Creates a new tree from a pre-existing node.
+ *
+ * Arguments: node - The pre-existing node.
+ * 
+ * Returns: Pointer to the newly created tree.
+ */
+AvlTree * make_tree_from_node(Node *node){
+  // Check arguments.
+  assert(node != NULL);
+  
+  // Allocate space for the new tree.
+  AvlTree *tree = (AvlTree *)malloc(sizeof(AvlTree));
+  if(tree == NULL) return NULL; // Memory allocation failed.
+
+  tree->root = node; // Assign root.
+  tree->finger = node;
+  tree->min_node = leftmost(node);
+  tree->max_node = rightmost(node);
+  tree->node_size = sizeof(Node);
+  tree->augment = NULL;
+  tree->augment_offset = 0;
+  tree->value_size = tree->value_offset = 0;
+  tree->compact_block = NULL;
+  tree->cache = NULL;
+  tree->filter = NULL;
+  tree->expiry = NULL;
+  tree->relaxed = tree->piggyback = 0;
+  memset(&tree->memory, 0, sizeof(tree->memory));
+  tree->budget = tree->limit = 0;
+  tree->on_budget = NULL;
+  tree->budget_ctx = NULL;
+  tree->over_budget = 0;
+  tree->trace = NULL;
+  tree->trace_ctx = NULL;
+  memory_charge(tree, NODE_BYTES(1), 0, sizeof(AvlTree), 0);
+  // Set the correct tree atributes.
+  tree->height = 0;
+  tree->number_of_nodes = 1;
+  return tree;
+}
+
+/*
+ * Function: make_tree_empty
+ * -------------------------
+ * Description:
+ * Create and allocate a new tree, containing no
+ * nodes.
+ * 
+ * Arguments: none
+ *
+ * Returns: Pointer to the newly created tree.
+ */
+AvlTree * make_tree_empty(){
+  // Allocate memory.
+  AvlTree *new_tree = (AvlTree *)malloc(sizeof(AvlTree));
+  if(new_tree == NULL) return NULL; // Memory allocation failed.
+
+  // Set the correct tree attributes.
+  new_tree->root = NULL;
+  new_tree->finger = NULL;
+  new_tree->min_node = new_tree->max_node = NULL;
+  new_tree->node_size = sizeof(Node);
+  new_tree->augment = NULL;
+  new_tree->augment_offset = 0;
+  new_tree->value_size = new_tree->value_offset = 0;
+  new_tree->compact_block = NULL;
+  new_tree->cache = NULL;
+  new_tree->filter = NULL;
+  new_tree->expiry = NULL;
+  new_tree->relaxed = new_tree->piggyback = 0;
+  memset(&new_tree->memory, 0, sizeof(new_tree->memory));
+  new_tree->budget = new_tree->limit = 0;
+  new_tree->on_budget = NULL;
+  new_tree->budget_ctx = NULL;
+  new_tree->over_budget = 0;
+  new_tree->trace = NULL;
+  new_tree->trace_ctx = NULL;
+  memory_charge(new_tree, 0, 0, sizeof(AvlTree), 0);
+  new_tree->height = -1; // Represents an empty tree.
+  new_tree->number_of_nodes = 0;
+  return new_tree;
+}
+
+/*
+ * Function: make_tree_with_values
+ * -------------------------------
+ * Description:
+ * Create and allocate a new, empty tree whose nodes store
+ * a fixed-size value inline, directly behind the node in
+ * the same allocation (see avl_value).
+ *
+ * Arguments: value_size - Size of the values in bytes, which
+ *                         have to fit in a block chunk.
+ *
+ * Returns: Pointer to the newly created tree.
+ */
+AvlTree * make_tree_with_values(size_t value_size){
+  AvlTree *new_tree = make_tree_empty();
+  if(new_tree == NULL) return NULL;
+
+  // Reserve the value storage in the node extension area.
+  new_tree->value_offset = avl_reserve_node_ext(new_tree, value_size);
+  new_tree->value_size = value_size;
+  assert(new_tree->value_offset != 0);
+  return new_tree;
+}
+
+/*
+ * Function: make_node_empty
+ * -------------------------
+ * Description: 
+ * This function creates and allocates memory for 
+ * a new node, containing no data. It takes a key
+ * argument.
+ *
+ * Arguments: key - The order key the node has.
+ * 
+ * Returns: Node pointer to the new node.
+ */
+Node * make_node_empty(AVL_KEY_T key){
+  // Allocate memory for the new node.
+  Node *new_node = (Node *)malloc(sizeof(Node));
+  if(new_node == NULL) return NULL; // Memory allocation failed.
+
+  // Set correct node attributes (for empty node).
+  new_node->key = key;
+  new_node->data = NULL;
+  new_node->left_child = new_node->right_child = new_node->parent = NULL;
+  new_node->height = 0;
+  new_node->in_block = 0;
+  return new_node;
+}
+
+/*
+ * Function: upin
+ * --------------
+ * Description:
+ * This method is called after insertion of a node
+ * and walks up the tree from the freshly inserted
+ * node, checking the avl condition on every point.
+ * If the AVL condition is violated at a point, it
+ * calls the corresponding rotations to fix it.
+ *
+ * Arguments: node - The node from which upin is called. 
+ *            tree - The tree operating in.
+ * 
+ * Returns: void 
+ */
+void upin(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(node != NULL);
+
+  // Figure out the balance of the node.
+  int bal = balance(node);
+  
+  // End upin procedure if root is reached.
+  if(node->parent == NULL){
+    return;
+  }
+
+  // Pointer to the parent node.
+  Node *parent = node->parent;
+
+  // Figure out the balance of it's parent.
+  int p_bal = balance(parent);
+
+  // Check balance for correctness, rotating if necessary.
+  if(parent->left_child == node){
+    if(p_bal == 0){
+      // Exit upin if the parent balance is 0.
+      return;
+    }else if(p_bal == -1){
+      // Continue upin at the parent.
+      upin(tree, parent);
+    }else if(p_bal < -1){
+      if(bal == -1){
+	// Do a single right rotation.
+	rotate_right(tree, parent);
+      }else if(bal == 1){
+	// Do a double rotation (left, right).
+	rotate_left(tree, parent->left_child);
+	rotate_right(tree, parent);
+      }else{
+	// This should not be reached.
+	printf("Critical error occured in upin procedure.\n");
+	exit(2);
+      }
+    }else{
+      // This should not be reached.
+      printf("Critical error occured in upin procedure.\n");
+      exit(2);
+    }
+  }else{
+    if(p_bal <= 0){
+      // Exit upin if the parent balance is 0.
+      return;
+    }else if(p_bal == 1){
+      // Continue upin at the parent. 
+      upin(tree, parent);
+    }else if(p_bal > 1){
+      if(bal == 1){
+	// Do a single left rotation. 
+	rotate_left(tree, parent);
+      }else if(bal == -1){
+	// Do a double rotation (right, left).
+	rotate_right(tree, parent->right_child);
+	rotate_left(tree, parent);
+      }else{
+	// This should not be reached.
+	printf("Critical error occured in upin procedure.\n");
+	exit(2);
+      }
+    }else{
+      // This should not be reached.
+      printf("Critical error occured in upin procedure.\n");
+      exit(2);
+    }
+  }
+}
+
+/*
+ * Function: rebalance_node
+ * ------------------------
+ * Description:
+ * Internal helper. Update the height of a node whose children
+ * are balanced, and restore the AVL condition at the node with
+ * a single or double rotation if its balance is off by two.
+ *
+ * Arguments: tree - The tree operating in.
+ *            node - The node to rebalance.
+ *
+ * Returns: void
+ */
+static void rebalance_node(AvlTree *tree, Node *node){
+  // Get the balance of the current node.
+  int bal = balance(node);
+
+  if(bal < -1){
+    // The node has a left-heavy imbalance.
+
+    // Figure out the balance of its left child.
+    int l_bal = balance(node->left_child);
+
+    if(l_bal == -1){
+      // Double left heavy imbalance. Fix by single right rotation.
+      rotate_right(tree, node);
+    }else if(l_bal == 1){
+      // Left-Right imbalance. Fix with a left-right rotation.
+      rotate_left(tree, node->left_child);
+      rotate_right(tree, node);
+    }else{
+      rotate_right(tree, node);
+    }
+  }else if(bal > 1){
+    // The node has a right-heavy imbalance.
+
+    // Figure out the balance of its right child.
+    int r_bal = balance(node->right_child);
+
+    if(r_bal == 1){
+      // Double right heavy imbalance. Fix with a single left rotation.
+      rotate_left(tree, node);
+    }else if(r_bal == -1){
+      // Right-Left imbalance. Fix with a right-left rotation.
+      rotate_right(tree, node->right_child);
+      rotate_left(tree, node);
+    }else{
+      rotate_left(tree, node);
+    }
+  }
+
+  // Update the aggregate. If we rotated, the node moved down and
+  // this is a cheap repeat; its new parent was updated in the rotation.
+  if(tree->augment) augment_node(tree, node);
+}
+
+/*
+ * Function: upout
+ * ---------------
+ * Description:
+ * This method is called after deletion of a node
+ * and walks up the tree from the deleted
+ * node, checking the avl condition on every point.
+ * If the AVL condition is violated at a point, it
+ * calls the corresponding rotations to fix it.
+ *
+ * Arguments: node - The node from which upout is called. 
+ *            tree - The tree operating in.
+ * 
+ * Returns: void 
+ */
+void upout(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(node != NULL);
+
+  // Keep track of the parent of the node.
+  Node *parent = node->parent;
+
+  // Restore the AVL condition at the node.
+  rebalance_node(tree, node);
+
+  // Continue upwards traversal.
+  if(parent) upout(tree, parent);
+}
+
+/*
+ * Function: get_height
+ * --------------------
+ * Description:
+ * Calculates and returns the height of the given
+ * Node. This does not adapt the height of its
+ * children, so if those are off, the new height is
+ * also going to be off! This is to conserve computational
+ * effort. 
+ * 
+ * Arguments: node - The node to which to calculate the height.
+ * 
+ * Returns: The height of node.
+ */
+int get_height(Node *node){
+  // Check arguments.
+  assert(node != NULL);
+
+  // The base heights for no children.
+  int l_height = -1;
+  int r_height = -1;
+  // Update children's height if they exists.
+  if(node->left_child) l_height = node->left_child->height;
+  if(node->right_child) r_height = node->right_child->height;
+  
+  // Calculate and return the correct height.
+  return get_int_max(l_height, r_height) + 1;
+}
+
+/*
+ * Function: balance
+ * -----------------
+ * Description:
+ * Figure out the balance of a node.
+ * Scan the height of the children trees to calculate it.
+ *
+ * Arguments: node - The node in question.
+ * 
+ * Returns: the balance.
+ */
+int balance(Node *node){
+  // Check arguments.
+  assert(node != NULL);
+
+  // The base heights for no children.
+  int l_height = -1;
+  int r_height = -1;
+  // Update children's height if they exists.
+  if(node->left_child) l_height = node->left_child->height;
+  if(node->right_child) r_height = node->right_child->height;
+
+  // Update the current node's height.
+  node->height = get_int_max(l_height, r_height) + 1;
+
+  // Return the balance (height difference).
+  return r_height - l_height;
+}
+
+/*
+ * Function: rotate_right
+ * ----------------------
+ * Description:
+ * Execute a single righthand rotation around
+ * a given node.
+ *
+ * Arguments: node - The node to rotate.
+ *            tree - The tree operating in. 
+ *
+ * Returns: void 
+ */
+void rotate_right(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(node != NULL);
+
+  // Pointer to keep track of the second node in rotation.
+  Node *l_child = node->left_child;
+
+  // Do rotation.
+  if(node->parent == NULL){
+    // Operating on root.
+    tree->root = l_child;
+    l_child->parent = NULL;
+  }else{
+    // Give the parent its new child.
+    if(node->parent->left_child == node){
+      // We are left child.
+      node->parent->left_child = l_child;
+    }else{
+      // We are right child.
+      node->parent->right_child = l_child;
+    }
+    // Adapt the parent.
+    l_child->parent = node->parent;
+  }
+  // Rearrange the children nodes.
+  node->left_child = l_child->right_child;
+  // If a child is there, adapt its parent.
+  if(l_child->right_child) l_child->right_child->parent = node;
+  l_child->right_child = node;
+  node->parent = l_child;
+
+  // Update the heights.
+  if(node){
+    node->height = get_height(node);
+  }
+  if(l_child){
+    if(l_child->left_child){
+      l_child->left_child->height = get_height(l_child->left_child);
+    }
+    l_child->height = get_height(l_child);
+  }
+
+  // Update the aggregates, bottom up.
+  if(tree->augment){
+    augment_node(tree, node);
+    augment_node(tree, l_child);
+  }
+}
+
+/*
+ * Function: rotate_left
+ * ---------------------
+ * Description:
+ * Execute a single lefthand rotation around
+ * a given node. 
+ * 
+ * Arguments: node - The node to rotate.
+ *            tree - The tree operating in.
+ *
+ * Returns: void
+ */
+void rotate_left(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(node != NULL);
+
+  // Pointer to keep track of the second node in rotation.
+  Node *r_child = node->right_child;
+
+  // Do rotation.
+  if(node->parent == NULL){
+    // Operating on root.
+    tree->root = r_child;
+    r_child->parent = NULL;
+  }else{
+    // Give the parent its new child.
+    if(node->parent->left_child == node){
+      // We are left child.
+      node->parent->left_child = r_child;
+    }else{
+      // We are right child.
+      node->parent->right_child = r_child;
+    }
+    // Adapt the parent.
+    r_child->parent = node->parent;
+  }
+  // Rearrange the children nodes.
+  node->right_child = r_child->left_child;
+  // If a child is there, adapt its parent.
+  if(r_child->left_child) r_child->left_child->parent = node;
+  r_child->left_child = node;
+  node->parent = r_child;
+
+  // Update the heights.
+  if(node){
+    node->height = get_height(node);
+  }
+  if(r_child){
+    if(r_child->right_child){
+      r_child->right_child->height = get_height(r_child->right_child);
+    }
+    r_child->height = get_height(r_child);
+  }
+
+  // Update the aggregates, bottom up.
+  if(tree->augment){
+    augment_node(tree, node);
+    augment_node(tree, r_child);
+  }
+}
+
+/*
+ * ----------------------
+ * -- Relaxed balance. --
+ * ----------------------
+ */
+
+/*
+ * Function: is_dirty
+ * ------------------
+ * Description:
+ * Internal helper. Whether a node awaits rebalancing. The
+ * heights of such nodes are stale, so the mark is kept in
+ * place of the height.
+ *
+ * Arguments: node - The node, or NULL.
+ *
+ * Returns: 1 if the node is marked, 0 otherwise.
+ */
+static inline int is_dirty(Node *node){
+  return node != NULL && node->height == AVL_HEIGHT_DIRTY;
+}
+
+/*
+ * Function: relax_mark
+ * --------------------
+ * Description:
+ * Internal helper. Mark a node and its ancestors as awaiting
+ * rebalancing, up to the first one already marked. All
+ * ancestors of a marked node are marked, so every unmarked
+ * node roots a balanced subtree with correct heights.
+ *
+ * Arguments: node - The node, or NULL.
+ *
+ * Returns: void
+ */
+static void relax_mark(Node *node){
+  for(; node && !is_dirty(node); node = node->parent){
+    node->height = AVL_HEIGHT_DIRTY;
+  }
+}
+
+/*
+ * Function: relax_defer
+ * ---------------------
+ * Description:
+ * Internal helper. Record a change below a node of a relaxed
+ * tree instead of rebalancing it (see relax_mark), and do the
+ * piggybacked rebalancing steps. Aggregates are kept exact,
+ * so queries stay correct in between.
+ *
+ * Arguments: tree - The relaxed tree.
+ *            node - The lowest node whose subtree changed,
+ *                   or NULL.
+ *
+ * Returns: void
+ */
+static void relax_defer(AvlTree *tree, Node *node){
+  relax_mark(node);
+  if(tree->augment && node) augment_path(tree, node);
+  if(tree->piggyback) avl_rebalance_step(tree, tree->piggyback);
+  tree->height = tree->root ? tree->root->height : -1;
+}
+
+/*
+ * Function: child_link
+ * --------------------
+ * Description:
+ * Internal helper. The left or right child pointer of a node.
+ *
+ * Arguments: node  - The node.
+ *            right - 1 for the right child, 0 for the left.
+ *
+ * Returns: Pointer to the child pointer.
+ */
+static inline Node ** child_link(Node *node, int right){
+  return right ? &node->right_child : &node->left_child;
+}
+
+/*
+ * Function: relax_join
+ * --------------------
+ * Description:
+ * Internal helper. Rebalance a marked node whose subtrees are
+ * balanced, but differ in height by more than one (the AVL
+ * join). The taller subtree takes the node's place, and the
+ * node, with the shorter subtree, is linked in on the inner
+ * spine of the taller one where the heights match. This
+ * grows the spine by at most one level, which the rotations
+ * of an insertion repair on the way back up. O(height
+ * difference).
+ *
+ * Arguments: tree - The tree operating in.
+ *            node - The node to rebalance.
+ *            tall - 1 if the right subtree is the taller one,
+ *                   0 if the left one is.
+ *
+ * Returns: void
+ */
+static void relax_join(AvlTree *tree, Node *node, int tall){
+  Node *parent = node->parent;
+  Node *taller = *child_link(node, tall), *shorter = *child_link(node, !tall);
+  int height = shorter ? shorter->height : -1;
+
+  // The taller subtree takes the place of the node.
+  if(parent == NULL){
+    tree->root = taller;
+  }else{
+    *child_link(parent, parent->right_child == node) = taller;
+  }
+  taller->parent = parent;
+
+  // Descend the inner spine to the first subtree of at most
+  // one level more than the shorter one, and put the node in
+  // its place.
+  Node *above = taller, *below = *child_link(taller, !tall);
+  while(below && below->height > height + 1){
+    above = below;
+    below = *child_link(below, !tall);
+  }
+  *child_link(node, tall) = below;
+  if(below) below->parent = node;
+  *child_link(above, !tall) = node;
+  node->parent = above;
+  rebalance_node(tree, node);
+
+  // Rebalance the spine up to the subtree's root.
+  for(Node *up = above; up; ){
+    Node *next = up->parent;
+    rebalance_node(tree, up);
+    if(next == parent) break;
+    up = next;
+  }
+}
+
+/*
+ * Function: relax_fix
+ * -------------------
+ * Description:
+ * Internal helper. Rebalance a marked node whose children
+ * are unmarked, which clears its mark.
+ *
+ * Arguments: tree - The tree operating in.
+ *            node - The node to fix.
+ *
+ * Returns: void
+ */
+static void relax_fix(AvlTree *tree, Node *node){
+  int l_height = node->left_child ? node->left_child->height : -1;
+  int r_height = node->right_child ? node->right_child->height : -1;
+
+  if(r_height - l_height > 1){
+    relax_join(tree, node, 1);
+  }else if(l_height - r_height > 1){
+    relax_join(tree, node, 0);
+  }else{
+    node->height = get_int_max(l_height, r_height) + 1;
+  }
+}
+
+/*
+ * Function: deepest_dirty
+ * -----------------------
+ * Description:
+ * Internal helper. Descend from a marked node to a marked
+ * node below it without marked children.
+ *
+ * Arguments: node - A marked node.
+ *
+ * Returns: The marked node found.
+ */
+static Node * deepest_dirty(Node *node){
+  for(;;){
+    if(is_dirty(node->left_child)){
+      node = node->left_child;
+    }else if(is_dirty(node->right_child)){
+      node = node->right_child;
+    }else{
+      return node;
+    }
+  }
+}
+
+/*
+ * Function: avl_relaxed_begin
+ * ---------------------------
+ * Description:
+ * Switch a tree to relaxed balance, for bursts of updates.
+ * Insertions and deletions then only mark the path above
+ * the change, up to the first marked node, instead of
+ * updating heights and rotating. The marks are resolved by
+ * avl_rebalance_step, by a number of steps piggybacked on
+ * every update, and by avl_relaxed_end. Searches and all
+ * other queries stay correct, but paths can grow with the
+ * size of the burst: sorted keys without piggybacked steps
+ * degrade the tree to a list. While marks are pending, the
+ * tree's height is AVL_HEIGHT_DIRTY.
+ *
+ * Arguments: tree      - The tree.
+ *            piggyback - Rebalancing steps done by every
+ *                        update, 0 to defer all of them.
+ *
+ * Returns: void
+ */
+void avl_relaxed_begin(AvlTree *tree, int piggyback){
+  // Check arguments.
+  assert(tree != NULL && piggyback >= 0);
+
+  tree->relaxed = 1;
+  tree->piggyback = piggyback;
+}
+
+/*
+ * Function: avl_rebalance_step
+ * ----------------------------
+ * Description:
+ * Resolve up to budget marks of a relaxed tree, deepest
+ * first. Every step rebalances one node whose subtrees are
+ * balanced already, in O(1) amortized plus the difference
+ * of the subtree heights, so the total work of a full
+ * rebalance is bounded by the number of marked nodes and
+ * the imbalance built up.
+ *
+ * Arguments: tree   - The tree.
+ *            budget - The maximum number of steps.
+ *
+ * Returns: 1 - Marks are still pending.
+ *          0 - The tree is AVL balanced.
+ */
+int avl_rebalance_step(AvlTree *tree, int budget){
+  // Check arguments.
+  assert(tree != NULL && budget >= 0);
+
+  if(!is_dirty(tree->root)) return 0;
+
+  // Fix the marked nodes in post order, so that the subtrees of
+  // every node fixed are balanced.
+  Node *node = deepest_dirty(tree->root);
+  for(; budget > 0; budget--){
+    Node *parent = node->parent;
+    relax_fix(tree, node);
+    if(parent == NULL) break;
+    node = deepest_dirty(parent);
+  }
+  tree->height = tree->root->height;
+  return is_dirty(tree->root);
+}
+
+/*
+ * Function: avl_relaxed_end
+ * -------------------------
+ * Description:
+ * Resolve all pending marks of a relaxed tree and switch it
+ * back to strict AVL balance.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
+ */
+void avl_relaxed_end(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  avl_rebalance_step(tree, INT_MAX);
+  tree->relaxed = 0;
+  tree->piggyback = 0;
+}
+
+// Report a phase boundary to the profiling harness (see AVL_PHASE_DESCENT).
+#ifdef AVL_PROFILE
+#define PHASE(phase) avl_profile_phase(phase)
+#else
+#define PHASE(phase) ((void)0)
+#endif
+
+// Report an API call to the trace hook of the tree, if there is one.
+// Hooks take int keys, so the other key types are not traced.
+#ifndef AVL_PREFIX
+#define TRACE_ARG(tree, op, key, arg, result)				\
+  do{									\
+    if((tree)->trace){							\
+      (tree)->trace((tree)->trace_ctx, op, key, arg, result);		\
+    }									\
+  }while(0)
+#else
+#define TRACE_ARG(tree, op, key, arg, result) ((void)(key), (void)(result))
+#endif
+#define TRACE(tree, op, key, result) TRACE_ARG(tree, op, key, 0, result)
+
+/*
+ * Function: find_key
+ * ------------------
+ * Description:
+ * Internal helper. The search of search_by_key, which is not
+ * reported to the trace hook, for use inside the core. Only
+ * searches that do not need the would-be parent of an absent
+ * key may consult the filter.
+ *
+ * Arguments: tree     - The tree to search in.
+ *            key      - order key to search for.
+ *            node     - will point to node in question.
+ *            filtered - Whether the filter may answer the search,
+ *                       pointing node to NULL.
+ *
+ * Returns: 1  - If node has been found.
+ *          0  - If the node was not found.
+ */
+static int find_key(AvlTree *tree, AVL_KEY_T key, Node **node,
+		    int filtered){
+  // Check if the tree is empty.
+  if(tree->root == NULL){
+    // Return a NULL-pointer on the node, and falsy.
+    *node = NULL;
+    return 0;
+  }
+
+#ifndef AVL_PREFIX
+  // Hot keys are found in the cache, if there is one.
+  if(tree->cache){
+    Node *cached = cache_lookup(tree->cache, key);
+    if(cached){
+      *node = cached;
+      return 1;
+    }
+  }
+
+  // Keys rejected by the filter, if there is one, are not in the tree.
+  if(filtered && tree->filter){
+    if(!filter_probe(tree->filter, key, 0)){
+      tree->filter->stats.rejected++;
+      *node = NULL;
+      return 0;
+    }
+    tree->filter->stats.passed++;
+  }
+#endif
+
+  // Start traversing the tree.
+  *node = tree->root;
+  while(1){
+    int cmp = AVL_KEY_CMP(key, (*node)->key);
+    if(cmp < 0){
+      // Continue search to the left of the node.
+      if((*node)->left_child == NULL){
+	// Node not in tree, return.
+#ifndef AVL_PREFIX
+	if(filtered && tree->filter) tree->filter->stats.false_positives++;
+#endif
+	return 0;
+      }
+      // Continue traversal.
+      *node = (*node)->left_child;
+    }else if(cmp > 0){
+      // Continue search to the right of the node.
+      if((*node)->right_child == NULL){
+	// Node is not in tree, return.
+#ifndef AVL_PREFIX
+	if(filtered && tree->filter) tree->filter->stats.false_positives++;
+#endif
+	return 0;
+      }
+      // Continue traversal.
+      *node = (*node)->right_child;
+    }else{
+      // Found the node, return.
+#ifndef AVL_PREFIX
+      if(tree->cache && !tree->cache->frozen) cache_fill(tree->cache, *node);
+#endif
+      return 1;
+    }
+  }
+
+  // This should be unreachable code. Error if reached.
+  printf("Critical error occured while searching for a node.\n");
+  exit(2); // Exit with code 2. See Error index for details.
+}
+
+/*
+ * Function: search_visible
+ * ------------------------
+ * Description:
+ * Internal helper. A search reported to the trace hook, which
+ * does not find expired nodes hidden by the tree's expiry.
+ *
+ * Arguments: tree     - The tree to search in.
+ *            key      - order key to search for.
+ *            node     - will point to node in question.
+ *            filtered - Whether the filter may answer the search.
+ *
+ * Returns: 1  - If node has been found.
+ *          0  - If the node was not found.
+ */
+static int search_visible(AvlTree *tree, AVL_KEY_T key, Node **node,
+			  int filtered){
+  int found = find_key(tree, key, node, filtered);
+  // Expired nodes may be hidden until they are deleted.
+  if(found && expiry_hidden(tree, *node)) found = 0;
+  TRACE(tree, AVL_TRACE_SEARCH, key, found);
+  return found;
+}
+
+/*
+ * Function: search_by_key
+ * -------------------------
+ * Description:
+ * Search for a node in the tree. If the node is found,
+ * return a truthy and a pointer to the node-location.
+ * If not, return a falsey and point to the node which
+ * would represent it's parent, if it were in the tree.
+ * The tree's filter is not consulted, as it cannot tell
+ * the parent; use avl_contains for presence checks.
+ *
+ * Arguments: key  - order key to search for.
+ *            node - will point to node in question.
+ *            tree - The tree to search in.
+ * 
+ * Returns: 1  - If node has been found.
+ *          0  - If the node was not found.
+ */
+int search_by_key(AVL_KEY_T key, AvlTree *tree, Node **node){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(node != NULL);
+
+  return search_visible(tree, key, node, 0);
+}
+
+/*
+ * Function: avl_contains
+ * ----------------------
+ * Description:
+ * Check whether a key is in the tree. Unlike search_by_key
+ * this does not report a node, so the tree's filter (see
+ * avl_filter_attach) may answer it without a descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: 1 - If the key is in the tree.
+ *          0 - If it is not.
+ */
+int avl_contains(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL);
+
+  Node *node = NULL;
+  return search_visible(tree, key, &node, 1);
+}
+
+/*
+ * Function: alloc_node
+ * --------------------
+ * Description:
+ * Internal helper. Allocate a node for a given tree. Unlike
+ * make_node_empty this allocates the per-node extension area
+ * of the tree (see avl_reserve_node_ext) behind the node and
+ * zero-fills it.
+ *
+ * Arguments: tree - The tree the node is for.
+ *            key  - The order key the node has.
+ *
+ * Returns: Node pointer to the new node, NULL if memory ran
+ *          out or the tree reached its memory limit.
+ */
+static Node * alloc_node(AvlTree *tree, AVL_KEY_T key){
+  PHASE(AVL_PHASE_ALLOC);
+  if(!memory_charge(tree, NODE_BYTES(1), PAYLOAD_BYTES(tree, 1), 0, 1)){
+    return NULL;
+  }
+
+  // Allocate memory for the new node and its extension area.
+  Node *new_node = (Node *)malloc(tree->node_size);
+  if(new_node == NULL){
+    // Memory allocation failed, take back the charge.
+    memory_discharge(tree, NODE_BYTES(1), PAYLOAD_BYTES(tree, 1), 0);
+    return NULL;
+  }
+
+  avl_init_node(tree, new_node, key);
+  new_node->in_block = 0;
+  PHASE(AVL_PHASE_REBALANCE);
+  return new_node;
+}
+
+/*
+ * Function: link_below
+ * --------------------
+ * Description:
+ * Internal helper. Descend from a given start node to the
+ * insertion point of key and link a new node there. The
+ * caller has to make sure that key lies within the key range
+ * of the subtree rooted at start. If the tree is empty, the
+ * new node becomes the root. The tree is not rebalanced,
+ * the caller has to call finish_insert on the new node.
+ *
+ * Arguments: tree     - The tree to insert into.
+ *            start    - The node to start the descent at.
+ *            key      - The order key to use.
+ *            new_node - Receives the new node.
+ *
+ * Returns: 1  - The new node was linked.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If the node could not be
+ *          allocated. The tree is unchanged.
+ */
+static int link_below(AvlTree *tree, Node *start, AVL_KEY_T key,
+		      Node **new_node){
+  // Check arguments.
+  assert(tree != NULL && new_node != NULL);
+
+  if(tree->root == NULL){
+    // Tree is empty, make the new node the root.
+    tree->root = *new_node = alloc_node(tree, key);
+    return (tree->root != NULL) ? 1 : AVL_ERROR_NO_MEMORY;
+  }
+
+  // Traverse the tree.
+  // active keeps track of the current traversal "index".
+  assert(start != NULL);
+  Node *active = start;
+
+  while(1){
+    int cmp = AVL_KEY_CMP(key, active->key);
+    if(cmp < 0){
+      // New node is expected to left of active.
+      if(active->left_child == NULL){
+	// Insert to the left of active.
+	*new_node = alloc_node(tree, key);
+	if(*new_node == NULL) return AVL_ERROR_NO_MEMORY;
+	active->left_child = *new_node;
+	break;
+      }
+
+      // Continue traversal.
+      active = active->left_child;
+    }else if(cmp > 0){
+      // New node is expected to right of active.
+      if(active->right_child == NULL){
+	// Insert to the right of active.
+	*new_node = alloc_node(tree, key);
+	if(*new_node == NULL) return AVL_ERROR_NO_MEMORY;
+	active->right_child = *new_node;
+	break;
+      }
+
+      // Continue traversal.
+      active = active->right_child;
+    }else{
+      // Key already exists in tree. Insertion failure.
+      return 0;
+    }
+  }
+
+  (*new_node)->parent = active;
+  return 1;
+}
+
+/*
+ * Function: finish_insert
+ * -----------------------
+ * Description:
+ * Internal helper. Update the tree attributes after a node
+ * has been linked by link_below, and rebalance the tree.
+ *
+ * Arguments: tree     - The tree inserted into.
+ *            new_node - The freshly linked node.
+ *
+ * Returns: void
+ */
+static void finish_insert(AvlTree *tree, Node *new_node){
+  // Increase number of nodes in tree.
+  tree->number_of_nodes++;
+  // Remember the insertion position for hinted insertions.
+  tree->finger = new_node;
+#ifndef AVL_PREFIX
+  if(tree->filter) filter_insert(tree, new_node->key);
+#endif
+
+  if(new_node->parent == NULL){
+    // The only node is both the minimum and the maximum.
+    tree->min_node = tree->max_node = new_node;
+    if(tree->augment) augment_node(tree, new_node);
+    // Adapt the height of the tree.
+    tree->height = 0;
+    return;
+  }
+
+  // Keep the cached extremes up to date. The new node is a new
+  // extreme exactly if it hangs below the old one, on the outside
+  // (which does not depend on the keys, see the positional mode).
+  if(tree->min_node->left_child == new_node) tree->min_node = new_node;
+  if(tree->max_node->right_child == new_node) tree->max_node = new_node;
+  if(tree->relaxed){
+    // Leave the rebalancing for later.
+    if(tree->augment) augment_node(tree, new_node);
+    relax_defer(tree, new_node->parent);
+    return;
+  }
+  // Check balance and rebalance.
+  upin(tree, new_node);
+  // upin stops early, so refresh the aggregates up to the root.
+  if(tree->augment) augment_path(tree, new_node);
+  // Update the height of the tree.
+  tree->height = tree->root->height;
+}
+
+/*
+ * Function: insert_below
+ * ----------------------
+ * Description:
+ * Internal helper. Insert a new node, descending from a given
+ * start node (see link_below).
+ *
+ * Arguments: tree  - The tree to insert into.
+ *            start - The node to start the descent at.
+ *            key   - The order key to use.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+static int insert_below(AvlTree *tree, Node *start, AVL_KEY_T key){
+  Node *new_node = NULL;
+  int linked = link_below(tree, start, key, &new_node);
+  if(linked != 1) return linked;
+
+  finish_insert(tree, new_node);
+  memory_check(tree);
+  return 1;
+}
+
+/*
+ * Function: key_insert_new
+ * ------------------------
+ * Description:
+ * Insert a node in to the tree (if it does not
+ * exist already) according to its order key.
+ * The node will initially not contain any data.
+ * 
+ * Arguments: key  - The order key to use.
+ *            tree - The tree to insert into.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+int key_insert_new(AVL_KEY_T key, AvlTree *tree){
+  assert(tree != NULL); // Check arguments.
+
+  // Descend from the root.
+  PHASE(AVL_PHASE_DESCENT);
+  int inserted = insert_below(tree, tree->root, key);
+  PHASE(AVL_PHASE_DONE);
+  TRACE(tree, AVL_TRACE_INSERT, key, inserted);
+  return inserted;
+}
+
+/*
+ * Function: insert_hint
+ * ---------------------
+ * Description:
+ * Internal helper. The insertion of avl_insert_hint, which is
+ * not reported to the trace hook.
+ *
+ * Arguments: tree - The tree to insert into.
+ *            key  - The order key to use.
+ *            hint - A node of the tree close to the key, or NULL.
+ *
+ * Returns: As avl_insert_hint.
+ */
+static int insert_hint(AvlTree *tree, AVL_KEY_T key, Node *hint){
+  // Fall back to the finger, and to a regular insertion if
+  // there is no usable starting point.
+  if(hint == NULL) hint = tree->finger;
+  if(hint == NULL || tree->root == NULL){
+    return insert_below(tree, tree->root, key);
+  }
+
+  // Key already exists in tree. Insertion failure.
+  int side = AVL_KEY_CMP(key, hint->key);
+  if(side == 0) return 0;
+
+  // Keys beyond either end of the tree attach directly to the
+  // cached extreme, which makes appends O(1).
+  if(AVL_KEY_CMP(key, tree->max_node->key) > 0){
+    return insert_below(tree, tree->max_node, key);
+  }
+  if(AVL_KEY_CMP(key, tree->min_node->key) < 0){
+    return insert_below(tree, tree->min_node, key);
+  }
+
+  // start is the deepest subtree known to contain key in its
+  // key range. Every ancestor we reach from one side bounds
+  // the subtree below it on that side, so we only have to climb
+  // until we find an ancestor bounding key on the far side.
+  Node *start = hint;
+  Node *active = hint;
+  while(active->parent){
+    Node *parent = active->parent;
+    if(side > 0 && parent->left_child == active){
+      // The parent is an upper bound for the subtree below it.
+      int cmp = AVL_KEY_CMP(key, parent->key);
+      if(cmp < 0) break;
+      if(cmp == 0) return 0;
+      start = parent;
+    }else if(side < 0 && parent->right_child == active){
+      // The parent is a lower bound for the subtree below it.
+      int cmp = AVL_KEY_CMP(key, parent->key);
+      if(cmp > 0) break;
+      if(cmp == 0) return 0;
+      start = parent;
+    }
+    // Continue climbing.
+    active = parent;
+  }
+
+  // Descend from the subtree found.
+  return insert_below(tree, start, key);
+}
+
+/*
+ * Function: avl_insert_hint
+ * -------------------------
+ * Description:
+ * Insert a new node in to the tree, starting the search
+ * for the insertion point at a hint node instead of the
+ * root. The search climbs from the hint via the parent
+ * pointers only as far as needed to find the smallest
+ * subtree whose key range contains the new key, and then
+ * descends from there. For keys arriving in (nearly)
+ * sorted order this makes the descent O(1) instead of
+ * O(log n). If hint is NULL, the tree's finger (the most
+ * recently inserted node) is used.
+ *
+ * Arguments: tree - The tree to insert into.
+ *            key  - The order key to use.
+ *            hint - A node of the tree close to the key, or NULL.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+int avl_insert_hint(AvlTree *tree, AVL_KEY_T key, Node *hint){
+  // Check arguments.
+  assert(tree != NULL);
+
+  int inserted = insert_hint(tree, key, hint);
+  TRACE(tree, AVL_TRACE_INSERT_HINT, key, inserted);
+  return inserted;
+}
+
+/*
+ * Function: detach_node
+ * ---------------------
+ * Description:
+ * Internal helper. Unlink a node from the tree and rebalance,
+ * without freeing it. The node's links are left stale.
+ *
+ * Arguments: tree     - The tree the node is in.
+ *            del_node - The node to unlink.
+ *
+ * Returns: void
+ */
+static void detach_node(AvlTree *tree, Node *del_node){
+#ifndef AVL_PREFIX
+  if(tree->cache) cache_update(tree->cache, del_node->key, NULL);
+#endif
+  if(tree->expiry) expiry_schedule(tree, del_node, AVL_NO_DEADLINE);
+
+  // Move the cached extremes to their in-order neighbours. The
+  // minimum has no left child and the maximum no right child, so
+  // the neighbour is either in the remaining subtree or the parent.
+  if(tree->min_node == del_node){
+    tree->min_node = del_node->right_child
+      ? leftmost(del_node->right_child) : del_node->parent;
+  }
+  if(tree->max_node == del_node){
+    tree->max_node = del_node->left_child
+      ? rightmost(del_node->left_child) : del_node->parent;
+  }
+
+  // Pointer to the replacement node (for the deleted one).
+  Node *repl = del_node->left_child;
+  
+  // If the replacement pointer is null, there was no left child.
+  // Take the right one instead. If not, continue to iterate until
+  // the correct replacement (the predecessor in the tree) is found.
+  if(repl == NULL){
+    repl = del_node->right_child;
+  }else{
+    // Iterate until predecessor is found.
+    while(repl->right_child){
+      repl = repl->right_child;
+    }
+  }
+
+  // This points to the node from which we want to start the upout
+  // procedure after deleting. Generally, this is the parent of the
+  // actually unlinked node. So in case the replacement node is not
+  // a direct child of the deletion node, this will point to the
+  // parent of the replacement node. If it is a direct child, it will
+  // point to the parent of the deletion node. If that is the root, we
+  // let it point to NULL, and do not have to rebalance.
+  Node *rebalance = NULL;
+  if(repl){
+    if(repl->parent != del_node) rebalance = repl->parent;
+
+    // Give the replacement node the right child of the node to be
+    // deleted. If the replacement is the right child of the node to
+    // be deleted, skip this step.
+    if(repl != del_node->right_child){
+      repl->right_child = del_node->right_child;
+      if(del_node->right_child) del_node->right_child->parent = repl;
+    }
+
+    // Give the parent of the replacement node its left child as a right child,
+    // and adjust the left child of the replacement node to be the left child
+    // of the deletion node.
+    // If the parent of the replacement node is the deletion node itself, skip
+    // this step.
+    if(repl->parent != del_node){
+      repl->parent->right_child = repl->left_child;
+      if(repl->left_child) repl->left_child->parent = repl->parent;
+      repl->left_child = del_node->left_child;
+      del_node->left_child->parent = repl;
+    }
+  }else{
+    if(!rebalance && del_node->parent) rebalance = del_node->parent;
+  }
+  
+  // Point the parent of the deletion node to the replacement node.
+  if(del_node->parent){
+    if(del_node->parent->left_child == del_node){
+      // Deletion node is a left child of its parent.
+      del_node->parent->left_child = repl;
+    }else{
+      // Deletion node is a right child of its parent.
+      del_node->parent->right_child = repl;
+    }
+    if(repl) repl->parent = del_node->parent;
+  }else{
+    // Handeling the deletion of the root.
+    tree->root = repl;
+    if(repl) repl->parent = NULL;
+  }
+
+  // Call the rebalance procedure from the rebalance node on (if one exists).
+  if(tree->relaxed){
+    // Leave the rebalancing for later. The replacement node
+    // moved up, so its height is stale as well.
+    relax_mark(repl);
+    relax_defer(tree, rebalance ? rebalance : repl);
+  }else if(rebalance){
+    upout(tree, rebalance);
+  }else{
+    if(repl) upout(tree, repl);
+  }
+
+  // Update the tree height.
+  if(tree->root){
+    tree->height = tree->root->height;
+  }else{
+    tree->height = -1;
+  }
+  // Update the number of nodes in the tree.
+  tree->number_of_nodes--;
+  // Do not leave the finger dangling.
+  if(tree->finger == del_node) tree->finger = NULL;
+#ifndef AVL_PREFIX
+  if(tree->filter) filter_delete(tree);
+#endif
+}
+
+/*
+ * Function: unlink_node
+ * ---------------------
+ * Description:
+ * Internal helper. The deletion of avl_delete_node, which is
+ * not reported to the trace hook.
+ *
+ * Arguments: tree     - The tree the node is in.
+ *            del_node - The node to delete.
+ *
+ * Returns: 1 - Successful deletion.
+ */
+static int unlink_node(AvlTree *tree, Node *del_node){
+  if(del_node){
+    detach_node(tree, del_node);
+
+    // Free the memory location and return.
+    PHASE(AVL_PHASE_FREE);
+    release_node(tree, del_node);
+    del_node = NULL;
+    return 1;
+  }
+
+  // This should be unreachable code. Error if reached.
+  printf("Critical error occured while deleting a node.\n");
+  exit(2);
+}
+
+/*
+ * Function: avl_delete_node
+ * -------------------------
+ * Description:
+ * Unlink a node of the tree and free it, without
+ * searching for it first. Rebalances the tree.
+ *
+ * Arguments: tree     - The tree the node is in.
+ *            del_node - The node to delete.
+ *
+ * Returns: 1 - Successful deletion.
+ */
+int avl_delete_node(AvlTree *tree, Node *del_node){
+  // Check arguments.
+  assert(tree != NULL);
+
+  // unlink_node reports a missing node.
+  if(del_node == NULL) return unlink_node(tree, del_node);
+
+  AVL_KEY_T key = del_node->key;
+  int deleted = unlink_node(tree, del_node);
+  TRACE(tree, AVL_TRACE_DELETE, key, deleted);
+  return deleted;
+}
+
+/*
+ * Function: key_delete
+ * --------------------
+ * Description:
+ * This function, for a given key, searches the node
+ * with that order key in the given tree and tries
+ * to delete it. If the key could not be found, the
+ * function returns 0, otherwise it returns 1 after 
+ * deletion.
+ *
+ * Arguments: key - The key to search and delete.
+ *            tree - The tree to search and delete in.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - Deletion unsuccessful (key not found).
+ */
+int key_delete(AVL_KEY_T key, AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  // Pointer to the node to be deleted.
+  Node *del_node = NULL;
+
+  // Search for the key to be deleted.
+  PHASE(AVL_PHASE_DESCENT);
+  if(!find_key(tree, key, &del_node, 1)){
+    // The key was not found, return unsuccessful deletion.
+    PHASE(AVL_PHASE_DONE);
+    TRACE(tree, AVL_TRACE_DELETE, key, 0);
+    return 0;
+  }
+
+  // Unlink and free the node found.
+  PHASE(AVL_PHASE_REBALANCE);
+  int deleted = unlink_node(tree, del_node);
+  PHASE(AVL_PHASE_DONE);
+  TRACE(tree, AVL_TRACE_DELETE, key, deleted);
+  return deleted;
+}
+
+/*
+ * Function: avl_min
+ * -----------------
+ * Description:
+ * Get the node with the smallest key in O(1).
+ *
+ * Arguments: tree - The tree to look in.
+ *
+ * Returns: The node with the smallest key, NULL if empty.
+ */
+Node * avl_min(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  return tree->min_node;
+}
+
+/*
+ * Function: avl_max
+ * -----------------
+ * Description:
+ * Get the node with the largest key in O(1).
+ *
+ * Arguments: tree - The tree to look in.
+ *
+ * Returns: The node with the largest key, NULL if empty.
+ */
+Node * avl_max(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  return tree->max_node;
+}
+
+/*
+ * Function: pop_node
+ * ------------------
+ * Description:
+ * Internal helper. Hand out key and data of a node and
+ * delete it from the tree.
+ *
+ * Arguments: tree - The tree the node is in.
+ *            node - The node to pop, may be NULL.
+ *            key  - Receives the key of the node, may be NULL.
+ *            data - Receives the data of the node, may be NULL.
+ *            op   - The operation, for the trace hook.
+ *
+ * Returns: 1 - If a node was popped.
+ *          0 - If node was NULL (empty tree).
+ */
+static int pop_node(AvlTree *tree, Node *node, AVL_KEY_T *key, void **data,
+		    AvlTraceOp op){
+  if(node == NULL){
+    TRACE(tree, op, 0, 0);
+    return 0;
+  }
+
+  if(key) *key = node->key;
+  if(data) *data = node->data;
+  AVL_KEY_T popped_key = node->key;
+  int popped = unlink_node(tree, node);
+  TRACE(tree, op, popped_key, popped);
+  return popped;
+}
+
+/*
+ * Function: avl_pop_min
+ * ---------------------
+ * Description:
+ * Remove the node with the smallest key from the tree,
+ * unlinking the cached minimum directly (no search).
+ *
+ * Arguments: tree - The tree to pop from.
+ *            key  - Receives the key of the node, may be NULL.
+ *            data - Receives the data of the node, may be NULL.
+ *
+ * Returns: 1 - If a node was popped.
+ *          0 - If the tree was empty.
+ */
+int avl_pop_min(AvlTree *tree, AVL_KEY_T *key, void **data){
+  // Check arguments.
+  assert(tree != NULL);
+
+  return pop_node(tree, tree->min_node, key, data, AVL_TRACE_POP_MIN);
+}
+
+/*
+ * Function: avl_pop_max
+ * ---------------------
+ * Description:
+ * Remove the node with the largest key from the tree,
+ * unlinking the cached maximum directly (no search).
+ *
+ * Arguments: tree - The tree to pop from.
+ *            key  - Receives the key of the node, may be NULL.
+ *            data - Receives the data of the node, may be NULL.
+ *
+ * Returns: 1 - If a node was popped.
+ *          0 - If the tree was empty.
+ */
+int avl_pop_max(AvlTree *tree, AVL_KEY_T *key, void **data){
+  // Check arguments.
+  assert(tree != NULL);
+
+  return pop_node(tree, tree->max_node, key, data, AVL_TRACE_POP_MAX);
+}
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: bracket
+ * -----------------
+ * Description:
+ * Internal helper. Single descent for the nearest-key
+ * queries. Finds the node with the key itself, if present,
+ * and the closest nodes strictly below and above the key.
+ *
+ * Arguments: tree  - The tree to search in.
+ *            key   - The key to bracket.
+ *            below - Receives the largest node with a smaller key.
+ *            exact - Receives the node with the key, or NULL.
+ *            above - Receives the smallest node with a larger key.
+ *
+ * Returns: void
+ */
+static void bracket(AvlTree *tree, int key, Node **below, Node **exact,
+		    Node **above){
+  *below = *exact = *above = NULL;
+
+  Node *node = tree->root;
+  while(node){
+    if(key < node->key){
+      // Every node further down is smaller than this one.
+      *above = node;
+      node = node->left_child;
+    }else if(key > node->key){
+      // Every node further down is larger than this one.
+      *below = node;
+      node = node->right_child;
+    }else{
+      // The in-order neighbours are in the subtrees, if there.
+      *exact = node;
+      if(node->left_child) *below = rightmost(node->left_child);
+      if(node->right_child) *above = leftmost(node->right_child);
+      return;
+    }
+  }
+}
+#endif
+
+/*
+ * Function: avl_next
+ * ------------------
+ * Description:
+ * Step to the in-order successor of a node, using the
+ * parent pointers. Amortized O(1) when iterating.
+ *
+ * Arguments: node - The node to step from.
+ *
+ * Returns: The next node in key order, NULL if node is the last.
+ */
+Node * avl_next(Node *node){
+  // Check arguments.
+  assert(node != NULL);
+
+  if(node->right_child) return leftmost(node->right_child);
+
+  // Climb until we come from a left child.
+  while(node->parent && node->parent->right_child == node){
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+/*
+ * Function: avl_prev
+ * ------------------
+ * Description:
+ * Step to the in-order predecessor of a node, using the
+ * parent pointers. Amortized O(1) when iterating.
+ *
+ * Arguments: node - The node to step from.
+ *
+ * Returns: The previous node in key order, NULL if node is the first.
+ */
+Node * avl_prev(Node *node){
+  // Check arguments.
+  assert(node != NULL);
+
+  if(node->left_child) return rightmost(node->left_child);
+
+  // Climb until we come from a right child.
+  while(node->parent && node->parent->left_child == node){
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+/*
+ * Function: avl_floor
+ * -------------------
+ * Description:
+ * Find the node with the largest key less than or equal
+ * to a given key, in a single descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+Node * avl_floor(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL);
+
+  Node *found = NULL;
+  for(Node *node = tree->root; node; ){
+    int cmp = AVL_KEY_CMP(key, node->key);
+    if(cmp < 0){
+      node = node->left_child;
+    }else if(cmp > 0){
+      // A candidate, but there may be a closer one to the right.
+      found = node;
+      node = node->right_child;
+    }else{
+      found = node;
+      break;
+    }
+  }
+  TRACE(tree, AVL_TRACE_FLOOR, key, found != NULL);
+  return found;
+}
+
+/*
+ * Function: find_ceiling
+ * ----------------------
+ * Description:
+ * Internal helper. The descent of avl_ceiling, which is not
+ * reported to the trace hook, for use inside the core.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+static Node * find_ceiling(AvlTree *tree, AVL_KEY_T key){
+  Node *found = NULL;
+  for(Node *node = tree->root; node; ){
+    int cmp = AVL_KEY_CMP(key, node->key);
+    if(cmp > 0){
+      node = node->right_child;
+    }else if(cmp < 0){
+      // A candidate, but there may be a closer one to the left.
+      found = node;
+      node = node->left_child;
+    }else{
+      return node;
+    }
+  }
+  return found;
+}
+
+/*
+ * Function: avl_ceiling
+ * ---------------------
+ * Description:
+ * Find the node with the smallest key greater than or
+ * equal to a given key, in a single descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+Node * avl_ceiling(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL);
+
+  Node *found = find_ceiling(tree, key);
+  TRACE(tree, AVL_TRACE_CEILING, key, found != NULL);
+  return found;
+}
+
+/*
+ * Function: avl_predecessor
+ * -------------------------
+ * Description:
+ * Find the node with the largest key strictly less than
+ * a given key, which does not have to be in the tree.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+Node * avl_predecessor(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL);
+
+  Node *found = NULL;
+  for(Node *node = tree->root; node; ){
+    if(AVL_KEY_CMP(node->key, key) < 0){
+      found = node;
+      node = node->right_child;
+    }else{
+      node = node->left_child;
+    }
+  }
+  TRACE(tree, AVL_TRACE_PREDECESSOR, key, found != NULL);
+  return found;
+}
+
+/*
+ * Function: find_successor
+ * ------------------------
+ * Description:
+ * Internal helper. The descent of avl_successor, which is not
+ * reported to the trace hook, for use inside the core.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+static Node * find_successor(AvlTree *tree, AVL_KEY_T key){
+  Node *found = NULL;
+  for(Node *node = tree->root; node; ){
+    if(AVL_KEY_CMP(node->key, key) > 0){
+      found = node;
+      node = node->left_child;
+    }else{
+      node = node->right_child;
+    }
+  }
+  return found;
+}
+
+/*
+ * Function: avl_successor
+ * -----------------------
+ * Description:
+ * Find the node with the smallest key strictly greater
+ * than a given key, which does not have to be in the tree.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+Node * avl_successor(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL);
+
+  Node *found = find_successor(tree, key);
+  TRACE(tree, AVL_TRACE_SUCCESSOR, key, found != NULL);
+  return found;
+}
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_k_nearest
+ * -----------------------
+ * Description:
+ * Find the k nodes with the keys closest to a given key,
+ * ordered by increasing distance (ties go to the smaller key).
+ * One descent brackets the key, then the result is merged
+ * outwards in both directions with O(k) parent pointer steps.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search around.
+ *            k    - The number of nodes wanted.
+ *            out  - Array of at least k entries receiving the nodes.
+ *
+ * Returns: The number of nodes written to out (less than k
+ *          only if the tree holds fewer nodes).
+ */
+int avl_k_nearest(AvlTree *tree, int key, int k, Node **out){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(k <= 0 || out != NULL);
+
+  Node *below, *exact, *above;
+  bracket(tree, key, &below, &exact, &above);
+
+  int count = 0;
+  if(exact && count < k) out[count++] = exact;
+
+  // Merge the two directions by distance to the key.
+  while(count < k && (below || above)){
+    if(above == NULL
+       || (below && (long long)key - below->key
+	   <= (long long)above->key - key)){
+      out[count++] = below;
+      below = avl_prev(below);
+    }else{
+      out[count++] = above;
+      above = avl_next(above);
+    }
+  }
+  TRACE_ARG(tree, AVL_TRACE_K_NEAREST, key, k, count);
+  return count;
+}
+#endif
+
+/*
+ * Function: avl_reserve_node_ext
+ * ------------------------------
+ * Description:
+ * Reserve bytes in the per-node extension area of a tree.
+ * Every node allocated for the tree afterwards carries the
+ * extension area directly behind the Node structure. The
+ * reserved bytes can be accessed with AVL_NODE_EXT. Only
+ * possible while the tree is empty.
+ *
+ * Arguments: tree - The tree to reserve in.
+ *            size - The number of bytes to reserve.
+ *
+ * Returns: Offset of the reserved bytes from the node start
+ *          (8-byte aligned), 0 if the tree is not empty or
+ *          the node would not fit in a block chunk.
+ */
+size_t avl_reserve_node_ext(AvlTree *tree, size_t size){
+  // Check arguments.
+  assert(tree != NULL);
+
+  if(tree->root != NULL) return 0;
+
+  // Align the reservation to 8 bytes.
+  size_t offset = (tree->node_size + 7) & ~(size_t)7;
+  if(size > AVL_CHUNK_SIZE - AVL_CHUNK_HEADER - offset) return 0;
+  tree->node_size = offset + size;
+  return offset;
+}
+
+/*
+ * Function: avl_value
+ * -------------------
+ * Description:
+ * Get a pointer to the inline value of a node, in a tree
+ * created by make_tree_with_values. The pointer stays valid
+ * as long as the node is in the tree.
+ *
+ * Arguments: tree - The tree the node is in.
+ *            node - The node in question.
+ *
+ * Returns: Pointer to the value bytes of the node.
+ */
+void * avl_value(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->value_offset != 0);
+  assert(node != NULL);
+
+  return AVL_NODE_EXT(node, tree->value_offset);
+}
+
+/*
+ * Function: avl_insert_value
+ * --------------------------
+ * Description:
+ * Insert a new node and copy a value in to its inline value
+ * storage. No allocation besides the node itself.
+ *
+ * Arguments: tree  - The tree to insert into.
+ *            key   - The order key to use.
+ *            value - The value (value size bytes), NULL to zero-fill.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+int avl_insert_value(AvlTree *tree, AVL_KEY_T key, const void *value){
+  // Check arguments.
+  assert(tree != NULL && tree->value_offset != 0);
+
+  Node *new_node = NULL;
+  int linked = link_below(tree, tree->root, key, &new_node);
+  if(linked != 1){
+    TRACE(tree, AVL_TRACE_INSERT, key, linked);
+    return linked;
+  }
+
+  if(value){
+    memcpy(AVL_NODE_EXT(new_node, tree->value_offset), value, tree->value_size);
+  }
+  finish_insert(tree, new_node);
+  memory_check(tree);
+  TRACE(tree, AVL_TRACE_INSERT, key, 1);
+  return 1;
+}
+
+/*
+ * Function: avl_lookup_value
+ * --------------------------
+ * Description:
+ * Search for a key and return a pointer to the inline value
+ * of its node, without a further dereference.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: Pointer to the value bytes, NULL if the key is absent.
+ */
+void * avl_lookup_value(AvlTree *tree, AVL_KEY_T key){
+  // Check arguments.
+  assert(tree != NULL && tree->value_offset != 0);
+
+  Node *node = NULL;
+  if(!search_visible(tree, key, &node, 1)) return NULL;
+  return AVL_NODE_EXT(node, tree->value_offset);
+}
+
+/*
+ * Function: avl_augment_attach
+ * ----------------------------
+ * Description:
+ * Augment an empty tree with a per-node value and a
+ * subtree aggregate, combined by the given augmentation.
+ * The aggregates are kept up to date through insertion,
+ * deletion and all rotations. New nodes start with a
+ * zero-filled value. The descriptor has to outlive the tree.
+ *
+ * Arguments: tree - The tree to augment.
+ *            aug  - The augmentation, e.g. &avl_augment_sum_i64.
+ *
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already augmented.
+ */
+int avl_augment_attach(AvlTree *tree, const AvlAugment *aug){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(aug != NULL);
+  assert(aug->kind != AVL_AUG_CUSTOM || aug->combine != NULL);
+#ifdef AVL_PREFIX
+  assert(aug->kind != AVL_AUG_MERKLE); // Hashes int keys.
+#endif
+
+  if(tree->root != NULL || tree->augment != NULL) return 0;
+
+  // Value followed by aggregate.
+  tree->augment_offset = avl_reserve_node_ext(tree, 2 * aug->size);
+  tree->augment = aug;
+  return 1;
+}
+
+/*
+ * Function: avl_augment_value
+ * ---------------------------
+ * Description:
+ * Get a pointer to the augmentation value of a node. After
+ * writing to it, call avl_augment_update on the node.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The node in question.
+ *
+ * Returns: Pointer to the value of the node.
+ */
+void * avl_augment_value(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(node != NULL);
+
+  return AUG_VALUE(tree, node);
+}
+
+/*
+ * Function: avl_augment_aggregate
+ * -------------------------------
+ * Description:
+ * Get a pointer to the aggregate over the subtree of a node.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The root of the subtree.
+ *
+ * Returns: Pointer to the aggregate of the subtree.
+ */
+const void * avl_augment_aggregate(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(node != NULL);
+
+  return AUG_AGGREGATE(tree, node);
+}
+
+/*
+ * Function: avl_augment_update
+ * ----------------------------
+ * Description:
+ * Recompute the aggregates from a node up to the root,
+ * after its value has been changed in place. O(log n).
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The node whose value changed.
+ *
+ * Returns: void
+ */
+void avl_augment_update(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(node != NULL);
+
+  augment_path(tree, node);
+}
+
+/*
+ * Function: avl_augment_set
+ * -------------------------
+ * Description:
+ * Set the augmentation value of a node and update the
+ * aggregates up to the root. O(log n).
+ *
+ * Arguments: tree  - The augmented tree.
+ *            node  - The node to set the value of.
+ *            value - The new value (augmentation size bytes).
+ *
+ * Returns: void
+ */
+void avl_augment_set(AvlTree *tree, Node *node, const void *value){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(node != NULL);
+  assert(value != NULL);
+
+  memcpy(AUG_VALUE(tree, node), value, tree->augment->size);
+  augment_path(tree, node);
+  TRACE(tree, AVL_TRACE_AUGMENT_SET, node->key, 1);
+}
+
+/*
+ * Function: avl_augment_insert
+ * ----------------------------
+ * Description:
+ * Insert a new node with the given augmentation value.
+ * The value is in place before the tree is rebalanced,
+ * so the aggregates are only computed once.
+ *
+ * Arguments: tree  - The augmented tree.
+ *            key   - The order key to use.
+ *            value - The value of the node (augmentation size bytes).
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+int avl_augment_insert(AvlTree *tree, AVL_KEY_T key, const void *value){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(value != NULL);
+
+  Node *new_node = NULL;
+  int linked = link_below(tree, tree->root, key, &new_node);
+  if(linked != 1){
+    TRACE(tree, AVL_TRACE_INSERT, key, linked);
+    return linked;
+  }
+
+  memcpy(AUG_VALUE(tree, new_node), value, tree->augment->size);
+  finish_insert(tree, new_node);
+  memory_check(tree);
+  TRACE(tree, AVL_TRACE_INSERT, key, 1);
+  return 1;
+}
+
+/*
+ * Function: range_aggregate
+ * -------------------------
+ * Description:
+ * Internal helper. The aggregate of avl_range_aggregate, which
+ * is not reported to the trace hook, for use inside the core.
+ *
+ * Arguments: tree - The augmented tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *            out  - Receives the aggregate (augmentation size bytes).
+ *
+ * Returns: 1 - If the range contains at least one key.
+ *          0 - If the range is empty (out is left untouched).
+ */
+static int range_aggregate(AvlTree *tree, AVL_KEY_T lo, AVL_KEY_T hi,
+			   void *out){
+  size_t size = tree->augment->size;
+
+  // Find the split node, where the paths to lo and hi diverge.
+  Node *split = tree->root;
+  while(split){
+    if(AVL_KEY_CMP(split->key, lo) < 0){
+      split = split->right_child;
+    }else if(AVL_KEY_CMP(split->key, hi) > 0){
+      split = split->left_child;
+    }else{
+      break;
+    }
+  }
+  if(split == NULL) return 0;
+
+  // Everything is combined in to out, starting with the split node.
+  memcpy(out, AUG_VALUE(tree, split), size);
+
+  // Walk the left boundary. Nodes in range are prepended together
+  // with their right subtree, which lies between them and what
+  // has been collected so far.
+  long long part[(size + sizeof(long long) - 1) / sizeof(long long)];
+  for(Node *node = split->left_child; node; ){
+    if(AVL_KEY_CMP(node->key, lo) >= 0){
+      memcpy(part, AUG_VALUE(tree, node), size);
+      if(node->right_child){
+	augment_combine(tree, part, part, AUG_AGGREGATE(tree, node->right_child));
+      }
+      augment_combine(tree, out, part, out);
+      node = node->left_child;
+    }else{
+      node = node->right_child;
+    }
+  }
+
+  // Walk the right boundary, appending symmetrically.
+  for(Node *node = split->right_child; node; ){
+    if(AVL_KEY_CMP(node->key, hi) <= 0){
+      if(node->left_child){
+	augment_combine(tree, out, out, AUG_AGGREGATE(tree, node->left_child));
+      }
+      augment_combine(tree, out, out, AUG_VALUE(tree, node));
+      node = node->right_child;
+    }else{
+      node = node->left_child;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Function: avl_range_aggregate
+ * -----------------------------
+ * Description:
+ * Compute the aggregate over all nodes with a key in the
+ * inclusive range [lo, hi], combined in key order. Only the
+ * two boundary paths are visited: subtrees entirely inside the
+ * range contribute their stored aggregate. O(log n).
+ *
+ * Arguments: tree - The augmented tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *            out  - Receives the aggregate (augmentation size bytes).
+ *
+ * Returns: 1 - If the range contains at least one key.
+ *          0 - If the range is empty (out is left untouched).
+ */
+int avl_range_aggregate(AvlTree *tree, AVL_KEY_T lo, AVL_KEY_T hi,
+			void *out){
+  // Check arguments.
+  assert(tree != NULL && tree->augment != NULL);
+  assert(out != NULL);
+
+  int found = range_aggregate(tree, lo, hi, out);
+  TRACE_ARG(tree, AVL_TRACE_RANGE_AGGREGATE, lo, hi, found);
+  return found;
+}
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_merkle_set_payload
+ * --------------------------------
+ * Description:
+ * Make the payload of a node part of its hash in a Merkle
+ * augmented tree, so that avl_diff reports nodes whose
+ * payloads differ. Call again whenever the payload changes.
+ * O(log n).
+ *
+ * Arguments: tree    - The Merkle augmented tree.
+ *            node    - The node.
+ *            payload - The payload bytes, NULL for none.
+ *            len     - Length of the payload.
+ *
+ * Returns: void
+ */
+void avl_merkle_set_payload(AvlTree *tree, Node *node, const void *payload,
+			    size_t len){
+  // Check arguments.
+  assert(tree != NULL && node != NULL);
+  assert(tree->augment != NULL && tree->augment->kind == AVL_AUG_MERKLE);
+
+  uint64_t h = merkle_hash(node->key, payload, len);
+  memcpy(AUG_VALUE(tree, node), &h, sizeof(h));
+  augment_path(tree, node);
+}
+
+/*
+ * Function: avl_merkle_range_hash
+ * -------------------------------
+ * Description:
+ * The hash of the entries with a key in the inclusive range
+ * [lo, hi] of a Merkle augmented tree. It only depends on the
+ * keys and payloads in the range, not on the shape of the
+ * tree, so replicas can compare ranges by exchanging hashes.
+ * O(log n).
+ *
+ * Arguments: tree - The Merkle augmented tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *
+ * Returns: The hash, 0 for an empty range.
+ */
+unsigned long long avl_merkle_range_hash(AvlTree *tree, int lo, int hi){
+  // Check arguments.
+  assert(tree != NULL);
+  assert(tree->augment != NULL && tree->augment->kind == AVL_AUG_MERKLE);
+
+  unsigned long long h = 0;
+  range_aggregate(tree, lo, hi, &h);
+  return h;
+}
+
+/*
+ * Structure: avl_diff_s
+ * ---------------------
+ * Description:
+ * The state of a tree diff.
+ *
+ * Fields: a - The first tree, whose shape is followed.
+ *         b - The second tree, queried by key ranges.
+ *         report - Called for every difference.
+ *         ctx - Passed to report.
+ *         differences - Number of differences reported.
+ */
+typedef struct avl_diff_s {
+  AvlTree *a, *b;
+  avl_diff_fn report;
+  void *ctx;
+  long differences;
+} AvlDiff;
+
+/*
+ * Function: diff_report_all
+ * -------------------------
+ * Description:
+ * Internal helper. Report all nodes of a subtree of the
+ * first tree as missing from the second, in key order.
+ *
+ * Arguments: diff - The diff state.
+ *            node - The root of the subtree.
+ *
+ * Returns: void
+ */
+static void diff_report_all(AvlDiff *diff, Node *node){
+  if(node == NULL) return;
+  diff_report_all(diff, node->left_child);
+  diff->report(node->key, node, NULL, diff->ctx);
+  diff->differences++;
+  diff_report_all(diff, node->right_child);
+}
+
+/*
+ * Function: diff_subtree
+ * ----------------------
+ * Description:
+ * Internal helper. Diff a subtree of the first tree against
+ * the keys of the second tree in the subtree's key range,
+ * [lo, hi]. Ranges with equal hashes are skipped, so only the
+ * paths to the differences are visited.
+ *
+ * Arguments: diff - The diff state.
+ *            node - The root of the subtree, or NULL.
+ *            lo   - Smallest key the subtree may hold.
+ *            hi   - Largest key the subtree may hold.
+ *
+ * Returns: void
+ */
+static void diff_subtree(AvlDiff *diff, Node *node, int lo, int hi){
+  AvlTree *a = diff->a, *b = diff->b;
+
+  unsigned long long hash_b = 0;
+  if(!range_aggregate(b, lo, hi, &hash_b)){
+    // Nothing of the range is in the second tree.
+    diff_report_all(diff, node);
+    return;
+  }
+  if(node == NULL){
+    // Everything of the range is missing from the first tree.
+    for(Node *match = find_ceiling(b, lo); match && match->key <= hi;
+	match = avl_next(match)){
+      diff->report(match->key, NULL, match, diff->ctx);
+      diff->differences++;
+    }
+    return;
+  }
+  if(*(unsigned long long *)AUG_AGGREGATE(a, node) == hash_b) return;
+
+  if(node->key > lo) diff_subtree(diff, node->left_child, lo, node->key - 1);
+
+  Node *match = NULL;
+  if(!find_key(b, node->key, &match, 1)){
+    diff->report(node->key, node, NULL, diff->ctx);
+    diff->differences++;
+  }else if(memcmp(AUG_VALUE(a, node), AUG_VALUE(b, match),
+		  sizeof(unsigned long long)) != 0){
+    diff->report(node->key, node, match, diff->ctx);
+    diff->differences++;
+  }
+
+  if(node->key < hi) diff_subtree(diff, node->right_child, node->key + 1, hi);
+}
+
+/*
+ * Function: avl_diff
+ * ------------------
+ * Description:
+ * Report the differences between two Merkle augmented trees,
+ * in key order: keys present in only one of them, and keys
+ * present in both with different payload hashes. Key ranges
+ * with equal hashes are skipped without visiting their nodes,
+ * so a diff of d entries costs O(d log^2 n) instead of O(n).
+ * The trees may have different shapes. The trees must not be
+ * modified by report.
+ *
+ * Arguments: a      - The first tree.
+ *            b      - The second tree.
+ *            report - Called for every difference with the key
+ *                     and its node in a and in b (NULL if the
+ *                     key is absent from that tree).
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of differences reported.
+ */
+long avl_diff(AvlTree *a, AvlTree *b, avl_diff_fn report, void *ctx){
+  // Check arguments.
+  assert(a != NULL && b != NULL && report != NULL);
+  assert(a->augment != NULL && a->augment->kind == AVL_AUG_MERKLE);
+  assert(b->augment != NULL && b->augment->kind == AVL_AUG_MERKLE);
+
+  AvlDiff diff = {a, b, report, ctx, 0};
+  diff_subtree(&diff, a->root, INT_MIN, INT_MAX);
+  return diff.differences;
+}
+
+/*
+ * ----------------------
+ * -- Positional mode. --
+ * ----------------------
+ */
+
+// The augmentation of a positional tree: every node counts one, so
+// the aggregate of a subtree is its size.
+static const AvlAugment seq_augment = {AVL_AUG_SUM_I64, sizeof(long long),
+				       NULL, NULL};
+
+/*
+ * Function: seq_size
+ * ------------------
+ * Description:
+ * Internal helper. The number of nodes in a subtree of a
+ * positional tree.
+ *
+ * Arguments: tree - The positional tree.
+ *            node - The root of the subtree, may be NULL.
+ *
+ * Returns: The size of the subtree.
+ */
+static inline int seq_size(AvlTree *tree, Node *node){
+  return node ? (int)*(long long *)AUG_AGGREGATE(tree, node) : 0;
+}
+
+/*
+ * Function: seq_node
+ * ------------------
+ * Description:
+ * Internal helper. Descend to the node at a position,
+ * steering by the subtree sizes.
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position, within the tree.
+ *
+ * Returns: The node at the position.
+ */
+static Node * seq_node(AvlTree *tree, int index){
+  Node *node = tree->root;
+  while(1){
+    int left = seq_size(tree, node->left_child);
+    if(index < left){
+      node = node->left_child;
+    }else if(index > left){
+      index -= left + 1;
+      node = node->right_child;
+    }else{
+      return node;
+    }
+  }
+}
+
+/*
+ * Function: seq_alloc
+ * -------------------
+ * Description:
+ * Internal helper. Allocate an unlinked node of a
+ * positional tree.
+ *
+ * Arguments: tree - The positional tree.
+ *            data - The data of the node.
+ *
+ * Returns: The new node, NULL if memory ran out or the tree
+ *          reached its memory limit.
+ */
+static Node * seq_alloc(AvlTree *tree, void *data){
+  Node *node = alloc_node(tree, 0);
+  if(node == NULL) return NULL;
+
+  node->data = data;
+  *(long long *)AUG_VALUE(tree, node) = 1;
+  *(long long *)AUG_AGGREGATE(tree, node) = 1;
+  return node;
+}
+
+/*
+ * Function: seq_join
+ * ------------------
+ * Description:
+ * Internal helper. Join two balanced subtrees with a node in
+ * between, in O(height difference) (see relax_join). The
+ * joined subtree is left in tree->root, so the caller has to
+ * set the root of the tree afterwards.
+ *
+ * Arguments: tree  - The tree operating in.
+ *            left  - The subtree in front of the node, may be NULL.
+ *            mid   - The node, unlinked.
+ *            right - The subtree behind the node, may be NULL.
+ *
+ * Returns: The root of the joined subtree.
+ */
+static Node * seq_join(AvlTree *tree, Node *left, Node *mid, Node *right){
+  mid->left_child = left;
+  mid->right_child = right;
+  mid->parent = NULL;
+  if(left) left->parent = mid;
+  if(right) right->parent = mid;
+  augment_node(tree, mid);
+
+  // Rebalancing replaces the root of the subtree, which has no
+  // parent, in tree->root.
+  tree->root = mid;
+  relax_fix(tree, mid);
+  return tree->root;
+}
+
+/*
+ * Function: seq_build
+ * -------------------
+ * Description:
+ * Internal helper. Link unlinked nodes in to a perfectly
+ * balanced subtree, in the given order.
+ *
+ * Arguments: tree  - The tree operating in.
+ *            nodes - The nodes.
+ *            n     - The number of nodes.
+ *
+ * Returns: The root of the subtree, NULL if n is 0.
+ */
+static Node * seq_build(AvlTree *tree, Node **nodes, int n){
+  if(n == 0) return NULL;
+
+  Node *root = nodes[n / 2];
+  root->left_child = seq_build(tree, nodes, n / 2);
+  root->right_child = seq_build(tree, nodes + n / 2 + 1, n - n / 2 - 1);
+  if(root->left_child) root->left_child->parent = root;
+  if(root->right_child) root->right_child->parent = root;
+  root->parent = NULL;
+  root->height = get_height(root);
+  augment_node(tree, root);
+  return root;
+}
+
+/*
+ * Function: seq_set_root
+ * ----------------------
+ * Description:
+ * Internal helper. Make a subtree the content of a positional
+ * tree, after it was joined or split.
+ *
+ * Arguments: tree - The positional tree.
+ *            root - The root of the subtree, may be NULL.
+ *            n    - The number of nodes in the subtree.
+ *
+ * Returns: void
+ */
+static void seq_set_root(AvlTree *tree, Node *root, int n){
+  tree->root = root;
+  tree->number_of_nodes = n;
+  tree->height = root ? root->height : -1;
+  tree->min_node = root ? leftmost(root) : NULL;
+  tree->max_node = root ? rightmost(root) : NULL;
+  // The finger may have moved to another tree.
+  tree->finger = NULL;
+  if(root) root->parent = NULL;
+}
+
+/*
+ * Function: avl_seq_attach
+ * ------------------------
+ * Description:
+ * Switch an empty tree to positional mode: the nodes are
+ * ordered by their position in a sequence, kept as subtree
+ * sizes in the augmentation, instead of by their keys. The
+ * keys are ignored (and 0), so the key based operations, the
+ * hot-key cache, the filter, relaxed balance and incremental
+ * compaction must not be used on the tree. Iteration (avl_min,
+ * avl_next, ...), node deletion, inline values, avl_compact
+ * and the memory accounting work as usual.
+ *
+ * Arguments: tree - The tree, empty and not augmented.
+ *
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already augmented.
+ */
+int avl_seq_attach(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  int attached = avl_augment_attach(tree, &seq_augment);
+  TRACE(tree, AVL_TRACE_SEQ_ATTACH, 0, attached);
+  return attached;
+}
+
+/*
+ * Function: avl_seq_attached
+ * --------------------------
+ * Description:
+ * Check whether a tree is in positional mode.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: 1 - The tree is positional (see avl_seq_attach).
+ *          0 - The tree is ordered by key.
+ */
+int avl_seq_attached(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  return tree->augment == &seq_augment;
+}
+
+/*
+ * Function: avl_seq_insert_at
+ * ---------------------------
+ * Description:
+ * Insert a new node at a position of a positional tree, in
+ * front of the node that was there. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position, 0 to the length of the tree.
+ *            data  - The data of the new node.
+ *
+ * Returns: The new node, NULL if memory ran out or the tree
+ *          reached its memory limit.
+ */
+Node * avl_seq_insert_at(AvlTree *tree, int index, void *data){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment);
+  assert(index >= 0 && index <= tree->number_of_nodes);
+
+  Node *new_node = seq_alloc(tree, data);
+  if(new_node == NULL){
+    TRACE(tree, AVL_TRACE_SEQ_INSERT_AT, index, 0);
+    return NULL;
+  }
+
+  if(tree->root == NULL){
+    // Tree is empty, make the new node the root.
+    tree->root = new_node;
+  }else if(index == tree->number_of_nodes){
+    // Append behind the last node.
+    tree->max_node->right_child = new_node;
+    new_node->parent = tree->max_node;
+  }else{
+    // Insert in front of the node at the position: as its left
+    // child, or behind its predecessor in the left subtree.
+    Node *next = seq_node(tree, index);
+    Node *prev = next->left_child ? rightmost(next->left_child) : NULL;
+    if(prev){
+      prev->right_child = new_node;
+      new_node->parent = prev;
+    }else{
+      next->left_child = new_node;
+      new_node->parent = next;
+    }
+  }
+
+  finish_insert(tree, new_node);
+  TRACE(tree, AVL_TRACE_SEQ_INSERT_AT, index, 1);
+  memory_check(tree);
+  return new_node;
+}
+
+/*
+ * Function: avl_seq_erase_at
+ * --------------------------
+ * Description:
+ * Delete the node at a position of a positional tree, moving
+ * the nodes behind it one position forward. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position.
+ *            data  - Receives the data of the node. May be NULL.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - If the position is out of range.
+ */
+int avl_seq_erase_at(AvlTree *tree, int index, void **data){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment);
+
+  int erased = 0;
+  if(index >= 0 && index < tree->number_of_nodes){
+    Node *node = seq_node(tree, index);
+    if(data) *data = node->data;
+    erased = unlink_node(tree, node);
+  }
+  TRACE(tree, AVL_TRACE_SEQ_ERASE_AT, index, erased);
+  return erased;
+}
+
+/*
+ * Function: avl_seq_get
+ * ---------------------
+ * Description:
+ * Find the node at a position of a positional tree. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position.
+ *
+ * Returns: The node, NULL if the position is out of range.
+ */
+Node * avl_seq_get(AvlTree *tree, int index){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment);
+
+  Node *node = NULL;
+  if(index >= 0 && index < tree->number_of_nodes) node = seq_node(tree, index);
+  TRACE(tree, AVL_TRACE_SEQ_GET, index, node != NULL);
+  return node;
+}
+
+/*
+ * Function: avl_seq_index
+ * -----------------------
+ * Description:
+ * Find the position of a node of a positional tree, climbing
+ * to the root. O(log n).
+ *
+ * Arguments: tree - The positional tree.
+ *            node - The node.
+ *
+ * Returns: The position of the node.
+ */
+int avl_seq_index(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment && node != NULL);
+
+  int index = seq_size(tree, node->left_child);
+  for(; node->parent; node = node->parent){
+    if(node->parent->right_child == node){
+      // Everything left of the parent lies in front of the node.
+      index += seq_size(tree, node->parent->left_child) + 1;
+    }
+  }
+  TRACE(tree, AVL_TRACE_SEQ_INDEX, index, 1);
+  return index;
+}
+
+/*
+ * Function: avl_seq_append
+ * ------------------------
+ * Description:
+ * Append new nodes to the end of a positional tree, in bulk:
+ * they are linked in to a balanced subtree, which is joined
+ * to the tree. O(n + log of the tree's length), instead of a
+ * descent and rebalancing per node.
+ *
+ * Arguments: tree - The positional tree.
+ *            data - The data of the new nodes, in order. May be
+ *                   NULL, for nodes without data.
+ *            n    - The number of nodes to append.
+ *
+ * Returns: 1 - On success.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the tree
+ *          reached its memory limit. The tree is unchanged.
+ */
+int avl_seq_append(AvlTree *tree, void *const *data, int n){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment && n >= 0);
+  assert(!tree->relaxed);
+
+  if(n == 0){
+    TRACE(tree, AVL_TRACE_SEQ_APPEND, n, 1);
+    return 1;
+  }
+  Node **nodes = (Node **)malloc(n * sizeof(Node *));
+  if(nodes == NULL){
+    TRACE(tree, AVL_TRACE_SEQ_APPEND, n, AVL_ERROR_NO_MEMORY);
+    return AVL_ERROR_NO_MEMORY;
+  }
+
+  for(int i = 0; i < n; i++){
+    nodes[i] = seq_alloc(tree, data ? data[i] : NULL);
+    if(nodes[i] == NULL){
+      // Take back the nodes allocated so far.
+      while(i-- > 0) release_node(tree, nodes[i]);
+      free(nodes);
+      TRACE(tree, AVL_TRACE_SEQ_APPEND, n, AVL_ERROR_NO_MEMORY);
+      return AVL_ERROR_NO_MEMORY;
+    }
+  }
+
+  Node *root;
+  if(tree->root == NULL){
+    root = seq_build(tree, nodes, n);
+  }else{
+    // The first new node joins the tree and the others.
+    root = seq_join(tree, tree->root, nodes[0],
+		    seq_build(tree, nodes + 1, n - 1));
+  }
+  seq_set_root(tree, root, tree->number_of_nodes + n);
+  free(nodes);
+  TRACE(tree, AVL_TRACE_SEQ_APPEND, n, 1);
+  memory_check(tree);
+  return 1;
+}
+
+/*
+ * Function: avl_seq_concat
+ * ------------------------
+ * Description:
+ * Append all nodes of one positional tree to another, and
+ * free the emptied tree. The last node of the first tree
+ * joins them, so this takes O(log n) and touches no other
+ * node. The trees have to have the same node layout.
+ *
+ * Arguments: left  - The tree appended to.
+ *            right - The tree appended. It is freed.
+ *
+ * Returns: void
+ */
+void avl_seq_concat(AvlTree *left, AvlTree *right){
+  // Check arguments.
+  assert(left != NULL && right != NULL && left != right);
+  assert(left->augment == &seq_augment && right->augment == &seq_augment);
+  assert(left->node_size == right->node_size);
+  assert(!left->relaxed && !right->relaxed);
+  assert(left->expiry == NULL && right->expiry == NULL);
+  assert(left->compact_block == NULL && right->compact_block == NULL);
+
+  int appended = right->number_of_nodes;
+  int n = left->number_of_nodes + appended;
+  Node *root = right->root;
+  if(left->root && right->root){
+    Node *mid = left->max_node;
+    detach_node(left, mid);
+    root = seq_join(left, left->root, mid, right->root);
+  }else if(left->root){
+    root = left->root;
+  }
+  seq_set_root(left, root, n);
+
+  // Hand the memory of the nodes over.
+  avl_cache_detach(right);
+  avl_filter_detach(right);
+  memory_charge(left, right->memory.nodes, right->memory.payload,
+		right->memory.aux - sizeof(AvlTree), 0);
+  free(right);
+  TRACE(left, AVL_TRACE_SEQ_CONCAT, appended, 1);
+  memory_check(left);
+}
+
+/*
+ * Function: avl_seq_split
+ * -----------------------
+ * Description:
+ * Split a positional tree at a position: the nodes from the
+ * position on move, in order, to a new tree with the same
+ * node layout. Works bottom up along the path to the root,
+ * joining the subtrees hanging off it to either side, which
+ * takes O(log n) in total. Node blocks (see avl_compact) are
+ * shared by the two trees, and freed with their last node.
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position, 0 to the length of the tree.
+ *
+ * Returns: The tree of the nodes from the position on, NULL
+ *          if memory ran out.
+ */
+AvlTree * avl_seq_split(AvlTree *tree, int index){
+  // Check arguments.
+  assert(tree != NULL && tree->augment == &seq_augment);
+  assert(index >= 0 && index <= tree->number_of_nodes);
+  assert(!tree->relaxed && tree->expiry == NULL);
+
+  AvlTree *rest = make_tree_empty();
+  if(rest == NULL){
+    TRACE(tree, AVL_TRACE_SEQ_SPLIT, index, 0);
+    return NULL;
+  }
+  rest->node_size = tree->node_size;
+  rest->augment = tree->augment;
+  rest->augment_offset = tree->augment_offset;
+  rest->value_size = tree->value_size;
+  rest->value_offset = tree->value_offset;
+  if(index == tree->number_of_nodes){
+    TRACE(tree, AVL_TRACE_SEQ_SPLIT, index, 1);
+    return rest;
+  }
+
+  // The node at the position starts the right part.
+  Node *node = seq_node(tree, index);
+  Node *parent = node->parent;
+  int from_right = parent && parent->right_child == node;
+  Node *left = node->left_child;
+  Node *right = seq_join(tree, NULL, node, node->right_child);
+
+  // Climb to the root. Coming from the right, the parent and its
+  // left subtree lie in front of the position, else behind it.
+  while(parent){
+    Node *up = parent->parent;
+    int up_right = up && up->right_child == parent;
+    if(from_right){
+      left = seq_join(tree, parent->left_child, parent, left);
+    }else{
+      right = seq_join(tree, right, parent, parent->right_child);
+    }
+    parent = up;
+    from_right = up_right;
+  }
+
+  int moved = tree->number_of_nodes - index;
+  seq_set_root(tree, left, index);
+  seq_set_root(rest, right, moved);
+  memory_discharge(tree, NODE_BYTES(moved), PAYLOAD_BYTES(tree, moved), 0);
+  memory_charge(rest, NODE_BYTES(moved), PAYLOAD_BYTES(rest, moved), 0, 0);
+  TRACE(tree, AVL_TRACE_SEQ_SPLIT, index, 1);
+  return rest;
+}
+#endif
+
+/*
+ * Function: relocate
+ * ------------------
+ * Description:
+ * Internal helper. Move a node, including its extension
+ * area, to a new memory location and release the old one.
+ * Its parent, children and the tree's cached node pointers
+ * are redirected to the new location.
+ *
+ * Arguments: tree - The tree the node belongs to.
+ *            node - The node to move.
+ *            dest - The new location of the node.
+ *
+ * Returns: void
+ */
+static void relocate(AvlTree *tree, Node *node, Node *dest){
+  memcpy(dest, node, tree->node_size);
+  dest->in_block = 1;
+
+  if(node->parent == NULL){
+    tree->root = dest;
+  }else if(node->parent->left_child == node){
+    node->parent->left_child = dest;
+  }else{
+    node->parent->right_child = dest;
+  }
+  if(node->left_child) node->left_child->parent = dest;
+  if(node->right_child) node->right_child->parent = dest;
+
+  if(tree->finger == node) tree->finger = dest;
+  if(tree->min_node == node) tree->min_node = dest;
+  if(tree->max_node == node) tree->max_node = dest;
+#ifndef AVL_PREFIX
+  if(tree->cache) cache_update(tree->cache, node->key, dest);
+#endif
+  if(tree->expiry && EXPIRY_ENTRY(tree, dest)->slot >= 0){
+    tree->expiry->heap[EXPIRY_ENTRY(tree, dest)->slot] = dest;
+  }
+  release_node(tree, node);
+}
+
+/*
+ * Function: veb_order
+ * -------------------
+ * Description:
+ * Internal helper. List the top levels of a subtree in van
+ * Emde Boas order: the upper half of the levels first, then
+ * each subtree hanging below them, all laid out recursively.
+ *
+ * Arguments: node   - The root of the subtree.
+ *            levels - The number of levels to list.
+ *            order  - The output list.
+ *            n      - Number of nodes listed so far, updated.
+ *
+ * Returns: void
+ */
+static void veb_order(Node *node, int levels, Node **order, int *n);
+
+/*
+ * Function: veb_bottom
+ * --------------------
+ * Description:
+ * Internal helper for veb_order. Lay out every subtree rooted
+ * at a given depth below node, from left to right.
+ *
+ * Arguments: node   - The root of the enclosing subtree.
+ *            depth  - Depth of the subtrees to lay out.
+ *            levels - The number of levels of each subtree.
+ *            order  - The output list.
+ *            n      - Number of nodes listed so far, updated.
+ *
+ * Returns: void
+ */
+static void veb_bottom(Node *node, int depth, int levels, Node **order,
+		       int *n){
+  if(node == NULL) return;
+  if(depth == 0){
+    veb_order(node, levels, order, n);
+    return;
+  }
+  veb_bottom(node->left_child, depth - 1, levels, order, n);
+  veb_bottom(node->right_child, depth - 1, levels, order, n);
+}
+
+static void veb_order(Node *node, int levels, Node **order, int *n){
+  if(node == NULL) return;
+  if(levels == 1){
+    order[(*n)++] = node;
+    return;
+  }
+  int top = levels / 2;
+  veb_order(node, top, order, n);
+  veb_bottom(node, top, levels - top, order, n);
+}
+
+/*
+ * Function: avl_compact
+ * ---------------------
+ * Description:
+ * Defragment a tree by moving all of its nodes in to one new
+ * contiguous block, in the given layout. O(n) time, plus a
+ * temporary list of n node pointers. Pointers to the nodes of
+ * the tree held outside of it are invalidated. An incremental
+ * compaction in progress is ended first.
+ *
+ * Arguments: tree   - The tree to compact.
+ *            layout - Order of the nodes in the block.
+ *
+ * Returns: The number of nodes moved.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out. The tree is
+ *          unchanged.
+ */
+int avl_compact(AvlTree *tree, AvlLayout layout){
+  // Check arguments.
+  assert(tree != NULL);
+
+  int n = tree->number_of_nodes;
+  Node **order = NULL;
+  AvlNodeBlock *block = NULL;
+  if(n > 0){
+    order = (Node **)malloc(n * sizeof(Node *));
+    if(order == NULL) return AVL_ERROR_NO_MEMORY;
+    block = alloc_block(tree, n);
+    if(block == NULL){
+      free(order);
+      return AVL_ERROR_NO_MEMORY;
+    }
+  }
+
+  if(tree->compact_block){
+    block_unref(tree->compact_block, 1);
+    tree->compact_block = NULL;
+  }
+  if(n == 0) return 0;
+
+  // List the nodes in their new order.
+  int listed = 0;
+  switch(layout){
+  case AVL_LAYOUT_INORDER:
+    for(Node *node = tree->min_node; node; node = avl_next(node)){
+      order[listed++] = node;
+    }
+    break;
+  case AVL_LAYOUT_BFS:
+    // The list doubles as the queue.
+    order[listed++] = tree->root;
+    for(int i = 0; i < listed; i++){
+      if(order[i]->left_child) order[listed++] = order[i]->left_child;
+      if(order[i]->right_child) order[listed++] = order[i]->right_child;
+    }
+    break;
+  case AVL_LAYOUT_VEB:
+    // The van Emde Boas order is cut by height.
+    avl_rebalance_step(tree, INT_MAX);
+    veb_order(tree->root, tree->root->height + 1, order, &listed);
+    break;
+  }
+  assert(listed == n);
+
+  // Move the nodes. Each is moved once, so the pointers in the
+  // list stay valid until their node's turn. The extra reference
+  // keeps the block alive while it is being filled.
+  block->refs++;
+  for(int i = 0; i < n; i++){
+    relocate(tree, order[i], block_take(tree, block));
+  }
+  block_unref(block, 1);
+
+  free(order);
+  memory_check(tree);
+  return n;
+}
+
+/*
+ * Function: avl_compact_begin
+ * ---------------------------
+ * Description:
+ * Start an incremental in-order compaction. The nodes present
+ * now are moved in to a new block in key order by subsequent
+ * calls to avl_compact_step, which may be interleaved with any
+ * other operations on the tree. Nodes inserted meanwhile are
+ * moved if the compaction has not passed their key yet and
+ * the block has room left.
+ *
+ * Arguments: tree - The tree to compact.
+ *
+ * Returns: 1 - The compaction was started.
+ *          0 - The tree is empty.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out. The tree is
+ *          unchanged.
+ */
+int avl_compact_begin(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  AvlNodeBlock *block = NULL;
+  if(tree->number_of_nodes > 0){
+    block = alloc_block(tree, tree->number_of_nodes);
+    if(block == NULL) return AVL_ERROR_NO_MEMORY;
+  }
+
+  if(tree->compact_block){
+    block_unref(tree->compact_block, 1);
+    tree->compact_block = NULL;
+  }
+  if(block == NULL) return 0;
+
+  tree->compact_block = block;
+  block->refs++;
+  memory_check(tree);
+  return 1;
+}
+
+/*
+ * Function: avl_compact_step
+ * --------------------------
+ * Description:
+ * Continue an incremental compaction by moving up to budget
+ * nodes, in O(budget * log n). Pointers to the moved nodes
+ * held outside of the tree are invalidated. The compaction
+ * ends once all nodes are moved or the block is full.
+ *
+ * Arguments: tree   - The tree being compacted.
+ *            budget - Maximum number of nodes to move.
+ *
+ * Returns: 1 - The compaction is still in progress.
+ *          0 - The compaction is complete (or was not started).
+ */
+int avl_compact_step(AvlTree *tree, int budget){
+  // Check arguments.
+  assert(tree != NULL);
+
+  AvlNodeBlock *block = tree->compact_block;
+  if(block == NULL) return 0;
+
+  for(; budget > 0; budget--){
+    // Move the nodes in key order, from the minimum on.
+    Node *node = block->used ? find_successor(tree, tree->compact_key)
+      : tree->min_node;
+    if(node == NULL || block->used == block->size) break;
+
+    tree->compact_key = node->key;
+    relocate(tree, node, block_take(tree, block));
+  }
+  if(budget > 0){
+    // Out of nodes or room, drop the compaction's reference.
+    block_unref(block, 1);
+    tree->compact_block = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Function: avl_init_node
+ * -----------------------
+ * Description:
+ * Initialize a node slot of a tree as an empty, unlinked node
+ * with the given key, zero-filling the extension area. In a
+ * Merkle augmented tree the node starts with its key's hash.
+ * The node is marked as living in a node block, so the slot
+ * has to come from avl_alloc_nodes.
+ *
+ * Arguments: tree - The tree the node is for.
+ *            node - The node slot.
+ *            key  - The order key the node has.
+ *
+ * Returns: void
+ */
+void avl_init_node(AvlTree *tree, Node *node, AVL_KEY_T key){
+  // Set correct node attributes (for empty node).
+  node->key = key;
+  node->data = NULL;
+  node->left_child = node->right_child = node->parent = NULL;
+  node->height = 0;
+  node->in_block = 1;
+  if(tree->node_size > sizeof(Node)){
+    memset(node + 1, 0, tree->node_size - sizeof(Node));
+  }
+#ifndef AVL_PREFIX
+  if(tree->augment && tree->augment->kind == AVL_AUG_MERKLE){
+    uint64_t h = merkle_hash(key, NULL, 0);
+    memcpy(AUG_VALUE(tree, node), &h, sizeof(h));
+    memcpy(AUG_AGGREGATE(tree, node), &h, sizeof(h));
+  }
+#endif
+  if(tree->expiry){
+    EXPIRY_ENTRY(tree, node)->deadline = AVL_NO_DEADLINE;
+    EXPIRY_ENTRY(tree, node)->slot = -1;
+  }
+}
+
+/*
+ * Function: avl_alloc_nodes
+ * -------------------------
+ * Description:
+ * Allocate a block of n node slots for a tree, for
+ * bulk construction. The slots are uninitialized (see
+ * avl_init_node) and addressed with AVL_NODE_SLOT. All of
+ * them have to become nodes of the tree, which are then
+ * released like any other node.
+ *
+ * Arguments: tree - The tree the nodes are for.
+ *            n    - The number of slots, at least 1.
+ *
+ * Returns: Pointer to the first slot, NULL if memory ran out.
+ */
+Node * avl_alloc_nodes(AvlTree *tree, int n){
+  // Check arguments.
+  assert(tree != NULL && n > 0);
+
+  AvlNodeBlock *block = alloc_block(tree, n);
+  if(block == NULL) return NULL;
+  block->used = block->size;
+  block->refs = n;
+  memory_charge(tree, NODE_BYTES(n), PAYLOAD_BYTES(tree, n), 0, 0);
+  return BLOCK_SLOTS(block);
+}
+
+/*
+ * Function: avl_release_slots
+ * ---------------------------
+ * Description:
+ * Give back the unused tail of node slots handed out by
+ * avl_alloc_nodes, for bulk construction of an unknown number
+ * of nodes. The slots stay allocated until the block's nodes
+ * are all released, but no longer keep it alive.
+ *
+ * Arguments: tree  - The tree the slots belong to.
+ *            slots - The first unused slot.
+ *            n     - The number of unused slots, up to the end
+ *                    of the block.
+ *
+ * Returns: void
+ */
+void avl_release_slots(AvlTree *tree, Node *slots, int n){
+  // Check arguments.
+  assert(tree != NULL && slots != NULL && n >= 0);
+
+  if(n == 0) return;
+  AvlNodeBlock *block = node_block(slots);
+  assert(slots == AVL_NODE_SLOT(tree, BLOCK_SLOTS(block), block->size - n));
+  memory_discharge(tree, NODE_BYTES(n), PAYLOAD_BYTES(tree, n), 0);
+  block_unref(block, n);
+}
+
+/*
+ * Function: augment_subtree
+ * -------------------------
+ * Description:
+ * Internal helper. Recompute the aggregates of all nodes of
+ * a subtree, bottom up.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The root of the subtree.
+ *
+ * Returns: void
+ */
+static void augment_subtree(AvlTree *tree, Node *node){
+  if(node == NULL) return;
+  augment_subtree(tree, node->left_child);
+  augment_subtree(tree, node->right_child);
+  augment_node(tree, node);
+}
+
+/*
+ * Function: free_subtree
+ * ----------------------
+ * Description:
+ * Internal helper. Free all nodes of a subtree, leaves first,
+ * climbing back up through the parent pointers. Not recursive,
+ * as a tree in relaxed balance can be arbitrarily deep.
  *
- * Arguments: node - The pre-existing node.
- * 
- * Returns: Pointer to the newly created tree.
+ * Arguments: tree - The tree the subtree belongs to.
+ *            node - The root of the subtree to free.
+ *
+ * Returns: void
  */
-AvlTree * make_tree_from_node(Node *node){
-  // Check arguments.
-  assert(node != NULL);
-  
-  // Allocate space for the new tree.
-  AvlTree *tree = (AvlTree *)malloc(sizeof(AvlTree));
-  if(tree == NULL){
-    // Memory allocation failed, report and exit.
-    printf("Memory allocation failed while creating a new tree from a node.\n");
-    exit(1); // Throw memory allocation error.
+static void free_subtree(AvlTree *tree, Node *node){
+  Node *stop = node ? node->parent : NULL;
+  while(node != stop){
+    if(node->left_child){
+      node = node->left_child;
+    }else if(node->right_child){
+      node = node->right_child;
+    }else{
+      // A leaf, unlink and free it.
+      Node *parent = node->parent;
+      if(parent && parent->left_child == node) parent->left_child = NULL;
+      else if(parent) parent->right_child = NULL;
+      release_node(tree, node);
+      node = parent;
+    }
   }
-
-  tree->root = node; // Assign root.
-  // Set the correct tree atributes.
-  tree->height = 0;
-  tree->number_of_nodes = 1;
-  return tree;
 }
 
 /*
- * Function: make_tree_empty
+ * Function: avl_adopt_nodes
  * -------------------------
  * Description:
- * Create and allocate a new tree, containing no
- * nodes.
- * 
- * Arguments: none
+ * Make a subtree built outside of the core the content of an
+ * empty tree. The subtree has to be a valid AVL-Tree with
+ * correct heights and parent pointers, made of nodes of this
+ * tree (see avl_alloc_nodes). Aggregates of an augmented tree
+ * are computed here, in O(n).
  *
- * Returns: Pointer to the newly created tree.
+ * Arguments: tree - The empty tree.
+ *            root - Root of the subtree.
+ *            n    - Number of nodes in the subtree.
+ *
+ * Returns: 1 - The subtree was adopted.
+ *          0 - The tree is not empty.
+ *          AVL_ERROR_NO_MEMORY - If memory to grow the tree's
+ *          filter ran out. The tree stays empty, and the nodes
+ *          of the subtree are freed.
  */
-AvlTree * make_tree_empty(){
-  // Allocate memory.
-  AvlTree *new_tree = (AvlTree *)malloc(sizeof(AvlTree));
-  if(new_tree == NULL){
-    // Memory allocation failed, report and exit.
-    printf("Memory allocation failed while creating an empty tree.\n");
-    exit(1); // Throw memory allocation error.
-  }
+int avl_adopt_nodes(AvlTree *tree, Node *root, int n){
+  // Check arguments.
+  assert(tree != NULL && root != NULL);
 
-  // Set the correct tree attributes.
-  new_tree->root = NULL;
-  new_tree->height = -1; // Represents an empty tree.
-  new_tree->number_of_nodes = 0;
-  return new_tree;
+  if(tree->root != NULL) return 0;
+
+  root->parent = NULL;
+  tree->root = root;
+  tree->height = root->height;
+  tree->number_of_nodes = n;
+  tree->finger = NULL;
+  tree->min_node = leftmost(root);
+  tree->max_node = rightmost(root);
+  if(tree->augment) augment_subtree(tree, root);
+#ifndef AVL_PREFIX
+  if(tree->filter){
+    int capacity = tree->filter->capacity;
+    if(n > capacity) tree->filter->capacity = n;
+    if(!filter_rebuild(tree)){
+      // The old filter is intact, so just empty the tree again.
+      tree->filter->capacity = capacity;
+      tree->root = tree->min_node = tree->max_node = NULL;
+      tree->height = -1;
+      tree->number_of_nodes = 0;
+      free_subtree(tree, root);
+      return AVL_ERROR_NO_MEMORY;
+    }
+  }
+#endif
+  memory_check(tree);
+  return 1;
 }
 
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
 /*
- * Function: make_node_empty
- * -------------------------
- * Description: 
- * This function creates and allocates memory for 
- * a new node, containing no data. It takes a key
- * argument.
+ * Function: avl_cache_attach
+ * --------------------------
+ * Description:
+ * Attach a hot-key cache to a tree. Searches check the cache
+ * before descending, and found nodes are cached, so repeated
+ * lookups of the same keys take O(1). Deletion and relocation
+ * of nodes keep the cache valid. The cache is freed with the
+ * tree.
  *
- * Arguments: key - The order key the node has.
- * 
- * Returns: Node pointer to the new node.
+ * Arguments: tree      - The tree.
+ *            n_entries - Capacity of the cache, rounded down to a
+ *                        power of two of at least 4 entries.
+ *
+ * Returns: 1 - The cache was attached.
+ *          0 - The tree already has a cache.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
  */
-Node * make_node_empty(int key){
-  // Allocate memory for the new node.
-  Node *new_node = (Node *)malloc(sizeof(Node));
-  if(new_node == NULL){
-    // Memory allocation failed, report and exit.
-    printf("Memory allocation failed while generating a new empty node.\n");
-    exit(1); // Throw memory allocation error. 
+int avl_cache_attach(AvlTree *tree, int n_entries){
+  // Check arguments.
+  assert(tree != NULL && n_entries > 0);
+
+  if(tree->cache) return 0;
+
+  int set_bits = 0;
+  while((CACHE_WAYS << (set_bits + 1)) <= n_entries) set_bits++;
+  size_t n_sets = (size_t)1 << set_bits;
+
+  AvlCache *cache = (AvlCache *)malloc(sizeof(AvlCache));
+  AvlCacheEntry *entries =
+    (AvlCacheEntry *)calloc(n_sets * CACHE_WAYS, sizeof(AvlCacheEntry));
+  if(cache == NULL || entries == NULL){
+    free(cache);
+    free(entries);
+    return AVL_ERROR_NO_MEMORY;
   }
 
-  // Set correct node attributes (for empty node).
-  new_node->key = key;
-  new_node->data = NULL;
-  new_node->left_child = new_node->right_child = new_node->parent = NULL;
-  new_node->height = 0;
-  return new_node;
+  cache->entries = entries;
+  cache->set_bits = set_bits;
+  cache->frozen = 0;
+  cache->stats.hits = cache->stats.misses = cache->stats.evictions = 0;
+  tree->cache = cache;
+  memory_charge(tree, 0, 0, sizeof(AvlCache)
+		+ n_sets * CACHE_WAYS * sizeof(AvlCacheEntry), 0);
+  memory_check(tree);
+  return 1;
 }
 
 /*
- * Function: upin
- * --------------
+ * Function: avl_cache_detach
+ * --------------------------
  * Description:
- * This method is called after insertion of a node
- * and walks up the tree from the freshly inserted
- * node, checking the avl condition on every point.
- * If the AVL condition is violated at a point, it
- * calls the corresponding rotations to fix it.
+ * Remove and free the hot-key cache of a tree, if any.
  *
- * Arguments: node - The node from which upin is called. 
- *            tree - The tree operating in.
- * 
- * Returns: void 
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
  */
-void upin(AvlTree *tree, Node *node){
+void avl_cache_detach(AvlTree *tree){
   // Check arguments.
   assert(tree != NULL);
-  assert(node != NULL);
-
-  // Figure out the balance of the node.
-  int bal = balance(node);
-  
-  // End upin procedure if root is reached.
-  if(node->parent == NULL){
-    return;
-  }
 
-  // Pointer to the parent node.
-  Node *parent = node->parent;
+  if(tree->cache == NULL) return;
+  size_t n_sets = (size_t)1 << tree->cache->set_bits;
+  memory_discharge(tree, 0, 0, sizeof(AvlCache)
+		   + n_sets * CACHE_WAYS * sizeof(AvlCacheEntry));
+  free(tree->cache->entries);
+  free(tree->cache);
+  tree->cache = NULL;
+}
 
-  // Figure out the balance of it's parent.
-  int p_bal = balance(parent);
+/*
+ * Function: avl_cache_freeze
+ * --------------------------
+ * Description:
+ * Freeze or thaw the hot-key cache of a tree. Lookups in a
+ * frozen cache only read it: hits are not moved to the front,
+ * found keys are not added and the counters stay as they are.
+ * Searches of a tree with a frozen cache can then run
+ * concurrently (e.g. under a reader lock). Insertions,
+ * deletions and compaction still update the cache and need
+ * exclusive access.
+ *
+ * Arguments: tree   - The tree, with a cache attached.
+ *            frozen - 1 to freeze the cache, 0 to thaw it.
+ *
+ * Returns: void
+ */
+void avl_cache_freeze(AvlTree *tree, int frozen){
+  // Check arguments.
+  assert(tree != NULL && tree->cache != NULL);
 
-  // Check balance for correctness, rotating if necessary.
-  if(node->key < parent->key){
-    if(p_bal == 0){
-      // Exit upin if the parent balance is 0.
-      return;
-    }else if(p_bal == -1){
-      // Continue upin at the parent.
-      upin(tree, parent);
-    }else if(p_bal < -1){
-      if(bal == -1){
-	// Do a single right rotation.
-	rotate_right(tree, parent);
-      }else if(bal == 1){
-	// Do a double rotation (left, right).
-	rotate_left(tree, parent->left_child);
-	rotate_right(tree, parent);
-      }else{
-	// This should not be reached.
-	printf("Critical error occured in upin procedure.\n");
-	exit(2);
-      }
-    }else{
-      // This should not be reached.
-      printf("Critical error occured in upin procedure.\n");
-      exit(2);
-    }
-  }else{
-    if(p_bal <= 0){
-      // Exit upin if the parent balance is 0.
-      return;
-    }else if(p_bal == 1){
-      // Continue upin at the parent. 
-      upin(tree, parent);
-    }else if(p_bal > 1){
-      if(bal == 1){
-	// Do a single left rotation. 
-	rotate_left(tree, parent);
-      }else if(bal == -1){
-	// Do a double rotation (right, left).
-	rotate_right(tree, parent->right_child);
-	rotate_left(tree, parent);
-      }else{
-	// This should not be reached.
-	printf("Critical error occured in upin procedure.\n");
-	exit(2);
-      }
-    }else{
-      // This should not be reached.
-      printf("Critical error occured in upin procedure.\n");
-      exit(2);
-    }
-  }
+  tree->cache->frozen = frozen;
 }
 
 /*
- * Function: upout
- * ---------------
+ * Function: avl_cache_stats
+ * -------------------------
  * Description:
- * This method is called after deletion of a node
- * and walks up the tree from the deleted
- * node, checking the avl condition on every point.
- * If the AVL condition is violated at a point, it
- * calls the corresponding rotations to fix it.
+ * Get the counters of the hot-key cache of a tree.
  *
- * Arguments: node - The node from which upout is called. 
- *            tree - The tree operating in.
- * 
- * Returns: void 
+ * Arguments: tree - The tree, with a cache attached.
+ *
+ * Returns: The hit, miss and eviction counts so far.
  */
-void upout(AvlTree *tree, Node *node){
+AvlCacheStats avl_cache_stats(AvlTree *tree){
   // Check arguments.
-  assert(tree != NULL);
-  assert(node != NULL);
+  assert(tree != NULL && tree->cache != NULL);
 
-  // Keep track of the parent of the node.
-  Node *parent = node->parent;
-  
-  // Get the balance of the current node.
-  int bal = balance(node);
+  return tree->cache->stats;
+}
 
-  if(bal < -1){
-    // The node has a left-heavy imbalance.
+/*
+ * Function: avl_filter_attach
+ * ---------------------------
+ * Description:
+ * Attach a blocked Bloom filter to a tree, filled with its
+ * current keys. Searches for keys the filter rejects return
+ * after reading a single cache line of the filter, instead
+ * of descending the tree. The filter grows with the tree, and
+ * is rebuilt after many deletions. It is freed with the tree.
+ *
+ * Arguments: tree          - The tree.
+ *            expected_keys - The number of keys to size the filter
+ *                            for (grown automatically).
+ *            fp_rate       - The targeted rate of false positives,
+ *                            between 0 and 1, for example 0.01.
+ *
+ * Returns: 1 - The filter was attached.
+ *          0 - The tree already has a filter.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+int avl_filter_attach(AvlTree *tree, int expected_keys, double fp_rate){
+  // Check arguments.
+  assert(tree != NULL && fp_rate > 0.0 && fp_rate < 1.0);
 
-    // Figure out the balance of its left child.
-    int l_bal = balance(node->left_child);
+  if(tree->filter) return 0;
 
-    if(l_bal == -1){
-      // Double left heavy imbalance. Fix by single right rotation.
-      rotate_right(tree, node);
-    }else if(l_bal == 1){
-      // Left-Right imbalance. Fix with a left-right rotation.
-      rotate_left(tree, node->left_child);
-      rotate_right(tree, node);
-    }else{
-      rotate_right(tree, node);
-    }
-  }else if(bal > 1){
-    // The node has a right-heavy imbalance.
+  AvlFilter *filter = (AvlFilter *)malloc(sizeof(AvlFilter));
+  if(filter == NULL) return AVL_ERROR_NO_MEMORY;
 
-    // Figure out the balance of its right child.
-    int r_bal = balance(node->right_child);
+  // log2(1 / fp_rate) probes, and about 1.5 bits per probe and key
+  // (1.44 for a classic Bloom filter, plus slack for the blocking).
+  int probes = 0;
+  for(double rate = 1.0; rate > fp_rate && probes < FILTER_MAX_PROBES;
+      rate /= 2) probes++;
+  filter->probes = probes;
+  filter->bits_per_key = (3 * probes + 1) / 2;
+  filter->capacity = (expected_keys > tree->number_of_nodes)
+    ? expected_keys : tree->number_of_nodes;
+  if(filter->capacity < 64) filter->capacity = 64;
+  filter->memory = NULL;
+  filter->stats.rejected = filter->stats.passed = 0;
+  filter->stats.false_positives = filter->stats.rebuilds = 0;
 
-    if(r_bal == 1){
-      // Double right heavy imbalance. Fix with a single left rotation.
-      rotate_left(tree, node);
-    }else if(r_bal == -1){
-      // Right-Left imbalance. Fix with a right-left rotation.
-      rotate_right(tree, node->right_child);
-      rotate_left(tree, node);
-    }else{
-      rotate_left(tree, node);
-    }
+  tree->filter = filter;
+  if(!filter_rebuild(tree)){
+    tree->filter = NULL;
+    free(filter);
+    return AVL_ERROR_NO_MEMORY;
   }
-
-  // Continue upwards traversal.
-  if(parent) upout(tree, parent);
+  memory_charge(tree, 0, 0, sizeof(AvlFilter), 0);
+  memory_check(tree);
+  return 1;
 }
 
 /*
- * Function: get_height
- * --------------------
+ * Function: avl_filter_detach
+ * ---------------------------
  * Description:
- * Calculates and returns the height of the given
- * Node. This does not adapt the height of its
- * children, so if those are off, the new height is
- * also going to be off! This is to conserve computational
- * effort. 
- * 
- * Arguments: node - The node to which to calculate the height.
- * 
- * Returns: The height of node.
+ * Remove and free the filter of a tree, if any.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
  */
-int get_height(Node *node){
+void avl_filter_detach(AvlTree *tree){
   // Check arguments.
-  assert(node != NULL);
+  assert(tree != NULL);
 
-  // The base heights for no children.
-  int l_height = -1;
-  int r_height = -1;
-  // Update children's height if they exists.
-  if(node->left_child) l_height = node->left_child->height;
-  if(node->right_child) r_height = node->right_child->height;
-  
-  // Calculate and return the correct height.
-  return get_int_max(l_height, r_height) + 1;
+  if(tree->filter == NULL) return;
+  memory_discharge(tree, 0, 0, sizeof(AvlFilter) + 63
+		   + tree->filter->n_blocks * (FILTER_BLOCK_BITS / 8));
+  free(tree->filter->memory);
+  free(tree->filter);
+  tree->filter = NULL;
 }
 
 /*
- * Function: balance
- * -----------------
+ * Function: avl_filter_stats
+ * --------------------------
  * Description:
- * Figure out the balance of a node.
- * Scan the height of the children trees to calculate it.
+ * Get the counters of the filter of a tree.
  *
- * Arguments: node - The node in question.
- * 
- * Returns: the balance.
+ * Arguments: tree - The tree, with a filter attached.
+ *
+ * Returns: The filter counters so far.
  */
-int balance(Node *node){
-  // Check arguments.
-  assert(node != NULL);
-
-  // The base heights for no children.
-  int l_height = -1;
-  int r_height = -1;
-  // Update children's height if they exists.
-  if(node->left_child) l_height = node->left_child->height;
-  if(node->right_child) r_height = node->right_child->height;
-
-  // Update the current node's height.
-  node->height = get_int_max(l_height, r_height) + 1;
+AvlFilterStats avl_filter_stats(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL && tree->filter != NULL);
 
-  // Return the balance (height difference).
-  return r_height - l_height;
+  return tree->filter->stats;
 }
+#endif
 
 /*
- * Function: rotate_right
- * ----------------------
+ * Function: avl_expiry_attach
+ * ---------------------------
  * Description:
- * Execute a single righthand rotation around
- * a given node.
+ * Make an empty tree expiring: every node gets a deadline
+ * (initially AVL_NO_DEADLINE), and the nodes with one are
+ * kept in a heap ordered by deadline, so that avl_expire
+ * finds the expired nodes without visiting the live ones.
+ * Deadlines and the current time are in any unit the caller
+ * chooses, e.g. milliseconds.
  *
- * Arguments: node - The node to rotate.
- *            tree - The tree operating in. 
+ * Arguments: tree         - The tree, empty.
+ *            hide_expired - Whether lookups (search_by_key,
+ *                           avl_lookup_value) treat expired
+ *                           nodes as absent before they are
+ *                           deleted (see avl_expiry_now).
  *
- * Returns: void 
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already expiring.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
  */
-void rotate_right(AvlTree *tree, Node *node){
+int avl_expiry_attach(AvlTree *tree, int hide_expired){
   // Check arguments.
   assert(tree != NULL);
-  assert(node != NULL);
 
-  // Pointer to keep track of the second node in rotation.
-  Node *l_child = node->left_child;
+  if(tree->root != NULL || tree->expiry != NULL) return 0;
 
-  // Do rotation.
-  if(node->parent == NULL){
-    // Operating on root.
-    tree->root = l_child;
-    l_child->parent = NULL;
-  }else{
-    // Give the parent its new child.
-    if(node->key < node->parent->key){
-      // We are left child.
-      node->parent->left_child = l_child;
-    }else{
-      // We are right child.
-      node->parent->right_child = l_child;
-    }
-    // Adapt the parent.
-    l_child->parent = node->parent;
-  }
-  // Rearrange the children nodes.
-  node->left_child = l_child->right_child;
-  // If a child is there, adapt its parent.
-  if(l_child->right_child) l_child->right_child->parent = node;
-  l_child->right_child = node;
-  node->parent = l_child;
+  AvlExpiry *expiry = (AvlExpiry *)malloc(sizeof(AvlExpiry));
+  if(expiry == NULL) return AVL_ERROR_NO_MEMORY;
 
-  // Update the heights.
-  if(node){
-    node->height = get_height(node);
-  }
-  if(l_child){
-    if(l_child->left_child){
-      l_child->left_child->height = get_height(l_child->left_child);
-    }
-    l_child->height = get_height(l_child);
-  }
+  expiry->heap = NULL;
+  expiry->size = expiry->capacity = 0;
+  expiry->offset = avl_reserve_node_ext(tree, sizeof(ExpiryEntry));
+  expiry->now = 0;
+  expiry->hide = hide_expired;
+  tree->expiry = expiry;
+  memory_charge(tree, 0, 0, sizeof(AvlExpiry), 0);
+  memory_check(tree);
+  return 1;
 }
 
 /*
- * Function: rotate_left
- * ---------------------
+ * Function: avl_expiry_set
+ * ------------------------
  * Description:
- * Execute a single lefthand rotation around
- * a given node. 
- * 
- * Arguments: node - The node to rotate.
- *            tree - The tree operating in.
+ * Set, change or clear the deadline of a node of an expiring
+ * tree. O(log n).
  *
- * Returns: void
+ * Arguments: tree     - The expiring tree.
+ *            node     - The node.
+ *            deadline - The new deadline, AVL_NO_DEADLINE for none.
+ *
+ * Returns: 1 - On success.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the tree
+ *          reached its memory limit. The deadline is unchanged.
  */
-void rotate_left(AvlTree *tree, Node *node){
+int avl_expiry_set(AvlTree *tree, Node *node, long long deadline){
   // Check arguments.
-  assert(tree != NULL);
-  assert(node != NULL);
+  assert(tree != NULL && tree->expiry != NULL && node != NULL);
 
-  // Pointer to keep track of the second node in rotation.
-  Node *r_child = node->right_child;
+  if(!expiry_schedule(tree, node, deadline)) return AVL_ERROR_NO_MEMORY;
+  memory_check(tree);
+  return 1;
+}
 
-  // Do rotation.
-  if(node->parent == NULL){
-    // Operating on root.
-    tree->root = r_child;
-    r_child->parent = NULL;
-  }else{
-    // Give the parent its new child.
-    if(node->key < node->parent->key){
-      // We are left child.
-      node->parent->left_child = r_child;
-    }else{
-      // We are right child.
-      node->parent->right_child = r_child;
-    }
-    // Adapt the parent.
-    r_child->parent = node->parent;
-  }
-  // Rearrange the children nodes.
-  node->right_child = r_child->left_child;
-  // If a child is there, adapt its parent.
-  if(r_child->left_child) r_child->left_child->parent = node;
-  r_child->left_child = node;
-  node->parent = r_child;
+/*
+ * Function: avl_expiry_deadline
+ * -----------------------------
+ * Description:
+ * Get the deadline of a node of an expiring tree.
+ *
+ * Arguments: tree - The expiring tree.
+ *            node - The node.
+ *
+ * Returns: The deadline, AVL_NO_DEADLINE if it has none.
+ */
+long long avl_expiry_deadline(AvlTree *tree, Node *node){
+  // Check arguments.
+  assert(tree != NULL && tree->expiry != NULL && node != NULL);
 
-  // Update the heights.
-  if(node){
-    node->height = get_height(node);
-  }
-  if(r_child){
-    if(r_child->right_child){
-      r_child->right_child->height = get_height(r_child->right_child);
-    }
-    r_child->height = get_height(r_child);
-  }
+  return EXPIRY_ENTRY(tree, node)->deadline;
 }
 
 /*
- * Function: search_by_key
- * -------------------------
+ * Function: avl_insert_expiring
+ * -----------------------------
  * Description:
- * Search for a node in the tree. If the node is found,
- * return a truthy and a pointer to the node-location.
- * If not, return a falsey and point to the node which
- * would represent it's parent, if it were in the tree.
+ * Insert a node in to an expiring tree (if the key does not
+ * exist already), with a deadline. Expired nodes that were
+ * not deleted yet still exist for insertions, even if lookups
+ * hide them.
  *
- * Arguments: key  - order key to search for.
- *            node - will point to node in question.
- *            tree - The tree to search in.
- * 
- * Returns: 1  - If node has been found.
- *          0  - If the node was not found.
+ * Arguments: tree     - The expiring tree.
+ *            key      - The order key to use.
+ *            deadline - The deadline, AVL_NO_DEADLINE for none.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
  */
-int search_by_key(int key, AvlTree *tree, Node **node){
+int avl_insert_expiring(AvlTree *tree, AVL_KEY_T key,
+			long long deadline){
   // Check arguments.
-  assert(tree != NULL);
-  assert(node != NULL);
-  
-  // Check if the tree is empty.
-  if(tree->root == NULL){
-    // Return a NULL-pointer on the node, and falsy.
-    *node = NULL;
-    return 0;
-  }
+  assert(tree != NULL && tree->expiry != NULL);
 
-  // Start traversing the tree.
-  *node = tree->root;
-  while(1){
-    if(key < (*node)->key){
-      // Continue search to the left of the node.
-      if((*node)->left_child == NULL){
-	// Node not in tree, return.
-	return 0;
-      }
-      // Continue traversal.
-      *node = (*node)->left_child;
-    }else if(key > (*node)->key){
-      // Continue search to the right of the node.
-      if((*node)->right_child == NULL){
-	// Node is not in tree, return.
-	return 0;
-      }
-      // Continue traversal.
-      *node = (*node)->right_child;
-    }else{
-      // Found the node, return.
-      return 1;
-    }
+  // Make room in the heap first, so the insertion cannot fail later.
+  int linked = AVL_ERROR_NO_MEMORY;
+  Node *new_node = NULL;
+  if(deadline == AVL_NO_DEADLINE || expiry_reserve(tree)){
+    linked = link_below(tree, tree->root, key, &new_node);
+  }
+  if(linked != 1){
+    TRACE(tree, AVL_TRACE_INSERT, key, linked);
+    return linked;
   }
 
-  // This should be unreachable code. Error if reached.
-  printf("Critical error occured while searching for a node.\n");
-  exit(2); // Exit with code 2. See Error index for details.
+  expiry_schedule(tree, new_node, deadline);
+  finish_insert(tree, new_node);
+  memory_check(tree);
+  TRACE(tree, AVL_TRACE_INSERT, key, 1);
+  return 1;
 }
 
 /*
- * Function: key_insert_new
+ * Function: avl_expiry_now
  * ------------------------
  * Description:
- * Insert a node in to the tree (if it does not
- * exist already) according to its order key.
- * The node will initially not contain any data.
- * 
- * Arguments: key  - The order key to use.
- *            tree - The tree to insert into.
+ * Set the current time of an expiring tree, against which
+ * lookups hide expired nodes (see avl_expiry_attach). Nothing
+ * is deleted.
  *
- * Returns: 1  - On successful insertion.
- *          0  - If insertion failed.
+ * Arguments: tree - The expiring tree.
+ *            now  - The current time.
+ *
+ * Returns: void
  */
-int key_insert_new(int key, AvlTree *tree){
-  assert(tree != NULL); // Check arguments.
-
-  // The new node.
-  Node *new_node = make_node_empty(key);
-  
-  if(tree->root == NULL){
-    // Tree is empty, make the new node the root.
-    tree->root = new_node;
-    new_node->parent = NULL;
-    // Adapt the height of the tree.
-    tree->height = 0;
-    // Increment number of nodes in tree.
-    tree->number_of_nodes++;
-    return 1;
-  }else{
-    // Traverse the tree.
-    // active keeps track of the current traversal "index".
-    Node *active = tree->root;
-    
-    while(1){
-      if(key < active->key){
-	// New node is expected to left of active.
-	if(active->left_child == NULL){
-	  // Insert to the left of active.
-	  active->left_child = new_node;
-	  new_node->parent = active;
-	  // Increase number of nodes in tree.
-	  tree->number_of_nodes++;
-	  // Check balance and rebalance.
-	  upin(tree, new_node);
-	  // Update the height of the tree.
-	  tree->height = tree->root->height;
-	  return 1;
-	}
-
-	// Continue traversal.
-	active = active->left_child;
-      }else if(key > active->key){
-	// New node is expected to right of active.
-	if(active->right_child == NULL){
-	  // Insert to the right of active.
-	  active->right_child = new_node;
-	  new_node->parent = active;
-	  // Increase number of nodes in tree.
-	  tree->number_of_nodes++;
-	  // Check balance and rebalance.
-	  upin(tree, new_node);
-	  // Update the height of the tree.
-	  tree->height = tree->root->height;
-	  return 1;
-	}
-
-	// Continue traversal.
-	active = active->right_child; 
-      }else{
-	// Key already exists in tree. Insertion failure.
-	return 0;
-      }
-    }
-  }
+void avl_expiry_now(AvlTree *tree, long long now){
+  // Check arguments.
+  assert(tree != NULL && tree->expiry != NULL);
 
-  // This should be unreachable code. Error if reached.
-  printf("Critical error occured while inserting a new node.\n");
-  exit(2); // Exit with code 2. See Error index for details.
+  tree->expiry->now = now;
 }
 
 /*
- * Function: key_delete
+ * Function: avl_expire
  * --------------------
  * Description:
- * This function, for a given key, searches the node
- * with that order key in the given tree and tries
- * to delete it. If the key could not be found, the
- * function returns 0, otherwise it returns 1 after 
- * deletion.
+ * Delete all nodes of an expiring tree whose deadline is at
+ * or before a given time, earliest first, and make that time
+ * the current time of the tree. Only the expired nodes are
+ * visited: O(k log n) for k expired nodes. The deletions are
+ * reported to the trace hook.
  *
- * Arguments: key - The key to search and delete.
- *            tree - The tree to search and delete in.
+ * Arguments: tree    - The expiring tree.
+ *            now     - The current time.
+ *            expired - Called for every expired node before it
+ *                      is deleted. May be NULL.
+ *            ctx     - Passed to expired.
  *
- * Returns: 1 - Successful deletion.
- *          0 - Deletion unsuccessful (key not found).
+ * Returns: The number of nodes deleted.
  */
-int key_delete(int key, AvlTree *tree){
+long avl_expire(AvlTree *tree, long long now, avl_expire_fn expired,
+		void *ctx){
   // Check arguments.
-  assert(tree != NULL);
+  assert(tree != NULL && tree->expiry != NULL);
 
-  // Pointer to the node to be deleted.
-  Node *del_node = NULL;
+  AvlExpiry *expiry = tree->expiry;
+  expiry->now = now;
 
-  // Search for the key to be deleted.
-  if(!search_by_key(key, tree, &del_node)){
-    // The key was not found, return unsuccessful deletion.
-    return 0;
+  long count = 0;
+  while(expiry->size > 0
+	&& EXPIRY_ENTRY(tree, expiry->heap[0])->deadline <= now){
+    Node *node = expiry->heap[0];
+    AVL_KEY_T key = node->key;
+    if(expired) expired(node, ctx);
+    unlink_node(tree, node);
+    TRACE(tree, AVL_TRACE_DELETE, key, 1);
+    count++;
   }
+  return count;
+}
 
-  if(del_node){
-    // Pointer to the replacement node (for the deleted one).
-    Node *repl = del_node->left_child;
-    
-    // If the replacement pointer is null, there was no left child.
-    // Take the right one instead. If not, continue to iterate until
-    // the correct replacement (the predecessor in the tree) is found.
-    if(repl == NULL){
-      repl = del_node->right_child;
-    }else{
-      // Iterate until predecessor is found.
-      while(repl->right_child){
-	repl = repl->right_child;
-      }
-    }
+/*
+ * Function: avl_memory_stats
+ * --------------------------
+ * Description:
+ * Get the memory held by a tree, by kind. O(1), the counts
+ * are kept up to date by every allocation and release.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: The bytes held by the tree.
+ */
+AvlMemoryStats avl_memory_stats(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
 
-    // This points to the node from which we want to start the upout
-    // procedure after deleting. Generally, this is the parent of the
-    // actually unlinked node. So in case the replacement node is not
-    // a direct child of the deletion node, this will point to the
-    // parent of the replacement node. If it is a direct child, it will
-    // point to the parent of the deletion node. If that is the root, we
-    // let it point to NULL, and do not have to rebalance.
-    Node *rebalance = NULL;
-    if(repl){
-      if(repl->parent != del_node) rebalance = repl->parent;
-
-      // Give the replacement node the right child of the node to be
-      // deleted. If the replacement is the right child of the node to
-      // be deleted, skip this step.
-      if(repl != del_node->right_child){
-	repl->right_child = del_node->right_child;
-	if(del_node->right_child) del_node->right_child->parent = repl;
-      }
+  return tree->memory;
+}
 
-      // Give the parent of the replacement node its left child as a right child,
-      // and adjust the left child of the replacement node to be the left child
-      // of the deletion node.
-      // If the parent of the replacement node is the deletion node itself, skip
-      // this step.
-      if(repl->parent != del_node){
-	repl->parent->right_child = repl->left_child;
-	if(repl->left_child) repl->left_child->parent = repl->parent;
-	repl->left_child = del_node->left_child;
-	del_node->left_child->parent = repl;
-      }
-    }else{
-      if(!rebalance && del_node->parent) rebalance = del_node->parent;
-    }
-    
-    // Point the parent of the deletion node to the replacement node.
-    if(del_node->parent){
-      if(del_node->key < del_node->parent->key){
-	// Deletion node is a left child of its parent.
-	del_node->parent->left_child = repl;
-      }else{
-	// Deletion node is a right child of its parent.
-	del_node->parent->right_child = repl;
-      }
-      if(repl) repl->parent = del_node->parent;
-    }else{
-      // Handeling the deletion of the root.
-      tree->root = repl;
-      if(repl) repl->parent = NULL;
-    }
+/*
+ * Function: avl_memory_budget
+ * ---------------------------
+ * Description:
+ * Set the memory budget and limit of a tree. Crossing the
+ * soft budget calls on_budget once, so that the caller can
+ * evict or spill keys; crossing it again requires the tree
+ * to get back within the budget first. The hard limit makes
+ * insertions that would exceed it fail with
+ * AVL_ERROR_NO_MEMORY instead. Bulk loading, compaction,
+ * caches and filters are accounted for, but not refused. If
+ * the tree is over the new budget already, on_budget is
+ * called right away.
+ *
+ * Arguments: tree      - The tree.
+ *            budget    - The soft budget in bytes, 0 for none.
+ *            limit     - The hard limit in bytes, 0 for none.
+ *            on_budget - Called when the budget is crossed. May
+ *                        be NULL.
+ *            ctx       - Passed to on_budget.
+ *
+ * Returns: void
+ */
+void avl_memory_budget(AvlTree *tree, size_t budget, size_t limit,
+		       avl_budget_fn on_budget, void *ctx){
+  // Check arguments.
+  assert(tree != NULL);
 
-    // Call the rebalance procedure from the rebalance node on (if one exists).
-    if(rebalance){
-      upout(tree, rebalance);
-    }else{
-      if(repl) upout(tree, repl);
-    }
+  tree->budget = budget;
+  tree->limit = limit;
+  tree->on_budget = on_budget;
+  tree->budget_ctx = ctx;
+  tree->over_budget = 0;
+  memory_check(tree);
+}
 
-    // Update the tree height.
-    if(tree->root){
-      tree->height = tree->root->height;
-    }else{
-      tree->height = -1;
-    }
-    // Update the number of nodes in the tree.
-    tree->number_of_nodes--;
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_trace_hook
+ * ------------------------
+ * Description:
+ * Set the trace hook of a tree, which is called after every
+ * search, lookup, insertion and deletion through the public
+ * API, and every positional call (see AvlTraceOp), including
+ * those of modules built on the core.
+ * Calls made inside the core are not reported. Without a hook
+ * tracing costs one branch per call.
+ *
+ * Arguments: tree  - The tree.
+ *            trace - The hook, NULL to stop tracing.
+ *            ctx   - Passed to the hook.
+ *
+ * Returns: void
+ */
+void avl_trace_hook(AvlTree *tree, avl_trace_fn trace, void *ctx){
+  // Check arguments.
+  assert(tree != NULL);
 
-    // Free the memory location and return.
-    free(del_node);
-    del_node = NULL;
-    return 1;
-  }
+  tree->trace = trace;
+  tree->trace_ctx = ctx;
+}
+#endif
 
-  // This should be unreachable code. Error if reached.
-  printf("Critical error occured while deleting a node.\n");
-  exit(2);
+/*
+ * Function: free_tree
+ * -------------------
+ * Description:
+ * Free all nodes of the tree and the tree itself.
+ * Data attached to the nodes is not freed.
+ *
+ * Arguments: tree - The tree to free.
+ *
+ * Returns: void
+ */
+void free_tree(AvlTree *tree){
+  // Check arguments.
+  assert(tree != NULL);
+
+  if(tree->compact_block) block_unref(tree->compact_block, 1);
+#ifndef AVL_PREFIX
+  avl_cache_detach(tree);
+  avl_filter_detach(tree);
+#endif
+  if(tree->expiry){
+    free(tree->expiry->heap);
+    free(tree->expiry);
+  }
+  free_subtree(tree, tree->root);
+  free(tree);
 }
 
 /*
@@ -715,3 +4907,6 @@ int key_delete(int key, AvlTree *tree){
 inline int get_int_max(int a, int b){
   return (a > b) ? a : b;
 }
+
+// Take the names of an instance back (see avl_names.h).
+#include "avl_names.h"
@@ -19,6 +19,8 @@
  *     - Basic AVL-Tree structure
  *     - Insertion, Deletion and Lookup in AVL-Tree
  *     - Traversal and visualization of AVL-Tree(s).
+ * The core is written for int keys, and can be built for
+ * other key types as well (see avl_typed.h).
  *
  * Exit Code Index:
  *     > 0:  Successful Execution.
@@ -29,12 +31,265 @@
 #ifndef __AVL_CORE_H_
 #define __AVL_CORE_H_
 
+#include <stddef.h>
+
 /*
  * -----------------------------
  * -- Structures and typedefs --
  * -----------------------------
  */
 
+/*
+ * Macro: AVL_NODE_EXT
+ * -------------------
+ * Description:
+ * Access the per-node extension area of a tree's nodes at
+ * an offset handed out by avl_reserve_node_ext.
+ */
+#define AVL_NODE_EXT(node, offset) ((void *)((char *)(node) + (offset)))
+
+#define AVL_HEIGHT_DIRTY -2 // Height of nodes awaiting relaxed rebalancing.
+
+#define AVL_ERROR_NO_MEMORY -1 // An operation ran out of memory or the limit.
+
+// Deadline of the nodes of an expiring tree that never expire.
+#define AVL_NO_DEADLINE 0x7fffffffffffffffLL
+
+/*
+ * Phases of key_insert_new and key_delete, reported to
+ * avl_profile_phase (supplied by the profiling harness,
+ * profile-avl.c) when the core is built with -DAVL_PROFILE.
+ * Every report ends the phase before it. Without the flag
+ * the reports compile to nothing.
+ */
+#define AVL_PHASE_DESCENT 0   // Searching for the key.
+#define AVL_PHASE_ALLOC 1     // Charging and allocating the new node.
+#define AVL_PHASE_REBALANCE 2 // (Un)linking the node and rebalancing.
+#define AVL_PHASE_FREE 3      // Freeing and discharging the old node.
+#define AVL_PHASE_DONE 4      // The operation returns.
+#define AVL_PHASES 4          // Phases that take time.
+
+#ifdef AVL_PROFILE
+extern void avl_profile_phase(int phase);
+#endif
+
+#define AVL_CHUNK_SIZE ((size_t)1 << 16) // Aligned bytes per block chunk.
+#define AVL_CHUNK_HEADER 16              // Bytes in front of the slots.
+
+// Node slots per chunk of a node block.
+#define AVL_CHUNK_SLOTS(tree) \
+  ((AVL_CHUNK_SIZE - AVL_CHUNK_HEADER) / (tree)->node_size)
+
+/*
+ * Macro: AVL_NODE_SLOT
+ * --------------------
+ * Description:
+ * Address the i-th node slot of a block handed out by
+ * avl_alloc_nodes. A block is made of aligned chunks, each
+ * starting with a header that leads back to the block, so
+ * slots are tree->node_size bytes apart within a chunk.
+ * Evaluates its arguments more than once.
+ */
+#define AVL_NODE_SLOT(tree, base, i) \
+  ((Node *)((char *)(base) + \
+	    (size_t)(i) / AVL_CHUNK_SLOTS(tree) * AVL_CHUNK_SIZE + \
+	    (size_t)(i) % AVL_CHUNK_SLOTS(tree) * (tree)->node_size))
+
+/*
+ * Enum: avl_augment_kind_e
+ * ------------------------
+ * Description:
+ * The kind of an augmentation. The int64 kinds and the Merkle
+ * hash are built-in and specialized at compile time, so they
+ * avoid an indirect call per node update.
+ */
+typedef enum avl_augment_kind_e {
+  AVL_AUG_SUM_I64,
+  AVL_AUG_MIN_I64,
+  AVL_AUG_MAX_I64,
+  AVL_AUG_MERKLE,
+  AVL_AUG_CUSTOM
+} AvlAugmentKind;
+
+/*
+ * Type: avl_combine_fn
+ * --------------------
+ * Description:
+ * Combine function of a custom augmentation: out = a (+) b.
+ * Has to be associative. out may alias a or b.
+ */
+typedef void (*avl_combine_fn)(void *out, const void *a, const void *b,
+			       void *ctx);
+
+/*
+ * Structure: avl_augment_s
+ * ------------------------
+ * Description:
+ * Describes a monoid used to augment the tree. Every node
+ * stores a value and the aggregate of all values in its
+ * subtree, combined in key order.
+ *
+ * Fields: kind - The kind of the augmentation.
+ *         size - Size of a value/aggregate in bytes.
+ *         combine - Combine function (AVL_AUG_CUSTOM only).
+ *         ctx - Passed to combine.
+ */
+typedef struct avl_augment_s {
+  AvlAugmentKind kind;
+  size_t size;
+  avl_combine_fn combine;
+  void *ctx;
+} AvlAugment;
+
+/*
+ * Enum: avl_layout_e
+ * ------------------
+ * Description:
+ * Node layouts for avl_compact. In-order places neighbouring
+ * keys next to each other, which suits range scans. Breadth
+ * first and van Emde Boas order place the upper levels of the
+ * tree, and the nodes of each descent, close together, which
+ * suits lookups.
+ */
+typedef enum avl_layout_e {
+  AVL_LAYOUT_INORDER,
+  AVL_LAYOUT_BFS,
+  AVL_LAYOUT_VEB
+} AvlLayout;
+
+// A contiguous block of nodes owned by a tree (internal).
+typedef struct avl_node_block_s AvlNodeBlock;
+
+// A hot-key cache attached to a tree (internal).
+typedef struct avl_cache_s AvlCache;
+
+/*
+ * Structure: avl_cache_stats_s
+ * ----------------------------
+ * Description:
+ * The counters of a hot-key cache.
+ *
+ * Fields: hits - Searches answered by the cache.
+ *         misses - Searches that had to descend the tree.
+ *         evictions - Entries displaced by newer ones.
+ */
+typedef struct avl_cache_stats_s {
+  long hits, misses, evictions;
+} AvlCacheStats;
+
+// A negative lookup filter attached to a tree (internal).
+typedef struct avl_filter_s AvlFilter;
+
+/*
+ * Structure: avl_filter_stats_s
+ * -----------------------------
+ * Description:
+ * The counters of a negative lookup filter.
+ *
+ * Fields: rejected - Searches answered by the filter alone.
+ *         passed - Searches the filter let through.
+ *         false_positives - Searches let through for absent keys.
+ *         rebuilds - Times the filter was (re)built.
+ */
+typedef struct avl_filter_stats_s {
+  long rejected, passed, false_positives, rebuilds;
+} AvlFilterStats;
+
+// The deadlines of an expiring tree (internal).
+typedef struct avl_expiry_s AvlExpiry;
+
+/*
+ * Structure: avl_memory_stats_s
+ * -----------------------------
+ * Description:
+ * The memory held by a tree, in bytes. Nodes in node blocks
+ * count like nodes allocated on their own. Blocks can be
+ * shared between trees, so their headers and the slots of
+ * deleted nodes are not counted.
+ *
+ * Fields: nodes - The nodes themselves.
+ *         payload - The per-node extension areas: inline values
+ *                   and augmentation values.
+ *         aux - The tree structure, the hot-key cache and the
+ *               filter.
+ *         total - The sum of the above.
+ */
+typedef struct avl_memory_stats_s {
+  size_t nodes, payload, aux, total;
+} AvlMemoryStats;
+
+/*
+ * Enum: avl_trace_op_e
+ * --------------------
+ * Description:
+ * The API calls reported to the trace hook of a tree. The
+ * lookups report whether they found a node (1) or not (0).
+ * The positional calls report the position as the key, and
+ * a second argument is only reported where noted.
+ */
+typedef enum avl_trace_op_e {
+  AVL_TRACE_SEARCH,          // search_by_key, avl_contains, avl_lookup_value.
+  AVL_TRACE_INSERT,          // key_insert_new and the value/augment inserts.
+  AVL_TRACE_INSERT_HINT,     // avl_insert_hint.
+  AVL_TRACE_DELETE,          // key_delete, avl_delete_node.
+  AVL_TRACE_POP_MIN,         // avl_pop_min, with the popped key.
+  AVL_TRACE_POP_MAX,         // avl_pop_max, with the popped key.
+  AVL_TRACE_FLOOR,           // avl_floor.
+  AVL_TRACE_CEILING,         // avl_ceiling.
+  AVL_TRACE_PREDECESSOR,     // avl_predecessor.
+  AVL_TRACE_SUCCESSOR,       // avl_successor.
+  AVL_TRACE_K_NEAREST,       // avl_k_nearest, with k, the number found.
+  AVL_TRACE_RANGE_AGGREGATE, // avl_range_aggregate, lo, with hi.
+  AVL_TRACE_AUGMENT_SET,     // avl_augment_set, with the node's key.
+  AVL_TRACE_SEQ_ATTACH,      // avl_seq_attach.
+  AVL_TRACE_SEQ_INSERT_AT,   // avl_seq_insert_at, 1 for a new node.
+  AVL_TRACE_SEQ_ERASE_AT,    // avl_seq_erase_at.
+  AVL_TRACE_SEQ_GET,         // avl_seq_get.
+  AVL_TRACE_SEQ_INDEX,       // avl_seq_index, the position found.
+  AVL_TRACE_SEQ_APPEND,      // avl_seq_append, the number of nodes.
+  AVL_TRACE_SEQ_CONCAT,      // avl_seq_concat, the number of nodes appended.
+  AVL_TRACE_SEQ_SPLIT        // avl_seq_split, 1 for a new tree.
+} AvlTraceOp;
+
+/*
+ * Type: avl_trace_fn
+ * ------------------
+ * Description:
+ * Trace hook of a tree, called after every traced API call
+ * with the operation, its key, its second argument (0 if it
+ * has none, see AvlTraceOp) and its result.
+ */
+typedef void (*avl_trace_fn)(void *ctx, AvlTraceOp op, int key, int arg,
+			     int result);
+
+// The built-in augmentations over long long values.
+extern const AvlAugment avl_augment_sum_i64;
+extern const AvlAugment avl_augment_min_i64;
+extern const AvlAugment avl_augment_max_i64;
+
+// Order independent set hash of the keys (and payloads), for avl_diff.
+extern const AvlAugment avl_augment_merkle;
+
+#endif /* __AVL_CORE_H_ */
+
+/*
+ * ------------------------------
+ * -- Key dependent structures --
+ * ------------------------------
+ *
+ * The rest of this file depends on the key type. It is read
+ * once for the int core, and once more for every instance of
+ * the core built for another key type, with AVL_PREFIX and
+ * AVL_KEY_T defined (see avl_typed.h). avl_names.h then maps
+ * the names below to the names of the instance.
+ */
+#if defined(AVL_PREFIX) || !defined(__AVL_CORE_INT_H_)
+#ifndef AVL_PREFIX
+#define __AVL_CORE_INT_H_
+#define AVL_KEY_T int
+#endif
+#include "avl_names.h"
+
 /*
  * Structure: tree_node_s
  * ----------------------
@@ -45,16 +300,54 @@
  * Fields: key - Used for ordering. Holds order of the node.
  *         data - Pointer to the actual data stored in the node.
  *         height - Holds the height value of the node.
+ *         in_block - Nonzero if the node lives in a node block
+ *                    (see avl_alloc_nodes), 0 if it was
+ *                    allocated on its own.
  *         left-child - Pointer to the left child node of the node.
  *         right-child - Pointer to the right child node of the node.
  *         parent - Pointer to the parent node of the node.
  */
 typedef struct tree_node_s {
-  int key, height;
+  AVL_KEY_T key;
+  short height, in_block;
   void *data;
   struct tree_node_s *left_child, *right_child, *parent;
 } Node;
 
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Type: avl_diff_fn
+ * -----------------
+ * Description:
+ * Receives a difference found by avl_diff: the key and its
+ * node in either tree, NULL where the key is absent.
+ */
+typedef void (*avl_diff_fn)(int key, Node *a, Node *b, void *ctx);
+#endif
+
+/*
+ * Type: avl_expire_fn
+ * -------------------
+ * Description:
+ * Called by avl_expire for every expired node, before the node
+ * is deleted, e.g. to free its data. Must not modify the tree.
+ */
+typedef void (*avl_expire_fn)(Node *node, void *ctx);
+
+/*
+ * Type: avl_budget_fn
+ * -------------------
+ * Description:
+ * Called once the memory of a tree grew past its budget,
+ * with the bytes in use, at the end of the operation that
+ * crossed it. The tree is consistent, so the callback may
+ * evict keys. It is called again only after the tree went
+ * back within the budget.
+ */
+struct avl_tree_s;
+typedef void (*avl_budget_fn)(struct avl_tree_s *tree, size_t used,
+			      void *ctx);
+
 /*
  * Structure: avl_tree_s
  * ---------------------
@@ -63,11 +356,65 @@ typedef struct tree_node_s {
  * The type AVL-Tree.
  *
  * Fields: height - Holds the total height of the tree.
+ *         number_of_nodes - Number of nodes in the tree.
  *         root - Pointer to the root of the tree.
+ *         finger - Pointer to the most recently inserted node.
+ *                  Used as the default starting point for
+ *                  hinted insertions. NULL if unknown.
+ *         min_node - Pointer to the node with the smallest key.
+ *         max_node - Pointer to the node with the largest key.
+ *         node_size - Bytes allocated per node, including the
+ *                     per-node extension area.
+ *         augment - The augmentation of the tree, NULL if none.
+ *         augment_offset - Offset of the augmentation value and
+ *                          aggregate in the extension area.
+ *         value_size - Size of the inline node values in bytes.
+ *         value_offset - Offset of the inline node values in the
+ *                        extension area, 0 if there are none.
+ *         compact_block - The block filled by an incremental
+ *                         compaction, NULL if none is running.
+ *         compact_key - Largest key moved so far by the
+ *                       incremental compaction.
+ *         cache - The hot-key cache, NULL if none is attached.
+ *         filter - The negative lookup filter, NULL if none is
+ *                  attached.
+ *         expiry - The deadlines of the nodes, NULL if the tree
+ *                  does not expire nodes.
+ *         relaxed - Whether the tree is in relaxed balance.
+ *         piggyback - Rebalancing steps done per update while
+ *                     relaxed.
+ *         memory - The memory held by the tree.
+ *         budget - Soft memory budget in bytes, 0 if none.
+ *         limit - Hard memory limit for insertions, 0 if none.
+ *         on_budget - Called when the budget is crossed.
+ *         budget_ctx - Passed to on_budget.
+ *         over_budget - Whether on_budget was called and the
+ *                       tree is still over the budget.
+ *         trace - The trace hook, NULL if none is set.
+ *         trace_ctx - Passed to trace.
  */
 typedef struct avl_tree_s {
   int height, number_of_nodes;
   struct tree_node_s *root;
+  struct tree_node_s *finger;
+  struct tree_node_s *min_node, *max_node;
+  size_t node_size;
+  const struct avl_augment_s *augment;
+  size_t augment_offset;
+  size_t value_size, value_offset;
+  AvlNodeBlock *compact_block;
+  AVL_KEY_T compact_key;
+  AvlCache *cache;
+  AvlFilter *filter;
+  AvlExpiry *expiry;
+  int relaxed, piggyback;
+  AvlMemoryStats memory;
+  size_t budget, limit;
+  avl_budget_fn on_budget;
+  void *budget_ctx;
+  int over_budget;
+  avl_trace_fn trace;
+  void *trace_ctx;
 } AvlTree;
 
 /*
@@ -84,7 +431,8 @@ typedef struct avl_tree_s {
  *
  * Arguments: node - The pre-existing node.
  * 
- * Returns: Pointer to the newly created tree.
+ * Returns: Pointer to the newly created tree, NULL if memory
+ *          allocation failed.
  */
 extern AvlTree * make_tree_from_node(Node *node);
 
@@ -97,10 +445,26 @@ extern AvlTree * make_tree_from_node(Node *node);
  * 
  * Arguments: none
  *
- * Returns: Pointer to the newly created tree.
+ * Returns: Pointer to the newly created tree, NULL if memory
+ *          allocation failed.
  */
 extern AvlTree * make_tree_empty();
 
+/*
+ * Function: make_tree_with_values
+ * -------------------------------
+ * Description:
+ * Create and allocate a new, empty tree whose nodes store
+ * a fixed-size value inline, directly behind the node in
+ * the same allocation (see avl_value).
+ *
+ * Arguments: value_size - Size of the values in bytes.
+ *
+ * Returns: Pointer to the newly created tree, NULL if memory
+ *          allocation failed.
+ */
+extern AvlTree * make_tree_with_values(size_t value_size);
+
 /*
  * Function: make_node_empty
  * -------------------------
@@ -111,9 +475,10 @@ extern AvlTree * make_tree_empty();
  *
  * Arguments: key - The order key the node has.
  * 
- * Returns: Node pointer to the new node.
+ * Returns: Node pointer to the new node, NULL if memory
+ *          allocation failed.
  */
-extern Node * make_node_empty(int key);
+extern Node * make_node_empty(AVL_KEY_T key);
 
 /*
  * Function: upin
@@ -206,6 +571,61 @@ extern void rotate_right(AvlTree *tree, Node *node);
  */
 extern void rotate_left(AvlTree *tree, Node *node);
 
+/*
+ * Function: avl_relaxed_begin
+ * ---------------------------
+ * Description:
+ * Switch a tree to relaxed balance, for bursts of updates.
+ * Insertions and deletions then only mark the path above
+ * the change, up to the first marked node, instead of
+ * updating heights and rotating. The marks are resolved by
+ * avl_rebalance_step, by a number of steps piggybacked on
+ * every update, and by avl_relaxed_end. Searches and all
+ * other queries stay correct, but paths can grow with the
+ * size of the burst: sorted keys without piggybacked steps
+ * degrade the tree to a list. While marks are pending, the
+ * tree's height is AVL_HEIGHT_DIRTY.
+ *
+ * Arguments: tree      - The tree.
+ *            piggyback - Rebalancing steps done by every
+ *                        update, 0 to defer all of them.
+ *
+ * Returns: void
+ */
+extern void avl_relaxed_begin(AvlTree *tree, int piggyback);
+
+/*
+ * Function: avl_rebalance_step
+ * ----------------------------
+ * Description:
+ * Resolve up to budget marks of a relaxed tree, deepest
+ * first. Every step rebalances one node whose subtrees are
+ * balanced already, in O(1) amortized plus the difference
+ * of the subtree heights, so the total work of a full
+ * rebalance is bounded by the number of marked nodes and
+ * the imbalance built up.
+ *
+ * Arguments: tree   - The tree.
+ *            budget - The maximum number of steps.
+ *
+ * Returns: 1 - Marks are still pending.
+ *          0 - The tree is AVL balanced.
+ */
+extern int avl_rebalance_step(AvlTree *tree, int budget);
+
+/*
+ * Function: avl_relaxed_end
+ * -------------------------
+ * Description:
+ * Resolve all pending marks of a relaxed tree and switch it
+ * back to strict AVL balance.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
+ */
+extern void avl_relaxed_end(AvlTree *tree);
+
 /*
  * Function: search_by_key
  * -----------------------
@@ -214,6 +634,8 @@ extern void rotate_left(AvlTree *tree, Node *node);
  * return a truthy and a pointer to the node-location.
  * If not, return a falsey and point to the node which
  * would represent it's parent, if it were in the tree.
+ * The tree's filter is not consulted, as it cannot tell
+ * the parent; use avl_contains for presence checks.
  *
  * Arguments: key  - order key to search for.
  *            node - will point to node in question.
@@ -222,7 +644,23 @@ extern void rotate_left(AvlTree *tree, Node *node);
  * Returns: 1  - If node has been found.
  *          0  - If the node was not found.
  */
-extern int search_by_key(int key, AvlTree *tree, Node **node);
+extern int search_by_key(AVL_KEY_T key, AvlTree *tree, Node **node);
+
+/*
+ * Function: avl_contains
+ * ----------------------
+ * Description:
+ * Check whether a key is in the tree. Unlike search_by_key
+ * this does not report a node, so the tree's filter (see
+ * avl_filter_attach) may answer it without a descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: 1 - If the key is in the tree.
+ *          0 - If it is not.
+ */
+extern int avl_contains(AvlTree *tree, AVL_KEY_T key);
 
 /*
  * Function: key_insert_new
@@ -236,9 +674,36 @@ extern int search_by_key(int key, AvlTree *tree, Node **node);
  *            tree - The tree to insert into.
  *
  * Returns: 1  - On successful insertion.
- *          0  - If insertion failed.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+extern int key_insert_new(AVL_KEY_T key, AvlTree *tree);
+
+/*
+ * Function: avl_insert_hint
+ * -------------------------
+ * Description:
+ * Insert a new node in to the tree, starting the search
+ * for the insertion point at a hint node instead of the
+ * root. The search climbs from the hint via the parent
+ * pointers only as far as needed to find the smallest
+ * subtree whose key range contains the new key, and then
+ * descends from there. For keys arriving in (nearly)
+ * sorted order this makes the descent O(1) instead of
+ * O(log n). If hint is NULL, the tree's finger (the most
+ * recently inserted node) is used.
+ *
+ * Arguments: tree - The tree to insert into.
+ *            key  - The order key to use.
+ *            hint - A node of the tree close to the key, or NULL.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
  */
-extern int key_insert_new(int key, AvlTree *tree);
+extern int avl_insert_hint(AvlTree *tree, AVL_KEY_T key, Node *hint);
 
 /*
  * Function: key_delete
@@ -256,7 +721,1002 @@ extern int key_insert_new(int key, AvlTree *tree);
  * Returns: 1 - Successful deletion.
  *          0 - Deletion unsuccessful (key not found).
  */
-extern int key_delete(int key, AvlTree *tree);
+extern int key_delete(AVL_KEY_T key, AvlTree *tree);
+
+/*
+ * Function: avl_delete_node
+ * -------------------------
+ * Description:
+ * Unlink a node of the tree and free it, without
+ * searching for it first. Rebalances the tree.
+ *
+ * Arguments: tree     - The tree the node is in.
+ *            del_node - The node to delete.
+ *
+ * Returns: 1 - Successful deletion.
+ */
+extern int avl_delete_node(AvlTree *tree, Node *del_node);
+
+/*
+ * Function: avl_min
+ * -----------------
+ * Description:
+ * Get the node with the smallest key in O(1).
+ *
+ * Arguments: tree - The tree to look in.
+ *
+ * Returns: The node with the smallest key, NULL if empty.
+ */
+extern Node * avl_min(AvlTree *tree);
+
+/*
+ * Function: avl_max
+ * -----------------
+ * Description:
+ * Get the node with the largest key in O(1).
+ *
+ * Arguments: tree - The tree to look in.
+ *
+ * Returns: The node with the largest key, NULL if empty.
+ */
+extern Node * avl_max(AvlTree *tree);
+
+/*
+ * Function: avl_pop_min
+ * ---------------------
+ * Description:
+ * Remove the node with the smallest key from the tree,
+ * unlinking the cached minimum directly (no search).
+ *
+ * Arguments: tree - The tree to pop from.
+ *            key  - Receives the key of the node, may be NULL.
+ *            data - Receives the data of the node, may be NULL.
+ *
+ * Returns: 1 - If a node was popped.
+ *          0 - If the tree was empty.
+ */
+extern int avl_pop_min(AvlTree *tree, AVL_KEY_T *key, void **data);
+
+/*
+ * Function: avl_pop_max
+ * ---------------------
+ * Description:
+ * Remove the node with the largest key from the tree,
+ * unlinking the cached maximum directly (no search).
+ *
+ * Arguments: tree - The tree to pop from.
+ *            key  - Receives the key of the node, may be NULL.
+ *            data - Receives the data of the node, may be NULL.
+ *
+ * Returns: 1 - If a node was popped.
+ *          0 - If the tree was empty.
+ */
+extern int avl_pop_max(AvlTree *tree, AVL_KEY_T *key, void **data);
+
+/*
+ * Function: avl_next
+ * ------------------
+ * Description:
+ * Step to the in-order successor of a node, using the
+ * parent pointers. Amortized O(1) when iterating.
+ *
+ * Arguments: node - The node to step from.
+ *
+ * Returns: The next node in key order, NULL if node is the last.
+ */
+extern Node * avl_next(Node *node);
+
+/*
+ * Function: avl_prev
+ * ------------------
+ * Description:
+ * Step to the in-order predecessor of a node, using the
+ * parent pointers. Amortized O(1) when iterating.
+ *
+ * Arguments: node - The node to step from.
+ *
+ * Returns: The previous node in key order, NULL if node is the first.
+ */
+extern Node * avl_prev(Node *node);
+
+/*
+ * Function: avl_floor
+ * -------------------
+ * Description:
+ * Find the node with the largest key less than or equal
+ * to a given key, in a single descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+extern Node * avl_floor(AvlTree *tree, AVL_KEY_T key);
+
+/*
+ * Function: avl_ceiling
+ * ---------------------
+ * Description:
+ * Find the node with the smallest key greater than or
+ * equal to a given key, in a single descent.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+extern Node * avl_ceiling(AvlTree *tree, AVL_KEY_T key);
+
+/*
+ * Function: avl_predecessor
+ * -------------------------
+ * Description:
+ * Find the node with the largest key strictly less than
+ * a given key, which does not have to be in the tree.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+extern Node * avl_predecessor(AvlTree *tree, AVL_KEY_T key);
+
+/*
+ * Function: avl_successor
+ * -----------------------
+ * Description:
+ * Find the node with the smallest key strictly greater
+ * than a given key, which does not have to be in the tree.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: The node found, NULL if there is none.
+ */
+extern Node * avl_successor(AvlTree *tree, AVL_KEY_T key);
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_k_nearest
+ * -----------------------
+ * Description:
+ * Find the k nodes with the keys closest to a given key,
+ * ordered by increasing distance (ties go to the smaller key).
+ * One descent brackets the key, then the result is merged
+ * outwards in both directions with O(k) parent pointer steps.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search around.
+ *            k    - The number of nodes wanted.
+ *            out  - Array of at least k entries receiving the nodes.
+ *
+ * Returns: The number of nodes written to out (less than k
+ *          only if the tree holds fewer nodes).
+ */
+extern int avl_k_nearest(AvlTree *tree, int key, int k, Node **out);
+#endif
+
+/*
+ * Function: avl_reserve_node_ext
+ * ------------------------------
+ * Description:
+ * Reserve bytes in the per-node extension area of a tree.
+ * Every node allocated for the tree afterwards carries the
+ * extension area directly behind the Node structure. The
+ * reserved bytes can be accessed with AVL_NODE_EXT. Only
+ * possible while the tree is empty.
+ *
+ * Arguments: tree - The tree to reserve in.
+ *            size - The number of bytes to reserve.
+ *
+ * Returns: Offset of the reserved bytes from the node start
+ *          (8-byte aligned), 0 if the tree is not empty or
+ *          the node would not fit in a block chunk.
+ */
+extern size_t avl_reserve_node_ext(AvlTree *tree, size_t size);
+
+/*
+ * Function: avl_value
+ * -------------------
+ * Description:
+ * Get a pointer to the inline value of a node, in a tree
+ * created by make_tree_with_values. The pointer stays valid
+ * as long as the node is in the tree.
+ *
+ * Arguments: tree - The tree the node is in.
+ *            node - The node in question.
+ *
+ * Returns: Pointer to the value bytes of the node.
+ */
+extern void * avl_value(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_insert_value
+ * --------------------------
+ * Description:
+ * Insert a new node and copy a value in to its inline value
+ * storage. No allocation besides the node itself.
+ *
+ * Arguments: tree  - The tree to insert into.
+ *            key   - The order key to use.
+ *            value - The value (value size bytes), NULL to zero-fill.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+extern int avl_insert_value(AvlTree *tree, AVL_KEY_T key,
+			    const void *value);
+
+/*
+ * Function: avl_lookup_value
+ * --------------------------
+ * Description:
+ * Search for a key and return a pointer to the inline value
+ * of its node, without a further dereference.
+ *
+ * Arguments: tree - The tree to search in.
+ *            key  - The key to search for.
+ *
+ * Returns: Pointer to the value bytes, NULL if the key is absent.
+ */
+extern void * avl_lookup_value(AvlTree *tree, AVL_KEY_T key);
+
+/*
+ * Function: avl_augment_attach
+ * ----------------------------
+ * Description:
+ * Augment an empty tree with a per-node value and a
+ * subtree aggregate, combined by the given augmentation.
+ * The aggregates are kept up to date through insertion,
+ * deletion and all rotations. New nodes start with a
+ * zero-filled value. The descriptor has to outlive the tree.
+ *
+ * Arguments: tree - The tree to augment.
+ *            aug  - The augmentation, e.g. &avl_augment_sum_i64.
+ *
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already augmented.
+ */
+extern int avl_augment_attach(AvlTree *tree, const AvlAugment *aug);
+
+/*
+ * Function: avl_augment_value
+ * ---------------------------
+ * Description:
+ * Get a pointer to the augmentation value of a node. After
+ * writing to it, call avl_augment_update on the node.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The node in question.
+ *
+ * Returns: Pointer to the value of the node.
+ */
+extern void * avl_augment_value(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_augment_aggregate
+ * -------------------------------
+ * Description:
+ * Get a pointer to the aggregate over the subtree of a node.
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The root of the subtree.
+ *
+ * Returns: Pointer to the aggregate of the subtree.
+ */
+extern const void * avl_augment_aggregate(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_augment_update
+ * ----------------------------
+ * Description:
+ * Recompute the aggregates from a node up to the root,
+ * after its value has been changed in place. O(log n).
+ *
+ * Arguments: tree - The augmented tree.
+ *            node - The node whose value changed.
+ *
+ * Returns: void
+ */
+extern void avl_augment_update(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_augment_set
+ * -------------------------
+ * Description:
+ * Set the augmentation value of a node and update the
+ * aggregates up to the root. O(log n).
+ *
+ * Arguments: tree  - The augmented tree.
+ *            node  - The node to set the value of.
+ *            value - The new value (augmentation size bytes).
+ *
+ * Returns: void
+ */
+extern void avl_augment_set(AvlTree *tree, Node *node, const void *value);
+
+/*
+ * Function: avl_augment_insert
+ * ----------------------------
+ * Description:
+ * Insert a new node with the given augmentation value.
+ * The value is in place before the tree is rebalanced,
+ * so the aggregates are only computed once.
+ *
+ * Arguments: tree  - The augmented tree.
+ *            key   - The order key to use.
+ *            value - The value of the node (augmentation size bytes).
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+extern int avl_augment_insert(AvlTree *tree, AVL_KEY_T key,
+			      const void *value);
+
+/*
+ * Function: avl_range_aggregate
+ * -----------------------------
+ * Description:
+ * Compute the aggregate over all nodes with a key in the
+ * inclusive range [lo, hi], combined in key order. Only the
+ * two boundary paths are visited: subtrees entirely inside the
+ * range contribute their stored aggregate. O(log n).
+ *
+ * Arguments: tree - The augmented tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *            out  - Receives the aggregate (augmentation size bytes).
+ *
+ * Returns: 1 - If the range contains at least one key.
+ *          0 - If the range is empty (out is left untouched).
+ */
+extern int avl_range_aggregate(AvlTree *tree, AVL_KEY_T lo, AVL_KEY_T hi,
+			       void *out);
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_merkle_set_payload
+ * --------------------------------
+ * Description:
+ * Make the payload of a node part of its hash in a Merkle
+ * augmented tree, so that avl_diff reports nodes whose
+ * payloads differ. Call again whenever the payload changes.
+ * O(log n).
+ *
+ * Arguments: tree    - The Merkle augmented tree.
+ *            node    - The node.
+ *            payload - The payload bytes, NULL for none.
+ *            len     - Length of the payload.
+ *
+ * Returns: void
+ */
+extern void avl_merkle_set_payload(AvlTree *tree, Node *node,
+				   const void *payload, size_t len);
+
+/*
+ * Function: avl_merkle_range_hash
+ * -------------------------------
+ * Description:
+ * The hash of the entries with a key in the inclusive range
+ * [lo, hi] of a Merkle augmented tree. It only depends on the
+ * keys and payloads in the range, not on the shape of the
+ * tree, so replicas can compare ranges by exchanging hashes.
+ * O(log n).
+ *
+ * Arguments: tree - The Merkle augmented tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *
+ * Returns: The hash, 0 for an empty range.
+ */
+extern unsigned long long avl_merkle_range_hash(AvlTree *tree, int lo, int hi);
+
+/*
+ * Function: avl_diff
+ * ------------------
+ * Description:
+ * Report the differences between two Merkle augmented trees,
+ * in key order: keys present in only one of them, and keys
+ * present in both with different payload hashes. Key ranges
+ * with equal hashes are skipped without visiting their nodes,
+ * so a diff of d entries costs O(d log^2 n) instead of O(n).
+ * The trees may have different shapes. The trees must not be
+ * modified by report.
+ *
+ * Arguments: a      - The first tree.
+ *            b      - The second tree.
+ *            report - Called for every difference with the key
+ *                     and its node in a and in b (NULL if the
+ *                     key is absent from that tree).
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of differences reported.
+ */
+extern long avl_diff(AvlTree *a, AvlTree *b, avl_diff_fn report, void *ctx);
+
+/*
+ * Function: avl_seq_attach
+ * ------------------------
+ * Description:
+ * Switch an empty tree to positional mode: the nodes are
+ * ordered by their position in a sequence, kept as subtree
+ * sizes in the augmentation, instead of by their keys. The
+ * keys are ignored (and 0), so the key based operations, the
+ * hot-key cache, the filter, relaxed balance and incremental
+ * compaction must not be used on the tree. Iteration (avl_min,
+ * avl_next, ...), node deletion, inline values, avl_compact
+ * and the memory accounting work as usual.
+ *
+ * Arguments: tree - The tree, empty and not augmented.
+ *
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already augmented.
+ */
+extern int avl_seq_attach(AvlTree *tree);
+
+/*
+ * Function: avl_seq_attached
+ * --------------------------
+ * Description:
+ * Check whether a tree is in positional mode.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: 1 - The tree is positional (see avl_seq_attach).
+ *          0 - The tree is ordered by key.
+ */
+extern int avl_seq_attached(AvlTree *tree);
+
+/*
+ * Function: avl_seq_insert_at
+ * ---------------------------
+ * Description:
+ * Insert a new node at a position of a positional tree, in
+ * front of the node that was there. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position, 0 to the length of the tree.
+ *            data  - The data of the new node.
+ *
+ * Returns: The new node, NULL if memory ran out or the tree
+ *          reached its memory limit.
+ */
+extern Node * avl_seq_insert_at(AvlTree *tree, int index, void *data);
+
+/*
+ * Function: avl_seq_erase_at
+ * --------------------------
+ * Description:
+ * Delete the node at a position of a positional tree, moving
+ * the nodes behind it one position forward. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position.
+ *            data  - Receives the data of the node. May be NULL.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - If the position is out of range.
+ */
+extern int avl_seq_erase_at(AvlTree *tree, int index, void **data);
+
+/*
+ * Function: avl_seq_get
+ * ---------------------
+ * Description:
+ * Find the node at a position of a positional tree. O(log n).
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position.
+ *
+ * Returns: The node, NULL if the position is out of range.
+ */
+extern Node * avl_seq_get(AvlTree *tree, int index);
+
+/*
+ * Function: avl_seq_index
+ * -----------------------
+ * Description:
+ * Find the position of a node of a positional tree, climbing
+ * to the root. O(log n).
+ *
+ * Arguments: tree - The positional tree.
+ *            node - The node.
+ *
+ * Returns: The position of the node.
+ */
+extern int avl_seq_index(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_seq_append
+ * ------------------------
+ * Description:
+ * Append new nodes to the end of a positional tree, in bulk:
+ * they are linked in to a balanced subtree, which is joined
+ * to the tree. O(n + log of the tree's length), instead of a
+ * descent and rebalancing per node.
+ *
+ * Arguments: tree - The positional tree.
+ *            data - The data of the new nodes, in order. May be
+ *                   NULL, for nodes without data.
+ *            n    - The number of nodes to append.
+ *
+ * Returns: 1 - On success.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the tree
+ *          reached its memory limit. The tree is unchanged.
+ */
+extern int avl_seq_append(AvlTree *tree, void *const *data, int n);
+
+/*
+ * Function: avl_seq_concat
+ * ------------------------
+ * Description:
+ * Append all nodes of one positional tree to another, and
+ * free the emptied tree. The last node of the first tree
+ * joins them, so this takes O(log n) and touches no other
+ * node. The trees have to have the same node layout.
+ *
+ * Arguments: left  - The tree appended to.
+ *            right - The tree appended. It is freed.
+ *
+ * Returns: void
+ */
+extern void avl_seq_concat(AvlTree *left, AvlTree *right);
+
+/*
+ * Function: avl_seq_split
+ * -----------------------
+ * Description:
+ * Split a positional tree at a position: the nodes from the
+ * position on move, in order, to a new tree with the same
+ * node layout. Works bottom up along the path to the root,
+ * joining the subtrees hanging off it to either side, which
+ * takes O(log n) in total. Node blocks (see avl_compact) are
+ * shared by the two trees, and freed with their last node.
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position, 0 to the length of the tree.
+ *
+ * Returns: The tree of the nodes from the position on, NULL
+ *          if memory ran out.
+ */
+extern AvlTree * avl_seq_split(AvlTree *tree, int index);
+#endif
+
+/*
+ * Function: avl_compact
+ * ---------------------
+ * Description:
+ * Defragment a tree by moving all of its nodes in to one new
+ * contiguous block, in the given layout. O(n) time, plus a
+ * temporary list of n node pointers. Pointers to the nodes of
+ * the tree held outside of it are invalidated. An incremental
+ * compaction in progress is ended first.
+ *
+ * Arguments: tree   - The tree to compact.
+ *            layout - Order of the nodes in the block.
+ *
+ * Returns: The number of nodes moved.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out. The tree is
+ *          unchanged.
+ */
+extern int avl_compact(AvlTree *tree, AvlLayout layout);
+
+/*
+ * Function: avl_compact_begin
+ * ---------------------------
+ * Description:
+ * Start an incremental in-order compaction. The nodes present
+ * now are moved in to a new block in key order by subsequent
+ * calls to avl_compact_step, which may be interleaved with any
+ * other operations on the tree. Nodes inserted meanwhile are
+ * moved if the compaction has not passed their key yet and
+ * the block has room left.
+ *
+ * Arguments: tree - The tree to compact.
+ *
+ * Returns: 1 - The compaction was started.
+ *          0 - The tree is empty.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out. The tree is
+ *          unchanged.
+ */
+extern int avl_compact_begin(AvlTree *tree);
+
+/*
+ * Function: avl_compact_step
+ * --------------------------
+ * Description:
+ * Continue an incremental compaction by moving up to budget
+ * nodes, in O(budget * log n). Pointers to the moved nodes
+ * held outside of the tree are invalidated. The compaction
+ * ends once all nodes are moved or the block is full.
+ *
+ * Arguments: tree   - The tree being compacted.
+ *            budget - Maximum number of nodes to move.
+ *
+ * Returns: 1 - The compaction is still in progress.
+ *          0 - The compaction is complete (or was not started).
+ */
+extern int avl_compact_step(AvlTree *tree, int budget);
+
+/*
+ * Function: avl_init_node
+ * -----------------------
+ * Description:
+ * Initialize a node slot of a tree as an empty, unlinked node
+ * with the given key, zero-filling the extension area. In a
+ * Merkle augmented tree the node starts with its key's hash.
+ * The node is marked as living in a node block, so the slot
+ * has to come from avl_alloc_nodes.
+ *
+ * Arguments: tree - The tree the node is for.
+ *            node - The node slot.
+ *            key  - The order key the node has.
+ *
+ * Returns: void
+ */
+extern void avl_init_node(AvlTree *tree, Node *node, AVL_KEY_T key);
+
+/*
+ * Function: avl_alloc_nodes
+ * -------------------------
+ * Description:
+ * Allocate a block of n node slots for a tree, for
+ * bulk construction. The slots are uninitialized (see
+ * avl_init_node) and addressed with AVL_NODE_SLOT. All of
+ * them have to become nodes of the tree, which are then
+ * released like any other node.
+ *
+ * Arguments: tree - The tree the nodes are for.
+ *            n    - The number of slots, at least 1.
+ *
+ * Returns: Pointer to the first slot, NULL if memory ran out.
+ */
+extern Node * avl_alloc_nodes(AvlTree *tree, int n);
+
+/*
+ * Function: avl_release_slots
+ * ---------------------------
+ * Description:
+ * Give back the unused tail of node slots handed out by
+ * avl_alloc_nodes, for bulk construction of an unknown number
+ * of nodes. The slots stay allocated until the block's nodes
+ * are all released, but no longer keep it alive.
+ *
+ * Arguments: tree  - The tree the slots belong to.
+ *            slots - The first unused slot.
+ *            n     - The number of unused slots, up to the end
+ *                    of the block.
+ *
+ * Returns: void
+ */
+extern void avl_release_slots(AvlTree *tree, Node *slots, int n);
+
+/*
+ * Function: avl_adopt_nodes
+ * -------------------------
+ * Description:
+ * Make a subtree built outside of the core the content of an
+ * empty tree. The subtree has to be a valid AVL-Tree with
+ * correct heights and parent pointers, made of nodes of this
+ * tree (see avl_alloc_nodes). Aggregates of an augmented tree
+ * are computed here, in O(n).
+ *
+ * Arguments: tree - The empty tree.
+ *            root - Root of the subtree.
+ *            n    - Number of nodes in the subtree.
+ *
+ * Returns: 1 - The subtree was adopted.
+ *          0 - The tree is not empty.
+ *          AVL_ERROR_NO_MEMORY - If memory to grow the tree's
+ *          filter ran out. The tree stays empty, and the nodes
+ *          of the subtree are freed.
+ */
+extern int avl_adopt_nodes(AvlTree *tree, Node *root, int n);
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_cache_attach
+ * --------------------------
+ * Description:
+ * Attach a hot-key cache to a tree. Searches check the cache
+ * before descending, and found nodes are cached, so repeated
+ * lookups of the same keys take O(1). Deletion and relocation
+ * of nodes keep the cache valid. The cache is freed with the
+ * tree.
+ * Searches write to the cache (recency order, fills and the
+ * counters), so with a cache attached even searches need
+ * exclusive access to the tree, unless the cache is frozen
+ * (see avl_cache_freeze).
+ *
+ * Arguments: tree      - The tree.
+ *            n_entries - Capacity of the cache, rounded down to a
+ *                        power of two of at least 4 entries.
+ *
+ * Returns: 1 - The cache was attached.
+ *          0 - The tree already has a cache.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+extern int avl_cache_attach(AvlTree *tree, int n_entries);
+
+/*
+ * Function: avl_cache_detach
+ * --------------------------
+ * Description:
+ * Remove and free the hot-key cache of a tree, if any.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
+ */
+extern void avl_cache_detach(AvlTree *tree);
+
+/*
+ * Function: avl_cache_freeze
+ * --------------------------
+ * Description:
+ * Freeze or thaw the hot-key cache of a tree. Lookups in a
+ * frozen cache only read it: hits are not moved to the front,
+ * found keys are not added and the counters stay as they are.
+ * Searches of a tree with a frozen cache can then run
+ * concurrently (e.g. under a reader lock). Insertions,
+ * deletions and compaction still update the cache and need
+ * exclusive access.
+ *
+ * Arguments: tree   - The tree, with a cache attached.
+ *            frozen - 1 to freeze the cache, 0 to thaw it.
+ *
+ * Returns: void
+ */
+extern void avl_cache_freeze(AvlTree *tree, int frozen);
+
+/*
+ * Function: avl_cache_stats
+ * -------------------------
+ * Description:
+ * Get the counters of the hot-key cache of a tree.
+ *
+ * Arguments: tree - The tree, with a cache attached.
+ *
+ * Returns: The hit, miss and eviction counts so far.
+ */
+extern AvlCacheStats avl_cache_stats(AvlTree *tree);
+
+/*
+ * Function: avl_filter_attach
+ * ---------------------------
+ * Description:
+ * Attach a blocked Bloom filter to a tree, filled with its
+ * current keys. Presence checks (avl_contains,
+ * avl_lookup_value, key_delete) for keys the filter rejects
+ * return after reading a single cache line of the filter,
+ * instead of descending the tree. search_by_key does not use
+ * the filter, as it reports the would-be parent of absent
+ * keys. The filter grows with the tree, and
+ * is rebuilt after many deletions. It is freed with the tree.
+ *
+ * Arguments: tree          - The tree.
+ *            expected_keys - The number of keys to size the filter
+ *                            for (grown automatically).
+ *            fp_rate       - The targeted rate of false positives,
+ *                            between 0 and 1, for example 0.01.
+ *
+ * Returns: 1 - The filter was attached.
+ *          0 - The tree already has a filter.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+extern int avl_filter_attach(AvlTree *tree, int expected_keys, double fp_rate);
+
+/*
+ * Function: avl_filter_detach
+ * ---------------------------
+ * Description:
+ * Remove and free the filter of a tree, if any.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: void
+ */
+extern void avl_filter_detach(AvlTree *tree);
+
+/*
+ * Function: avl_filter_stats
+ * --------------------------
+ * Description:
+ * Get the counters of the filter of a tree.
+ *
+ * Arguments: tree - The tree, with a filter attached.
+ *
+ * Returns: The filter counters so far.
+ */
+extern AvlFilterStats avl_filter_stats(AvlTree *tree);
+#endif
+
+/*
+ * Function: avl_expiry_attach
+ * ---------------------------
+ * Description:
+ * Make an empty tree expiring: every node gets a deadline
+ * (initially AVL_NO_DEADLINE), and the nodes with one are
+ * kept in a heap ordered by deadline, so that avl_expire
+ * finds the expired nodes without visiting the live ones.
+ * Deadlines and the current time are in any unit the caller
+ * chooses, e.g. milliseconds.
+ *
+ * Arguments: tree         - The tree, empty.
+ *            hide_expired - Whether lookups (search_by_key,
+ *                           avl_lookup_value) treat expired
+ *                           nodes as absent before they are
+ *                           deleted (see avl_expiry_now).
+ *
+ * Returns: 1 - On success.
+ *          0 - If the tree is not empty or already expiring.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+extern int avl_expiry_attach(AvlTree *tree, int hide_expired);
+
+/*
+ * Function: avl_expiry_set
+ * ------------------------
+ * Description:
+ * Set, change or clear the deadline of a node of an expiring
+ * tree. O(log n).
+ *
+ * Arguments: tree     - The expiring tree.
+ *            node     - The node.
+ *            deadline - The new deadline, AVL_NO_DEADLINE for none.
+ *
+ * Returns: 1 - On success.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the tree
+ *          reached its memory limit. The deadline is unchanged.
+ */
+extern int avl_expiry_set(AvlTree *tree, Node *node, long long deadline);
+
+/*
+ * Function: avl_expiry_deadline
+ * -----------------------------
+ * Description:
+ * Get the deadline of a node of an expiring tree.
+ *
+ * Arguments: tree - The expiring tree.
+ *            node - The node.
+ *
+ * Returns: The deadline, AVL_NO_DEADLINE if it has none.
+ */
+extern long long avl_expiry_deadline(AvlTree *tree, Node *node);
+
+/*
+ * Function: avl_insert_expiring
+ * -----------------------------
+ * Description:
+ * Insert a node in to an expiring tree (if the key does not
+ * exist already), with a deadline. Expired nodes that were
+ * not deleted yet still exist for insertions, even if lookups
+ * hide them.
+ *
+ * Arguments: tree     - The expiring tree.
+ *            key      - The order key to use.
+ *            deadline - The deadline, AVL_NO_DEADLINE for none.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out, or the
+ *          tree reached its memory limit.
+ */
+extern int avl_insert_expiring(AvlTree *tree, AVL_KEY_T key,
+			       long long deadline);
+
+/*
+ * Function: avl_expiry_now
+ * ------------------------
+ * Description:
+ * Set the current time of an expiring tree, against which
+ * lookups hide expired nodes (see avl_expiry_attach). Nothing
+ * is deleted.
+ *
+ * Arguments: tree - The expiring tree.
+ *            now  - The current time.
+ *
+ * Returns: void
+ */
+extern void avl_expiry_now(AvlTree *tree, long long now);
+
+/*
+ * Function: avl_expire
+ * --------------------
+ * Description:
+ * Delete all nodes of an expiring tree whose deadline is at
+ * or before a given time, earliest first, and make that time
+ * the current time of the tree. Only the expired nodes are
+ * visited: O(k log n) for k expired nodes. The deletions are
+ * reported to the trace hook.
+ *
+ * Arguments: tree    - The expiring tree.
+ *            now     - The current time.
+ *            expired - Called for every expired node before it
+ *                      is deleted. May be NULL.
+ *            ctx     - Passed to expired.
+ *
+ * Returns: The number of nodes deleted.
+ */
+extern long avl_expire(AvlTree *tree, long long now, avl_expire_fn expired,
+		       void *ctx);
+
+/*
+ * Function: avl_memory_stats
+ * --------------------------
+ * Description:
+ * Get the memory held by a tree, by kind. O(1), the counts
+ * are kept up to date by every allocation and release.
+ *
+ * Arguments: tree - The tree.
+ *
+ * Returns: The bytes held by the tree.
+ */
+extern AvlMemoryStats avl_memory_stats(AvlTree *tree);
+
+/*
+ * Function: avl_memory_budget
+ * ---------------------------
+ * Description:
+ * Set the memory budget and limit of a tree. Crossing the
+ * soft budget calls on_budget once, so that the caller can
+ * evict or spill keys; crossing it again requires the tree
+ * to get back within the budget first. The hard limit makes
+ * insertions that would exceed it fail with
+ * AVL_ERROR_NO_MEMORY instead. Bulk loading, compaction,
+ * caches and filters are accounted for, but not refused. If
+ * the tree is over the new budget already, on_budget is
+ * called right away.
+ *
+ * Arguments: tree      - The tree.
+ *            budget    - The soft budget in bytes, 0 for none.
+ *            limit     - The hard limit in bytes, 0 for none.
+ *            on_budget - Called when the budget is crossed. May
+ *                        be NULL.
+ *            ctx       - Passed to on_budget.
+ *
+ * Returns: void
+ */
+extern void avl_memory_budget(AvlTree *tree, size_t budget, size_t limit,
+			      avl_budget_fn on_budget, void *ctx);
+
+#ifndef AVL_PREFIX // Int keys only, see avl_typed.h.
+/*
+ * Function: avl_trace_hook
+ * ------------------------
+ * Description:
+ * Set the trace hook of a tree, which is called after every
+ * search, lookup, insertion and deletion through the public
+ * API, and every positional call (see AvlTraceOp), including
+ * those of modules built on the core.
+ * Calls made inside the core are not reported. Without a hook
+ * tracing costs one branch per call.
+ *
+ * Arguments: tree  - The tree.
+ *            trace - The hook, NULL to stop tracing.
+ *            ctx   - Passed to the hook.
+ *
+ * Returns: void
+ */
+extern void avl_trace_hook(AvlTree *tree, avl_trace_fn trace, void *ctx);
+#endif
+
+/*
+ * Function: free_tree
+ * -------------------
+ * Description:
+ * Free all nodes of the tree and the tree itself.
+ * Data attached to the nodes is not freed.
+ *
+ * Arguments: tree - The tree to free.
+ *
+ * Returns: void
+ */
+extern void free_tree(AvlTree *tree);
 
 /*
  * Function: get_int_max
@@ -272,4 +1732,8 @@ extern int key_delete(int key, AvlTree *tree);
  */
 extern int get_int_max(int a, int b);
 
-#endif /*  __AVL_CORE_H_ */
+#include "avl_names.h"
+#ifndef AVL_PREFIX
+#undef AVL_KEY_T
+#endif
+#endif /* AVL_PREFIX || !__AVL_CORE_INT_H_ */
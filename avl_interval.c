@@ -0,0 +1,346 @@
+/* Basic AVL-Tree implementation - Interval tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the interval tree module of the AVL-Tree implementation.
+ * It stores half open intervals [start, end) in an AVL-Tree keyed
+ * by start, augmented with the maximum end point in every subtree.
+ * This module provides:
+ *     - Insertion and deletion of intervals in O(log n).
+ *     - Stabbing and overlap queries in O(min(n, (k + 1) log n)).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#include "avl_interval.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+ * Structure: interval_query_s
+ * ---------------------------
+ * Description:
+ * Internal state of an overlap query.
+ *
+ * Fields: lo - Smallest point of the query interval.
+ *         last - Largest point of the query interval.
+ *         report - Callback for the intervals found.
+ *         ctx - Passed to report.
+ *         count - Number of intervals reported so far.
+ *         stop - Set once report asked to stop.
+ */
+typedef struct interval_query_s {
+  int lo, last;
+  interval_report_fn report;
+  void *ctx;
+  int count, stop;
+} IntervalQuery;
+
+/*
+ * Function: max_end
+ * -----------------
+ * Description:
+ * Internal helper. The maximum end point in a subtree.
+ *
+ * Arguments: itree - The interval tree.
+ *            node  - The root of the subtree.
+ *
+ * Returns: The maximum end point.
+ */
+static inline long long max_end(IntervalTree *itree, Node *node){
+  return *(const long long *)avl_augment_aggregate(itree->tree, node);
+}
+
+/*
+ * Function: free_chains
+ * ---------------------
+ * Description:
+ * Internal helper. Recursively free the interval chains of
+ * all nodes in a subtree.
+ *
+ * Arguments: node - The root of the subtree.
+ *
+ * Returns: void
+ */
+static void free_chains(Node *node){
+  if(node == NULL) return;
+  free_chains(node->left_child);
+  free_chains(node->right_child);
+
+  Interval *interval = (Interval *)node->data;
+  while(interval){
+    Interval *next = interval->next;
+    free(interval);
+    interval = next;
+  }
+  node->data = NULL;
+}
+
+/*
+ * Function: make_interval_tree
+ * ----------------------------
+ * Description:
+ * Create and allocate a new, empty interval tree.
+ *
+ * Arguments: none
+ *
+ * Returns: Pointer to the newly created interval tree.
+ */
+IntervalTree * make_interval_tree(){
+  // Allocate memory.
+  IntervalTree *itree = (IntervalTree *)malloc(sizeof(IntervalTree));
+  if(itree == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating an interval tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+
+  // The underlying tree tracks the maximum end point per subtree.
+  itree->tree = make_tree_empty();
+  if(itree->tree == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating an interval tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  avl_augment_attach(itree->tree, &avl_augment_max_i64);
+  itree->number_of_intervals = 0;
+  return itree;
+}
+
+/*
+ * Function: free_interval_tree
+ * ----------------------------
+ * Description:
+ * Free an interval tree with all its intervals. Data
+ * attached to the intervals is not freed.
+ *
+ * Arguments: itree - The interval tree to free.
+ *
+ * Returns: void
+ */
+void free_interval_tree(IntervalTree *itree){
+  // Check arguments.
+  assert(itree != NULL);
+
+  // Free the interval chains, then the tree itself.
+  free_chains(itree->tree->root);
+  free_tree(itree->tree);
+  free(itree);
+}
+
+/*
+ * Function: interval_insert
+ * -------------------------
+ * Description:
+ * Insert the interval [start, end) in to the tree. O(log n)
+ * plus the number of intervals sharing the start point.
+ *
+ * Arguments: itree - The interval tree to insert into.
+ *            start - Start point (inclusive).
+ *            end   - End point (exclusive), greater than start.
+ *            data  - Data to attach to the interval.
+ *
+ * Returns: Pointer to the stored interval, used as handle
+ *          for interval_delete.
+ */
+Interval * interval_insert(IntervalTree *itree, int start, int end,
+			   void *data){
+  // Check arguments.
+  assert(itree != NULL);
+  assert(start < end);
+
+  // Allocate the interval.
+  Interval *interval = (Interval *)malloc(sizeof(Interval));
+  if(interval == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while inserting an interval.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  interval->start = start;
+  interval->end = end;
+  interval->data = data;
+  interval->next = NULL;
+  itree->number_of_intervals++;
+
+  Node *node = NULL;
+  long long end_value = end;
+  if(!search_by_key(start, itree->tree, &node)){
+    // First interval with this start point, add a node for it.
+    if(avl_augment_insert(itree->tree, start, &end_value) != 1){
+      // Memory allocation failed, report and exit.
+      printf("Memory allocation failed while inserting an interval.\n");
+      exit(1); // Throw memory allocation error.
+    }
+    // The finger points to the freshly inserted node.
+    itree->tree->finger->data = interval;
+    return interval;
+  }
+
+  // Add the interval to the chain, keeping it sorted by
+  // descending end point.
+  Interval **link = (Interval **)&node->data;
+  while(*link && (*link)->end > end) link = &(*link)->next;
+  interval->next = *link;
+  *link = interval;
+
+  // The head of the chain has the maximum end point.
+  if(node->data == interval) avl_augment_set(itree->tree, node, &end_value);
+  return interval;
+}
+
+/*
+ * Function: interval_delete
+ * -------------------------
+ * Description:
+ * Remove an interval, given by the handle returned on
+ * insertion, from the tree and free it. O(log n) plus the
+ * number of intervals sharing the start point.
+ *
+ * Arguments: itree    - The interval tree to delete from.
+ *            interval - The interval to delete.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - The interval was not found.
+ */
+int interval_delete(IntervalTree *itree, Interval *interval){
+  // Check arguments.
+  assert(itree != NULL);
+  assert(interval != NULL);
+
+  // Find the node of the start point.
+  Node *node = NULL;
+  if(!search_by_key(interval->start, itree->tree, &node)) return 0;
+
+  // Unlink the interval from the chain.
+  Interval **link = (Interval **)&node->data;
+  while(*link && *link != interval) link = &(*link)->next;
+  if(*link == NULL) return 0;
+  *link = interval->next;
+  free(interval);
+  itree->number_of_intervals--;
+
+  if(node->data == NULL){
+    // Last interval with this start point, remove the node.
+    avl_delete_node(itree->tree, node);
+  }else if(link == (Interval **)&node->data){
+    // The head changed, so the maximum end point may have dropped.
+    long long end_value = ((Interval *)node->data)->end;
+    avl_augment_set(itree->tree, node, &end_value);
+  }
+  return 1;
+}
+
+/*
+ * Function: overlap_subtree
+ * -------------------------
+ * Description:
+ * Internal helper. Recursively report the intervals of a
+ * subtree overlapping the query, in order of their start
+ * points. Subtrees ending at or before the query are pruned
+ * by their maximum end point, subtrees starting after it by
+ * their key.
+ *
+ * Arguments: itree - The interval tree.
+ *            node  - The root of the subtree.
+ *            query - The query state.
+ *
+ * Returns: void
+ */
+static void overlap_subtree(IntervalTree *itree, Node *node,
+			    IntervalQuery *query){
+  // Prune empty subtrees and subtrees ending before the query.
+  if(node == NULL || query->stop || max_end(itree, node) <= query->lo){
+    return;
+  }
+
+  // Intervals to the left start earlier, so they come first.
+  overlap_subtree(itree, node->left_child, query);
+  // Nodes starting after the query (and their right subtree) are out.
+  if(query->stop || node->key > query->last) return;
+
+  // The chain is sorted by descending end point, so stop at the
+  // first interval ending at or before the query.
+  for(Interval *interval = (Interval *)node->data;
+      interval && interval->end > query->lo; interval = interval->next){
+    query->count++;
+    if(query->report && query->report(interval, query->ctx)){
+      query->stop = 1;
+      return;
+    }
+  }
+
+  overlap_subtree(itree, node->right_child, query);
+}
+
+/*
+ * Function: interval_overlap
+ * --------------------------
+ * Description:
+ * Report all intervals overlapping the half open query
+ * interval [lo, hi), in order of their start points.
+ * Subtrees whose maximum end point is at most lo are skipped,
+ * but the path to every reported interval is still walked, so
+ * the query is O(min(n, (k + 1) log n)) for k reported
+ * intervals, not O(log n + k).
+ *
+ * Arguments: itree  - The interval tree to query.
+ *            lo     - Start of the query interval (inclusive).
+ *            hi     - End of the query interval (exclusive).
+ *            report - Called for every interval found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of intervals reported.
+ */
+int interval_overlap(IntervalTree *itree, int lo, int hi,
+		     interval_report_fn report, void *ctx){
+  // Check arguments.
+  assert(itree != NULL);
+
+  // An empty query interval overlaps nothing.
+  if(hi <= lo) return 0;
+
+  IntervalQuery query = {lo, hi - 1, report, ctx, 0, 0};
+  overlap_subtree(itree, itree->tree->root, &query);
+  return query.count;
+}
+
+/*
+ * Function: interval_stab
+ * -----------------------
+ * Description:
+ * Report all intervals containing a point.
+ * O(min(n, (k + 1) log n)), see interval_overlap.
+ *
+ * Arguments: itree  - The interval tree to query.
+ *            point  - The query point.
+ *            report - Called for every interval found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of intervals reported.
+ */
+int interval_stab(IntervalTree *itree, int point,
+		  interval_report_fn report, void *ctx){
+  // Check arguments.
+  assert(itree != NULL);
+
+  IntervalQuery query = {point, point, report, ctx, 0, 0};
+  overlap_subtree(itree, itree->tree->root, &query);
+  return query.count;
+}
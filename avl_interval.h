@@ -0,0 +1,189 @@
+/* Basic AVL-Tree implementation - Interval tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the interval tree module of the AVL-Tree implementation.
+ * It stores half open intervals [start, end) in an AVL-Tree keyed
+ * by start, augmented with the maximum end point in every subtree.
+ * This module provides:
+ *     - Insertion and deletion of intervals in O(log n).
+ *     - Stabbing and overlap queries in O(min(n, (k + 1) log n)).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_INTERVAL_H_
+#define __AVL_INTERVAL_H_
+
+#include "avl_core.h"
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: avl_interval_s
+ * -------------------------
+ * Description:
+ * A half open interval [start, end) stored in an interval
+ * tree. Intervals sharing a start point are chained in the
+ * same tree node, sorted by descending end point.
+ *
+ * Fields: start - Start point (inclusive).
+ *         end - End point (exclusive).
+ *         data - Pointer to the data attached to the interval.
+ *         next - Next interval with the same start point.
+ */
+typedef struct avl_interval_s {
+  int start, end;
+  void *data;
+  struct avl_interval_s *next;
+} Interval;
+
+/*
+ * Structure: interval_tree_s
+ * --------------------------
+ * Description:
+ * An interval tree. The nodes of the underlying AVL-Tree are
+ * keyed by start point, their data is the chain of intervals
+ * starting there, and they are augmented with the maximum end
+ * point (avl_augment_max_i64).
+ *
+ * Fields: tree - The underlying augmented AVL-Tree.
+ *         number_of_intervals - Number of intervals stored.
+ */
+typedef struct interval_tree_s {
+  AvlTree *tree;
+  int number_of_intervals;
+} IntervalTree;
+
+/*
+ * Type: interval_report_fn
+ * ------------------------
+ * Description:
+ * Callback receiving the intervals found by a query.
+ * Returning nonzero stops the query.
+ */
+typedef int (*interval_report_fn)(Interval *interval, void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: make_interval_tree
+ * ----------------------------
+ * Description:
+ * Create and allocate a new, empty interval tree.
+ *
+ * Arguments: none
+ *
+ * Returns: Pointer to the newly created interval tree.
+ */
+extern IntervalTree * make_interval_tree();
+
+/*
+ * Function: free_interval_tree
+ * ----------------------------
+ * Description:
+ * Free an interval tree with all its intervals. Data
+ * attached to the intervals is not freed.
+ *
+ * Arguments: itree - The interval tree to free.
+ *
+ * Returns: void
+ */
+extern void free_interval_tree(IntervalTree *itree);
+
+/*
+ * Function: interval_insert
+ * -------------------------
+ * Description:
+ * Insert the interval [start, end) in to the tree. O(log n)
+ * plus the number of intervals sharing the start point.
+ *
+ * Arguments: itree - The interval tree to insert into.
+ *            start - Start point (inclusive).
+ *            end   - End point (exclusive), greater than start.
+ *            data  - Data to attach to the interval.
+ *
+ * Returns: Pointer to the stored interval, used as handle
+ *          for interval_delete.
+ */
+extern Interval * interval_insert(IntervalTree *itree, int start, int end,
+				  void *data);
+
+/*
+ * Function: interval_delete
+ * -------------------------
+ * Description:
+ * Remove an interval, given by the handle returned on
+ * insertion, from the tree and free it. O(log n) plus the
+ * number of intervals sharing the start point.
+ *
+ * Arguments: itree    - The interval tree to delete from.
+ *            interval - The interval to delete.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - The interval was not found.
+ */
+extern int interval_delete(IntervalTree *itree, Interval *interval);
+
+/*
+ * Function: interval_overlap
+ * --------------------------
+ * Description:
+ * Report all intervals overlapping the half open query
+ * interval [lo, hi), in order of their start points.
+ * Subtrees whose maximum end point is at most lo are skipped,
+ * but the path to every reported interval is still walked, so
+ * the query is O(min(n, (k + 1) log n)) for k reported
+ * intervals, not O(log n + k).
+ *
+ * Arguments: itree  - The interval tree to query.
+ *            lo     - Start of the query interval (inclusive).
+ *            hi     - End of the query interval (exclusive).
+ *            report - Called for every interval found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of intervals reported.
+ */
+extern int interval_overlap(IntervalTree *itree, int lo, int hi,
+			    interval_report_fn report, void *ctx);
+
+/*
+ * Function: interval_stab
+ * -----------------------
+ * Description:
+ * Report all intervals containing a point.
+ * O(min(n, (k + 1) log n)), see interval_overlap.
+ *
+ * Arguments: itree  - The interval tree to query.
+ *            point  - The query point.
+ *            report - Called for every interval found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of intervals reported.
+ */
+extern int interval_stab(IntervalTree *itree, int point,
+			 interval_report_fn report, void *ctx);
+
+#endif /* __AVL_INTERVAL_H_ */
@@ -0,0 +1,306 @@
+/* Basic AVL-Tree implementation - K-way merge module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the k-way merge module of the AVL-Tree implementation.
+ * It iterates over the nodes of many trees (e.g. the partitions
+ * of a sharded key space) in one global key order, without
+ * copying them: one cursor per tree steps along the parent
+ * pointers, and a binary heap of the cursors, ordered by key and
+ * then by tree, picks the next node in O(log k) for k trees.
+ * Keys present in several trees are reported once per tree, or
+ * once in total from the first or the last tree holding them.
+ * The trees must not be modified while they are merged.
+ * This module provides:
+ *     - Merged in-order iteration over k trees, O(log k) per step.
+ *     - Seeking to the first key at or above a bound (lower bound).
+ *     - Deduplication of keys shared between trees.
+ *     - Bounded visits with early termination.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#include "avl_merge.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Function: merge_before
+ * ----------------------
+ * Description:
+ * Internal helper. Order cursors by key, then by tree, so
+ * that equal keys come out in tree order.
+ *
+ * Arguments: a - The first cursor.
+ *            b - The second cursor.
+ *
+ * Returns: Nonzero if a comes before b.
+ */
+static inline int merge_before(const AvlMergeEntry *a, const AvlMergeEntry *b){
+  return a->key < b->key || (a->key == b->key && a->tree < b->tree);
+}
+
+/*
+ * Function: merge_sift_down
+ * -------------------------
+ * Description:
+ * Internal helper. Move a heap entry down to its place.
+ *
+ * Arguments: merge - The merge.
+ *            i     - Position of the entry.
+ *
+ * Returns: void
+ */
+static void merge_sift_down(AvlMerge *merge, int i){
+  AvlMergeEntry *heap = merge->heap;
+  AvlMergeEntry entry = heap[i];
+  for(;;){
+    int child = 2 * i + 1;
+    if(child >= merge->size) break;
+    if(child + 1 < merge->size && merge_before(&heap[child + 1], &heap[child])){
+      child++;
+    }
+    if(!merge_before(&heap[child], &entry)) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = entry;
+}
+
+/*
+ * Function: merge_rebuild
+ * -----------------------
+ * Description:
+ * Internal helper. Rebuild the heap from the cursors, bottom
+ * up in O(k).
+ *
+ * Arguments: merge - The merge.
+ *
+ * Returns: void
+ */
+static void merge_rebuild(AvlMerge *merge){
+  merge->size = 0;
+  for(int i = 0; i < merge->number_of_trees; i++){
+    if(merge->cursors[i] == NULL) continue;
+    merge->heap[merge->size].key = merge->cursors[i]->key;
+    merge->heap[merge->size++].tree = i;
+  }
+  for(int i = merge->size / 2 - 1; i >= 0; i--) merge_sift_down(merge, i);
+}
+
+/*
+ * Function: merge_advance
+ * -----------------------
+ * Description:
+ * Internal helper. Step the cursor at the top of the heap to
+ * the next node of its tree, dropping it when done.
+ *
+ * Arguments: merge - The merge, not done.
+ *
+ * Returns: void
+ */
+static void merge_advance(AvlMerge *merge){
+  int tree = merge->heap[0].tree;
+  Node *next = avl_next(merge->cursors[tree]);
+  merge->cursors[tree] = next;
+  if(next){
+    merge->heap[0].key = next->key;
+  }else{
+    merge->heap[0] = merge->heap[--merge->size];
+  }
+  merge_sift_down(merge, 0);
+}
+
+/*
+ * Function: make_avl_merge
+ * ------------------------
+ * Description:
+ * Start a merge of several trees, positioned at the smallest
+ * key. The array of trees is copied, the trees are not. O(k).
+ *
+ * Arguments: trees  - The trees to merge.
+ *            n      - The number of trees.
+ *            policy - AVL_MERGE_ALL, AVL_MERGE_FIRST or
+ *                     AVL_MERGE_LAST.
+ *
+ * Returns: Pointer to the newly created merge.
+ */
+AvlMerge * make_avl_merge(AvlTree **trees, int n, int policy){
+  // Check arguments.
+  assert(n >= 0 && (trees != NULL || n == 0));
+  assert(policy == AVL_MERGE_ALL || policy == AVL_MERGE_FIRST ||
+	 policy == AVL_MERGE_LAST);
+
+  // Allocate memory.
+  AvlMerge *merge = (AvlMerge *)malloc(sizeof(AvlMerge));
+  if(merge != NULL){
+    merge->trees = (AvlTree **)malloc((n ? n : 1) * sizeof(AvlTree *));
+    merge->cursors = (Node **)malloc((n ? n : 1) * sizeof(Node *));
+    merge->heap = (AvlMergeEntry *)malloc((n ? n : 1) * sizeof(AvlMergeEntry));
+  }
+  if(merge == NULL || merge->trees == NULL || merge->cursors == NULL ||
+     merge->heap == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating a merge.\n");
+    exit(1); // Throw memory allocation error.
+  }
+
+  if(n) memcpy(merge->trees, trees, n * sizeof(AvlTree *));
+  merge->number_of_trees = n;
+  merge->policy = policy;
+  for(int i = 0; i < n; i++){
+    assert(trees[i] != NULL);
+    merge->cursors[i] = avl_min(trees[i]);
+  }
+  merge_rebuild(merge);
+  return merge;
+}
+
+/*
+ * Function: free_avl_merge
+ * ------------------------
+ * Description:
+ * Free a merge. The trees are not touched.
+ *
+ * Arguments: merge - The merge to free.
+ *
+ * Returns: void
+ */
+void free_avl_merge(AvlMerge *merge){
+  // Check arguments.
+  assert(merge != NULL);
+
+  free(merge->trees);
+  free(merge->cursors);
+  free(merge->heap);
+  free(merge);
+}
+
+/*
+ * Function: avl_merge_seek
+ * ------------------------
+ * Description:
+ * Position a merge at the smallest key greater than or equal
+ * to a given key (lower bound), forwards or backwards, with
+ * one descent per tree. O(k log n).
+ *
+ * Arguments: merge - The merge.
+ *            key   - The key to seek to.
+ *
+ * Returns: void
+ */
+void avl_merge_seek(AvlMerge *merge, int key){
+  // Check arguments.
+  assert(merge != NULL);
+
+  for(int i = 0; i < merge->number_of_trees; i++){
+    merge->cursors[i] = avl_ceiling(merge->trees[i], key);
+  }
+  merge_rebuild(merge);
+}
+
+/*
+ * Function: avl_merge_peek
+ * ------------------------
+ * Description:
+ * Get the next node of a merge without stepping past it.
+ * Under AVL_MERGE_LAST this may be an earlier tree's node of
+ * the key that avl_merge_next will report. O(1).
+ *
+ * Arguments: merge - The merge.
+ *
+ * Returns: The node, NULL once the merge is done.
+ */
+Node * avl_merge_peek(AvlMerge *merge){
+  // Check arguments.
+  assert(merge != NULL);
+
+  return merge->size ? merge->cursors[merge->heap[0].tree] : NULL;
+}
+
+/*
+ * Function: avl_merge_next
+ * ------------------------
+ * Description:
+ * Step a merge: get its next node in global key order and
+ * advance past it (and, when deduplicating, past the other
+ * nodes of the same key). O(log k), times the number of
+ * trees sharing the key when deduplicating.
+ *
+ * Arguments: merge - The merge.
+ *            tree  - Receives the index of the node's tree, may
+ *                    be NULL.
+ *
+ * Returns: The node, NULL once the merge is done.
+ */
+Node * avl_merge_next(AvlMerge *merge, int *tree){
+  // Check arguments.
+  assert(merge != NULL);
+
+  if(merge->size == 0) return NULL;
+  int from = merge->heap[0].tree;
+  Node *node = merge->cursors[from];
+  merge_advance(merge);
+
+  // Equal keys follow in tree order, the last one wins under LAST.
+  if(merge->policy != AVL_MERGE_ALL){
+    while(merge->size && merge->heap[0].key == node->key){
+      if(merge->policy == AVL_MERGE_LAST){
+	from = merge->heap[0].tree;
+	node = merge->cursors[from];
+      }
+      merge_advance(merge);
+    }
+  }
+
+  if(tree) *tree = from;
+  return node;
+}
+
+/*
+ * Function: avl_merge_visit
+ * -------------------------
+ * Description:
+ * Step a merge through all nodes with keys up to a bound,
+ * passing them to a callback, until the callback asks to
+ * stop. Nodes past the bound are left for the next call.
+ *
+ * Arguments: merge - The merge.
+ *            last  - The largest key to visit (inclusive).
+ *            visit - Called for every node, with its tree.
+ *            ctx   - Passed to visit.
+ *
+ * Returns: The number of nodes visited.
+ */
+long avl_merge_visit(AvlMerge *merge, int last, avl_merge_fn visit,
+		     void *ctx){
+  // Check arguments.
+  assert(merge != NULL && visit != NULL);
+
+  long count = 0;
+  while(merge->size && merge->heap[0].key <= last){
+    int tree = 0;
+    Node *node = avl_merge_next(merge, &tree);
+    count++;
+    if(visit(node, tree, ctx)) break;
+  }
+  return count;
+}
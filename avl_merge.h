@@ -0,0 +1,196 @@
+/* Basic AVL-Tree implementation - K-way merge module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the k-way merge module of the AVL-Tree implementation.
+ * It iterates over the nodes of many trees (e.g. the partitions
+ * of a sharded key space) in one global key order, without
+ * copying them: one cursor per tree steps along the parent
+ * pointers, and a binary heap of the cursors, ordered by key and
+ * then by tree, picks the next node in O(log k) for k trees.
+ * Keys present in several trees are reported once per tree, or
+ * once in total from the first or the last tree holding them.
+ * The trees must not be modified while they are merged.
+ * This module provides:
+ *     - Merged in-order iteration over k trees, O(log k) per step.
+ *     - Seeking to the first key at or above a bound (lower bound).
+ *     - Deduplication of keys shared between trees.
+ *     - Bounded visits with early termination.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_MERGE_H_
+#define __AVL_MERGE_H_
+
+#include "avl_core.h"
+
+#define AVL_MERGE_ALL 0   // Report every node, equal keys by tree.
+#define AVL_MERGE_FIRST 1 // Report each key once, from the first tree.
+#define AVL_MERGE_LAST 2  // Report each key once, from the last tree.
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: avl_merge_entry_s
+ * ----------------------------
+ * Description:
+ * A cursor in the heap of a merge. The key is kept next to
+ * the tree so that sifting does not touch the nodes.
+ *
+ * Fields: key - The key of the cursor's node.
+ *         tree - The index of the cursor's tree.
+ */
+typedef struct avl_merge_entry_s {
+  int key, tree;
+} AvlMergeEntry;
+
+/*
+ * Structure: avl_merge_s
+ * ----------------------
+ * Description:
+ * A running merge of several trees.
+ *
+ * Fields: trees - The merged trees.
+ *         cursors - The next node of every tree, NULL once done.
+ *         heap - The cursors not done, as a binary min-heap.
+ *         number_of_trees - Number of merged trees.
+ *         size - Number of cursors in the heap.
+ *         policy - How keys shared between trees are reported,
+ *                  one of AVL_MERGE_ALL, _FIRST and _LAST.
+ */
+typedef struct avl_merge_s {
+  AvlTree **trees;
+  Node **cursors;
+  AvlMergeEntry *heap;
+  int number_of_trees;
+  int size;
+  int policy;
+} AvlMerge;
+
+/*
+ * Type: avl_merge_fn
+ * ------------------
+ * Description:
+ * Callback receiving the nodes of a merge, with the index of
+ * their tree. Returning nonzero stops the visit.
+ */
+typedef int (*avl_merge_fn)(Node *node, int tree, void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: make_avl_merge
+ * ------------------------
+ * Description:
+ * Start a merge of several trees, positioned at the smallest
+ * key. The array of trees is copied, the trees are not. O(k).
+ *
+ * Arguments: trees  - The trees to merge.
+ *            n      - The number of trees.
+ *            policy - AVL_MERGE_ALL, AVL_MERGE_FIRST or
+ *                     AVL_MERGE_LAST.
+ *
+ * Returns: Pointer to the newly created merge.
+ */
+extern AvlMerge * make_avl_merge(AvlTree **trees, int n, int policy);
+
+/*
+ * Function: free_avl_merge
+ * ------------------------
+ * Description:
+ * Free a merge. The trees are not touched.
+ *
+ * Arguments: merge - The merge to free.
+ *
+ * Returns: void
+ */
+extern void free_avl_merge(AvlMerge *merge);
+
+/*
+ * Function: avl_merge_seek
+ * ------------------------
+ * Description:
+ * Position a merge at the smallest key greater than or equal
+ * to a given key (lower bound), forwards or backwards, with
+ * one descent per tree. O(k log n).
+ *
+ * Arguments: merge - The merge.
+ *            key   - The key to seek to.
+ *
+ * Returns: void
+ */
+extern void avl_merge_seek(AvlMerge *merge, int key);
+
+/*
+ * Function: avl_merge_peek
+ * ------------------------
+ * Description:
+ * Get the next node of a merge without stepping past it.
+ * Under AVL_MERGE_LAST this may be an earlier tree's node of
+ * the key that avl_merge_next will report. O(1).
+ *
+ * Arguments: merge - The merge.
+ *
+ * Returns: The node, NULL once the merge is done.
+ */
+extern Node * avl_merge_peek(AvlMerge *merge);
+
+/*
+ * Function: avl_merge_next
+ * ------------------------
+ * Description:
+ * Step a merge: get its next node in global key order and
+ * advance past it (and, when deduplicating, past the other
+ * nodes of the same key). O(log k), times the number of
+ * trees sharing the key when deduplicating.
+ *
+ * Arguments: merge - The merge.
+ *            tree  - Receives the index of the node's tree, may
+ *                    be NULL.
+ *
+ * Returns: The node, NULL once the merge is done.
+ */
+extern Node * avl_merge_next(AvlMerge *merge, int *tree);
+
+/*
+ * Function: avl_merge_visit
+ * -------------------------
+ * Description:
+ * Step a merge through all nodes with keys up to a bound,
+ * passing them to a callback, until the callback asks to
+ * stop. Nodes past the bound are left for the next call.
+ *
+ * Arguments: merge - The merge.
+ *            last  - The largest key to visit (inclusive).
+ *            visit - Called for every node, with its tree.
+ *            ctx   - Passed to visit.
+ *
+ * Returns: The number of nodes visited.
+ */
+extern long avl_merge_visit(AvlMerge *merge, int last, avl_merge_fn visit,
+			    void *ctx);
+
+#endif /* __AVL_MERGE_H_ */
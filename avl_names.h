@@ -0,0 +1,176 @@
+/* Basic AVL-Tree implementation - Core instance names */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * The names of an instance of the core for another key type
+ * (see avl_typed.h). While AVL_PREFIX is defined, including
+ * this file maps the types and functions of the core that
+ * depend on the key to AVL_PREFIX##_name, with an avl_ in
+ * front of name dropped: Node becomes avl_i64_node, avl_min
+ * becomes avl_i64_min and key_insert_new becomes
+ * avl_i64_key_insert_new. Including it again takes the names
+ * back. Without AVL_PREFIX (the int core) it maps nothing.
+ *
+ * There is deliberately no include guard.
+ */
+
+#ifndef AVL_NAMES_ACTIVE
+#define AVL_NAMES_ACTIVE
+
+#ifdef AVL_PREFIX
+#define AVL_NAME_PASTE(prefix, name) prefix##_##name
+#define AVL_NAME_EXPAND(prefix, name) AVL_NAME_PASTE(prefix, name)
+#define AVL_NAME(name) AVL_NAME_EXPAND(AVL_PREFIX, name)
+
+// Types.
+#define tree_node_s AVL_NAME(node_s)
+#define Node AVL_NAME(node)
+#define avl_tree_s AVL_NAME(tree_s)
+#define AvlTree AVL_NAME(tree)
+#define avl_expire_fn AVL_NAME(expire_fn)
+#define avl_budget_fn AVL_NAME(budget_fn)
+
+// Functions.
+#define make_tree_from_node AVL_NAME(make_tree_from_node)
+#define make_tree_empty AVL_NAME(make_tree_empty)
+#define make_tree_with_values AVL_NAME(make_tree_with_values)
+#define make_node_empty AVL_NAME(make_node_empty)
+#define upin AVL_NAME(upin)
+#define upout AVL_NAME(upout)
+#define get_height AVL_NAME(get_height)
+#define balance AVL_NAME(balance)
+#define rotate_right AVL_NAME(rotate_right)
+#define rotate_left AVL_NAME(rotate_left)
+#define avl_relaxed_begin AVL_NAME(relaxed_begin)
+#define avl_rebalance_step AVL_NAME(rebalance_step)
+#define avl_relaxed_end AVL_NAME(relaxed_end)
+#define search_by_key AVL_NAME(search_by_key)
+#define avl_contains AVL_NAME(contains)
+#define key_insert_new AVL_NAME(key_insert_new)
+#define avl_insert_hint AVL_NAME(insert_hint)
+#define key_delete AVL_NAME(key_delete)
+#define avl_delete_node AVL_NAME(delete_node)
+#define avl_min AVL_NAME(min)
+#define avl_max AVL_NAME(max)
+#define avl_pop_min AVL_NAME(pop_min)
+#define avl_pop_max AVL_NAME(pop_max)
+#define avl_next AVL_NAME(next)
+#define avl_prev AVL_NAME(prev)
+#define avl_floor AVL_NAME(floor)
+#define avl_ceiling AVL_NAME(ceiling)
+#define avl_predecessor AVL_NAME(predecessor)
+#define avl_successor AVL_NAME(successor)
+#define avl_reserve_node_ext AVL_NAME(reserve_node_ext)
+#define avl_value AVL_NAME(value)
+#define avl_insert_value AVL_NAME(insert_value)
+#define avl_lookup_value AVL_NAME(lookup_value)
+#define avl_augment_attach AVL_NAME(augment_attach)
+#define avl_augment_value AVL_NAME(augment_value)
+#define avl_augment_aggregate AVL_NAME(augment_aggregate)
+#define avl_augment_update AVL_NAME(augment_update)
+#define avl_augment_set AVL_NAME(augment_set)
+#define avl_augment_insert AVL_NAME(augment_insert)
+#define avl_range_aggregate AVL_NAME(range_aggregate)
+#define avl_compact AVL_NAME(compact)
+#define avl_compact_begin AVL_NAME(compact_begin)
+#define avl_compact_step AVL_NAME(compact_step)
+#define avl_init_node AVL_NAME(init_node)
+#define avl_alloc_nodes AVL_NAME(alloc_nodes)
+#define avl_release_slots AVL_NAME(release_slots)
+#define avl_adopt_nodes AVL_NAME(adopt_nodes)
+#define avl_expiry_attach AVL_NAME(expiry_attach)
+#define avl_expiry_set AVL_NAME(expiry_set)
+#define avl_expiry_deadline AVL_NAME(expiry_deadline)
+#define avl_insert_expiring AVL_NAME(insert_expiring)
+#define avl_expiry_now AVL_NAME(expiry_now)
+#define avl_expire AVL_NAME(expire)
+#define avl_memory_stats AVL_NAME(memory_stats)
+#define avl_memory_budget AVL_NAME(memory_budget)
+#define free_tree AVL_NAME(free_tree)
+#define get_int_max AVL_NAME(get_int_max)
+#endif /* AVL_PREFIX */
+
+#else /* AVL_NAMES_ACTIVE */
+#undef AVL_NAMES_ACTIVE
+
+#undef AVL_NAME_PASTE
+#undef AVL_NAME_EXPAND
+#undef AVL_NAME
+
+#undef tree_node_s
+#undef Node
+#undef avl_tree_s
+#undef AvlTree
+#undef avl_expire_fn
+#undef avl_budget_fn
+
+#undef make_tree_from_node
+#undef make_tree_empty
+#undef make_tree_with_values
+#undef make_node_empty
+#undef upin
+#undef upout
+#undef get_height
+#undef balance
+#undef rotate_right
+#undef rotate_left
+#undef avl_relaxed_begin
+#undef avl_rebalance_step
+#undef avl_relaxed_end
+#undef search_by_key
+#undef avl_contains
+#undef key_insert_new
+#undef avl_insert_hint
+#undef key_delete
+#undef avl_delete_node
+#undef avl_min
+#undef avl_max
+#undef avl_pop_min
+#undef avl_pop_max
+#undef avl_next
+#undef avl_prev
+#undef avl_floor
+#undef avl_ceiling
+#undef avl_predecessor
+#undef avl_successor
+#undef avl_reserve_node_ext
+#undef avl_value
+#undef avl_insert_value
+#undef avl_lookup_value
+#undef avl_augment_attach
+#undef avl_augment_value
+#undef avl_augment_aggregate
+#undef avl_augment_update
+#undef avl_augment_set
+#undef avl_augment_insert
+#undef avl_range_aggregate
+#undef avl_compact
+#undef avl_compact_begin
+#undef avl_compact_step
+#undef avl_init_node
+#undef avl_alloc_nodes
+#undef avl_release_slots
+#undef avl_adopt_nodes
+#undef avl_expiry_attach
+#undef avl_expiry_set
+#undef avl_expiry_deadline
+#undef avl_insert_expiring
+#undef avl_expiry_now
+#undef avl_expire
+#undef avl_memory_stats
+#undef avl_memory_budget
+#undef free_tree
+#undef get_int_max
+#endif /* AVL_NAMES_ACTIVE */
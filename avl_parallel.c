@@ -0,0 +1,922 @@
+/* Basic AVL-Tree implementation - Parallel module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the parallel module of the AVL-Tree implementation,
+ * built on POSIX threads. Trees are not thread safe; while a
+ * parallel operation runs, no other thread may modify the tree.
+ * This module provides:
+ *     - Parallel bulk construction from unsorted keys: parallel
+ *       radix sort, deduplication and subtree construction.
+ *     - Parallel map/reduce and for each over the nodes, on a
+ *       work stealing pool of threads.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ *     > 3:  Thread Creation Failure.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_parallel.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define RADIX_BITS 11 // Bits sorted per radix pass.
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES 3 // Passes covering all 32 key bits.
+#define TASKS_PER_THREAD 4 // Subtrees built per thread, for balance.
+#define KEY_BIAS 0x80000000u // Maps signed to unsigned key order.
+#define PARALLEL_CUTOFF_HEIGHT 10 // Subtrees walked sequentially.
+#define DEQUE_SIZE 64 // Capacity of a worker's task deque.
+
+/*
+ * Structure: build_task_s
+ * -----------------------
+ * Description:
+ * A subtree to be built by a worker: the nodes for the keys
+ * at positions [lo, hi) of the sorted unique keys.
+ *
+ * Fields: lo - First key position.
+ *         hi - End of the key positions.
+ *         parent - Parent of the subtree root.
+ *         link - Where to store the subtree root.
+ */
+typedef struct build_task_s {
+  int lo, hi;
+  Node *parent;
+  Node **link;
+} BuildTask;
+
+/*
+ * Structure: parallel_build_s
+ * ---------------------------
+ * Description:
+ * State shared by the workers of a parallel build. The fields
+ * written by the first worker between two barriers are read
+ * by all workers after the second.
+ *
+ * Fields: tree - The tree being built.
+ *         keys - The input keys.
+ *         n - The number of input keys.
+ *         threads - The number of workers.
+ *         buffers - Two radix buffers of n biased keys each.
+ *         counts - Per worker radix counts, turned in to offsets.
+ *         unique_counts - Per worker number of unique keys,
+ *                         turned in to offsets.
+ *         unique - The sorted unique keys.
+ *         n_unique - The number of unique keys.
+ *         nodes - The node slots, one per unique key.
+ *         root - The root of the built tree.
+ *         tasks - The subtrees left to the workers.
+ *         n_tasks - The number of tasks.
+ *         capacity - Allocated size of tasks.
+ *         barrier - Separates the build phases.
+ */
+typedef struct parallel_build_s {
+  AvlTree *tree;
+  const int *keys;
+  int n, threads;
+  unsigned *buffers[2];
+  size_t (*counts)[RADIX_BUCKETS];
+  int *unique_counts;
+  unsigned *unique;
+  int n_unique;
+  Node *nodes, *root;
+  BuildTask *tasks;
+  int n_tasks, capacity;
+  pthread_barrier_t barrier;
+} ParallelBuild;
+
+/*
+ * Structure: build_worker_s
+ * -------------------------
+ * Description:
+ * Arguments of a worker thread.
+ *
+ * Fields: build - The shared build state.
+ *         id - Index of the worker, 0 is the calling thread.
+ */
+typedef struct build_worker_s {
+  ParallelBuild *build;
+  int id;
+} BuildWorker;
+
+/*
+ * Structure: walk_task_s
+ * ----------------------
+ * Description:
+ * A subtree offered to other workers during a walk.
+ *
+ * Fields: node - The root of the subtree.
+ *         result - Receives the reduced value of the subtree.
+ *         has_value - Whether result holds a value.
+ *         done - Set once a thief has walked the subtree.
+ */
+typedef struct walk_task_s {
+  Node *node;
+  void *result;
+  int has_value, done;
+} WalkTask;
+
+/*
+ * Structure: walk_deque_s
+ * -----------------------
+ * Description:
+ * The task deque of a worker. The owner pushes and pops at
+ * the bottom, thieves take from the top.
+ *
+ * Fields: lock - Protects the deque.
+ *         tasks - The tasks, valid between top and bottom.
+ *         top - Position of the oldest task.
+ *         bottom - Position after the newest task.
+ */
+typedef struct walk_deque_s {
+  pthread_mutex_t lock;
+  WalkTask *tasks[DEQUE_SIZE];
+  int top, bottom;
+} WalkDeque;
+
+/*
+ * Structure: walk_s
+ * -----------------
+ * Description:
+ * State shared by the workers of a parallel walk.
+ *
+ * Fields: map - Maps a node to its value (reductions).
+ *         visit - Called on every node (for each).
+ *         combine - Combines two values.
+ *         size - Size of a value in bytes.
+ *         words - Size of a value buffer in long longs.
+ *         ctx - Passed to map, visit and combine.
+ *         threads - The number of workers.
+ *         deques - The task deques, one per worker.
+ *         finished - Set once the walk is complete.
+ */
+typedef struct walk_s {
+  avl_map_fn map;
+  avl_visit_fn visit;
+  avl_combine_fn combine;
+  size_t size, words;
+  void *ctx;
+  int threads;
+  WalkDeque *deques;
+  int finished;
+} Walk;
+
+/*
+ * Structure: walk_worker_s
+ * ------------------------
+ * Description:
+ * Arguments of a worker thread of a walk.
+ *
+ * Fields: walk - The shared walk state.
+ *         id - Index of the worker, 0 is the calling thread.
+ */
+typedef struct walk_worker_s {
+  Walk *walk;
+  int id;
+} WalkWorker;
+
+/*
+ * Function: checked_malloc
+ * ------------------------
+ * Description:
+ * Internal helper. malloc, exiting on failure.
+ *
+ * Arguments: size - Number of bytes to allocate.
+ *
+ * Returns: Pointer to the allocated memory.
+ */
+static void * checked_malloc(size_t size){
+  void *ptr = malloc(size);
+  if(ptr == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed in a parallel tree operation.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  return ptr;
+}
+
+/*
+ * Function: resolve_threads
+ * -------------------------
+ * Description:
+ * Internal helper. The number of threads to use.
+ *
+ * Arguments: threads - Requested number, 0 for one per
+ *                      online processor.
+ *
+ * Returns: The number of threads, at least 1.
+ */
+static int resolve_threads(int threads){
+  if(threads > 0) return threads;
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  return (online > 0) ? (int)online : 1;
+}
+
+/*
+ * Function: chunk_start
+ * ---------------------
+ * Description:
+ * Internal helper. Start of a worker's share of n items.
+ *
+ * Arguments: n       - The number of items.
+ *            id      - The worker.
+ *            threads - The number of workers.
+ *
+ * Returns: Position of the worker's first item.
+ */
+static inline int chunk_start(int n, int id, int threads){
+  return (int)((long long)n * id / threads);
+}
+
+/*
+ * Function: range_height
+ * ----------------------
+ * Description:
+ * Internal helper. Height of a subtree of m > 0 nodes built
+ * by splitting at the middle: floor(log2(m)).
+ *
+ * Arguments: m - The number of nodes.
+ *
+ * Returns: The height of the subtree.
+ */
+static inline int range_height(int m){
+  int height = -1;
+  for(; m > 0; m >>= 1) height++;
+  return height;
+}
+
+/*
+ * Function: make_range_node
+ * -------------------------
+ * Description:
+ * Internal helper. Initialize the node for the middle key of
+ * a range of unique keys, without its children.
+ *
+ * Arguments: build  - The build state.
+ *            lo     - First key position of the range.
+ *            hi     - End of the key positions, hi > lo.
+ *            parent - Parent of the node.
+ *
+ * Returns: The node.
+ */
+static Node * make_range_node(ParallelBuild *build, int lo, int hi,
+			      Node *parent){
+  int mid = lo + (hi - lo) / 2;
+  Node *node = AVL_NODE_SLOT(build->tree, build->nodes, mid);
+  avl_init_node(build->tree, node, (int)(build->unique[mid] ^ KEY_BIAS));
+  node->parent = parent;
+  node->height = range_height(hi - lo);
+  return node;
+}
+
+/*
+ * Function: build_range
+ * ---------------------
+ * Description:
+ * Internal helper. Build the subtree for a range of unique
+ * keys, splitting at the middle. Each key's node goes in to
+ * the slot of its position, so the tree is laid out in order.
+ *
+ * Arguments: build  - The build state.
+ *            lo     - First key position of the range.
+ *            hi     - End of the key positions.
+ *            parent - Parent of the subtree root.
+ *
+ * Returns: The subtree root, NULL for an empty range.
+ */
+static Node * build_range(ParallelBuild *build, int lo, int hi, Node *parent){
+  if(lo >= hi) return NULL;
+  int mid = lo + (hi - lo) / 2;
+  Node *node = make_range_node(build, lo, hi, parent);
+  node->left_child = build_range(build, lo, mid, node);
+  node->right_child = build_range(build, mid + 1, hi, node);
+  return node;
+}
+
+/*
+ * Function: plan_range
+ * --------------------
+ * Description:
+ * Internal helper. Build the top levels of the tree for a
+ * range of unique keys, and leave the subtrees of at most
+ * grain keys below them as tasks to the workers.
+ *
+ * Arguments: build  - The build state.
+ *            lo     - First key position of the range.
+ *            hi     - End of the key positions.
+ *            parent - Parent of the subtree root.
+ *            link   - Where to store the subtree root.
+ *            grain  - Largest range left as one task.
+ *
+ * Returns: void
+ */
+static void plan_range(ParallelBuild *build, int lo, int hi, Node *parent,
+		       Node **link, int grain){
+  if(hi - lo <= grain){
+    if(build->n_tasks == build->capacity){
+      build->capacity *= 2;
+      build->tasks = (BuildTask *)realloc(build->tasks,
+					  build->capacity * sizeof(BuildTask));
+      if(build->tasks == NULL){
+	// Memory allocation failed, report and exit.
+	printf("Memory allocation failed in a parallel tree operation.\n");
+	exit(1); // Throw memory allocation error.
+      }
+    }
+    BuildTask task = {lo, hi, parent, link};
+    build->tasks[build->n_tasks++] = task;
+    return;
+  }
+
+  int mid = lo + (hi - lo) / 2;
+  Node *node = make_range_node(build, lo, hi, parent);
+  *link = node;
+  plan_range(build, lo, mid, node, &node->left_child, grain);
+  plan_range(build, mid + 1, hi, node, &node->right_child, grain);
+}
+
+/*
+ * Function: build_worker
+ * ----------------------
+ * Description:
+ * Internal helper. Body of every worker of a parallel build.
+ * The phases are separated by barriers:
+ *     1. LSD radix sort of the biased keys, each pass counting
+ *        per worker, computing offsets, and scattering.
+ *     2. Deduplication, counting and then copying the unique
+ *        keys of each worker's share.
+ *     3. Construction of the subtrees planned by the first
+ *        worker, which also builds the top levels.
+ *
+ * Arguments: arg - The BuildWorker of this thread.
+ *
+ * Returns: NULL
+ */
+static void * build_worker(void *arg){
+  BuildWorker *worker = (BuildWorker *)arg;
+  ParallelBuild *build = worker->build;
+  int id = worker->id, threads = build->threads;
+  int lo = chunk_start(build->n, id, threads);
+  int hi = chunk_start(build->n, id + 1, threads);
+  unsigned *src = build->buffers[0], *dst = build->buffers[1];
+
+  for(int i = lo; i < hi; i++) src[i] = (unsigned)build->keys[i] ^ KEY_BIAS;
+
+  // Phase 1: radix sort.
+  for(int pass = 0; pass < RADIX_PASSES; pass++){
+    int shift = pass * RADIX_BITS;
+    size_t *count = build->counts[id];
+    memset(count, 0, RADIX_BUCKETS * sizeof(size_t));
+    for(int i = lo; i < hi; i++){
+      count[(src[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+    }
+    pthread_barrier_wait(&build->barrier);
+
+    if(id == 0){
+      // Each worker's offset for a digit follows the lower digits
+      // and the same digit of the lower workers, keeping it stable.
+      size_t offset = 0;
+      for(int digit = 0; digit < RADIX_BUCKETS; digit++){
+	for(int t = 0; t < threads; t++){
+	  size_t c = build->counts[t][digit];
+	  build->counts[t][digit] = offset;
+	  offset += c;
+	}
+      }
+    }
+    pthread_barrier_wait(&build->barrier);
+
+    for(int i = lo; i < hi; i++){
+      dst[count[(src[i] >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+    }
+    pthread_barrier_wait(&build->barrier);
+    unsigned *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  // Phase 2: deduplication in to the spare buffer.
+  int unique = 0;
+  for(int i = lo; i < hi; i++){
+    if(i == 0 || src[i] != src[i - 1]) unique++;
+  }
+  build->unique_counts[id] = unique;
+  pthread_barrier_wait(&build->barrier);
+
+  if(id == 0){
+    int offset = 0;
+    for(int t = 0; t < threads; t++){
+      int c = build->unique_counts[t];
+      build->unique_counts[t] = offset;
+      offset += c;
+    }
+    build->n_unique = offset;
+    build->unique = dst;
+  }
+  pthread_barrier_wait(&build->barrier);
+
+  unique = build->unique_counts[id];
+  for(int i = lo; i < hi; i++){
+    if(i == 0 || src[i] != src[i - 1]) dst[unique++] = src[i];
+  }
+  pthread_barrier_wait(&build->barrier);
+
+  // Phase 3: the first worker builds the top levels, then all
+  // workers build the subtrees below them.
+  if(id == 0 && build->n_unique > 0){
+    int n = build->n_unique;
+    int grain = n / (threads * TASKS_PER_THREAD);
+    if(grain < 1) grain = 1;
+    // Without nodes there are no tasks, and the build fails.
+    build->nodes = avl_alloc_nodes(build->tree, n);
+    if(build->nodes){
+      plan_range(build, 0, n, NULL, &build->root, grain);
+    }
+  }
+  pthread_barrier_wait(&build->barrier);
+
+  for(int k = id; k < build->n_tasks; k += threads){
+    BuildTask *task = &build->tasks[k];
+    *task->link = build_range(build, task->lo, task->hi, task->parent);
+  }
+  return NULL;
+}
+
+/*
+ * Function: avl_build_parallel
+ * ----------------------------
+ * Description:
+ * Build a balanced tree from unsorted keys, using a number of
+ * threads. The keys are radix sorted and deduplicated in
+ * parallel, and the tree is built in to one contiguous block
+ * in key order, with the subtrees below the top levels built
+ * by the threads concurrently. O(n) work.
+ *
+ * Arguments: keys    - The keys, in any order, duplicates allowed.
+ *            n       - The number of keys.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: Pointer to the newly created tree.
+ */
+AvlTree * avl_build_parallel(const int *keys, int n, int threads){
+  AvlTree *tree = make_tree_empty();
+  if(tree == NULL || avl_build_parallel_into(tree, keys, n, threads) != 1){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while building a tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  return tree;
+}
+
+/*
+ * Function: avl_build_parallel_into
+ * ---------------------------------
+ * Description:
+ * Like avl_build_parallel, but build in to an existing empty
+ * tree, for example one created by make_tree_with_values or
+ * with an augmentation attached. Node data, inline values and
+ * augmentation values start out zeroed.
+ *
+ * Arguments: tree    - The empty tree to build in to.
+ *            keys    - The keys, in any order, duplicates allowed.
+ *            n       - The number of keys.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: 1 - The tree was built.
+ *          0 - The tree is not empty.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out. The tree stays
+ *          empty.
+ */
+int avl_build_parallel_into(AvlTree *tree, const int *keys, int n,
+			    int threads){
+  // Check arguments.
+  assert(tree != NULL && n >= 0 && (keys != NULL || n == 0));
+
+  if(tree->root != NULL) return 0;
+  if(n == 0) return 1;
+
+  threads = resolve_threads(threads);
+  if(threads > n) threads = n;
+
+  ParallelBuild build;
+  memset(&build, 0, sizeof(build));
+  build.tree = tree;
+  build.keys = keys;
+  build.n = n;
+  build.threads = threads;
+  build.buffers[0] = (unsigned *)malloc(n * sizeof(unsigned));
+  build.buffers[1] = (unsigned *)malloc(n * sizeof(unsigned));
+  build.counts = malloc(threads * sizeof(*build.counts));
+  build.unique_counts = (int *)malloc(threads * sizeof(int));
+  build.capacity = 2 * threads * TASKS_PER_THREAD + 2;
+  build.tasks = (BuildTask *)malloc(build.capacity * sizeof(BuildTask));
+  BuildWorker *workers = (BuildWorker *)malloc(threads * sizeof(BuildWorker));
+  pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  if(build.buffers[0] == NULL || build.buffers[1] == NULL ||
+     build.counts == NULL || build.unique_counts == NULL ||
+     build.tasks == NULL || workers == NULL || ids == NULL){
+    build.nodes = NULL;
+  }else{
+    pthread_barrier_init(&build.barrier, NULL, threads);
+
+    // The calling thread is worker 0.
+    for(int t = 0; t < threads; t++){
+      workers[t].build = &build;
+      workers[t].id = t;
+      if(t > 0 && pthread_create(&ids[t], NULL, build_worker, &workers[t])){
+	// Thread creation failed, report and exit.
+	printf("Thread creation failed while building a tree.\n");
+	exit(3); // Throw thread creation error.
+      }
+    }
+    build_worker(&workers[0]);
+    for(int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+    pthread_barrier_destroy(&build.barrier);
+  }
+
+  int result = AVL_ERROR_NO_MEMORY;
+  if(build.nodes) result = avl_adopt_nodes(tree, build.root, build.n_unique);
+
+  free(ids);
+  free(workers);
+  free(build.tasks);
+  free(build.unique_counts);
+  free(build.counts);
+  free(build.buffers[1]);
+  free(build.buffers[0]);
+  return result;
+}
+
+/*
+ * Function: deque_push
+ * --------------------
+ * Description:
+ * Internal helper. Push a task on the bottom of a worker's
+ * own deque.
+ *
+ * Arguments: deque - The deque.
+ *            task  - The task.
+ *
+ * Returns: 1 - The task was pushed.
+ *          0 - The deque is full.
+ */
+static int deque_push(WalkDeque *deque, WalkTask *task){
+  pthread_mutex_lock(&deque->lock);
+  int pushed = (deque->bottom < DEQUE_SIZE);
+  if(pushed) deque->tasks[deque->bottom++] = task;
+  pthread_mutex_unlock(&deque->lock);
+  return pushed;
+}
+
+/*
+ * Function: deque_pop
+ * -------------------
+ * Description:
+ * Internal helper. Take a task back from the bottom of a
+ * worker's own deque, unless it has been stolen.
+ *
+ * Arguments: deque - The deque.
+ *            task  - The task pushed last.
+ *
+ * Returns: 1 - The task was taken back.
+ *          0 - The task has been stolen.
+ */
+static int deque_pop(WalkDeque *deque, WalkTask *task){
+  pthread_mutex_lock(&deque->lock);
+  int popped = (deque->bottom > deque->top
+		&& deque->tasks[deque->bottom - 1] == task);
+  if(popped) deque->bottom--;
+  if(deque->bottom == deque->top) deque->bottom = deque->top = 0;
+  pthread_mutex_unlock(&deque->lock);
+  return popped;
+}
+
+/*
+ * Function: deque_steal
+ * ---------------------
+ * Description:
+ * Internal helper. Take the oldest task, the largest subtree,
+ * from the top of another worker's deque.
+ *
+ * Arguments: deque - The deque to steal from.
+ *
+ * Returns: The task, NULL if the deque is empty.
+ */
+static WalkTask * deque_steal(WalkDeque *deque){
+  WalkTask *task = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if(deque->top < deque->bottom) task = deque->tasks[deque->top++];
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+/*
+ * Function: walk_node
+ * -------------------
+ * Description:
+ * Internal helper. Visit a node, or map it and append its
+ * value to an accumulated value.
+ *
+ * Arguments: walk - The walk state.
+ *            node - The node.
+ *            acc  - The accumulated value.
+ *            has  - Whether acc holds a value yet.
+ *
+ * Returns: Whether acc holds a value now.
+ */
+static int walk_node(Walk *walk, Node *node, void *acc, int has){
+  if(walk->visit){
+    walk->visit(node, walk->ctx);
+    return 0;
+  }
+  long long part[walk->words];
+  walk->map(has ? part : acc, node, walk->ctx);
+  if(has) walk->combine(acc, acc, part, walk->ctx);
+  return 1;
+}
+
+/*
+ * Function: append_value
+ * ----------------------
+ * Description:
+ * Internal helper. Append a value to an accumulated value.
+ *
+ * Arguments: walk  - The walk state.
+ *            acc   - The accumulated value.
+ *            has   - Whether acc holds a value yet.
+ *            value - The value to append.
+ *
+ * Returns: Whether acc holds a value now.
+ */
+static int append_value(Walk *walk, void *acc, int has, const void *value){
+  if(has){
+    walk->combine(acc, acc, value, walk->ctx);
+  }else{
+    memcpy(acc, value, walk->size);
+  }
+  return 1;
+}
+
+/*
+ * Function: walk_sequential
+ * -------------------------
+ * Description:
+ * Internal helper. Walk a subtree in order on this thread.
+ *
+ * Arguments: walk - The walk state.
+ *            node - The root of the subtree.
+ *            out  - Receives the reduced value of the subtree.
+ *
+ * Returns: Whether out holds a value (the subtree is not
+ *          empty and this is a reduction).
+ */
+static int walk_sequential(Walk *walk, Node *node, void *out){
+  if(node == NULL) return 0;
+  int has = walk_sequential(walk, node->left_child, out);
+  has = walk_node(walk, node, out, has);
+
+  long long right[walk->words];
+  if(walk_sequential(walk, node->right_child, right)){
+    has = append_value(walk, out, has, right);
+  }
+  return has;
+}
+
+static int walk_subtree(WalkWorker *worker, Node *node, void *out);
+
+/*
+ * Function: steal_and_run
+ * -----------------------
+ * Description:
+ * Internal helper. Steal a task from another worker and run
+ * it on this one.
+ *
+ * Arguments: worker - The stealing worker.
+ *
+ * Returns: 1 - A task was run.
+ *          0 - There was nothing to steal.
+ */
+static int steal_and_run(WalkWorker *worker){
+  Walk *walk = worker->walk;
+  for(int i = 1; i < walk->threads; i++){
+    int victim = (worker->id + i) % walk->threads;
+    WalkTask *task = deque_steal(&walk->deques[victim]);
+    if(task){
+      task->has_value = walk_subtree(worker, task->node, task->result);
+      __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Function: walk_subtree
+ * ----------------------
+ * Description:
+ * Internal helper. Walk a subtree as a fork-join task: the
+ * left subtree is offered to thieves while this worker walks
+ * the right one, and is then walked here unless it has been
+ * stolen, in which case this worker steals other tasks until
+ * it is done. Small subtrees are walked sequentially.
+ *
+ * Arguments: worker - The worker.
+ *            node   - The root of the subtree.
+ *            out    - Receives the reduced value of the subtree.
+ *
+ * Returns: Whether out holds a value.
+ */
+static int walk_subtree(WalkWorker *worker, Node *node, void *out){
+  Walk *walk = worker->walk;
+  if(node == NULL || node->height <= PARALLEL_CUTOFF_HEIGHT){
+    return walk_sequential(walk, node, out);
+  }
+
+  long long left_result[walk->words], right_result[walk->words];
+  WalkTask left = {node->left_child, left_result, 0, 0};
+  WalkDeque *deque = &walk->deques[worker->id];
+  int pushed = deque_push(deque, &left);
+
+  int has_right = walk_subtree(worker, node->right_child, right_result);
+
+  if(!pushed || deque_pop(deque, &left)){
+    left.has_value = walk_subtree(worker, left.node, left_result);
+  }else{
+    while(!__atomic_load_n(&left.done, __ATOMIC_ACQUIRE)){
+      if(!steal_and_run(worker)) sched_yield();
+    }
+  }
+
+  // Combine in key order: left subtree, node, right subtree.
+  int has = left.has_value;
+  if(has) memcpy(out, left_result, walk->size);
+  has = walk_node(walk, node, out, has);
+  if(has_right) has = append_value(walk, out, has, right_result);
+  return has;
+}
+
+/*
+ * Function: walk_worker
+ * ---------------------
+ * Description:
+ * Internal helper. Body of the helper threads of a walk:
+ * steal tasks until the walk is finished.
+ *
+ * Arguments: arg - The WalkWorker of this thread.
+ *
+ * Returns: NULL
+ */
+static void * walk_worker(void *arg){
+  WalkWorker *worker = (WalkWorker *)arg;
+  while(!__atomic_load_n(&worker->walk->finished, __ATOMIC_ACQUIRE)){
+    if(!steal_and_run(worker)) sched_yield();
+  }
+  return NULL;
+}
+
+/*
+ * Function: run_walk
+ * ------------------
+ * Description:
+ * Internal helper. Walk a whole tree with a pool of workers,
+ * the calling thread being worker 0 and starting at the root.
+ *
+ * Arguments: walk - The walk state, without the pool.
+ *            tree - The tree to walk.
+ *            out  - Receives the reduced value.
+ *
+ * Returns: Whether out holds a value.
+ */
+static int run_walk(Walk *walk, AvlTree *tree, void *out){
+  int threads = walk->threads;
+  walk->finished = 0;
+  walk->deques = (WalkDeque *)checked_malloc(threads * sizeof(WalkDeque));
+  WalkWorker *workers =
+    (WalkWorker *)checked_malloc(threads * sizeof(WalkWorker));
+  pthread_t *ids = (pthread_t *)checked_malloc(threads * sizeof(pthread_t));
+
+  for(int t = 0; t < threads; t++){
+    pthread_mutex_init(&walk->deques[t].lock, NULL);
+    walk->deques[t].top = walk->deques[t].bottom = 0;
+    workers[t].walk = walk;
+    workers[t].id = t;
+  }
+  for(int t = 1; t < threads; t++){
+    if(pthread_create(&ids[t], NULL, walk_worker, &workers[t])){
+      // Thread creation failed, report and exit.
+      printf("Thread creation failed while walking a tree.\n");
+      exit(3); // Throw thread creation error.
+    }
+  }
+
+  int has = walk_subtree(&workers[0], tree->root, out);
+  __atomic_store_n(&walk->finished, 1, __ATOMIC_RELEASE);
+  for(int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+
+  for(int t = 0; t < threads; t++) pthread_mutex_destroy(&walk->deques[t].lock);
+  free(ids);
+  free(workers);
+  free(walk->deques);
+  return has;
+}
+
+/*
+ * Function: avl_parallel_reduce
+ * -----------------------------
+ * Description:
+ * Map every node of a tree to a value and reduce the values
+ * in key order, in parallel. Subtrees are split off as tasks
+ * and balanced over the threads by work stealing; subtrees
+ * of height PARALLEL_CUTOFF_HEIGHT or less are walked
+ * sequentially. Only associativity of combine is required.
+ * The tree must not be modified during the reduction.
+ *
+ * Arguments: tree    - The tree to reduce.
+ *            map     - Maps a node to its value.
+ *            combine - Combines two values (see avl_combine_fn).
+ *            size    - Size of a value in bytes.
+ *            out     - Receives the reduced value.
+ *            ctx     - Passed to map and combine.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: 1 - The reduced value was stored in out.
+ *          0 - The tree is empty (out is left untouched).
+ */
+int avl_parallel_reduce(AvlTree *tree, avl_map_fn map,
+			avl_combine_fn combine, size_t size, void *out,
+			void *ctx, int threads){
+  // Check arguments.
+  assert(tree != NULL && map != NULL && combine != NULL && out != NULL);
+
+  if(tree->root == NULL) return 0;
+
+  Walk walk;
+  memset(&walk, 0, sizeof(walk));
+  walk.map = map;
+  walk.combine = combine;
+  walk.size = size;
+  walk.words = (size + sizeof(long long) - 1) / sizeof(long long) + 1;
+  walk.ctx = ctx;
+  walk.threads = resolve_threads(threads);
+  return run_walk(&walk, tree, out);
+}
+
+/*
+ * Function: avl_parallel_for_each
+ * -------------------------------
+ * Description:
+ * Call a function on every node of a tree, in parallel and
+ * in no particular order, balanced over the threads like
+ * avl_parallel_reduce. The function may modify the data of
+ * the node it is called on, but not the tree.
+ *
+ * Arguments: tree    - The tree to walk.
+ *            visit   - Called for every node.
+ *            ctx     - Passed to visit.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: void
+ */
+void avl_parallel_for_each(AvlTree *tree, avl_visit_fn visit, void *ctx,
+			   int threads){
+  // Check arguments.
+  assert(tree != NULL && visit != NULL);
+
+  if(tree->root == NULL) return;
+
+  Walk walk;
+  memset(&walk, 0, sizeof(walk));
+  walk.visit = visit;
+  walk.words = 1;
+  walk.ctx = ctx;
+  walk.threads = resolve_threads(threads);
+  long long unused;
+  run_walk(&walk, tree, &unused);
+}
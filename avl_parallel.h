@@ -0,0 +1,153 @@
+/* Basic AVL-Tree implementation - Parallel module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the parallel module of the AVL-Tree implementation,
+ * built on POSIX threads. Trees are not thread safe; while a
+ * parallel operation runs, no other thread may modify the tree.
+ * This module provides:
+ *     - Parallel bulk construction from unsorted keys: parallel
+ *       radix sort, deduplication and subtree construction.
+ *     - Parallel map/reduce and for each over the nodes, on a
+ *       work stealing pool of threads.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ *     > 3:  Thread Creation Failure.
+ */
+
+#ifndef __AVL_PARALLEL_H_
+#define __AVL_PARALLEL_H_
+
+#include "avl_core.h"
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Type: avl_map_fn
+ * ----------------
+ * Description:
+ * Map function of a parallel reduction: store the value of
+ * a node in out.
+ */
+typedef void (*avl_map_fn)(void *out, Node *node, void *ctx);
+
+/*
+ * Type: avl_visit_fn
+ * ------------------
+ * Description:
+ * Called on every node by avl_parallel_for_each.
+ */
+typedef void (*avl_visit_fn)(Node *node, void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: avl_build_parallel
+ * ----------------------------
+ * Description:
+ * Build a balanced tree from unsorted keys, using a number of
+ * threads. The keys are radix sorted and deduplicated in
+ * parallel, and the tree is built in to one contiguous block
+ * in key order, with the subtrees below the top levels built
+ * by the threads concurrently. O(n) work.
+ *
+ * Arguments: keys    - The keys, in any order, duplicates allowed.
+ *            n       - The number of keys.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: Pointer to the newly created tree.
+ */
+extern AvlTree * avl_build_parallel(const int *keys, int n, int threads);
+
+/*
+ * Function: avl_build_parallel_into
+ * ---------------------------------
+ * Description:
+ * Like avl_build_parallel, but build in to an existing empty
+ * tree, for example one created by make_tree_with_values or
+ * with an augmentation attached. Node data, inline values and
+ * augmentation values start out zeroed.
+ *
+ * Arguments: tree    - The empty tree to build in to.
+ *            keys    - The keys, in any order, duplicates allowed.
+ *            n       - The number of keys.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: 1 - The tree was built.
+ *          0 - The tree is not empty.
+ */
+extern int avl_build_parallel_into(AvlTree *tree, const int *keys, int n,
+				   int threads);
+
+/*
+ * Function: avl_parallel_reduce
+ * -----------------------------
+ * Description:
+ * Map every node of a tree to a value and reduce the values
+ * in key order, in parallel. Subtrees are split off as tasks
+ * and balanced over the threads by work stealing; subtrees
+ * of height PARALLEL_CUTOFF_HEIGHT or less are walked
+ * sequentially. Only associativity of combine is required.
+ * The tree must not be modified during the reduction.
+ *
+ * Arguments: tree    - The tree to reduce.
+ *            map     - Maps a node to its value.
+ *            combine - Combines two values (see avl_combine_fn).
+ *            size    - Size of a value in bytes.
+ *            out     - Receives the reduced value.
+ *            ctx     - Passed to map and combine.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: 1 - The reduced value was stored in out.
+ *          0 - The tree is empty (out is left untouched).
+ */
+extern int avl_parallel_reduce(AvlTree *tree, avl_map_fn map,
+			       avl_combine_fn combine, size_t size, void *out,
+			       void *ctx, int threads);
+
+/*
+ * Function: avl_parallel_for_each
+ * -------------------------------
+ * Description:
+ * Call a function on every node of a tree, in parallel and
+ * in no particular order, balanced over the threads like
+ * avl_parallel_reduce. The function may modify the data of
+ * the node it is called on, but not the tree.
+ *
+ * Arguments: tree    - The tree to walk.
+ *            visit   - Called for every node.
+ *            ctx     - Passed to visit.
+ *            threads - The number of threads, 0 for one per
+ *                      online processor.
+ *
+ * Returns: void
+ */
+extern void avl_parallel_for_each(AvlTree *tree, avl_visit_fn visit,
+				  void *ctx, int threads);
+
+#endif /* __AVL_PARALLEL_H_ */
@@ -0,0 +1,463 @@
+/* Basic AVL-Tree implementation - 2-D range tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the 2-D range tree module of the AVL-Tree implementation.
+ * It answers orthogonal range queries over a fixed set of points:
+ * the points with x in [x_lo, x_hi] and y in [y_lo, y_hi]. The
+ * points are indexed by an AVL-Tree keyed by x, one node per
+ * distinct x, in which every node carries the points of its
+ * subtree sorted by y. A query splits the x range in to O(log n)
+ * such subtrees and searches each of them on y.
+ * This module provides:
+ *     - Bulk construction from a point array in O(n log n).
+ *     - Range counting in O(log^2 n).
+ *     - Range reporting in O(log^2 n + k).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#include "avl_range.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Structure: range_node_s
+ * -----------------------
+ * Description:
+ * The extension area of a node of a range tree.
+ *
+ * Fields: first - Position of the node's first point in the
+ *                 x-sorted points.
+ *         here - Number of points with the node's x.
+ *         list - Position of the y-sorted list of the subtree's
+ *                points in the entries.
+ *         count - Number of points in the subtree.
+ */
+typedef struct range_node_s {
+  int first, here;
+  long list;
+  int count;
+} RangeNode;
+
+/*
+ * Structure: range_query_s
+ * ------------------------
+ * Description:
+ * Internal state of a range query.
+ *
+ * Fields: y_lo - Smallest y of the query.
+ *         y_hi - Largest y of the query.
+ *         report - Callback for the points found, NULL to count.
+ *         ctx - Passed to report.
+ *         count - Number of points found so far.
+ *         stop - Set once report asked to stop.
+ */
+typedef struct range_query_s {
+  int y_lo, y_hi;
+  range_report_fn report;
+  void *ctx;
+  int count, stop;
+} RangeQuery;
+
+// The extension area of a node.
+#define RANGE_NODE(rtree, node) \
+  ((RangeNode *)AVL_NODE_EXT(node, (rtree)->offset))
+
+/*
+ * Function: compare_points
+ * ------------------------
+ * Description:
+ * Internal helper. Order points by x, then y, for qsort.
+ *
+ * Arguments: a - The first point.
+ *            b - The second point.
+ *
+ * Returns: Negative, zero or positive, as for qsort.
+ */
+static int compare_points(const void *a, const void *b){
+  const RangePoint *p = (const RangePoint *)a, *q = (const RangePoint *)b;
+  if(p->x != q->x) return (p->x < q->x) ? -1 : 1;
+  if(p->y != q->y) return (p->y < q->y) ? -1 : 1;
+  return 0;
+}
+
+/*
+ * Function: build_subtree
+ * -----------------------
+ * Description:
+ * Internal helper. Build the subtree for a range of distinct
+ * x values, splitting at the middle, and the y-sorted list of
+ * its points, merged from the lists of its children and its
+ * own points.
+ *
+ * Arguments: rtree  - The range tree being built.
+ *            slots  - The node slots, one per distinct x.
+ *            starts - Position of the first point of every
+ *                     distinct x, and the number of points.
+ *            lo     - First distinct x of the range.
+ *            hi     - End of the distinct x range.
+ *            parent - Parent of the subtree root.
+ *
+ * Returns: The subtree root, NULL for an empty range.
+ */
+static Node * build_subtree(RangeTree *rtree, Node *slots, const int *starts,
+			    int lo, int hi, Node *parent){
+  if(lo >= hi) return NULL;
+
+  int mid = lo + (hi - lo) / 2;
+  Node *node = AVL_NODE_SLOT(rtree->tree, slots, mid);
+  avl_init_node(rtree->tree, node, rtree->points[starts[mid]].x);
+  node->parent = parent;
+  node->left_child = build_subtree(rtree, slots, starts, lo, mid, node);
+  node->right_child = build_subtree(rtree, slots, starts, mid + 1, hi, node);
+  node->height = get_height(node);
+
+  RangeNode *range = RANGE_NODE(rtree, node);
+  range->first = starts[mid];
+  range->here = starts[mid + 1] - starts[mid];
+
+  // Heads of the three y-sorted inputs: the children's lists and
+  // the node's own points.
+  const RangeEntry *left = NULL, *right = NULL;
+  int n_left = 0, n_right = 0, i = 0, j = 0, k = 0;
+  if(node->left_child){
+    left = rtree->entries + RANGE_NODE(rtree, node->left_child)->list;
+    n_left = RANGE_NODE(rtree, node->left_child)->count;
+  }
+  if(node->right_child){
+    right = rtree->entries + RANGE_NODE(rtree, node->right_child)->list;
+    n_right = RANGE_NODE(rtree, node->right_child)->count;
+  }
+  const RangePoint *own = rtree->points + range->first;
+
+  range->list = rtree->number_of_entries;
+  range->count = n_left + n_right + range->here;
+  RangeEntry *out = rtree->entries + range->list;
+  for(int n = 0; n < range->count; n++){
+    // Take the smallest y of the three heads.
+    int from = -1, y = 0;
+    if(i < n_left){
+      from = 0;
+      y = left[i].y;
+    }
+    if(j < n_right && (from < 0 || right[j].y < y)){
+      from = 1;
+      y = right[j].y;
+    }
+    if(k < range->here && (from < 0 || own[k].y < y)) from = 2;
+
+    if(from == 0){
+      out[n] = left[i++];
+    }else if(from == 1){
+      out[n] = right[j++];
+    }else{
+      out[n].y = own[k].y;
+      out[n].index = range->first + k++;
+    }
+  }
+  rtree->number_of_entries += range->count;
+  return node;
+}
+
+/*
+ * Function: make_range_tree
+ * -------------------------
+ * Description:
+ * Build a range tree over an array of points, which is
+ * copied. Points may share coordinates. O(n log n) time and
+ * space: every point is listed once per level of the tree.
+ *
+ * Arguments: points - The points.
+ *            n      - The number of points.
+ *
+ * Returns: Pointer to the newly created range tree, NULL if
+ *          memory allocation failed.
+ */
+RangeTree * make_range_tree(const RangePoint *points, int n){
+  // Check arguments.
+  assert(n >= 0 && (points != NULL || n == 0));
+
+  // Allocate memory.
+  RangeTree *rtree = (RangeTree *)malloc(sizeof(RangeTree));
+  int *starts = (int *)malloc((n + 1) * sizeof(int));
+  if(rtree == NULL || starts == NULL){
+    free(rtree);
+    free(starts);
+    return NULL;
+  }
+  rtree->tree = make_tree_empty();
+  rtree->points = (RangePoint *)malloc((n ? n : 1) * sizeof(RangePoint));
+  rtree->entries = NULL;
+  if(rtree->tree == NULL || rtree->points == NULL){
+    if(rtree->tree) free_tree(rtree->tree);
+    free(rtree->points);
+    free(rtree);
+    free(starts);
+    return NULL;
+  }
+  rtree->offset = avl_reserve_node_ext(rtree->tree, sizeof(RangeNode));
+  rtree->number_of_points = n;
+  rtree->number_of_entries = 0;
+
+  // Sort the points and group them by x.
+  if(n) memcpy(rtree->points, points, n * sizeof(RangePoint));
+  qsort(rtree->points, n, sizeof(RangePoint), compare_points);
+  int m = 0;
+  for(int i = 0; i < n; i++){
+    if(i == 0 || rtree->points[i].x != rtree->points[i - 1].x) starts[m++] = i;
+  }
+  starts[m] = n;
+
+  // Every point is listed once on each level above it.
+  int levels = 0;
+  for(int size = m; size > 0; size >>= 1) levels++;
+  rtree->entries = (RangeEntry *)malloc(((long)n * levels + 1)
+					* sizeof(RangeEntry));
+  int built = (rtree->entries != NULL);
+
+  if(built && m > 0){
+    Node *slots = avl_alloc_nodes(rtree->tree, m);
+    built = (slots != NULL);
+    if(built){
+      Node *root = build_subtree(rtree, slots, starts, 0, m, NULL);
+      built = (avl_adopt_nodes(rtree->tree, root, m) == 1);
+    }
+  }
+  free(starts);
+  if(!built){
+    free_range_tree(rtree);
+    return NULL;
+  }
+  return rtree;
+}
+
+/*
+ * Function: free_range_tree
+ * -------------------------
+ * Description:
+ * Free a range tree with all its points. Data attached to the
+ * points is not freed.
+ *
+ * Arguments: rtree - The range tree to free.
+ *
+ * Returns: void
+ */
+void free_range_tree(RangeTree *rtree){
+  // Check arguments.
+  assert(rtree != NULL);
+
+  free_tree(rtree->tree);
+  free(rtree->points);
+  free(rtree->entries);
+  free(rtree);
+}
+
+/*
+ * Function: query_points
+ * ----------------------
+ * Description:
+ * Internal helper. Count or report the points of a node,
+ * all with x in the query, whose y is in the query.
+ *
+ * Arguments: rtree - The range tree.
+ *            node  - The node.
+ *            query - The query state.
+ *
+ * Returns: void
+ */
+static void query_points(RangeTree *rtree, Node *node, RangeQuery *query){
+  const RangeNode *range = RANGE_NODE(rtree, node);
+  const RangePoint *own = rtree->points + range->first;
+
+  // Binary search for the first point at or above y_lo.
+  int lo = 0, hi = range->here;
+  while(lo < hi){
+    int mid = lo + (hi - lo) / 2;
+    if(own[mid].y < query->y_lo) lo = mid + 1;
+    else hi = mid;
+  }
+
+  for(; lo < range->here && own[lo].y <= query->y_hi; lo++){
+    query->count++;
+    if(query->report && query->report(&own[lo], query->ctx)){
+      query->stop = 1;
+      return;
+    }
+  }
+}
+
+/*
+ * Function: query_subtree
+ * -----------------------
+ * Description:
+ * Internal helper. Count or report the points of a subtree,
+ * all with x in the query, whose y is in the query: two
+ * binary searches in its y-sorted list when counting.
+ *
+ * Arguments: rtree - The range tree.
+ *            node  - The root of the subtree, may be NULL.
+ *            query - The query state.
+ *
+ * Returns: void
+ */
+static void query_subtree(RangeTree *rtree, Node *node, RangeQuery *query){
+  if(node == NULL || query->stop) return;
+  const RangeNode *range = RANGE_NODE(rtree, node);
+  const RangeEntry *list = rtree->entries + range->list;
+
+  // Binary search for the first entry at or above y_lo.
+  int lo = 0, hi = range->count;
+  while(lo < hi){
+    int mid = lo + (hi - lo) / 2;
+    if(list[mid].y < query->y_lo) lo = mid + 1;
+    else hi = mid;
+  }
+
+  if(query->report == NULL){
+    // And for the first entry above y_hi.
+    int end = lo;
+    hi = range->count;
+    while(end < hi){
+      int mid = end + (hi - end) / 2;
+      if(list[mid].y <= query->y_hi) end = mid + 1;
+      else hi = mid;
+    }
+    query->count += end - lo;
+    return;
+  }
+
+  for(; lo < range->count && list[lo].y <= query->y_hi; lo++){
+    query->count++;
+    if(query->report(&rtree->points[list[lo].index], query->ctx)){
+      query->stop = 1;
+      return;
+    }
+  }
+}
+
+/*
+ * Function: query_range
+ * ---------------------
+ * Description:
+ * Internal helper. Split the x range of a query in to nodes
+ * and whole subtrees: descend to the first node within the x
+ * range, then along the paths to x_lo and x_hi, taking the
+ * subtrees hanging inside of them.
+ *
+ * Arguments: rtree - The range tree.
+ *            x_lo  - Smallest x of the query.
+ *            x_hi  - Largest x of the query.
+ *            query - The query state.
+ *
+ * Returns: void
+ */
+static void query_range(RangeTree *rtree, int x_lo, int x_hi,
+			RangeQuery *query){
+  // The node where the paths to x_lo and x_hi part.
+  Node *split = rtree->tree->root;
+  while(split && (split->key < x_lo || split->key > x_hi)){
+    split = (split->key < x_lo) ? split->right_child : split->left_child;
+  }
+  if(split == NULL) return;
+  query_points(rtree, split, query);
+
+  // Towards x_lo: right of the path is inside the range.
+  for(Node *node = split->left_child; node && !query->stop; ){
+    if(node->key >= x_lo){
+      query_points(rtree, node, query);
+      query_subtree(rtree, node->right_child, query);
+      node = node->left_child;
+    }else{
+      node = node->right_child;
+    }
+  }
+
+  // Towards x_hi: left of the path is inside the range.
+  for(Node *node = split->right_child; node && !query->stop; ){
+    if(node->key <= x_hi){
+      query_points(rtree, node, query);
+      query_subtree(rtree, node->left_child, query);
+      node = node->right_child;
+    }else{
+      node = node->left_child;
+    }
+  }
+}
+
+/*
+ * Function: range_count
+ * ---------------------
+ * Description:
+ * Count the points with x in [x_lo, x_hi] and y in [y_lo,
+ * y_hi], without visiting them. O(log^2 n).
+ *
+ * Arguments: rtree - The range tree to query.
+ *            x_lo  - Smallest x of the query (inclusive).
+ *            x_hi  - Largest x of the query (inclusive).
+ *            y_lo  - Smallest y of the query (inclusive).
+ *            y_hi  - Largest y of the query (inclusive).
+ *
+ * Returns: The number of points in the query rectangle.
+ */
+int range_count(RangeTree *rtree, int x_lo, int x_hi, int y_lo, int y_hi){
+  // Check arguments.
+  assert(rtree != NULL);
+
+  // An empty rectangle holds nothing.
+  if(x_hi < x_lo || y_hi < y_lo) return 0;
+
+  RangeQuery query = {y_lo, y_hi, NULL, NULL, 0, 0};
+  query_range(rtree, x_lo, x_hi, &query);
+  return query.count;
+}
+
+/*
+ * Function: range_report
+ * ----------------------
+ * Description:
+ * Report the points with x in [x_lo, x_hi] and y in [y_lo,
+ * y_hi]. Points of the same subtree are reported by ascending
+ * y, the subtrees in no particular order. O(log^2 n + k) for
+ * k reported points.
+ *
+ * Arguments: rtree  - The range tree to query.
+ *            x_lo   - Smallest x of the query (inclusive).
+ *            x_hi   - Largest x of the query (inclusive).
+ *            y_lo   - Smallest y of the query (inclusive).
+ *            y_hi   - Largest y of the query (inclusive).
+ *            report - Called for every point found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of points reported.
+ */
+int range_report(RangeTree *rtree, int x_lo, int x_hi, int y_lo, int y_hi,
+		 range_report_fn report, void *ctx){
+  // Check arguments.
+  assert(rtree != NULL);
+
+  // An empty rectangle holds nothing.
+  if(x_hi < x_lo || y_hi < y_lo) return 0;
+
+  RangeQuery query = {y_lo, y_hi, report, ctx, 0, 0};
+  query_range(rtree, x_lo, x_hi, &query);
+  return query.count;
+}
@@ -0,0 +1,183 @@
+/* Basic AVL-Tree implementation - 2-D range tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the 2-D range tree module of the AVL-Tree implementation.
+ * It answers orthogonal range queries over a fixed set of points:
+ * the points with x in [x_lo, x_hi] and y in [y_lo, y_hi]. The
+ * points are indexed by an AVL-Tree keyed by x, one node per
+ * distinct x, in which every node carries the points of its
+ * subtree sorted by y. A query splits the x range in to O(log n)
+ * such subtrees and searches each of them on y.
+ * This module provides:
+ *     - Bulk construction from a point array in O(n log n).
+ *     - Range counting in O(log^2 n).
+ *     - Range reporting in O(log^2 n + k).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_RANGE_H_
+#define __AVL_RANGE_H_
+
+#include "avl_core.h"
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: range_point_s
+ * ------------------------
+ * Description:
+ * A point stored in a range tree.
+ *
+ * Fields: x - The first coordinate, the key of the primary tree.
+ *         y - The second coordinate.
+ *         data - Pointer to the data attached to the point.
+ */
+typedef struct range_point_s {
+  int x, y;
+  void *data;
+} RangePoint;
+
+/*
+ * Structure: range_entry_s
+ * ------------------------
+ * Description:
+ * An entry of the y-sorted point list of a subtree.
+ *
+ * Fields: y - The y coordinate of the point.
+ *         index - Position of the point in the x-sorted points.
+ */
+typedef struct range_entry_s {
+  int y, index;
+} RangeEntry;
+
+/*
+ * Structure: range_tree_s
+ * -----------------------
+ * Description:
+ * A static 2-D range tree. The nodes of the underlying
+ * AVL-Tree are keyed by x. Every node refers to its own points
+ * (all with its x) in the x-sorted point array, and to the
+ * y-sorted list of all points in its subtree.
+ *
+ * Fields: tree - The underlying AVL-Tree, keyed by x.
+ *         points - The points, sorted by x, then y.
+ *         entries - The y-sorted lists of all subtrees.
+ *         number_of_points - Number of points stored.
+ *         number_of_entries - Total length of the lists.
+ *         offset - Offset of the per-node list in the node
+ *                  extension area.
+ */
+typedef struct range_tree_s {
+  AvlTree *tree;
+  RangePoint *points;
+  RangeEntry *entries;
+  int number_of_points;
+  long number_of_entries;
+  size_t offset;
+} RangeTree;
+
+/*
+ * Type: range_report_fn
+ * ---------------------
+ * Description:
+ * Callback receiving the points found by a range query.
+ * Returning nonzero stops the query.
+ */
+typedef int (*range_report_fn)(const RangePoint *point, void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: make_range_tree
+ * -------------------------
+ * Description:
+ * Build a range tree over an array of points, which is
+ * copied. Points may share coordinates. O(n log n) time and
+ * space: every point is listed once per level of the tree.
+ *
+ * Arguments: points - The points.
+ *            n      - The number of points.
+ *
+ * Returns: Pointer to the newly created range tree, NULL if
+ *          memory allocation failed.
+ */
+extern RangeTree * make_range_tree(const RangePoint *points, int n);
+
+/*
+ * Function: free_range_tree
+ * -------------------------
+ * Description:
+ * Free a range tree with all its points. Data attached to the
+ * points is not freed.
+ *
+ * Arguments: rtree - The range tree to free.
+ *
+ * Returns: void
+ */
+extern void free_range_tree(RangeTree *rtree);
+
+/*
+ * Function: range_count
+ * ---------------------
+ * Description:
+ * Count the points with x in [x_lo, x_hi] and y in [y_lo,
+ * y_hi], without visiting them. O(log^2 n).
+ *
+ * Arguments: rtree - The range tree to query.
+ *            x_lo  - Smallest x of the query (inclusive).
+ *            x_hi  - Largest x of the query (inclusive).
+ *            y_lo  - Smallest y of the query (inclusive).
+ *            y_hi  - Largest y of the query (inclusive).
+ *
+ * Returns: The number of points in the query rectangle.
+ */
+extern int range_count(RangeTree *rtree, int x_lo, int x_hi, int y_lo,
+		       int y_hi);
+
+/*
+ * Function: range_report
+ * ----------------------
+ * Description:
+ * Report the points with x in [x_lo, x_hi] and y in [y_lo,
+ * y_hi]. Points of the same subtree are reported by ascending
+ * y, the subtrees in no particular order. O(log^2 n + k) for
+ * k reported points.
+ *
+ * Arguments: rtree  - The range tree to query.
+ *            x_lo   - Smallest x of the query (inclusive).
+ *            x_hi   - Largest x of the query (inclusive).
+ *            y_lo   - Smallest y of the query (inclusive).
+ *            y_hi   - Largest y of the query (inclusive).
+ *            report - Called for every point found, may be NULL.
+ *            ctx    - Passed to report.
+ *
+ * Returns: The number of points reported.
+ */
+extern int range_report(RangeTree *rtree, int x_lo, int x_hi, int y_lo,
+			int y_hi, range_report_fn report, void *ctx);
+
+#endif /* __AVL_RANGE_H_ */
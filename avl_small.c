@@ -0,0 +1,346 @@
+/* Basic AVL-Tree implementation - Small tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the small tree module of the AVL-Tree implementation.
+ * A small tree keeps up to SMALL_TREE_CAPACITY keys in a sorted
+ * inline array, without any node allocations. When it grows past
+ * the capacity it is promoted to an AVL-Tree, and once it shrinks
+ * to SMALL_TREE_DEMOTE keys it is demoted back to the array. The
+ * gap between the two thresholds keeps a tree hovering around the
+ * capacity from converting on every operation.
+ * This module provides:
+ *     - Insertion, search and deletion by order-key.
+ *     - In-order iteration.
+ *     - Small trees embedded in other structures (small_tree_init).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#include "avl_small.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Function: lower_bound
+ * ---------------------
+ * Description:
+ * Internal helper. Position of the first inline key not
+ * smaller than key. The loop has no data dependent branches,
+ * so the compiler can vectorize it.
+ *
+ * Arguments: stree - The small tree, in array form.
+ *            key   - The key to locate.
+ *
+ * Returns: The position, between 0 and number_of_keys.
+ */
+static inline int lower_bound(SmallTree *stree, int key){
+  int pos = 0;
+  for(int i = 0; i < stree->number_of_keys; i++){
+    pos += (stree->keys[i] < key);
+  }
+  return pos;
+}
+
+/*
+ * Function: promote
+ * -----------------
+ * Description:
+ * Internal helper. Move the inline keys of a full small tree
+ * in to a new AVL-Tree. The keys are sorted, so every hinted
+ * insertion lands next to the previous one. If memory runs
+ * out, the small tree is left as it was.
+ *
+ * Arguments: stree - The small tree to promote.
+ *
+ * Returns: 1 - The small tree was promoted.
+ *          0 - Memory allocation failed.
+ */
+static int promote(SmallTree *stree){
+  AvlTree *tree = make_tree_empty();
+  if(tree == NULL) return 0;
+  for(int i = 0; i < stree->number_of_keys; i++){
+    if(avl_insert_hint(tree, stree->keys[i], NULL) != 1){
+      free_tree(tree);
+      return 0;
+    }
+    tree->finger->data = stree->data[i];
+  }
+  stree->tree = tree;
+  return 1;
+}
+
+/*
+ * Function: demote
+ * ----------------
+ * Description:
+ * Internal helper. Move the keys of a promoted small tree
+ * back in to the inline array and free the AVL-Tree.
+ *
+ * Arguments: stree - The small tree to demote.
+ *
+ * Returns: void
+ */
+static void demote(SmallTree *stree){
+  AvlTree *tree = stree->tree;
+  assert(tree->number_of_nodes <= SMALL_TREE_CAPACITY);
+
+  int i = 0;
+  for(Node *node = avl_min(tree); node != NULL; node = avl_next(node)){
+    stree->keys[i] = node->key;
+    stree->data[i] = node->data;
+    i++;
+  }
+  free_tree(tree);
+  stree->tree = NULL;
+}
+
+/*
+ * Function: make_small_tree
+ * -------------------------
+ * Description:
+ * Create and allocate a new, empty small tree.
+ *
+ * Arguments: none
+ *
+ * Returns: Pointer to the newly created small tree.
+ */
+SmallTree * make_small_tree(){
+  // Allocate memory.
+  SmallTree *stree = (SmallTree *)malloc(sizeof(SmallTree));
+  if(stree == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating a small tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+
+  small_tree_init(stree);
+  return stree;
+}
+
+/*
+ * Function: small_tree_init
+ * -------------------------
+ * Description:
+ * Initialize a small tree in caller provided memory, for
+ * example embedded in another structure. Release it with
+ * small_tree_clear.
+ *
+ * Arguments: stree - The small tree to initialize.
+ *
+ * Returns: void
+ */
+void small_tree_init(SmallTree *stree){
+  // Check arguments.
+  assert(stree != NULL);
+
+  stree->number_of_keys = 0;
+  stree->tree = NULL;
+}
+
+/*
+ * Function: small_tree_clear
+ * --------------------------
+ * Description:
+ * Remove all keys from a small tree, freeing the AVL-Tree if
+ * it was promoted. Data attached to the keys is not freed.
+ *
+ * Arguments: stree - The small tree to clear.
+ *
+ * Returns: void
+ */
+void small_tree_clear(SmallTree *stree){
+  // Check arguments.
+  assert(stree != NULL);
+
+  if(stree->tree) free_tree(stree->tree);
+  small_tree_init(stree);
+}
+
+/*
+ * Function: free_small_tree
+ * -------------------------
+ * Description:
+ * Free a small tree created by make_small_tree. Data
+ * attached to the keys is not freed.
+ *
+ * Arguments: stree - The small tree to free.
+ *
+ * Returns: void
+ */
+void free_small_tree(SmallTree *stree){
+  // Check arguments.
+  assert(stree != NULL);
+
+  small_tree_clear(stree);
+  free(stree);
+}
+
+/*
+ * Function: small_search
+ * ----------------------
+ * Description:
+ * Search a key. In array form this is a branch free scan of
+ * the inline keys, otherwise a descent of the AVL-Tree.
+ *
+ * Arguments: stree - The small tree to search.
+ *            key   - The key to search.
+ *            data  - Set to the data attached to the key, if
+ *                    found. May be NULL.
+ *
+ * Returns: 1 - The key was found.
+ *          0 - The key was not found.
+ */
+int small_search(SmallTree *stree, int key, void **data){
+  // Check arguments.
+  assert(stree != NULL);
+
+  if(stree->tree){
+    Node *node = NULL;
+    if(!search_by_key(key, stree->tree, &node)) return 0;
+    if(data) *data = node->data;
+    return 1;
+  }
+
+  int pos = lower_bound(stree, key);
+  if(pos == stree->number_of_keys || stree->keys[pos] != key) return 0;
+  if(data) *data = stree->data[pos];
+  return 1;
+}
+
+/*
+ * Function: small_insert
+ * ----------------------
+ * Description:
+ * Insert a key with attached data. Promotes the small tree
+ * to an AVL-Tree when the array is full.
+ *
+ * Arguments: stree - The small tree to insert into.
+ *            key   - The key to insert.
+ *            data  - The data to attach to the key.
+ *
+ * Returns: 1 - On successful insertion.
+ *          0 - If the key was already present.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+int small_insert(SmallTree *stree, int key, void *data){
+  // Check arguments.
+  assert(stree != NULL);
+
+  if(stree->tree == NULL){
+    int pos = lower_bound(stree, key);
+    if(pos < stree->number_of_keys && stree->keys[pos] == key) return 0;
+
+    if(stree->number_of_keys < SMALL_TREE_CAPACITY){
+      // Shift the larger keys up by one and insert in place.
+      int tail = stree->number_of_keys - pos;
+      memmove(&stree->keys[pos + 1], &stree->keys[pos], tail * sizeof(int));
+      memmove(&stree->data[pos + 1], &stree->data[pos],
+	      tail * sizeof(void *));
+      stree->keys[pos] = key;
+      stree->data[pos] = data;
+      stree->number_of_keys++;
+      return 1;
+    }
+
+    // The array is full, continue as an AVL-Tree.
+    if(!promote(stree)) return AVL_ERROR_NO_MEMORY;
+  }
+
+  int inserted = key_insert_new(key, stree->tree);
+  if(inserted != 1) return inserted;
+  stree->tree->finger->data = data;
+  stree->number_of_keys++;
+  return 1;
+}
+
+/*
+ * Function: small_delete
+ * ----------------------
+ * Description:
+ * Delete a key. Demotes a promoted small tree back to the
+ * array once it holds SMALL_TREE_DEMOTE keys.
+ *
+ * Arguments: stree - The small tree to delete from.
+ *            key   - The key to delete.
+ *            data  - Set to the data that was attached to the
+ *                    key, if found. May be NULL.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - The key was not found.
+ */
+int small_delete(SmallTree *stree, int key, void **data){
+  // Check arguments.
+  assert(stree != NULL);
+
+  if(stree->tree){
+    Node *node = NULL;
+    if(!search_by_key(key, stree->tree, &node)) return 0;
+    if(data) *data = node->data;
+    avl_delete_node(stree->tree, node);
+    stree->number_of_keys--;
+    if(stree->number_of_keys <= SMALL_TREE_DEMOTE) demote(stree);
+    return 1;
+  }
+
+  int pos = lower_bound(stree, key);
+  if(pos == stree->number_of_keys || stree->keys[pos] != key) return 0;
+  if(data) *data = stree->data[pos];
+
+  // Shift the larger keys down over the deleted one.
+  int tail = stree->number_of_keys - pos - 1;
+  memmove(&stree->keys[pos], &stree->keys[pos + 1], tail * sizeof(int));
+  memmove(&stree->data[pos], &stree->data[pos + 1], tail * sizeof(void *));
+  stree->number_of_keys--;
+  return 1;
+}
+
+/*
+ * Function: small_for_each
+ * ------------------------
+ * Description:
+ * Visit all keys of a small tree in ascending order. The
+ * small tree must not be modified during the iteration.
+ *
+ * Arguments: stree - The small tree to iterate.
+ *            visit - Called for every key.
+ *            ctx   - Passed to visit.
+ *
+ * Returns: The number of keys visited.
+ */
+int small_for_each(SmallTree *stree, small_visit_fn visit, void *ctx){
+  // Check arguments.
+  assert(stree != NULL && visit != NULL);
+
+  int count = 0;
+  if(stree->tree){
+    for(Node *node = avl_min(stree->tree); node; node = avl_next(node)){
+      count++;
+      if(visit(node->key, node->data, ctx)) break;
+    }
+  }else{
+    for(int i = 0; i < stree->number_of_keys; i++){
+      count++;
+      if(visit(stree->keys[i], stree->data[i], ctx)) break;
+    }
+  }
+  return count;
+}
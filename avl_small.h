@@ -0,0 +1,201 @@
+/* Basic AVL-Tree implementation - Small tree module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the small tree module of the AVL-Tree implementation.
+ * A small tree keeps up to SMALL_TREE_CAPACITY keys in a sorted
+ * inline array, without any node allocations. When it grows past
+ * the capacity it is promoted to an AVL-Tree, and once it shrinks
+ * to SMALL_TREE_DEMOTE keys it is demoted back to the array. The
+ * gap between the two thresholds keeps a tree hovering around the
+ * capacity from converting on every operation.
+ * This module provides:
+ *     - Insertion, search and deletion by order-key.
+ *     - In-order iteration.
+ *     - Small trees embedded in other structures (small_tree_init).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_SMALL_H_
+#define __AVL_SMALL_H_
+
+#include "avl_core.h"
+
+#define SMALL_TREE_CAPACITY 16 // Keys held inline before promotion.
+#define SMALL_TREE_DEMOTE 8    // Size at which a promoted tree demotes.
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: small_tree_s
+ * -----------------------
+ * Description:
+ * A hybrid of a sorted array and an AVL-Tree. While tree is
+ * NULL the keys live in the inline arrays, sorted ascending;
+ * afterwards the arrays are unused.
+ *
+ * Fields: number_of_keys - Number of keys stored.
+ *         tree - The AVL-Tree, once promoted, or NULL.
+ *         keys - The inline keys, sorted ascending.
+ *         data - The data attached to the inline keys.
+ */
+typedef struct small_tree_s {
+  int number_of_keys;
+  AvlTree *tree;
+  int keys[SMALL_TREE_CAPACITY];
+  void *data[SMALL_TREE_CAPACITY];
+} SmallTree;
+
+/*
+ * Type: small_visit_fn
+ * --------------------
+ * Description:
+ * Callback receiving the keys of a small tree in order.
+ * Returning nonzero stops the iteration.
+ */
+typedef int (*small_visit_fn)(int key, void *data, void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: make_small_tree
+ * -------------------------
+ * Description:
+ * Create and allocate a new, empty small tree.
+ *
+ * Arguments: none
+ *
+ * Returns: Pointer to the newly created small tree.
+ */
+extern SmallTree * make_small_tree();
+
+/*
+ * Function: small_tree_init
+ * -------------------------
+ * Description:
+ * Initialize a small tree in caller provided memory, for
+ * example embedded in another structure. Release it with
+ * small_tree_clear.
+ *
+ * Arguments: stree - The small tree to initialize.
+ *
+ * Returns: void
+ */
+extern void small_tree_init(SmallTree *stree);
+
+/*
+ * Function: small_tree_clear
+ * --------------------------
+ * Description:
+ * Remove all keys from a small tree, freeing the AVL-Tree if
+ * it was promoted. Data attached to the keys is not freed.
+ *
+ * Arguments: stree - The small tree to clear.
+ *
+ * Returns: void
+ */
+extern void small_tree_clear(SmallTree *stree);
+
+/*
+ * Function: free_small_tree
+ * -------------------------
+ * Description:
+ * Free a small tree created by make_small_tree. Data
+ * attached to the keys is not freed.
+ *
+ * Arguments: stree - The small tree to free.
+ *
+ * Returns: void
+ */
+extern void free_small_tree(SmallTree *stree);
+
+/*
+ * Function: small_search
+ * ----------------------
+ * Description:
+ * Search a key. In array form this is a branch free scan of
+ * the inline keys, otherwise a descent of the AVL-Tree.
+ *
+ * Arguments: stree - The small tree to search.
+ *            key   - The key to search.
+ *            data  - Set to the data attached to the key, if
+ *                    found. May be NULL.
+ *
+ * Returns: 1 - The key was found.
+ *          0 - The key was not found.
+ */
+extern int small_search(SmallTree *stree, int key, void **data);
+
+/*
+ * Function: small_insert
+ * ----------------------
+ * Description:
+ * Insert a key with attached data. Promotes the small tree
+ * to an AVL-Tree when the array is full.
+ *
+ * Arguments: stree - The small tree to insert into.
+ *            key   - The key to insert.
+ *            data  - The data to attach to the key.
+ *
+ * Returns: 1 - On successful insertion.
+ *          0 - If the key was already present.
+ *          AVL_ERROR_NO_MEMORY - If memory ran out.
+ */
+extern int small_insert(SmallTree *stree, int key, void *data);
+
+/*
+ * Function: small_delete
+ * ----------------------
+ * Description:
+ * Delete a key. Demotes a promoted small tree back to the
+ * array once it holds SMALL_TREE_DEMOTE keys.
+ *
+ * Arguments: stree - The small tree to delete from.
+ *            key   - The key to delete.
+ *            data  - Set to the data that was attached to the
+ *                    key, if found. May be NULL.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - The key was not found.
+ */
+extern int small_delete(SmallTree *stree, int key, void **data);
+
+/*
+ * Function: small_for_each
+ * ------------------------
+ * Description:
+ * Visit all keys of a small tree in ascending order. The
+ * small tree must not be modified during the iteration.
+ *
+ * Arguments: stree - The small tree to iterate.
+ *            visit - Called for every key.
+ *            ctx   - Passed to visit.
+ *
+ * Returns: The number of keys visited.
+ */
+extern int small_for_each(SmallTree *stree, small_visit_fn visit, void *ctx);
+
+#endif /* __AVL_SMALL_H_ */
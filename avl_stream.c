@@ -0,0 +1,371 @@
+/* Basic AVL-Tree implementation - Stream loading module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the stream loading module of the AVL-Tree implementation.
+ * It builds a balanced tree from a sorted key file of any size in
+ * one sequential pass over the file. The keys go straight from a
+ * fixed size read buffer in to the nodes, which are chained in key
+ * order while reading and linked in to a balanced tree at the end,
+ * so no key array is ever materialized: peak memory is the tree
+ * plus one buffer of AVL_STREAM_BUFFER bytes.
+ * This module provides:
+ *     - Loading of binary (native 32 bit integers) and text
+ *       (whitespace separated decimal integers) key files, from a
+ *       path or an open file descriptor (pipes included).
+ *     - Progress reporting through a callback.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_stream.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#define STREAM_MIN_BLOCK 4096 // Smallest node block of a discovered count.
+#define STREAM_GROWTH 8 // Blocks grow by an eighth of the tree.
+
+/*
+ * Structure: stream_load_s
+ * ------------------------
+ * Description:
+ * The state of a load. The loaded nodes form a list in key
+ * order, linked through their right children.
+ *
+ * Fields: tree - The tree being loaded.
+ *         head - First node of the list.
+ *         tail - Last node of the list.
+ *         slots - The node block being filled.
+ *         used - Slots of the block taken.
+ *         size - Slots of the block.
+ *         count - Number of nodes loaded.
+ *         expected - Expected number of keys, 0 if unknown.
+ */
+typedef struct stream_load_s {
+  AvlTree *tree;
+  Node *head, *tail;
+  Node *slots;
+  int used, size;
+  int count, expected;
+} StreamLoad;
+
+/*
+ * Structure: text_state_s
+ * -----------------------
+ * Description:
+ * The state of the text parser, carried across buffers so
+ * that a number may span two of them.
+ *
+ * Fields: digits - Digits of the current number, 0 between
+ *                  numbers.
+ *         sign - Whether the current number has a sign.
+ *         negative - Whether the current number is negative.
+ *         value - Absolute value of the current number.
+ */
+typedef struct text_state_s {
+  int digits, sign, negative;
+  long long value;
+} TextState;
+
+/*
+ * Function: append_key
+ * --------------------
+ * Description:
+ * Internal helper. Append the next key to the list of loaded
+ * nodes, taking a new node block when the current one is
+ * full. Repeated keys are skipped.
+ *
+ * Arguments: load - The load state.
+ *            key  - The key.
+ *
+ * Returns: 0 - On success.
+ *          AVL_STREAM_ERROR_ORDER - The key is smaller than
+ *          the previous one.
+ *          AVL_STREAM_ERROR_NO_MEMORY - No block could be taken.
+ */
+static inline int append_key(StreamLoad *load, int key){
+  if(load->tail != NULL && key <= load->tail->key){
+    return (key == load->tail->key) ? 0 : AVL_STREAM_ERROR_ORDER;
+  }
+
+  if(load->used == load->size){
+    int size = load->expected - load->count;
+    if(size <= 0){
+      size = load->count / STREAM_GROWTH;
+      if(size < STREAM_MIN_BLOCK) size = STREAM_MIN_BLOCK;
+    }
+    Node *slots = avl_alloc_nodes(load->tree, size);
+    if(slots == NULL) return AVL_STREAM_ERROR_NO_MEMORY;
+    load->slots = slots;
+    load->used = 0;
+    load->size = size;
+  }
+
+  Node *node = AVL_NODE_SLOT(load->tree, load->slots, load->used);
+  load->used++;
+  avl_init_node(load->tree, node, key);
+  if(load->tail) load->tail->right_child = node;
+  else load->head = node;
+  load->tail = node;
+  load->count++;
+  return 0;
+}
+
+/*
+ * Function: parse_binary
+ * ----------------------
+ * Description:
+ * Internal helper. Load the whole keys of a buffer of binary
+ * input.
+ *
+ * Arguments: load - The load state.
+ *            buf  - The input.
+ *            n    - Bytes of input.
+ *
+ * Returns: The number of bytes used, or a negative error code.
+ */
+static int parse_binary(StreamLoad *load, const char *buf, size_t n){
+  size_t whole = n - n % sizeof(int);
+  for(size_t i = 0; i < whole; i += sizeof(int)){
+    int key;
+    memcpy(&key, buf + i, sizeof(int));
+    int error = append_key(load, key);
+    if(error) return error;
+  }
+  return (int)whole;
+}
+
+/*
+ * Function: parse_text
+ * --------------------
+ * Description:
+ * Internal helper. Load the numbers of a buffer of text
+ * input. A number at the end of the buffer is kept in the
+ * parser state until a separator (or end_of_input) follows.
+ *
+ * Arguments: load         - The load state.
+ *            state        - The parser state.
+ *            buf          - The input.
+ *            n            - Bytes of input.
+ *            end_of_input - Whether this is the end of the file.
+ *
+ * Returns: 0 on success, or a negative error code.
+ */
+static int parse_text(StreamLoad *load, TextState *state, const char *buf,
+		      size_t n, int end_of_input){
+  for(size_t i = 0; i <= n; i++){
+    char c = (i < n) ? buf[i] : ' ';
+    if(i == n && !end_of_input) break;
+
+    if(c >= '0' && c <= '9'){
+      state->value = state->value * 10 + (c - '0');
+      state->digits++;
+      if(state->value > (long long)INT_MAX + 1){
+	return AVL_STREAM_ERROR_FORMAT;
+      }
+    } else if((c == '-' || c == '+') && !state->digits && !state->sign){
+      state->sign = 1;
+      state->negative = (c == '-');
+    } else if(c == ' ' || c == '\n' || c == '\t' || c == '\r'){
+      if(state->sign && !state->digits) return AVL_STREAM_ERROR_FORMAT;
+      if(!state->digits) continue;
+
+      long long key = state->negative ? -state->value : state->value;
+      if(key > INT_MAX) return AVL_STREAM_ERROR_FORMAT;
+      int error = append_key(load, (int)key);
+      if(error) return error;
+      state->digits = state->sign = state->negative = 0;
+      state->value = 0;
+    } else {
+      return AVL_STREAM_ERROR_FORMAT;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Function: link_list
+ * -------------------
+ * Description:
+ * Internal helper. Link the next n nodes of the list in to
+ * a balanced subtree, in place. The middle node becomes the
+ * root, so the subtree has the height of a complete one.
+ *
+ * Arguments: list - The list, advanced past the n nodes.
+ *            n    - The number of nodes.
+ *
+ * Returns: Root of the subtree.
+ */
+static Node * link_list(Node **list, int n){
+  if(n == 0) return NULL;
+
+  Node *left = link_list(list, n / 2);
+  Node *node = *list;
+  *list = node->right_child;
+  Node *right = link_list(list, n - 1 - n / 2);
+
+  node->left_child = left;
+  node->right_child = right;
+  if(left) left->parent = node;
+  if(right) right->parent = node;
+  node->height = -1;
+  for(int m = n; m > 0; m >>= 1) node->height++;
+  return node;
+}
+
+/*
+ * Function: avl_load_sorted_fd
+ * ----------------------------
+ * Description:
+ * Load the sorted keys read from a file descriptor in to an
+ * empty tree, until the end of the file. Repeated keys are
+ * loaded once. The node count is taken from count, or from
+ * the file size for a binary regular file, and discovered
+ * while reading otherwise: the nodes are then allocated in
+ * blocks growing with the tree, of which at most an eighth
+ * of the tree's size stays unused. Node data, inline values
+ * and augmentation values start out zeroed. On an error the
+ * tree holds the keys before the error, unless memory ran out
+ * while linking them up, which leaves it empty.
+ *
+ * Arguments: tree     - The empty tree to load in to.
+ *            fd       - The file descriptor, read from its
+ *                       current position. Not closed.
+ *            format   - The encoding of the keys.
+ *            count    - The expected number of keys, 0 if not
+ *                       known. A wrong count costs memory or
+ *                       extra blocks, but is not an error.
+ *            progress - Progress callback. May be NULL.
+ *            ctx      - Passed to progress.
+ *
+ * Returns: The number of keys loaded, or one of the negative
+ *          AVL_STREAM_* error codes.
+ */
+int avl_load_sorted_fd(AvlTree *tree, int fd, AvlKeyFormat format,
+		       int count, avl_progress_fn progress, void *ctx){
+  // Check arguments.
+  assert(tree != NULL && fd >= 0 && count >= 0);
+
+  if(tree->root != NULL) return AVL_STREAM_NOT_EMPTY;
+
+  // The size of a regular file bounds the progress and the count.
+  long long total = -1;
+  struct stat st;
+  if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    total = (long long)st.st_size - (position > 0 ? position : 0);
+    if(format == AVL_KEYS_BINARY && count == 0
+       && total / (long long)sizeof(int) <= INT_MAX){
+      count = (int)(total / (long long)sizeof(int));
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+
+  char *buf = (char *)malloc(AVL_STREAM_BUFFER);
+  if(buf == NULL) return AVL_STREAM_ERROR_NO_MEMORY;
+
+  StreamLoad load = {tree, NULL, NULL, NULL, 0, 0, 0, count};
+  TextState text = {0, 0, 0, 0};
+  long long bytes = 0;
+  size_t kept = 0; // Bytes of a partial binary key, carried over.
+  int error = 0;
+
+  for(;;){
+    ssize_t n = read(fd, buf + kept, AVL_STREAM_BUFFER - kept);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      error = AVL_STREAM_ERROR_IO;
+      break;
+    }
+    bytes += n;
+
+    if(format == AVL_KEYS_BINARY){
+      size_t avail = kept + (size_t)n;
+      int used = parse_binary(&load, buf, avail);
+      if(used < 0){
+	error = used;
+	break;
+      }
+      kept = avail - (size_t)used;
+      memmove(buf, buf + used, kept);
+      if(n == 0 && kept) error = AVL_STREAM_ERROR_FORMAT;
+    } else {
+      error = parse_text(&load, &text, buf, (size_t)n, n == 0);
+    }
+
+    if(progress && n > 0) progress(bytes, total, load.count, ctx);
+    if(error || n == 0) break;
+  }
+  free(buf);
+
+  // Give back the unused slots and link up the loaded nodes.
+  if(load.slots){
+    avl_release_slots(tree, AVL_NODE_SLOT(tree, load.slots, load.used),
+		      load.size - load.used);
+  }
+  if(load.count > 0){
+    Node *list = load.head;
+    load.tail->right_child = NULL;
+    if(avl_adopt_nodes(tree, link_list(&list, load.count), load.count) != 1){
+      return AVL_STREAM_ERROR_NO_MEMORY;
+    }
+  }
+  return error ? error : load.count;
+}
+
+/*
+ * Function: avl_load_sorted_file
+ * ------------------------------
+ * Description:
+ * Open a sorted key file and load it in to an empty tree,
+ * like avl_load_sorted_fd.
+ *
+ * Arguments: tree     - The empty tree to load in to.
+ *            path     - Path of the key file.
+ *            format   - The encoding of the keys.
+ *            progress - Progress callback. May be NULL.
+ *            ctx      - Passed to progress.
+ *
+ * Returns: The number of keys loaded, or one of the negative
+ *          AVL_STREAM_* error codes.
+ */
+int avl_load_sorted_file(AvlTree *tree, const char *path, AvlKeyFormat format,
+			 avl_progress_fn progress, void *ctx){
+  // Check arguments.
+  assert(tree != NULL && path != NULL);
+
+  if(tree->root != NULL) return AVL_STREAM_NOT_EMPTY;
+
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) return AVL_STREAM_ERROR_IO;
+  int loaded = avl_load_sorted_fd(tree, fd, format, 0, progress, ctx);
+  close(fd);
+  return loaded;
+}
@@ -0,0 +1,134 @@
+/* Basic AVL-Tree implementation - Stream loading module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the stream loading module of the AVL-Tree implementation.
+ * It builds a balanced tree from a sorted key file of any size in
+ * one sequential pass over the file. The keys go straight from a
+ * fixed size read buffer in to the nodes, which are chained in key
+ * order while reading and linked in to a balanced tree at the end,
+ * so no key array is ever materialized: peak memory is the tree
+ * plus one buffer of AVL_STREAM_BUFFER bytes.
+ * This module provides:
+ *     - Loading of binary (native 32 bit integers) and text
+ *       (whitespace separated decimal integers) key files, from a
+ *       path or an open file descriptor (pipes included).
+ *     - Progress reporting through a callback.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_STREAM_H_
+#define __AVL_STREAM_H_
+
+#include "avl_core.h"
+
+#define AVL_STREAM_BUFFER (1 << 20) // Bytes read from the file at once.
+
+#define AVL_STREAM_ERROR_IO -1     // Opening or reading the file failed.
+#define AVL_STREAM_ERROR_FORMAT -2 // The file holds something else than keys.
+#define AVL_STREAM_ERROR_ORDER -3  // The keys are not sorted ascending.
+#define AVL_STREAM_NOT_EMPTY -4    // The tree to load in to is not empty.
+#define AVL_STREAM_ERROR_NO_MEMORY -5 // Memory for the nodes ran out.
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Enum: avl_key_format_e
+ * ----------------------
+ * Description:
+ * The encodings of a key file.
+ */
+typedef enum avl_key_format_e {
+  AVL_KEYS_BINARY, // 32 bit integers in native byte order.
+  AVL_KEYS_TEXT    // Decimal integers, separated by whitespace.
+} AvlKeyFormat;
+
+/*
+ * Type: avl_progress_fn
+ * ---------------------
+ * Description:
+ * Called by the loaders after every buffer read, with the
+ * number of bytes read so far, the size of the file (-1 if
+ * not known, for example on a pipe) and the number of keys
+ * loaded so far.
+ */
+typedef void (*avl_progress_fn)(long long bytes, long long total, int keys,
+				void *ctx);
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: avl_load_sorted_fd
+ * ----------------------------
+ * Description:
+ * Load the sorted keys read from a file descriptor in to an
+ * empty tree, until the end of the file. Repeated keys are
+ * loaded once. The node count is taken from count, or from
+ * the file size for a binary regular file, and discovered
+ * while reading otherwise: the nodes are then allocated in
+ * blocks growing with the tree, of which at most an eighth
+ * of the tree's size stays unused. Node data, inline values
+ * and augmentation values start out zeroed. On an error the
+ * tree holds the keys before the error, unless memory ran out
+ * while linking them up, which leaves it empty.
+ *
+ * Arguments: tree     - The empty tree to load in to.
+ *            fd       - The file descriptor, read from its
+ *                       current position. Not closed.
+ *            format   - The encoding of the keys.
+ *            count    - The expected number of keys, 0 if not
+ *                       known. A wrong count costs memory or
+ *                       extra blocks, but is not an error.
+ *            progress - Progress callback. May be NULL.
+ *            ctx      - Passed to progress.
+ *
+ * Returns: The number of keys loaded, or one of the negative
+ *          AVL_STREAM_* error codes.
+ */
+extern int avl_load_sorted_fd(AvlTree *tree, int fd, AvlKeyFormat format,
+			      int count, avl_progress_fn progress, void *ctx);
+
+/*
+ * Function: avl_load_sorted_file
+ * ------------------------------
+ * Description:
+ * Open a sorted key file and load it in to an empty tree,
+ * like avl_load_sorted_fd.
+ *
+ * Arguments: tree     - The empty tree to load in to.
+ *            path     - Path of the key file.
+ *            format   - The encoding of the keys.
+ *            progress - Progress callback. May be NULL.
+ *            ctx      - Passed to progress.
+ *
+ * Returns: The number of keys loaded, or one of the negative
+ *          AVL_STREAM_* error codes.
+ */
+extern int avl_load_sorted_file(AvlTree *tree, const char *path,
+				AvlKeyFormat format, avl_progress_fn progress,
+				void *ctx);
+
+#endif /* __AVL_STREAM_H_ */
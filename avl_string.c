@@ -0,0 +1,285 @@
+/* Basic AVL-Tree implementation - String key module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the string key module of the AVL-Tree implementation.
+ * It is an instance of the core for string keys (see
+ * avl_typed.h), whose nodes store the first 8 bytes of the key,
+ * normalized to a big endian integer, and its length inline.
+ * Comparisons on the descent use the prefix first and only
+ * dereference the full strings on a prefix tie.
+ * This module provides:
+ *     - String-keyed AVL-Trees (byte strings with explicit length).
+ *     - Optional interning of the keys in to a tree owned arena.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ *     > 2:  Critical Error in core functions.
+ */
+
+// Needed by avl_core.c, before any system header.
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_string.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define ARENA_CHUNK_SIZE 65536 // Default capacity of an arena chunk.
+
+/*
+ * Function: cmp_str_key
+ * ---------------------
+ * Description:
+ * Three way comparison of two string keys, in byte order.
+ * Differing prefixes decide without touching the strings.
+ * On a prefix tie, strings of at most 8 bytes are fully
+ * contained in the (zero padded) prefix, so the shorter one
+ * is a prefix of the other and the lengths decide. Only if
+ * both are longer, the rest of the strings is compared.
+ *
+ * Arguments: a - first key.
+ *            b - second key.
+ *
+ * Returns: Negative, zero or positive for a <, ==, > b.
+ */
+static inline int cmp_str_key(AvlStrKey a, AvlStrKey b){
+  if(a.prefix != b.prefix) return (a.prefix < b.prefix) ? -1 : 1;
+
+  if(a.length > 8 && b.length > 8){
+    // Dereference the strings, skipping the shared prefix.
+    uint32_t common = (a.length < b.length) ? a.length : b.length;
+    int cmp = memcmp(a.str + 8, b.str + 8, common - 8);
+    if(cmp) return cmp;
+  }
+  return (a.length > b.length) - (a.length < b.length);
+}
+
+#define AVL_PREFIX avl_str
+#define AVL_KEY_T AvlStrKey
+#define AVL_KEY_CMP(a, b) cmp_str_key(a, b)
+#include "avl_core.c"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+#undef AVL_KEY_CMP
+
+/*
+ * Function: avl_str_make_key
+ * --------------------------
+ * Description:
+ * Build the key of a string, computing the normalized prefix.
+ * The string is not copied.
+ *
+ * Arguments: str    - The string.
+ *            length - Length of the string in bytes.
+ *
+ * Returns: The key.
+ */
+AvlStrKey avl_str_make_key(const char *str, size_t length){
+  // Check arguments.
+  assert(str != NULL || length == 0);
+  assert(length <= UINT32_MAX);
+
+  AvlStrKey key;
+  key.prefix = 0;
+  key.length = (uint32_t)length;
+  key.str = str;
+
+  // Big endian, so comparing the integers compares the bytes.
+  size_t n = (length < 8) ? length : 8;
+  for(size_t i = 0; i < n; i++){
+    key.prefix |= (uint64_t)(unsigned char)str[i] << (56 - 8 * i);
+  }
+  return key;
+}
+
+/*
+ * Function: arena_copy
+ * --------------------
+ * Description:
+ * Internal helper. Copy a string in to the arena of a tree,
+ * NUL terminated, adding a chunk if the current one is full.
+ *
+ * Arguments: stree  - The string tree owning the arena.
+ *            str    - The string to copy.
+ *            length - Length of the string in bytes.
+ *
+ * Returns: Pointer to the copy.
+ */
+static const char * arena_copy(StringTree *stree, const char *str,
+			       size_t length){
+  AvlStrChunk *chunk = stree->arena;
+  if(chunk == NULL || chunk->size - chunk->used < length + 1){
+    // Start a new chunk, big enough for long keys.
+    size_t size = (length + 1 > ARENA_CHUNK_SIZE) ? length + 1 : ARENA_CHUNK_SIZE;
+    chunk = (AvlStrChunk *)malloc(sizeof(AvlStrChunk) + size);
+    if(chunk == NULL){
+      // Memory allocation failed, report and exit.
+      printf("Memory allocation failed while interning a key.\n");
+      exit(1); // Throw memory allocation error.
+    }
+    chunk->used = 0;
+    chunk->size = size;
+    chunk->next = stree->arena;
+    stree->arena = chunk;
+  }
+
+  char *copy = chunk->bytes + chunk->used;
+  memcpy(copy, str, length);
+  copy[length] = '\0';
+  chunk->used += length + 1;
+  return copy;
+}
+
+/*
+ * Function: make_string_tree
+ * --------------------------
+ * Description:
+ * Create and allocate a new, empty string tree.
+ *
+ * Arguments: intern - If nonzero, inserted keys are copied in to
+ *                     an arena owned by the tree. Otherwise the
+ *                     caller has to keep them alive.
+ *
+ * Returns: Pointer to the newly created string tree.
+ */
+StringTree * make_string_tree(int intern){
+  // Allocate memory.
+  StringTree *stree = (StringTree *)malloc(sizeof(StringTree));
+  if(stree == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating a string tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+
+  stree->tree = avl_str_make_tree_empty();
+  if(stree->tree == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while creating a string tree.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  stree->intern = intern;
+  stree->arena = NULL;
+  return stree;
+}
+
+/*
+ * Function: free_string_tree
+ * --------------------------
+ * Description:
+ * Free a string tree with its nodes and its arena.
+ *
+ * Arguments: stree - The string tree to free.
+ *
+ * Returns: void
+ */
+void free_string_tree(StringTree *stree){
+  // Check arguments.
+  assert(stree != NULL);
+
+  avl_str_free_tree(stree->tree);
+  while(stree->arena){
+    AvlStrChunk *next = stree->arena->next;
+    free(stree->arena);
+    stree->arena = next;
+  }
+  free(stree);
+}
+
+/*
+ * Function: string_search
+ * -----------------------
+ * Description:
+ * Search for a string key. Same contract as search_by_key.
+ *
+ * Arguments: stree  - The string tree to search in.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *            node   - Receives the node, or its would-be parent.
+ *
+ * Returns: 1  - If node has been found.
+ *          0  - If the node was not found.
+ */
+int string_search(StringTree *stree, const char *str, size_t length,
+		  avl_str_node **node){
+  // Check arguments.
+  assert(stree != NULL);
+
+  return avl_str_search_by_key(avl_str_make_key(str, length), stree->tree,
+			       node);
+}
+
+/*
+ * Function: string_insert
+ * -----------------------
+ * Description:
+ * Insert a string key, interning it if the tree does so.
+ * Interned copies are NUL terminated.
+ *
+ * Arguments: stree  - The string tree to insert into.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *            out    - Receives the node holding the key, may be NULL.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ */
+int string_insert(StringTree *stree, const char *str, size_t length,
+		  avl_str_node **out){
+  // Check arguments.
+  assert(stree != NULL);
+
+  AvlStrKey key = avl_str_make_key(str, length);
+  int inserted = avl_str_key_insert_new(key, stree->tree);
+  if(inserted == AVL_ERROR_NO_MEMORY){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while inserting a key.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  if(!inserted){
+    if(out) avl_str_search_by_key(key, stree->tree, out);
+    return 0;
+  }
+
+  // Only intern keys actually inserted. The prefix stays the same.
+  avl_str_node *node = stree->tree->finger;
+  if(stree->intern) node->key.str = arena_copy(stree, str, length);
+  if(out) *out = node;
+  return 1;
+}
+
+/*
+ * Function: string_delete
+ * -----------------------
+ * Description:
+ * Delete a string key. Arena memory of interned keys is only
+ * released when the tree is freed.
+ *
+ * Arguments: stree  - The string tree to delete from.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - Deletion unsuccessful (key not found).
+ */
+int string_delete(StringTree *stree, const char *str, size_t length){
+  // Check arguments.
+  assert(stree != NULL);
+
+  return avl_str_key_delete(avl_str_make_key(str, length), stree->tree);
+}
@@ -0,0 +1,200 @@
+/* Basic AVL-Tree implementation - String key module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the string key module of the AVL-Tree implementation.
+ * It is an instance of the core for string keys (see
+ * avl_typed.h), whose nodes store the first 8 bytes of the key,
+ * normalized to a big endian integer, and its length inline.
+ * Comparisons on the descent use the prefix first and only
+ * dereference the full strings on a prefix tie.
+ * This module provides:
+ *     - String-keyed AVL-Trees (byte strings with explicit length).
+ *     - Optional interning of the keys in to a tree owned arena.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_STRING_H_
+#define __AVL_STRING_H_
+
+#include "avl_typed.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: avl_str_key_s
+ * ------------------------
+ * Description:
+ * The key of a string tree node.
+ *
+ * Fields: prefix - The first 8 bytes of the string as big endian
+ *                  integer, zero padded. Orders like the bytes.
+ *         length - Length of the string in bytes.
+ *         str - Pointer to the full string.
+ */
+typedef struct avl_str_key_s {
+  uint64_t prefix;
+  uint32_t length;
+  const char *str;
+} AvlStrKey;
+
+// The core for string keys: avl_str_node, avl_str_tree, ...
+#define AVL_PREFIX avl_str
+#define AVL_KEY_T AvlStrKey
+#include "avl_core.h"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+
+/*
+ * Structure: avl_str_chunk_s
+ * --------------------------
+ * Description:
+ * A chunk of the arena interned keys are copied to.
+ *
+ * Fields: next - The previously filled chunk.
+ *         used - Bytes used in the chunk.
+ *         size - Capacity of the chunk in bytes.
+ *         bytes - The storage.
+ */
+typedef struct avl_str_chunk_s {
+  struct avl_str_chunk_s *next;
+  size_t used, size;
+  char bytes[];
+} AvlStrChunk;
+
+/*
+ * Structure: string_tree_s
+ * ------------------------
+ * Description:
+ * A string-keyed AVL-Tree.
+ *
+ * Fields: tree - The underlying tree.
+ *         intern - Nonzero if inserted keys are copied in to the arena.
+ *         arena - The arena chunks, newest first.
+ */
+typedef struct string_tree_s {
+  avl_str_tree *tree;
+  int intern;
+  AvlStrChunk *arena;
+} StringTree;
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: avl_str_make_key
+ * --------------------------
+ * Description:
+ * Build the key of a string, computing the normalized prefix.
+ * The string is not copied.
+ *
+ * Arguments: str    - The string.
+ *            length - Length of the string in bytes.
+ *
+ * Returns: The key.
+ */
+extern AvlStrKey avl_str_make_key(const char *str, size_t length);
+
+/*
+ * Function: make_string_tree
+ * --------------------------
+ * Description:
+ * Create and allocate a new, empty string tree.
+ *
+ * Arguments: intern - If nonzero, inserted keys are copied in to
+ *                     an arena owned by the tree. Otherwise the
+ *                     caller has to keep them alive.
+ *
+ * Returns: Pointer to the newly created string tree.
+ */
+extern StringTree * make_string_tree(int intern);
+
+/*
+ * Function: free_string_tree
+ * --------------------------
+ * Description:
+ * Free a string tree with its nodes and its arena.
+ *
+ * Arguments: stree - The string tree to free.
+ *
+ * Returns: void
+ */
+extern void free_string_tree(StringTree *stree);
+
+/*
+ * Function: string_search
+ * -----------------------
+ * Description:
+ * Search for a string key. Same contract as search_by_key.
+ *
+ * Arguments: stree  - The string tree to search in.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *            node   - Receives the node, or its would-be parent.
+ *
+ * Returns: 1  - If node has been found.
+ *          0  - If the node was not found.
+ */
+extern int string_search(StringTree *stree, const char *str, size_t length,
+			 avl_str_node **node);
+
+/*
+ * Function: string_insert
+ * -----------------------
+ * Description:
+ * Insert a string key, interning it if the tree does so.
+ * Interned copies are NUL terminated.
+ *
+ * Arguments: stree  - The string tree to insert into.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *            out    - Receives the node holding the key, may be NULL.
+ *
+ * Returns: 1  - On successful insertion.
+ *          0  - If the key already exists.
+ */
+extern int string_insert(StringTree *stree, const char *str, size_t length,
+			 avl_str_node **out);
+
+/*
+ * Function: string_delete
+ * -----------------------
+ * Description:
+ * Delete a string key. Arena memory of interned keys is only
+ * released when the tree is freed.
+ *
+ * Arguments: stree  - The string tree to delete from.
+ *            str    - The key.
+ *            length - Length of the key in bytes.
+ *
+ * Returns: 1 - Successful deletion.
+ *          0 - Deletion unsuccessful (key not found).
+ */
+extern int string_delete(StringTree *stree, const char *str, size_t length);
+
+#endif /* __AVL_STRING_H_ */
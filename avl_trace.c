@@ -0,0 +1,590 @@
+/* Basic AVL-Tree implementation - Tracing module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the tracing module of the AVL-Tree implementation.
+ * It records the API calls made on a tree (see avl_trace_hook)
+ * to a compact binary trace file, and reads such traces back so
+ * that they can be replayed against another build (see the
+ * replay tool, replay-avl.c). Records are buffered and written
+ * in large chunks, so tracing costs a clock read and a 16 byte
+ * copy per call.
+ * Trace format: a 16 byte header (the magic "AVLTRACE", the
+ * format version and a byte order mark, as 32 bit integers),
+ * then one AVL_TRACE_RECORD_SIZE byte record per call: the
+ * operation and the result (8 bit each, the result saturated),
+ * 16 reserved bits, the key, the second argument and the
+ * nanoseconds since the previous record (32 bit, saturated),
+ * all in the byte order of the recording machine. A trace of
+ * a non-empty tree starts with one AVL_TRACE_LOAD record per
+ * node already present, after an AVL_TRACE_SEQ_ATTACH record
+ * if the tree is positional. The node data, values and
+ * augmentation values passed to the calls are not recorded.
+ * This module provides:
+ *     - Recording of a tree's API calls to a trace file.
+ *     - Reading of trace files and re-applying their records.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_trace.h"
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <assert.h>
+
+#define TRACE_MAGIC "AVLTRACE"
+#define TRACE_HEADER_SIZE 16
+#define TRACE_BYTE_ORDER 0x01020304u
+
+/*
+ * Function: now_ns
+ * ----------------
+ * Description:
+ * Internal helper. Read the monotonic clock.
+ *
+ * Arguments: none
+ *
+ * Returns: The current time in nanoseconds.
+ */
+static long long now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Function: write_all
+ * -------------------
+ * Description:
+ * Internal helper. Write a whole buffer to a file descriptor,
+ * retrying short and interrupted writes.
+ *
+ * Arguments: fd   - The file descriptor.
+ *            buf  - The bytes to write.
+ *            size - The number of bytes.
+ *
+ * Returns: 1 on success, 0 if writing failed.
+ */
+static int write_all(int fd, const unsigned char *buf, size_t size){
+  while(size > 0){
+    ssize_t n = write(fd, buf, size);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return 0;
+    }
+    buf += n;
+    size -= (size_t)n;
+  }
+  return 1;
+}
+
+/*
+ * Function: flush
+ * ---------------
+ * Description:
+ * Internal helper. Write the buffered records of a recording.
+ *
+ * Arguments: trace - The recording.
+ *
+ * Returns: void
+ */
+static void flush(AvlTrace *trace){
+  if(!trace->error && !write_all(trace->fd, trace->buffer, trace->used)){
+    trace->error = 1;
+  }
+  trace->used = 0;
+}
+
+/*
+ * Function: saturate
+ * ------------------
+ * Description:
+ * Internal helper. Clamp a result to the 8 bits of a record.
+ *
+ * Arguments: result - The result of an operation.
+ *
+ * Returns: The result, limited to -128 ... 127.
+ */
+static inline int saturate(int result){
+  return (result < -128) ? -128 : (result > 127) ? 127 : result;
+}
+
+/*
+ * Function: append
+ * ----------------
+ * Description:
+ * Internal helper. Append a record to the buffer of a
+ * recording, writing the buffer out when it is full.
+ *
+ * Arguments: trace    - The recording.
+ *            op       - The operation.
+ *            key      - The key of the operation.
+ *            arg      - The second argument of the operation.
+ *            result   - The result of the operation.
+ *            delta_ns - Nanoseconds since the previous record.
+ *
+ * Returns: void
+ */
+static void append(AvlTrace *trace, int op, int key, int arg, int result,
+		   uint32_t delta_ns){
+  if(trace->used + AVL_TRACE_RECORD_SIZE > AVL_TRACE_BUFFER) flush(trace);
+
+  unsigned char *record = trace->buffer + trace->used;
+  record[0] = (unsigned char)op;
+  record[1] = (unsigned char)(signed char)saturate(result);
+  record[2] = record[3] = 0;
+  memcpy(record + 4, &key, sizeof(int32_t));
+  memcpy(record + 8, &arg, sizeof(int32_t));
+  memcpy(record + 12, &delta_ns, sizeof(uint32_t));
+  trace->used += AVL_TRACE_RECORD_SIZE;
+  trace->records++;
+}
+
+/*
+ * Function: record_call
+ * ---------------------
+ * Description:
+ * Internal helper. The trace hook of a recording.
+ *
+ * Arguments: ctx    - The recording.
+ *            op     - The operation.
+ *            key    - The key of the operation.
+ *            arg    - The second argument of the operation.
+ *            result - The result of the operation.
+ *
+ * Returns: void
+ */
+static void record_call(void *ctx, AvlTraceOp op, int key, int arg,
+			int result){
+  AvlTrace *trace = (AvlTrace *)ctx;
+  long long now = now_ns();
+  long long delta = now - trace->last_ns;
+  trace->last_ns = now;
+  append(trace, op, key, arg, result,
+	 (delta > (long long)UINT32_MAX) ? UINT32_MAX : (uint32_t)delta);
+}
+
+/*
+ * Function: avl_trace_start
+ * -------------------------
+ * Description:
+ * Start recording the API calls made on a tree to a trace
+ * file, replacing the file. The nodes already in the tree are
+ * recorded first, as AVL_TRACE_LOAD records. Replaces any
+ * other trace hook of the tree.
+ *
+ * Arguments: tree - The tree to trace.
+ *            path - Path of the trace file.
+ *
+ * Returns: The recording, NULL if the file could not be
+ *          created.
+ */
+AvlTrace * avl_trace_start(AvlTree *tree, const char *path){
+  // Check arguments.
+  assert(tree != NULL && path != NULL);
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) return NULL;
+
+  AvlTrace *trace = (AvlTrace *)malloc(sizeof(AvlTrace));
+  unsigned char *buffer = (unsigned char *)malloc(AVL_TRACE_BUFFER);
+  if(trace == NULL || buffer == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while starting a trace.\n");
+    exit(1); // Throw memory allocation error.
+  }
+
+  trace->tree = tree;
+  trace->fd = fd;
+  trace->buffer = buffer;
+  trace->used = 0;
+  trace->records = 0;
+  trace->error = 0;
+
+  // The header, then the keys already present.
+  uint32_t header[2] = {AVL_TRACE_VERSION, TRACE_BYTE_ORDER};
+  memcpy(buffer, TRACE_MAGIC, 8);
+  memcpy(buffer + 8, header, sizeof(header));
+  trace->used = TRACE_HEADER_SIZE;
+  if(avl_seq_attached(tree)) append(trace, AVL_TRACE_SEQ_ATTACH, 0, 0, 1, 0);
+  for(Node *node = avl_min(tree); node; node = avl_next(node)){
+    append(trace, AVL_TRACE_LOAD, node->key, 0, 1, 0);
+  }
+
+  trace->last_ns = now_ns();
+  avl_trace_hook(tree, record_call, trace);
+  return trace;
+}
+
+/*
+ * Function: avl_trace_stop
+ * ------------------------
+ * Description:
+ * Stop a recording, write the remaining records, close the
+ * file and free the recording.
+ *
+ * Arguments: trace - The recording.
+ *
+ * Returns: The number of records written, or
+ *          AVL_TRACE_ERROR_IO if writing failed.
+ */
+long avl_trace_stop(AvlTrace *trace){
+  // Check arguments.
+  assert(trace != NULL);
+
+  avl_trace_hook(trace->tree, NULL, NULL);
+  flush(trace);
+  if(close(trace->fd) != 0) trace->error = 1;
+
+  long records = trace->error ? AVL_TRACE_ERROR_IO : trace->records;
+  free(trace->buffer);
+  free(trace);
+  return records;
+}
+
+/*
+ * Function: fill
+ * --------------
+ * Description:
+ * Internal helper. Move the unread bytes of a reader to the
+ * front of its buffer and read more behind them.
+ *
+ * Arguments: reader - The reader.
+ *
+ * Returns: The number of bytes read, 0 at the end of the
+ *          file, or AVL_TRACE_ERROR_IO.
+ */
+static int fill(AvlTraceReader *reader){
+  size_t kept = reader->size - reader->used;
+  memmove(reader->buffer, reader->buffer + reader->used, kept);
+  reader->used = 0;
+  reader->size = kept;
+
+  for(;;){
+    ssize_t n = read(reader->fd, reader->buffer + kept,
+		     AVL_TRACE_BUFFER - kept);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return AVL_TRACE_ERROR_IO;
+    }
+    reader->size += (size_t)n;
+    return (int)n;
+  }
+}
+
+/*
+ * Function: avl_trace_open
+ * ------------------------
+ * Description:
+ * Open a trace file for reading and check its header.
+ *
+ * Arguments: path  - Path of the trace file.
+ *            error - Receives the error code if opening fails.
+ *                    May be NULL.
+ *
+ * Returns: The reader, NULL on failure.
+ */
+AvlTraceReader * avl_trace_open(const char *path, int *error){
+  // Check arguments.
+  assert(path != NULL);
+
+  int fd = open(path, O_RDONLY);
+  if(fd < 0){
+    if(error) *error = AVL_TRACE_ERROR_IO;
+    return NULL;
+  }
+
+  AvlTraceReader *reader = (AvlTraceReader *)malloc(sizeof(AvlTraceReader));
+  unsigned char *buffer = (unsigned char *)malloc(AVL_TRACE_BUFFER);
+  if(reader == NULL || buffer == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while opening a trace.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  reader->fd = fd;
+  reader->buffer = buffer;
+  reader->used = reader->size = 0;
+
+  // Read until the header is complete, or the file ends.
+  int status = 1;
+  while(reader->size < TRACE_HEADER_SIZE && status > 0) status = fill(reader);
+
+  int valid = status >= 0 && reader->size >= TRACE_HEADER_SIZE
+    && memcmp(buffer, TRACE_MAGIC, 8) == 0;
+  if(valid){
+    uint32_t header[2];
+    memcpy(header, buffer + 8, sizeof(header));
+    valid = header[0] == AVL_TRACE_VERSION && header[1] == TRACE_BYTE_ORDER;
+  }
+  if(!valid){
+    if(error){
+      *error = (status < 0) ? AVL_TRACE_ERROR_IO : AVL_TRACE_ERROR_FORMAT;
+    }
+    avl_trace_close(reader);
+    return NULL;
+  }
+  reader->used = TRACE_HEADER_SIZE;
+  return reader;
+}
+
+/*
+ * Function: avl_trace_next
+ * ------------------------
+ * Description:
+ * Read the next record of a trace.
+ *
+ * Arguments: reader - The reader.
+ *            record - Receives the record.
+ *
+ * Returns: 1 - A record was read.
+ *          0 - The end of the trace was reached.
+ *          AVL_TRACE_ERROR_IO or AVL_TRACE_ERROR_FORMAT (the
+ *          trace ends in a partial record) on failure.
+ */
+int avl_trace_next(AvlTraceReader *reader, AvlTraceRecord *record){
+  // Check arguments.
+  assert(reader != NULL && record != NULL);
+
+  while(reader->size - reader->used < AVL_TRACE_RECORD_SIZE){
+    int status = fill(reader);
+    if(status < 0) return status;
+    if(status == 0){
+      return (reader->size == reader->used) ? 0 : AVL_TRACE_ERROR_FORMAT;
+    }
+  }
+
+  const unsigned char *bytes = reader->buffer + reader->used;
+  int32_t key, arg;
+  uint32_t delta_ns;
+  memcpy(&key, bytes + 4, sizeof(key));
+  memcpy(&arg, bytes + 8, sizeof(arg));
+  memcpy(&delta_ns, bytes + 12, sizeof(delta_ns));
+  record->op = bytes[0];
+  record->result = (signed char)bytes[1];
+  record->key = key;
+  record->arg = arg;
+  record->delta_ns = delta_ns;
+  reader->used += AVL_TRACE_RECORD_SIZE;
+  return 1;
+}
+
+/*
+ * Function: avl_trace_close
+ * -------------------------
+ * Description:
+ * Close a trace file and free its reader.
+ *
+ * Arguments: reader - The reader.
+ *
+ * Returns: void
+ */
+void avl_trace_close(AvlTraceReader *reader){
+  // Check arguments.
+  assert(reader != NULL);
+
+  close(reader->fd);
+  free(reader->buffer);
+  free(reader);
+}
+
+/*
+ * Function: apply_k_nearest
+ * -------------------------
+ * Description:
+ * Internal helper. Re-apply a recorded avl_k_nearest call.
+ *
+ * Arguments: tree - The tree.
+ *            key  - The key searched around.
+ *            k    - The number of nodes wanted.
+ *
+ * Returns: The number of nodes found.
+ */
+static int apply_k_nearest(AvlTree *tree, int key, int k){
+  if(k <= 0) return avl_k_nearest(tree, key, k, NULL);
+  Node **out = (Node **)malloc(k * sizeof(Node *));
+  if(out == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while applying a trace.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  int count = avl_k_nearest(tree, key, k, out);
+  free(out);
+  return count;
+}
+
+/*
+ * Function: apply_range_aggregate
+ * -------------------------------
+ * Description:
+ * Internal helper. Re-apply a recorded avl_range_aggregate
+ * call. Without an augmentation there is nothing to combine,
+ * so only a lookup of the range is made.
+ *
+ * Arguments: tree - The tree.
+ *            lo   - Lower bound of the key range.
+ *            hi   - Upper bound of the key range.
+ *
+ * Returns: 1 if the range holds a key, else 0.
+ */
+static int apply_range_aggregate(AvlTree *tree, int lo, int hi){
+  if(tree->augment == NULL){
+    Node *node = avl_ceiling(tree, lo);
+    return node != NULL && node->key <= hi;
+  }
+  long long out[(tree->augment->size + sizeof(long long) - 1)
+		/ sizeof(long long)];
+  return avl_range_aggregate(tree, lo, hi, out);
+}
+
+/*
+ * Function: apply_seq_concat
+ * --------------------------
+ * Description:
+ * Internal helper. Re-apply a recorded avl_seq_concat call,
+ * with a tree of as many nodes without data.
+ *
+ * Arguments: tree - The positional tree appended to.
+ *            n    - The number of nodes appended.
+ *
+ * Returns: 1 on success, AVL_ERROR_NO_MEMORY if the appended
+ *          tree could not be built.
+ */
+static int apply_seq_concat(AvlTree *tree, int n){
+  AvlTree *right = make_tree_empty();
+  if(right == NULL) return AVL_ERROR_NO_MEMORY;
+  // The same node layout as the tree appended to.
+  right->node_size = tree->node_size;
+  right->augment = tree->augment;
+  right->augment_offset = tree->augment_offset;
+  right->value_size = tree->value_size;
+  right->value_offset = tree->value_offset;
+  if(avl_seq_append(right, NULL, n) != 1){
+    free_tree(right);
+    return AVL_ERROR_NO_MEMORY;
+  }
+  avl_seq_concat(tree, right);
+  return 1;
+}
+
+/*
+ * Function: apply_seq_split
+ * -------------------------
+ * Description:
+ * Internal helper. Re-apply a recorded avl_seq_split call.
+ * The nodes split off left the traced tree, so their new tree
+ * is freed.
+ *
+ * Arguments: tree  - The positional tree.
+ *            index - The position split at.
+ *
+ * Returns: 1 if the tree was split, else 0.
+ */
+static int apply_seq_split(AvlTree *tree, int index){
+  AvlTree *rest = avl_seq_split(tree, index);
+  if(rest == NULL) return 0;
+  free_tree(rest);
+  return 1;
+}
+
+/*
+ * Function: avl_trace_apply
+ * -------------------------
+ * Description:
+ * Re-apply a record to a tree, with the API call it was
+ * recorded for. Insertions with a value or an augmentation
+ * value are applied as plain insertions, and hinted ones use
+ * the tree's finger as the hint. As values are not recorded,
+ * avl_augment_set only recomputes the aggregates above the
+ * node, and avl_seq_concat appends nodes without data. The
+ * tree split off by avl_seq_split is freed.
+ *
+ * Arguments: tree   - The tree to apply the record to.
+ *            record - The record.
+ *
+ * Returns: The result of the call, saturated like the recorded
+ *          one, to compare with it.
+ */
+int avl_trace_apply(AvlTree *tree, const AvlTraceRecord *record){
+  // Check arguments.
+  assert(tree != NULL && record != NULL);
+
+  Node *node = NULL;
+  int key = record->key, arg = record->arg;
+  switch(record->op){
+  case AVL_TRACE_SEARCH:
+    return search_by_key(key, tree, &node);
+  case AVL_TRACE_LOAD:
+    if(avl_seq_attached(tree)) return avl_seq_append(tree, NULL, 1);
+    return key_insert_new(key, tree);
+  case AVL_TRACE_INSERT:
+    return key_insert_new(key, tree);
+  case AVL_TRACE_INSERT_HINT:
+    return avl_insert_hint(tree, key, NULL);
+  case AVL_TRACE_DELETE:
+    return key_delete(key, tree);
+  case AVL_TRACE_POP_MIN:
+    return avl_pop_min(tree, NULL, NULL);
+  case AVL_TRACE_POP_MAX:
+    return avl_pop_max(tree, NULL, NULL);
+  case AVL_TRACE_FLOOR:
+    return avl_floor(tree, key) != NULL;
+  case AVL_TRACE_CEILING:
+    return avl_ceiling(tree, key) != NULL;
+  case AVL_TRACE_PREDECESSOR:
+    return avl_predecessor(tree, key) != NULL;
+  case AVL_TRACE_SUCCESSOR:
+    return avl_successor(tree, key) != NULL;
+  case AVL_TRACE_K_NEAREST:
+    return saturate(apply_k_nearest(tree, key, arg));
+  case AVL_TRACE_RANGE_AGGREGATE:
+    return apply_range_aggregate(tree, key, arg);
+  case AVL_TRACE_AUGMENT_SET:
+    // Only the aggregates are recomputed, the value is not known.
+    if(search_by_key(key, tree, &node) != 1) return 0;
+    if(tree->augment) avl_augment_update(tree, node);
+    return 1;
+  case AVL_TRACE_SEQ_ATTACH:
+    return avl_seq_attach(tree);
+  case AVL_TRACE_SEQ_INSERT_AT:
+    return avl_seq_insert_at(tree, key, NULL) != NULL;
+  case AVL_TRACE_SEQ_ERASE_AT:
+    return avl_seq_erase_at(tree, key, NULL);
+  case AVL_TRACE_SEQ_GET:
+    return avl_seq_get(tree, key) != NULL;
+  case AVL_TRACE_SEQ_INDEX:
+    node = avl_seq_get(tree, key);
+    return node != NULL && avl_seq_index(tree, node) == key;
+  case AVL_TRACE_SEQ_APPEND:
+    return avl_seq_append(tree, NULL, key);
+  case AVL_TRACE_SEQ_CONCAT:
+    return apply_seq_concat(tree, key);
+  case AVL_TRACE_SEQ_SPLIT:
+    return apply_seq_split(tree, key);
+  default:
+    return AVL_TRACE_ERROR_FORMAT;
+  }
+}
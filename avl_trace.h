@@ -0,0 +1,222 @@
+/* Basic AVL-Tree implementation - Tracing module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the tracing module of the AVL-Tree implementation.
+ * It records the API calls made on a tree (see avl_trace_hook)
+ * to a compact binary trace file, and reads such traces back so
+ * that they can be replayed against another build (see the
+ * replay tool, replay-avl.c). Records are buffered and written
+ * in large chunks, so tracing costs a clock read and a 16 byte
+ * copy per call.
+ * Trace format: a 16 byte header (the magic "AVLTRACE", the
+ * format version and a byte order mark, as 32 bit integers),
+ * then one AVL_TRACE_RECORD_SIZE byte record per call: the
+ * operation and the result (8 bit each, the result saturated),
+ * 16 reserved bits, the key, the second argument and the
+ * nanoseconds since the previous record (32 bit, saturated),
+ * all in the byte order of the recording machine. A trace of
+ * a non-empty tree starts with one AVL_TRACE_LOAD record per
+ * node already present, after an AVL_TRACE_SEQ_ATTACH record
+ * if the tree is positional. The node data, values and
+ * augmentation values passed to the calls are not recorded.
+ * This module provides:
+ *     - Recording of a tree's API calls to a trace file.
+ *     - Reading of trace files and re-applying their records.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_TRACE_H_
+#define __AVL_TRACE_H_
+
+#include "avl_core.h"
+
+#define AVL_TRACE_BUFFER (1 << 16) // Bytes of records written at once.
+#define AVL_TRACE_RECORD_SIZE 16   // Bytes per record.
+#define AVL_TRACE_VERSION 2        // Version of the trace format.
+
+#define AVL_TRACE_LOAD 0x7f // Record of a key present when tracing started.
+
+#define AVL_TRACE_ERROR_IO -1     // Opening, reading or writing failed.
+#define AVL_TRACE_ERROR_FORMAT -2 // The file is not a (complete) trace.
+
+/*
+ * -----------------------------
+ * -- Structures and typedefs --
+ * -----------------------------
+ */
+
+/*
+ * Structure: avl_trace_s
+ * ----------------------
+ * Description:
+ * A running recording of the API calls made on a tree.
+ *
+ * Fields: tree - The traced tree.
+ *         fd - The trace file.
+ *         buffer - Records not yet written.
+ *         used - Bytes of the buffer used.
+ *         last_ns - Time of the previous record.
+ *         records - Number of records so far.
+ *         error - Whether writing failed. Recording stops then.
+ */
+typedef struct avl_trace_s {
+  AvlTree *tree;
+  int fd;
+  unsigned char *buffer;
+  size_t used;
+  long long last_ns;
+  long records;
+  int error;
+} AvlTrace;
+
+/*
+ * Structure: avl_trace_record_s
+ * -----------------------------
+ * Description:
+ * One record of a trace.
+ *
+ * Fields: op - The operation, an AvlTraceOp or AVL_TRACE_LOAD.
+ *         key - The key of the operation.
+ *         arg - The second argument of the operation, or 0.
+ *         result - The result returned to the caller, saturated
+ *                  to -128 ... 127.
+ *         delta_ns - Nanoseconds since the previous record.
+ */
+typedef struct avl_trace_record_s {
+  int op, key, arg, result;
+  unsigned delta_ns;
+} AvlTraceRecord;
+
+/*
+ * Structure: avl_trace_reader_s
+ * -----------------------------
+ * Description:
+ * The state of reading a trace file.
+ *
+ * Fields: fd - The trace file.
+ *         buffer - Bytes read ahead.
+ *         used - Bytes of the buffer consumed.
+ *         size - Bytes in the buffer.
+ */
+typedef struct avl_trace_reader_s {
+  int fd;
+  unsigned char *buffer;
+  size_t used, size;
+} AvlTraceReader;
+
+/*
+ * ----------------------------
+ * -- Function declarations. --
+ * ----------------------------
+ */
+
+/*
+ * Function: avl_trace_start
+ * -------------------------
+ * Description:
+ * Start recording the API calls made on a tree to a trace
+ * file, replacing the file. The nodes already in the tree are
+ * recorded first, as AVL_TRACE_LOAD records. Replaces any
+ * other trace hook of the tree.
+ *
+ * Arguments: tree - The tree to trace.
+ *            path - Path of the trace file.
+ *
+ * Returns: The recording, NULL if the file could not be
+ *          created.
+ */
+extern AvlTrace * avl_trace_start(AvlTree *tree, const char *path);
+
+/*
+ * Function: avl_trace_stop
+ * ------------------------
+ * Description:
+ * Stop a recording, write the remaining records, close the
+ * file and free the recording.
+ *
+ * Arguments: trace - The recording.
+ *
+ * Returns: The number of records written, or
+ *          AVL_TRACE_ERROR_IO if writing failed.
+ */
+extern long avl_trace_stop(AvlTrace *trace);
+
+/*
+ * Function: avl_trace_open
+ * ------------------------
+ * Description:
+ * Open a trace file for reading and check its header.
+ *
+ * Arguments: path  - Path of the trace file.
+ *            error - Receives the error code if opening fails.
+ *                    May be NULL.
+ *
+ * Returns: The reader, NULL on failure.
+ */
+extern AvlTraceReader * avl_trace_open(const char *path, int *error);
+
+/*
+ * Function: avl_trace_next
+ * ------------------------
+ * Description:
+ * Read the next record of a trace.
+ *
+ * Arguments: reader - The reader.
+ *            record - Receives the record.
+ *
+ * Returns: 1 - A record was read.
+ *          0 - The end of the trace was reached.
+ *          AVL_TRACE_ERROR_IO or AVL_TRACE_ERROR_FORMAT (the
+ *          trace ends in a partial record) on failure.
+ */
+extern int avl_trace_next(AvlTraceReader *reader, AvlTraceRecord *record);
+
+/*
+ * Function: avl_trace_close
+ * -------------------------
+ * Description:
+ * Close a trace file and free its reader.
+ *
+ * Arguments: reader - The reader.
+ *
+ * Returns: void
+ */
+extern void avl_trace_close(AvlTraceReader *reader);
+
+/*
+ * Function: avl_trace_apply
+ * -------------------------
+ * Description:
+ * Re-apply a record to a tree, with the API call it was
+ * recorded for. Insertions with a value or an augmentation
+ * value are applied as plain insertions, and hinted ones use
+ * the tree's finger as the hint. As values are not recorded,
+ * avl_augment_set only recomputes the aggregates above the
+ * node, and avl_seq_concat appends nodes without data. The
+ * tree split off by avl_seq_split is freed.
+ *
+ * Arguments: tree   - The tree to apply the record to.
+ *            record - The record.
+ *
+ * Returns: The result of the call, saturated like the recorded
+ *          one, to compare with it.
+ */
+extern int avl_trace_apply(AvlTree *tree, const AvlTraceRecord *record);
+
+#endif /* __AVL_TRACE_H_ */
@@ -0,0 +1,96 @@
+/* Basic AVL-Tree implementation - Typed key module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the typed key module of the AVL-Tree implementation.
+ * The core module orders its nodes by an int key. This module
+ * declares instances of the core for other key types: avl_core.c
+ * compiled once more with the key type and a three way
+ * comparator as parameters, inlined at compile time. Every
+ * instance shares the core's rotations, rebalancing and
+ * deletion, and its API.
+ * This module provides:
+ *     - Ready made instances for int64_t (avl_i64), uint64_t
+ *       (avl_u64) and double (avl_f64) keys.
+ *     - The comparator of numeric keys.
+ *
+ * Usage:
+ * An instance is named by a prefix p. It is declared by
+ * defining AVL_PREFIX as p and AVL_KEY_T as the key type,
+ * including avl_core.h and undefining both again, as done
+ * below. It is defined the same way in exactly one source
+ * file, with AVL_KEY_CMP(a, b) defined as well and avl_core.c
+ * included instead (see avl_typed_i64.c). AVL_KEY_CMP has to
+ * return a negative value, zero or a positive value if a is
+ * less than, equal to or greater than b. As a macro or inline
+ * function it costs no call through a function pointer on the
+ * descent.
+ *
+ * The instance has the API of the core, with its types and
+ * functions renamed by avl_names.h: p_node and p_tree, and e.g.
+ * p_make_tree_empty, p_search_by_key, p_key_insert_new,
+ * p_key_delete, p_min, p_next, p_floor and p_free_tree.
+ * The features hashing the keys or computing with them only
+ * exist for int keys: the hot-key cache, the negative lookup
+ * filter, Merkle hashing and avl_diff, avl_k_nearest, the
+ * positional mode and the trace hook.
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ */
+
+#ifndef __AVL_TYPED_H_
+#define __AVL_TYPED_H_
+
+#include "avl_core.h"
+
+#include <stdint.h>
+
+/*
+ * Macro: AVL_CMP_NUMERIC
+ * ----------------------
+ * Description:
+ * Three way comparison for integer keys, compiles to
+ * branch free code.
+ */
+#define AVL_CMP_NUMERIC(a, b) (((a) > (b)) - ((a) < (b)))
+
+/*
+ * ---------------------------
+ * -- Ready made instances. --
+ * ---------------------------
+ */
+
+#define AVL_PREFIX avl_i64
+#define AVL_KEY_T int64_t
+#include "avl_core.h"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+
+#define AVL_PREFIX avl_u64
+#define AVL_KEY_T uint64_t
+#include "avl_core.h"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+
+// NaN sorts after every number, as a single key.
+#define AVL_PREFIX avl_f64
+#define AVL_KEY_T double
+#include "avl_core.h"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+
+#endif /* __AVL_TYPED_H_ */
@@ -0,0 +1,55 @@
+/* Basic AVL-Tree implementation - Typed key module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the typed key module of the AVL-Tree implementation.
+ * This file instantiates the core for double keys (avl_f64).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ *     > 2:  Critical Error in core functions.
+ */
+
+// Needed by avl_core.c, before any system header.
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_typed.h"
+
+/*
+ * Function: cmp_f64
+ * -----------------
+ * Description:
+ * Three way comparison of double keys. NaN does not compare
+ * to anything, which would break the ordering, so all NaNs
+ * are treated as one key sorting after every number.
+ *
+ * Arguments: a - first key.
+ *            b - second key.
+ *
+ * Returns: Negative, zero or positive for a <, ==, > b.
+ */
+static inline int cmp_f64(double a, double b){
+  if(a < b) return -1;
+  if(a > b) return 1;
+  if(a == b) return 0;
+  // At least one of them is NaN.
+  return (a != a) - (b != b);
+}
+
+#define AVL_PREFIX avl_f64
+#define AVL_KEY_T double
+#define AVL_KEY_CMP(a, b) cmp_f64(a, b)
+#include "avl_core.c"
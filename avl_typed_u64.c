@@ -0,0 +1,34 @@
+/* Basic AVL-Tree implementation - Typed key module */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * This is the typed key module of the AVL-Tree implementation.
+ * This file instantiates the core for uint64_t keys (avl_u64).
+ *
+ * Exit Code Index:
+ *     > 0:  Successful Execution.
+ *     > 1:  Memory Allocation Failure.
+ *     > 2:  Critical Error in core functions.
+ */
+
+// Needed by avl_core.c, before any system header.
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_typed.h"
+
+#define AVL_PREFIX avl_u64
+#define AVL_KEY_T uint64_t
+#define AVL_KEY_CMP(a, b) AVL_CMP_NUMERIC(a, b)
+#include "avl_core.c"
@@ -0,0 +1,1440 @@
+/* Basic AVL-Tree implementation - Benchmarks */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * Micro benchmarks for the AVL-Tree modules. Every benchmark
+ * prints one line per measured configuration.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "avl_core.h"
+#include "avl_interval.h"
+#include "avl_typed.h"
+#include "avl_string.h"
+#include "avl_small.h"
+#include "avl_parallel.h"
+#include "avl_combining.h"
+#include "avl_stream.h"
+#include "avl_trace.h"
+#include "avl_range.h"
+#include "avl_merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+#define N_BENCH 1000000 // The number of keys used per benchmark.
+
+/**
+ * @brief Get a monotonic timestamp in seconds.
+ * @return The current time in seconds.
+ */
+double now_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Generate a random number in a given range.
+ * @param min - The lower bound of the range.
+ * @param max - The upper bound of the range.
+ * @return A random number in the given range.
+ */
+int rand_in_range(int min, int max){
+  return min + rand() / (RAND_MAX / (max - min + 1) + 1);
+}
+
+/**
+ * @brief Fill an array with ascending keys and then swap
+ * a fraction of the keys with a close neighbour.
+ * @param keys - The array to fill.
+ * @param n - The number of keys.
+ * @param window - Maximum distance of a swap, 0 for sorted keys.
+ */
+void fill_nearly_sorted(int *keys, int n, int window){
+  for(int i = 0; i < n; i++) keys[i] = i * 2;
+  if(window == 0) return;
+  for(int i = 0; i < n / 10; i++){
+    int a = rand_in_range(0, n - 1);
+    int b = a + rand_in_range(1, window);
+    if(b >= n) continue;
+    int tmp = keys[a];
+    keys[a] = keys[b];
+    keys[b] = tmp;
+  }
+}
+
+/**
+ * @brief Compare plain insertion against hinted insertion on
+ * sequential, nearly sorted and random key streams.
+ */
+void bench_hinted_insertion(){
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL);
+
+  const char *names[] = {"sequential", "nearly-sorted", "random"};
+  for(int input = 0; input < 3; input++){
+    if(input < 2){
+      fill_nearly_sorted(keys, N_BENCH, input == 0 ? 0 : 16);
+    }else{
+      for(int i = 0; i < N_BENCH; i++) keys[i] = rand();
+    }
+
+    for(int hinted = 0; hinted < 2; hinted++){
+      AvlTree *tree = make_tree_empty();
+      double start = now_seconds();
+      for(int i = 0; i < N_BENCH; i++){
+	if(hinted){
+	  avl_insert_hint(tree, keys[i], NULL);
+	}else{
+	  key_insert_new(keys[i], tree);
+	}
+      }
+      double elapsed = now_seconds() - start;
+      printf("insert %-14s %-6s %8.1f ns/op\n", names[input],
+	     hinted ? "hint" : "root", elapsed * 1e9 / N_BENCH);
+      free_tree(tree);
+    }
+  }
+
+  free(keys);
+}
+
+/**
+ * @brief Compare interval tree overlap queries against a linear
+ * scan over the same intervals, for a range of selectivities.
+ */
+void bench_interval_queries(){
+  int n = N_BENCH;
+  int space = 100000000;
+  int *starts = (int *)malloc(n * sizeof(int));
+  int *ends = (int *)malloc(n * sizeof(int));
+  assert(starts != NULL && ends != NULL);
+
+  IntervalTree *itree = make_interval_tree();
+  for(int i = 0; i < n; i++){
+    starts[i] = rand_in_range(0, space);
+    ends[i] = starts[i] + rand_in_range(1, 1000);
+    interval_insert(itree, starts[i], ends[i], NULL);
+  }
+
+  int n_queries = 100;
+  for(int width = 1; width <= space / 10; width *= 10){
+    long long hits = 0;
+    double start = now_seconds();
+    for(int q = 0; q < n_queries; q++){
+      int lo = rand_in_range(0, space - width);
+      hits += interval_overlap(itree, lo, lo + width, NULL, NULL);
+    }
+    double tree_time = now_seconds() - start;
+
+    start = now_seconds();
+    volatile long long scan_hits = 0;
+    for(int q = 0; q < n_queries; q++){
+      int lo = rand_in_range(0, space - width);
+      long long found = 0;
+      for(int i = 0; i < n; i++){
+	found += (starts[i] < lo + width && ends[i] > lo);
+      }
+      scan_hits += found;
+    }
+    double scan_time = now_seconds() - start;
+
+    printf("overlap width %-10d selectivity %8.4f%% tree %10.1f us/q"
+	   " scan %10.1f us/q\n", width, 100.0 * hits / n_queries / n,
+	   tree_time * 1e6 / n_queries, scan_time * 1e6 / n_queries);
+  }
+
+  free_interval_tree(itree);
+  free(starts);
+  free(ends);
+}
+
+/**
+ * @brief Compare the int core against the int64 specialization on
+ * random insertions and lookups of the same keys.
+ */
+void bench_typed_keys(){
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < N_BENCH; i++) keys[i] = rand();
+
+  AvlTree *tree = make_tree_empty();
+  double start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], tree);
+  double insert_time = now_seconds() - start;
+  Node *node = NULL;
+  long long found = 0;
+  start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++) found += search_by_key(keys[i], tree, &node);
+  double search_time = now_seconds() - start;
+  printf("keys int   insert %8.1f ns/op search %8.1f ns/op (%lld)\n",
+	 insert_time * 1e9 / N_BENCH, search_time * 1e9 / N_BENCH, found);
+  free_tree(tree);
+
+  avl_i64_tree *i64_tree = avl_i64_make_tree_empty();
+  start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++) avl_i64_key_insert_new(keys[i], i64_tree);
+  insert_time = now_seconds() - start;
+  avl_i64_node *i64_node = NULL;
+  found = 0;
+  start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++){
+    found += avl_i64_search_by_key(keys[i], i64_tree, &i64_node);
+  }
+  search_time = now_seconds() - start;
+  printf("keys int64 insert %8.1f ns/op search %8.1f ns/op (%lld)\n",
+	 insert_time * 1e9 / N_BENCH, search_time * 1e9 / N_BENCH, found);
+  avl_i64_free_tree(i64_tree);
+
+  free(keys);
+}
+
+// A string tree comparing through the full strings, for reference.
+#define AVL_PREFIX plain_str
+#define AVL_KEY_T const char *
+#include "avl_core.h"
+#define AVL_KEY_CMP(a, b) strcmp(a, b)
+#include "avl_core.c"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+#undef AVL_KEY_CMP
+
+/**
+ * @brief Compare lookups in the prefix caching string tree against
+ * a tree comparing full strings and against the int core, for
+ * typical identifier strings.
+ */
+void bench_string_keys(){
+  int n = N_BENCH;
+  char **ids = (char **)malloc(n * sizeof(char *));
+  int *keys = (int *)malloc(n * sizeof(int));
+  assert(ids != NULL && keys != NULL);
+  for(int i = 0; i < n; i++){
+    keys[i] = rand();
+    ids[i] = (char *)malloc(24);
+    assert(ids[i] != NULL);
+    // Identifiers share a short stem, like "order-1b3f29c7".
+    snprintf(ids[i], 24, "%s-%08x", (i % 2) ? "order" : "user", keys[i]);
+  }
+
+  AvlTree *tree = make_tree_empty();
+  StringTree *stree = make_string_tree(1);
+  plain_str_tree *ptree = plain_str_make_tree_empty();
+  for(int i = 0; i < n; i++){
+    key_insert_new(keys[i], tree);
+    string_insert(stree, ids[i], strlen(ids[i]), NULL);
+    plain_str_key_insert_new(ids[i], ptree);
+  }
+
+  long long found = 0;
+  Node *node = NULL;
+  double start = now_seconds();
+  for(int i = 0; i < n; i++) found += search_by_key(keys[i], tree, &node);
+  double int_time = now_seconds() - start;
+
+  avl_str_node *snode = NULL;
+  start = now_seconds();
+  for(int i = 0; i < n; i++){
+    found += string_search(stree, ids[i], strlen(ids[i]), &snode);
+  }
+  double prefix_time = now_seconds() - start;
+
+  plain_str_node *pnode = NULL;
+  start = now_seconds();
+  for(int i = 0; i < n; i++)
+    found += plain_str_search_by_key(ids[i], ptree, &pnode);
+  double plain_time = now_seconds() - start;
+
+  printf("lookup int %8.1f ns/op prefix-string %8.1f ns/op strcmp-string"
+	 " %8.1f ns/op (%lld)\n", int_time * 1e9 / n, prefix_time * 1e9 / n,
+	 plain_time * 1e9 / n, found);
+
+  free_tree(tree);
+  free_string_tree(stree);
+  plain_str_free_tree(ptree);
+  for(int i = 0; i < n; i++) free(ids[i]);
+  free(ids);
+  free(keys);
+}
+
+/**
+ * @brief Compare reading a small value stored inline in the node
+ * against one stored in a separate allocation behind Node.data.
+ */
+void bench_inline_values(){
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < N_BENCH; i++) keys[i] = rand();
+
+  // Build the trees one after the other, and allocate the separate
+  // values in a later pass, as they would be after some churn.
+  AvlTree *inline_tree = make_tree_with_values(2 * sizeof(long long));
+  for(int i = 0; i < N_BENCH; i++){
+    long long value[2] = {keys[i], i};
+    avl_insert_value(inline_tree, keys[i], value);
+  }
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], tree);
+  for(int i = 0; i < N_BENCH; i++){
+    long long value[2] = {keys[i], i};
+    Node *node = NULL;
+    search_by_key(keys[i], tree, &node);
+    if(node->data) continue;
+    node->data = malloc(sizeof(value));
+    assert(node->data != NULL);
+    memcpy(node->data, value, sizeof(value));
+  }
+
+  // Look the keys up in a different order than they were inserted,
+  // so the separate allocations are not visited sequentially.
+  int *order = (int *)malloc(N_BENCH * sizeof(int));
+  assert(order != NULL);
+  for(int i = 0; i < N_BENCH; i++) order[i] = keys[i];
+  for(int i = N_BENCH - 1; i > 0; i--){
+    int j = rand_in_range(0, i), tmp = order[i];
+    order[i] = order[j];
+    order[j] = tmp;
+  }
+
+  long long sum = 0;
+  Node *node = NULL;
+  double start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++){
+    if(search_by_key(order[i], tree, &node)) sum += ((long long *)node->data)[1];
+  }
+  double data_time = now_seconds() - start;
+
+  start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++){
+    long long *value = (long long *)avl_lookup_value(inline_tree, order[i]);
+    if(value) sum += value[1];
+  }
+  double inline_time = now_seconds() - start;
+
+  printf("value lookup data-pointer %8.1f ns/op inline %8.1f ns/op (%lld)\n",
+	 data_time * 1e9 / N_BENCH, inline_time * 1e9 / N_BENCH, sum);
+
+  for(node = avl_min(tree); node; node = avl_next(node)) free(node->data);
+  free_tree(tree);
+  free_tree(inline_tree);
+  free(order);
+  free(keys);
+}
+
+/**
+ * @brief Many small trees: build and random lookups in small
+ * trees against plain AVL-Trees holding the same keys.
+ */
+void bench_small_trees(){
+  int n_trees = N_BENCH / 8;
+  for(int size = 4; size <= 32; size *= 2){
+    SmallTree *small = (SmallTree *)malloc(n_trees * sizeof(SmallTree));
+    AvlTree **trees = (AvlTree **)malloc(n_trees * sizeof(AvlTree *));
+    assert(small != NULL && trees != NULL);
+
+    double start = now_seconds();
+    for(int t = 0; t < n_trees; t++){
+      trees[t] = make_tree_empty();
+      for(int i = 0; i < size; i++) key_insert_new(rand() % 1000, trees[t]);
+    }
+    double avl_build = now_seconds() - start;
+
+    start = now_seconds();
+    for(int t = 0; t < n_trees; t++){
+      small_tree_init(&small[t]);
+      for(int i = 0; i < size; i++){
+	small_insert(&small[t], rand() % 1000, NULL);
+      }
+    }
+    double small_build = now_seconds() - start;
+
+    int n_lookups = 4 * N_BENCH;
+    long found = 0;
+    Node *node = NULL;
+    start = now_seconds();
+    for(int i = 0; i < n_lookups; i++){
+      found += search_by_key(rand() % 1000, trees[rand() % n_trees], &node);
+    }
+    double avl_lookup = now_seconds() - start;
+
+    start = now_seconds();
+    for(int i = 0; i < n_lookups; i++){
+      found += small_search(&small[rand() % n_trees], rand() % 1000, NULL);
+    }
+    double small_lookup = now_seconds() - start;
+
+    printf("small trees of %2d  build avl %6.1f small %6.1f ns/key  "
+	   "lookup avl %6.1f small %6.1f ns/op (%ld)\n", size,
+	   avl_build * 1e9 / (n_trees * size),
+	   small_build * 1e9 / (n_trees * size),
+	   avl_lookup * 1e9 / n_lookups, small_lookup * 1e9 / n_lookups, found);
+
+    for(int t = 0; t < n_trees; t++){
+      free_tree(trees[t]);
+      small_tree_clear(&small[t]);
+    }
+    free(trees);
+    free(small);
+  }
+}
+
+/**
+ * @brief Scan and random lookup throughput of a tree.
+ * @param tree - The tree to measure.
+ * @param lookups - Keys to look up.
+ * @param scan_ns - Receives the scan time per node.
+ * @param lookup_ns - Receives the time per lookup.
+ */
+void measure_layout(AvlTree *tree, int *lookups, double *scan_ns,
+		    double *lookup_ns){
+  volatile long sink = 0;
+  double start = now_seconds();
+  for(int pass = 0; pass < 4; pass++){
+    long sum = 0;
+    for(Node *node = avl_min(tree); node; node = avl_next(node)){
+      sum += node->key;
+    }
+    sink += sum;
+  }
+  *scan_ns = (now_seconds() - start) * 1e9 / (4.0 * tree->number_of_nodes);
+
+  Node *node = NULL;
+  long found = 0;
+  start = now_seconds();
+  for(int i = 0; i < N_BENCH; i++){
+    found += search_by_key(lookups[i], tree, &node);
+  }
+  *lookup_ns = (now_seconds() - start) * 1e9 / N_BENCH;
+  sink += found;
+}
+
+/**
+ * @brief Scans and lookups on a tree fragmented by churn, before
+ * and after compaction in to each layout.
+ */
+void bench_compaction(){
+  static const char *names[] = {"in-order", "bfs", "veb"};
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  int *lookups = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL && lookups != NULL);
+
+  // Build, then replace half of the keys with interleaved
+  // deletions and insertions to scatter the nodes on the heap.
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < N_BENCH; i++){
+    keys[i] = rand();
+    key_insert_new(keys[i], tree);
+  }
+  for(int i = 0; i < N_BENCH; i += 2){
+    key_delete(keys[i], tree);
+    keys[i] = rand();
+    key_insert_new(keys[i], tree);
+  }
+  for(int i = 0; i < N_BENCH; i++) lookups[i] = keys[rand() % N_BENCH];
+
+  double scan_ns, lookup_ns;
+  measure_layout(tree, lookups, &scan_ns, &lookup_ns);
+  printf("layout %-10s scan %6.1f ns/node  lookup %7.1f ns/op\n",
+	 "churned", scan_ns, lookup_ns);
+
+  for(int layout = AVL_LAYOUT_INORDER; layout <= AVL_LAYOUT_VEB; layout++){
+    double start = now_seconds();
+    avl_compact(tree, (AvlLayout)layout);
+    double compact_ns = (now_seconds() - start) * 1e9 / tree->number_of_nodes;
+    measure_layout(tree, lookups, &scan_ns, &lookup_ns);
+    printf("layout %-10s scan %6.1f ns/node  lookup %7.1f ns/op  "
+	   "(compaction %5.1f ns/node)\n", names[layout], scan_ns,
+	   lookup_ns, compact_ns);
+  }
+
+  free_tree(tree);
+  free(lookups);
+  free(keys);
+}
+
+/**
+ * @brief Bulk construction from unsorted keys: one insertion per
+ * key against the parallel build at different thread counts.
+ */
+void bench_parallel_build(){
+  int n = 4 * N_BENCH;
+  int *keys = (int *)malloc(n * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < n; i++) keys[i] = rand();
+
+  AvlTree *tree;
+  double start;
+  for(int threads = 1; threads <= 32; threads *= 2){
+    start = now_seconds();
+    tree = avl_build_parallel(keys, n, threads);
+    double build_time = now_seconds() - start;
+    printf("build %d keys  %2d threads %8.1f ms\n", n, threads,
+	   build_time * 1e3);
+    free_tree(tree);
+  }
+
+  start = now_seconds();
+  tree = make_tree_empty();
+  for(int i = 0; i < n; i++) key_insert_new(keys[i], tree);
+  double insert_time = now_seconds() - start;
+  printf("build %d keys  insertion  %8.1f ms\n", n, insert_time * 1e3);
+  free_tree(tree);
+  free(keys);
+}
+
+/**
+ * @brief Map function of the reduction benchmark: the key.
+ */
+void map_key(void *out, Node *node, void *ctx){
+  *(long long *)out = node->key;
+}
+
+/**
+ * @brief Combine function of the reduction benchmark: the sum.
+ */
+void combine_sum(void *out, const void *a, const void *b, void *ctx){
+  *(long long *)out = *(const long long *)a + *(const long long *)b;
+}
+
+/**
+ * @brief Summing the keys of a tree: a sequential in-order walk
+ * against the parallel reduction at different thread counts.
+ */
+void bench_parallel_reduce(){
+  int n = 4 * N_BENCH;
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < n; i++) key_insert_new(rand(), tree);
+
+  double start = now_seconds();
+  long long expect = 0;
+  for(Node *node = avl_min(tree); node; node = avl_next(node)){
+    expect += node->key;
+  }
+  printf("reduce %d nodes  sequential %7.1f ms\n", tree->number_of_nodes,
+	 (now_seconds() - start) * 1e3);
+
+  for(int threads = 1; threads <= 32; threads *= 2){
+    long long sum = 0;
+    start = now_seconds();
+    avl_parallel_reduce(tree, map_key, combine_sum, sizeof(sum), &sum, NULL,
+			threads);
+    double reduce_time = now_seconds() - start;
+    printf("reduce %d nodes  %2d threads %7.1f ms%s\n", tree->number_of_nodes,
+	   threads, reduce_time * 1e3, (sum == expect) ? "" : "  WRONG");
+  }
+  free_tree(tree);
+}
+
+/**
+ * @brief State shared by the threads of the contention benchmark.
+ */
+typedef struct contention_s {
+  AvlTree *tree;
+  FlatCombiner *fc;
+  pthread_mutex_t mutex;
+  int spinlock;
+  int mode; // 0 - mutex, 1 - spinlock, 2 - flat combining.
+  int ops_per_thread;
+} Contention;
+
+/**
+ * @brief Apply one operation directly to the tree.
+ */
+int apply_direct(AvlTree *tree, int op, int key){
+  Node *node = NULL;
+  if(op == FC_SEARCH) return search_by_key(key, tree, &node);
+  if(op == FC_INSERT) return key_insert_new(key, tree);
+  return key_delete(key, tree);
+}
+
+/**
+ * @brief Thread body of the contention benchmark: half searches,
+ * a quarter insertions and a quarter deletions of random keys.
+ */
+void * contention_thread(void *arg){
+  Contention *c = (Contention *)arg;
+  int slot = (c->mode == 2) ? fc_register(c->fc) : 0;
+  unsigned seed = (unsigned)(size_t)&slot;
+  long sum = 0;
+
+  for(int i = 0; i < c->ops_per_thread; i++){
+    seed = seed * 1103515245 + 12345;
+    int key = (seed >> 4) & 0xfffff;
+    int op = ((seed >> 28) < 8) ? FC_SEARCH
+      : ((seed >> 28) < 12) ? FC_INSERT : FC_DELETE;
+    if(c->mode == 0){
+      pthread_mutex_lock(&c->mutex);
+      sum += apply_direct(c->tree, op, key);
+      pthread_mutex_unlock(&c->mutex);
+    }else if(c->mode == 1){
+      while(__atomic_exchange_n(&c->spinlock, 1, __ATOMIC_ACQUIRE)){
+	while(__atomic_load_n(&c->spinlock, __ATOMIC_RELAXED)) sched_yield();
+      }
+      sum += apply_direct(c->tree, op, key);
+      __atomic_store_n(&c->spinlock, 0, __ATOMIC_RELEASE);
+    }else{
+      sum += fc_apply(c->fc, slot, (FcOp)op, key, NULL);
+    }
+  }
+  return (void *)sum;
+}
+
+/**
+ * @brief Many threads updating one tree: a mutex, a spinlock and
+ * the flat combiner at 1 to 64 threads.
+ */
+void bench_flat_combining(){
+  static const char *names[] = {"mutex", "spinlock", "flat-combining"};
+  int total_ops = N_BENCH / 2;
+  pthread_t ids[64];
+
+  for(int threads = 1; threads <= 64; threads *= 2){
+    printf("contention %2d threads", threads);
+    for(int mode = 0; mode < 3; mode++){
+      Contention c;
+      c.tree = make_tree_empty();
+      for(int i = 0; i < N_BENCH / 2; i++){
+	key_insert_new(rand() & 0xfffff, c.tree);
+      }
+      c.fc = make_flat_combiner(c.tree, threads);
+      pthread_mutex_init(&c.mutex, NULL);
+      c.spinlock = 0;
+      c.mode = mode;
+      c.ops_per_thread = total_ops / threads;
+
+      double start = now_seconds();
+      for(int t = 0; t < threads; t++){
+	pthread_create(&ids[t], NULL, contention_thread, &c);
+      }
+      for(int t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+      double elapsed = now_seconds() - start;
+      printf("  %s %6.2f Mops/s", names[mode],
+	     c.ops_per_thread * threads / elapsed * 1e-6);
+      if(mode == 2){
+	printf(" (%.1f ops/pass)", (double)c.fc->combined / c.fc->passes);
+      }
+
+      pthread_mutex_destroy(&c.mutex);
+      free_flat_combiner(c.fc);
+      free_tree(c.tree);
+    }
+    printf("\n");
+  }
+}
+
+/**
+ * @brief Draw a rank from a Zipf-like distribution over n ranks,
+ * by inverting the continuous (Pareto) approximation of its CDF.
+ * @param n - The number of ranks.
+ * @param exponent - The Zipf exponent, at least 1.
+ * @return A rank in [0, n).
+ */
+int zipf_rank(int n, double exponent){
+  double u = rand() / (RAND_MAX + 1.0);
+  double rank = (exponent == 1.0) ? exp(u * log(n))
+    : pow(1.0 - u * (1.0 - pow(n, 1.0 - exponent)), 1.0 / (1.0 - exponent));
+  return ((int)rank < n) ? (int)rank - 1 : n - 1;
+}
+
+/**
+ * @brief Skewed lookups with and without a hot-key cache of
+ * different sizes, for Zipf exponents 1.0 and 1.5.
+ */
+void bench_hot_key_cache(){
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  int *lookups = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL && lookups != NULL);
+
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < N_BENCH; i++){
+    keys[i] = rand();
+    key_insert_new(keys[i], tree);
+  }
+
+  for(int skew = 0; skew < 2; skew++){
+    double exponent = 1.0 + 0.5 * skew;
+    for(int i = 0; i < N_BENCH; i++){
+      lookups[i] = keys[zipf_rank(N_BENCH, exponent)];
+    }
+
+    for(int entries = 0; entries <= 65536;
+	entries = entries ? entries * 4 : 1024){
+      if(entries) avl_cache_attach(tree, entries);
+      Node *node = NULL;
+      long found = 0;
+      double start = now_seconds();
+      for(int pass = 0; pass < 2; pass++){
+	for(int i = 0; i < N_BENCH; i++){
+	  found += search_by_key(lookups[i], tree, &node);
+	}
+      }
+      double lookup_ns = (now_seconds() - start) * 1e9 / (2.0 * N_BENCH);
+      printf("zipf %.1f lookup  cache %5d entries %7.1f ns/op", exponent,
+	     entries, lookup_ns);
+      if(entries){
+	AvlCacheStats stats = avl_cache_stats(tree);
+	printf("  hit rate %4.1f%%  evictions %ld",
+	       100.0 * stats.hits / (stats.hits + stats.misses),
+	       stats.evictions);
+	avl_cache_detach(tree);
+      }
+      printf(" (%ld)\n", found);
+    }
+  }
+  free_tree(tree);
+  free(lookups);
+  free(keys);
+}
+
+/**
+ * @brief Lookups of which 70% miss, without and with a negative
+ * lookup filter at different false positive rates.
+ */
+void bench_negative_filter(){
+  static const double rates[] = {0.0, 0.05, 0.01, 0.001};
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  int *lookups = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL && lookups != NULL);
+
+  // Even keys are in the tree, odd ones are not.
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < N_BENCH; i++){
+    keys[i] = rand() & ~1;
+    key_insert_new(keys[i], tree);
+  }
+  for(int i = 0; i < N_BENCH; i++){
+    lookups[i] = (rand() % 10 < 7) ? (rand() | 1) : keys[rand() % N_BENCH];
+  }
+
+  for(int r = 0; r < 4; r++){
+    if(rates[r] > 0.0) avl_filter_attach(tree, N_BENCH, rates[r]);
+    long found = 0;
+    double start = now_seconds();
+    for(int i = 0; i < N_BENCH; i++){
+      found += avl_contains(tree, lookups[i]);
+    }
+    double lookup_ns = (now_seconds() - start) * 1e9 / N_BENCH;
+    if(rates[r] > 0.0){
+      AvlFilterStats stats = avl_filter_stats(tree);
+      printf("70%% misses  filter fp %5.3f %7.1f ns/op  measured fp %5.3f"
+	     " (%ld)\n", rates[r], lookup_ns, (double)stats.false_positives
+	     / (stats.rejected + stats.false_positives), found);
+      avl_filter_detach(tree);
+    }else{
+      printf("70%% misses  no filter       %7.1f ns/op (%ld)\n", lookup_ns,
+	     found);
+    }
+  }
+  free_tree(tree);
+  free(lookups);
+  free(keys);
+}
+
+/**
+ * @brief Read a file in 1 MiB chunks without parsing it.
+ * @return The number of bytes read.
+ */
+long read_only(const char *path){
+  static char buf[1 << 20];
+  long bytes = 0;
+  size_t n;
+  FILE *file = fopen(path, "rb");
+  assert(file != NULL);
+  while((n = fread(buf, 1, sizeof(buf), file)) > 0) bytes += n;
+  fclose(file);
+  return bytes;
+}
+
+/**
+ * @brief Load a sorted key file by reading all keys in to an array
+ * and inserting them one by one, the old way.
+ * @return The number of keys in the tree.
+ */
+int load_by_insertion(const char *path, AvlKeyFormat format){
+  int capacity = 1024, n = 0;
+  int *keys = (int *)malloc(capacity * sizeof(int));
+  FILE *file = fopen(path, format == AVL_KEYS_BINARY ? "rb" : "r");
+  assert(keys != NULL && file != NULL);
+  for(;;){
+    if(n == capacity){
+      capacity *= 2;
+      keys = (int *)realloc(keys, capacity * sizeof(int));
+      assert(keys != NULL);
+    }
+    if(format == AVL_KEYS_BINARY ? fread(&keys[n], sizeof(int), 1, file) != 1
+       : fscanf(file, "%d", &keys[n]) != 1) break;
+    n++;
+  }
+  fclose(file);
+
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < n; i++) key_insert_new(keys[i], tree);
+  int loaded = tree->number_of_nodes;
+  free_tree(tree);
+  free(keys);
+  return loaded;
+}
+
+/**
+ * @brief Loading sorted binary and text key files: raw read speed,
+ * parse-then-insert and the streaming loader.
+ */
+void bench_stream_load(){
+  const char *paths[] = {"out/bench-keys.bin", "out/bench-keys.txt"};
+  const char *names[] = {"binary", "text"};
+  int n = 4 * N_BENCH;
+
+  FILE *bin = fopen(paths[0], "wb"), *text = fopen(paths[1], "w");
+  assert(bin != NULL && text != NULL);
+  int key = -2147483647 - 1;
+  for(int i = 0; i < n; i++){
+    key += rand_in_range(1, 1000);
+    fwrite(&key, sizeof(int), 1, bin);
+    fprintf(text, "%d\n", key);
+  }
+  fclose(bin);
+  fclose(text);
+
+  for(int f = 0; f < 2; f++){
+    AvlKeyFormat format = f ? AVL_KEYS_TEXT : AVL_KEYS_BINARY;
+    read_only(paths[f]); // Warm the page cache.
+    double start = now_seconds();
+    long bytes = read_only(paths[f]);
+    double read_ms = (now_seconds() - start) * 1e3;
+
+    start = now_seconds();
+    int inserted = load_by_insertion(paths[f], format);
+    double insert_ms = (now_seconds() - start) * 1e3;
+
+    AvlTree *tree = make_tree_empty();
+    start = now_seconds();
+    int loaded = avl_load_sorted_file(tree, paths[f], format, NULL, NULL);
+    double stream_ms = (now_seconds() - start) * 1e3;
+    free_tree(tree);
+
+    printf("%-6s %4ld MiB  read only %7.1f ms  parse+insert %7.1f ms"
+	   "  stream load %7.1f ms (%d/%d keys)\n", names[f], bytes >> 20,
+	   read_ms, insert_ms, stream_ms, loaded, inserted);
+    remove(paths[f]);
+  }
+}
+
+/**
+ * @brief Diff callback counting the differences.
+ */
+void count_difference(int key, Node *a, Node *b, void *ctx){
+  (*(long *)ctx)++;
+}
+
+/**
+ * @brief Diff two trees the old way: walk both in key order.
+ * @return The number of differences.
+ */
+long diff_by_scan(AvlTree *a, AvlTree *b){
+  long differences = 0;
+  Node *x = avl_min(a), *y = avl_min(b);
+  while(x || y){
+    if(y == NULL || (x && x->key < y->key)){
+      differences++;
+      x = avl_next(x);
+    }else if(x == NULL || y->key < x->key){
+      differences++;
+      y = avl_next(y);
+    }else{
+      x = avl_next(x);
+      y = avl_next(y);
+    }
+  }
+  return differences;
+}
+
+/**
+ * @brief Insertion cost of the Merkle augmentation, and diffing two
+ * replicas by full scan and by avl_diff, for growing differences.
+ */
+void bench_merkle_diff(){
+  static const int deltas[] = {0, 10, 100, 1000, 10000, 100000};
+  int *keys = (int *)malloc(N_BENCH * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < N_BENCH; i++) keys[i] = rand();
+
+  for(int merkle = 0; merkle < 2; merkle++){
+    AvlTree *tree = make_tree_empty();
+    if(merkle) avl_augment_attach(tree, &avl_augment_merkle);
+    double start = now_seconds();
+    for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], tree);
+    printf("insert %-7s %7.1f ns/op\n", merkle ? "merkle" : "plain",
+	   (now_seconds() - start) * 1e9 / N_BENCH);
+    free_tree(tree);
+  }
+
+  for(int d = 0; d < 6; d++){
+    AvlTree *a = make_tree_empty(), *b = make_tree_empty();
+    avl_augment_attach(a, &avl_augment_merkle);
+    avl_augment_attach(b, &avl_augment_merkle);
+    for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], a);
+    for(int i = N_BENCH - 1; i >= 0; i--) key_insert_new(keys[i], b);
+    for(int i = 0; i < deltas[d]; i++) key_delete(keys[rand() % N_BENCH], b);
+
+    double start = now_seconds();
+    long scanned = diff_by_scan(a, b);
+    double scan_ms = (now_seconds() - start) * 1e3;
+    long found = 0;
+    start = now_seconds();
+    avl_diff(a, b, count_difference, &found);
+    double diff_ms = (now_seconds() - start) * 1e3;
+
+    printf("%6ld differences  scan %8.3f ms  avl_diff %8.3f ms\n", found,
+	   scan_ms, diff_ms);
+    if(found != scanned) printf("Mismatch: scan found %ld\n", scanned);
+    free_tree(a);
+    free_tree(b);
+  }
+  free(keys);
+}
+
+/**
+ * @brief A burst of random insertions and deletions in to a populated
+ * tree, strict and in relaxed balance with different piggyback
+ * budgets, including the final rebalance.
+ */
+void bench_relaxed_balance(){
+  static const int piggybacks[] = {-1, 0, 1, 4};
+  int *keys = (int *)malloc(2 * N_BENCH * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < 2 * N_BENCH; i++) keys[i] = rand();
+
+  for(int p = 0; p < 4; p++){
+    AvlTree *tree = make_tree_empty();
+    for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], tree);
+
+    if(piggybacks[p] >= 0) avl_relaxed_begin(tree, piggybacks[p]);
+    double start = now_seconds();
+    for(int i = N_BENCH; i < 2 * N_BENCH; i++){
+      key_insert_new(keys[i], tree);
+      if(i & 1) key_delete(keys[i - N_BENCH], tree);
+    }
+    double burst_ns = (now_seconds() - start) * 1e9 / (1.5 * N_BENCH);
+    start = now_seconds();
+    if(piggybacks[p] >= 0) avl_relaxed_end(tree);
+    double end_ms = (now_seconds() - start) * 1e3;
+
+    // Lookups afterwards, to show the tree is back in shape.
+    Node *node = NULL;
+    long found = 0;
+    start = now_seconds();
+    for(int i = 0; i < N_BENCH; i++){
+      found += search_by_key(keys[N_BENCH + i], tree, &node);
+    }
+    double search_ns = (now_seconds() - start) * 1e9 / N_BENCH;
+
+    if(piggybacks[p] < 0){
+      printf("strict               burst %6.1f ns/op                    ",
+	     burst_ns);
+    }else{
+      printf("relaxed piggyback %d  burst %6.1f ns/op  rebalance %6.1f ms",
+	     piggybacks[p], burst_ns, end_ms);
+    }
+    printf("  then search %6.1f ns/op (%ld, height %d)\n", search_ns, found,
+	   tree->height);
+    free_tree(tree);
+  }
+  free(keys);
+}
+
+/**
+ * @brief Cost of tracing: a mix of insertions, deletions and
+ * searches, untraced and recorded to a trace file.
+ */
+void bench_trace_overhead(){
+  const char *path = "out/bench-trace.bin";
+  int *keys = (int *)malloc(2 * N_BENCH * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < 2 * N_BENCH; i++) keys[i] = rand() % (2 * N_BENCH);
+
+  for(int traced = 0; traced < 2; traced++){
+    AvlTree *tree = make_tree_empty();
+    for(int i = 0; i < N_BENCH; i++) key_insert_new(keys[i], tree);
+    AvlTrace *trace = traced ? avl_trace_start(tree, path) : NULL;
+
+    Node *node = NULL;
+    long found = 0;
+    double start = now_seconds();
+    for(int i = N_BENCH; i < 2 * N_BENCH; i++){
+      key_insert_new(keys[i], tree);
+      found += search_by_key(keys[i - N_BENCH], tree, &node);
+      if(i & 1) key_delete(keys[i - N_BENCH / 2], tree);
+    }
+    double ns = (now_seconds() - start) * 1e9 / (2.5 * N_BENCH);
+    long records = trace ? avl_trace_stop(trace) : 0;
+
+    if(traced){
+      printf("traced    %6.1f ns/op  (%ld records, %ld bytes each)\n", ns,
+	     records, (long)AVL_TRACE_RECORD_SIZE);
+    }else{
+      printf("untraced  %6.1f ns/op  (%ld found)\n", ns, found);
+    }
+    free_tree(tree);
+  }
+  remove(path);
+  free(keys);
+}
+
+/**
+ * @brief The benchmarks, by name.
+ */
+#define SEQ_LENGTH (1 << 18) // Length of the edited sequences.
+#define SEQ_EDITS (1 << 14) // Edits per sequence benchmark.
+
+/**
+ * @brief A gap buffer: an array with a movable hole at the position
+ * of the last edit.
+ */
+typedef struct {
+  void **items;
+  int gap_start, gap_end, capacity;
+} GapBuffer;
+
+/**
+ * @brief Move the gap of a gap buffer to a position.
+ * @param gb - The gap buffer.
+ * @param index - The new start of the gap.
+ */
+void gap_move(GapBuffer *gb, int index){
+  if(index < gb->gap_start){
+    int n = gb->gap_start - index;
+    memmove(gb->items + gb->gap_end - n, gb->items + index, n * sizeof(void *));
+    gb->gap_start -= n;
+    gb->gap_end -= n;
+  }else if(index > gb->gap_start){
+    int n = index - gb->gap_start;
+    memmove(gb->items + gb->gap_start, gb->items + gb->gap_end,
+	    n * sizeof(void *));
+    gb->gap_start += n;
+    gb->gap_end += n;
+  }
+}
+
+/**
+ * @brief Get the element at a position of a gap buffer.
+ */
+void * gap_get(GapBuffer *gb, int index){
+  if(index >= gb->gap_start) index += gb->gap_end - gb->gap_start;
+  return gb->items[index];
+}
+
+/**
+ * @brief Apply an edit to one of the compared sequences.
+ * @param kind - 0: positional AVL tree, 1: gap buffer, 2: flat array.
+ * @param seq - The sequence.
+ * @param length - The current length, updated.
+ * @param insert - 1 to insert in front of index, 0 to erase at index.
+ * @param index - The position.
+ */
+void seq_edit(int kind, void *seq, int *length, int insert, int index){
+  if(kind == 0){
+    if(insert) avl_seq_insert_at((AvlTree *)seq, index, NULL);
+    else avl_seq_erase_at((AvlTree *)seq, index, NULL);
+  }else if(kind == 1){
+    GapBuffer *gb = (GapBuffer *)seq;
+    gap_move(gb, index);
+    if(insert) gb->items[gb->gap_start++] = NULL;
+    else gb->gap_end++;
+  }else{
+    void **items = (void **)seq;
+    if(insert){
+      memmove(items + index + 1, items + index,
+	      (*length - index) * sizeof(void *));
+      items[index] = NULL;
+    }else{
+      memmove(items + index, items + index + 1,
+	      (*length - index - 1) * sizeof(void *));
+    }
+  }
+  *length += insert ? 1 : -1;
+}
+
+/**
+ * @brief Compare the positional mode against a gap buffer and a flat
+ * array: alternating insertions and deletions at random positions and
+ * near a moving cursor, and random reads. Also bulk appends against
+ * appends one by one, and split and join.
+ */
+void bench_sequence(){
+  static const char *kinds[] = {"avl", "gap-buffer", "array"};
+  static const char *patterns[] = {"random", "cursor"};
+  int *positions = (int *)malloc(SEQ_EDITS * sizeof(int));
+  void **items = (void **)calloc(2 * SEQ_LENGTH, sizeof(void *));
+  assert(positions != NULL && items != NULL);
+
+  for(int pattern = 0; pattern < 2; pattern++){
+    // Positions below the length, so that every edit is valid.
+    int cursor = SEQ_LENGTH / 2;
+    for(int i = 0; i < SEQ_EDITS; i++){
+      if(pattern == 0){
+	positions[i] = rand_in_range(0, SEQ_LENGTH - 1);
+      }else{
+	cursor += rand_in_range(-16, 16);
+	if(cursor < 0) cursor = 0;
+	if(cursor > SEQ_LENGTH - 1) cursor = SEQ_LENGTH - 1;
+	positions[i] = cursor;
+      }
+    }
+
+    for(int kind = 0; kind < 3; kind++){
+      AvlTree *tree = NULL;
+      GapBuffer gb = {items, SEQ_LENGTH, 2 * SEQ_LENGTH, 2 * SEQ_LENGTH};
+      void *seq = items;
+      if(kind == 0){
+	tree = make_tree_empty();
+	avl_seq_attach(tree);
+	avl_seq_append(tree, items, SEQ_LENGTH);
+	seq = tree;
+      }else if(kind == 1){
+	seq = &gb;
+      }
+
+      int length = SEQ_LENGTH;
+      double start = now_seconds();
+      for(int i = 0; i < SEQ_EDITS; i++){
+	seq_edit(kind, seq, &length, !(i & 1), positions[i]);
+      }
+      double edit_ns = (now_seconds() - start) * 1e9 / SEQ_EDITS;
+
+      volatile long sum = 0;
+      start = now_seconds();
+      for(int i = 0; i < SEQ_EDITS; i++){
+	int index = positions[SEQ_EDITS - 1 - i];
+	if(kind == 0) sum += (long)avl_seq_get(tree, index)->data;
+	else if(kind == 1) sum += (long)gap_get(&gb, index);
+	else sum += (long)items[index];
+      }
+      double get_ns = (now_seconds() - start) * 1e9 / SEQ_EDITS;
+
+      printf("sequence %-7s %-10s  edit %9.1f ns/op  get %6.1f ns/op\n",
+	     patterns[pattern], kinds[kind], edit_ns, get_ns);
+      if(tree) free_tree(tree);
+    }
+  }
+
+  // Building: appends one by one against a bulk append.
+  for(int bulk = 0; bulk < 2; bulk++){
+    AvlTree *tree = make_tree_empty();
+    avl_seq_attach(tree);
+    double start = now_seconds();
+    if(bulk){
+      avl_seq_append(tree, items, SEQ_LENGTH);
+    }else{
+      for(int i = 0; i < SEQ_LENGTH; i++){
+	avl_seq_insert_at(tree, i, items[i]);
+      }
+    }
+    printf("sequence append %-10s %6.1f ns/element\n",
+	   bulk ? "bulk" : "one-by-one",
+	   (now_seconds() - start) * 1e9 / SEQ_LENGTH);
+
+    // Split at random positions and join the halves again.
+    if(bulk){
+      start = now_seconds();
+      for(int i = 0; i < SEQ_EDITS; i++){
+	AvlTree *rest = avl_seq_split(tree, positions[i]);
+	avl_seq_concat(tree, rest);
+      }
+      printf("sequence split+concat     %6.1f ns/op (height %d)\n",
+	     (now_seconds() - start) * 1e9 / SEQ_EDITS, tree->height);
+    }
+    free_tree(tree);
+  }
+
+  free(positions);
+  free(items);
+}
+
+#define EXPIRY_STEPS 20 // Time steps of the expiry benchmark.
+
+/**
+ * @brief Compare bulk expiration against the periodic scan it
+ * replaces, on an ordered cache of N_BENCH entries with random time
+ * to live, and the cost of hiding expired entries from lookups.
+ */
+void bench_expiry(){
+  int per_step = N_BENCH / 200; // Entries inserted (and expiring) per step.
+  for(int mode = 0; mode < 2; mode++){
+    // The scan keeps the deadlines as inline values.
+    AvlTree *tree;
+    if(mode == 0){
+      tree = make_tree_empty();
+      avl_expiry_attach(tree, 1);
+    }else{
+      tree = make_tree_with_values(sizeof(long long));
+    }
+    int *expired = (int *)malloc(N_BENCH * sizeof(int));
+    assert(expired != NULL);
+
+    // Fill, then run steps of inserting and expiring at equal rates.
+    srand(42);
+    long removed = 0;
+    double expire_s = 0, insert_s = 0;
+    for(int step = 0; step < EXPIRY_STEPS; step++){
+      double start = now_seconds();
+      for(int i = 0; i < (step ? per_step : N_BENCH); i++){
+	long long deadline = step + rand_in_range(1, 199);
+	if(mode == 0) avl_insert_expiring(tree, rand(), deadline);
+	else avl_insert_value(tree, rand(), &deadline);
+      }
+      double middle = now_seconds();
+      if(mode == 0){
+	removed += avl_expire(tree, step, NULL, NULL);
+      }else{
+	int n = 0;
+	for(Node *node = avl_min(tree); node; node = avl_next(node)){
+	  if(*(long long *)avl_value(tree, node) <= step){
+	    expired[n++] = node->key;
+	  }
+	}
+	for(int i = 0; i < n; i++) key_delete(expired[i], tree);
+	removed += n;
+      }
+      if(step > 0){
+	insert_s += middle - start;
+	expire_s += now_seconds() - middle;
+      }
+    }
+
+    // Lookups of random keys, expired ones hidden in the expiring tree.
+    Node *node = NULL;
+    long found = 0;
+    double start = now_seconds();
+    for(int i = 0; i < N_BENCH; i++){
+      found += search_by_key(rand(), tree, &node);
+    }
+    double search_ns = (now_seconds() - start) * 1e9 / N_BENCH;
+
+    printf("expiry %-5s %7d entries  expire %8.3f ms/step  insert %6.1f ns/op"
+	   "  search %6.1f ns/op (%ld expired)\n",
+	   mode == 0 ? "heap" : "scan", tree->number_of_nodes,
+	   expire_s * 1e3 / (EXPIRY_STEPS - 1),
+	   insert_s * 1e9 / ((double)(EXPIRY_STEPS - 1) * per_step), search_ns,
+	   removed);
+    free(expired);
+    free_tree(tree);
+  }
+}
+
+/**
+ * @brief Order points by x, for the x index of the range benchmark.
+ */
+int compare_point_x(const void *a, const void *b){
+  int x = ((const RangePoint *)a)->x, y = ((const RangePoint *)b)->x;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Compare range counting with the 2-D range tree against an
+ * x index (binary search on x, then filtering y) on random points,
+ * for growing x widths at a fixed 1% y selectivity.
+ */
+void bench_range_tree(){
+  int n = N_BENCH / 4;
+  int space = 1000000;
+  RangePoint *points = (RangePoint *)malloc(n * sizeof(RangePoint));
+  assert(points != NULL);
+  for(int i = 0; i < n; i++){
+    points[i].x = rand_in_range(0, space);
+    points[i].y = rand_in_range(0, space);
+    points[i].data = NULL;
+  }
+
+  double start = now_seconds();
+  RangeTree *rtree = make_range_tree(points, n);
+  double build_time = now_seconds() - start;
+  assert(rtree != NULL);
+  start = now_seconds();
+  qsort(points, n, sizeof(RangePoint), compare_point_x);
+  double sort_time = now_seconds() - start;
+  printf("range build %d points: tree %8.1f ms (%ld entries), x index"
+	 " %8.1f ms\n", n, build_time * 1e3, rtree->number_of_entries,
+	 sort_time * 1e3);
+
+  int n_queries = 1000, height = space / 100;
+  for(int width = space / 1000; width <= space; width *= 10){
+    int *x_lo = (int *)malloc(n_queries * sizeof(int));
+    int *y_lo = (int *)malloc(n_queries * sizeof(int));
+    assert(x_lo != NULL && y_lo != NULL);
+    for(int q = 0; q < n_queries; q++){
+      x_lo[q] = rand_in_range(0, space - width);
+      y_lo[q] = rand_in_range(0, space - height);
+    }
+
+    long long hits = 0;
+    start = now_seconds();
+    for(int q = 0; q < n_queries; q++){
+      hits += range_count(rtree, x_lo[q], x_lo[q] + width, y_lo[q],
+			  y_lo[q] + height);
+    }
+    double tree_time = now_seconds() - start;
+
+    volatile long long index_hits = 0;
+    start = now_seconds();
+    for(int q = 0; q < n_queries; q++){
+      // Binary search for the first point at or above x_lo.
+      int lo = 0, hi = n;
+      while(lo < hi){
+	int mid = lo + (hi - lo) / 2;
+	if(points[mid].x < x_lo[q]) lo = mid + 1;
+	else hi = mid;
+      }
+      long long found = 0;
+      for(; lo < n && points[lo].x <= x_lo[q] + width; lo++){
+	found += points[lo].y >= y_lo[q] && points[lo].y <= y_lo[q] + height;
+      }
+      index_hits += found;
+    }
+    double index_time = now_seconds() - start;
+
+    printf("range x width %-8d hits %8.1f/q  tree %8.2f us/q  x index"
+	   " %10.2f us/q%s\n", width, (double)hits / n_queries,
+	   tree_time * 1e6 / n_queries, index_time * 1e6 / n_queries,
+	   index_hits == hits ? "" : "  (MISMATCH)");
+    free(x_lo);
+    free(y_lo);
+  }
+
+  free_range_tree(rtree);
+  free(points);
+}
+
+/**
+ * @brief Order keys, for the dump-and-sort baseline of the merge
+ * benchmark.
+ */
+int compare_keys(const void *a, const void *b){
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Compare the k-way merge against dumping every partition in
+ * order and sorting the concatenation, for N_BENCH random keys spread
+ * over a growing number of trees: a full ordered scan, and short
+ * scans of 100 keys from a random lower bound.
+ */
+void bench_merge_iterator(){
+  int *dump = (int *)malloc(N_BENCH * sizeof(int));
+  assert(dump != NULL);
+  for(int k = 4; k <= 256; k *= 4){
+    AvlTree **trees = (AvlTree **)malloc(k * sizeof(AvlTree *));
+    assert(trees != NULL);
+    for(int t = 0; t < k; t++) trees[t] = make_tree_empty();
+    for(int i = 0; i < N_BENCH; i++){
+      key_insert_new(rand(), trees[rand_in_range(0, k - 1)]);
+    }
+
+    // Full scan: dump and sort.
+    double start = now_seconds();
+    int n = 0;
+    for(int t = 0; t < k; t++){
+      for(Node *node = avl_min(trees[t]); node; node = avl_next(node)){
+	dump[n++] = node->key;
+      }
+    }
+    qsort(dump, n, sizeof(int), compare_keys);
+    double sort_time = now_seconds() - start;
+
+    // Full scan: merge.
+    start = now_seconds();
+    AvlMerge *merge = make_avl_merge(trees, k, AVL_MERGE_ALL);
+    int merged = 0, ordered = 1;
+    for(Node *node; (node = avl_merge_next(merge, NULL)); merged++){
+      ordered &= merged < n && node->key == dump[merged];
+    }
+    double merge_time = now_seconds() - start;
+
+    // Short scans from a lower bound.
+    int n_scans = 1000;
+    long long sum = 0;
+    start = now_seconds();
+    for(int q = 0; q < n_scans; q++){
+      avl_merge_seek(merge, rand());
+      for(int i = 0; i < 100; i++){
+	Node *node = avl_merge_next(merge, NULL);
+	if(node == NULL) break;
+	sum += node->key;
+      }
+    }
+    double scan_us = (now_seconds() - start) * 1e6 / n_scans;
+    free_avl_merge(merge);
+
+    printf("merge %3d trees %7d keys  dump+sort %8.1f ms  merge %8.1f ms"
+	   " (%5.1f ns/key%s)  seek+100 %7.2f us\n", k, n, sort_time * 1e3,
+	   merge_time * 1e3, merge_time * 1e9 / n,
+	   (ordered && merged == n) ? "" : ", MISMATCH", scan_us);
+
+    for(int t = 0; t < k; t++) free_tree(trees[t]);
+    free(trees);
+  }
+  free(dump);
+}
+
+struct {
+  const char *name;
+  void (*run)();
+} benchmarks[] = {
+  {"hint", bench_hinted_insertion},
+  {"interval", bench_interval_queries},
+  {"typed", bench_typed_keys},
+  {"string", bench_string_keys},
+  {"values", bench_inline_values},
+  {"small", bench_small_trees},
+  {"compact", bench_compaction},
+  {"build", bench_parallel_build},
+  {"reduce", bench_parallel_reduce},
+  {"combining", bench_flat_combining},
+  {"cache", bench_hot_key_cache},
+  {"filter", bench_negative_filter},
+  {"stream", bench_stream_load},
+  {"merkle", bench_merkle_diff},
+  {"relaxed", bench_relaxed_balance},
+  {"trace", bench_trace_overhead},
+  {"sequence", bench_sequence},
+  {"expiry", bench_expiry},
+  {"range", bench_range_tree},
+  {"merge", bench_merge_iterator},
+};
+
+/**
+ * @brief Run all benchmarks, or only those named on the command line.
+ */
+int main(int argc, char **argv){
+  int n_benchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  for(int i = 0; i < n_benchmarks; i++){
+    int selected = (argc < 2);
+    for(int a = 1; a < argc; a++){
+      if(strcmp(argv[a], benchmarks[i].name) == 0) selected = 1;
+    }
+    if(!selected) continue;
+    srand(42);
+    benchmarks[i].run();
+  }
+  return 0;
+}
@@ -0,0 +1,544 @@
+/* Basic AVL-Tree implementation - Profiling harness */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * Hardware performance counter profile of the core operations
+ * (Linux only, through perf_event_open). For every key
+ * distribution and tree size, search, insertion and deletion
+ * are measured in batches of at most 1/16 of the tree size,
+ * every batch inserted and deleted again so that the tree keeps
+ * its size. The totals are measured with the counters. Every
+ * batch is then run again with the core's phase hooks (the core
+ * is built with -DAVL_PROFILE, see AVL_PHASE_DESCENT), which
+ * measure the descent, the allocation (with the memory
+ * accounting), the (un)linking with rebalancing and the freeing
+ * inside the operations themselves, less the calibrated cost of
+ * a hook. The counters form one group, so they are scheduled
+ * together, and the hooks read them from user space with rdpmc
+ * through the counters' mmap pages; where rdpmc is not possible
+ * (no x86, software counters, or the kernel does not allow it)
+ * the phase rows carry the time only. Prints one CSV row per
+ * phase, averaged per operation. Phases below the hook overhead
+ * are clamped to zero and reported on stderr. Counters the
+ * machine does not provide (e.g. in a virtual machine) are left
+ * empty.
+ */
+
+#define _GNU_SOURCE
+
+#include "avl_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <assert.h>
+
+#define N_OPS 65536 // Operations per measured batch.
+#define N_COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+// Cache event configuration: cache, operation and result.
+#define CACHE_EVENT(cache, op, result) \
+  ((cache) | ((op) << 8) | ((result) << 16))
+
+/**
+ * @brief A performance counter, opened once for the process as a
+ * member of the counter group.
+ */
+struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+  int fd;    // -1 if not available.
+  int slot;  // Position of the value in a reading of the group.
+  struct perf_event_mmap_page *page; // For rdpmc, NULL if impossible.
+} counters[] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, -1, NULL},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+   -1, -1, NULL},
+  {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+   -1, -1, NULL},
+  {"l1d_misses", PERF_TYPE_HW_CACHE,
+   CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+	       PERF_COUNT_HW_CACHE_RESULT_MISS), -1, -1, NULL},
+  {"llc_misses", PERF_TYPE_HW_CACHE,
+   CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+	       PERF_COUNT_HW_CACHE_RESULT_MISS), -1, -1, NULL},
+  {"dtlb_misses", PERF_TYPE_HW_CACHE,
+   CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+	       PERF_COUNT_HW_CACHE_RESULT_MISS), -1, -1, NULL},
+  {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,
+   -1, -1, NULL},
+};
+
+/**
+ * @brief The counter group: the first counter opened leads it.
+ */
+struct {
+  int leader;  // File descriptor of the leader, -1 if none.
+  int members; // Number of counters in the group.
+} group = {-1, 0};
+
+/**
+ * @brief The measurement of one phase, summed over the operations
+ * measured so far. Negative counter values mark counters that are
+ * not available.
+ */
+typedef struct {
+  double ns;
+  double values[N_COUNTERS];
+  long ops;
+} Sample;
+
+/**
+ * @brief The phase measuring state, fed by the core's
+ * avl_profile_phase hooks (see AVL_PHASE_DESCENT).
+ */
+struct {
+  int active;   // Whether the hooks are recorded.
+  int current;  // The phase running, -1 between operations.
+  long long last_ns;
+  uint64_t last[N_COUNTERS];
+  long long ns[AVL_PHASES];
+  uint64_t counts[AVL_PHASES][N_COUNTERS];
+  long marks[AVL_PHASES];
+} phases;
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds.
+ * @return The current time in nanoseconds.
+ */
+long long now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Open all counters for the calling process, user space only,
+ * as one group, so that they are always scheduled together and the
+ * phase hooks see consistent readings. The first counter available
+ * leads the group. Readings are scaled by the time the group
+ * actually ran, in case the kernel multiplexes it with others.
+ * Hardware counters are also mapped, for reading them with rdpmc.
+ */
+void open_counters(){
+  long page_size = sysconf(_SC_PAGESIZE);
+  for(size_t c = 0; c < N_COUNTERS; c++){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counters[c].type;
+    attr.config = counters[c].config;
+    attr.disabled = (group.leader < 0); // Members follow the leader.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+      | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    counters[c].fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1,
+				  group.leader, 0);
+    if(counters[c].fd < 0){
+      fprintf(stderr, "Counter %s not available.\n", counters[c].name);
+      continue;
+    }
+    if(group.leader < 0) group.leader = counters[c].fd;
+    counters[c].slot = group.members++;
+
+    // Software counters have no hardware register to read.
+    if(counters[c].type == PERF_TYPE_SOFTWARE) continue;
+    void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED,
+		      counters[c].fd, 0);
+    if(page != MAP_FAILED) counters[c].page = page;
+  }
+}
+
+/**
+ * @brief Reset and start the counter group.
+ */
+void start_counters(){
+  if(group.leader < 0) return;
+  ioctl(group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+/**
+ * @brief Stop the counter group and add its readings to a sample.
+ * @param sample - The sample to add to.
+ * @param ops - The number of operations measured.
+ */
+void stop_counters(Sample *sample, int ops){
+  // Number of values, time enabled, time running, then the values.
+  uint64_t reading[3 + N_COUNTERS] = {0};
+  ssize_t size = (3 + group.members) * sizeof(uint64_t);
+  int valid = 0;
+  if(group.leader >= 0){
+    ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    valid = read(group.leader, reading, size) == size && reading[2] > 0;
+  }
+
+  for(size_t c = 0; c < N_COUNTERS; c++){
+    if(counters[c].fd < 0 || !valid){
+      sample->values[c] = -1.0;
+    }else if(sample->values[c] >= 0){
+      sample->values[c] += reading[3 + counters[c].slot]
+	* ((double)reading[1] / reading[2]);
+    }
+  }
+  sample->ops += ops;
+}
+
+/**
+ * @brief Read a hardware counter from user space with rdpmc, through
+ * its mmap page: the kernel's part of the count plus the register,
+ * retried until the page did not change meanwhile.
+ * @param page - The mmap page of the counter.
+ * @param count - Receives the count.
+ * @return 1 on success, 0 if rdpmc is not possible (no x86, not
+ * allowed, or the counter is not scheduled).
+ */
+int read_rdpmc(volatile struct perf_event_mmap_page *page, uint64_t *count){
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t seq, index;
+  uint64_t value;
+  do{
+    seq = page->lock;
+    __asm__ volatile("" ::: "memory");
+    index = page->index;
+    value = page->offset;
+    if(!page->cap_user_rdpmc || index == 0) return 0;
+    uint32_t low, high;
+    __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index - 1));
+    // Sign extend the register from its width.
+    int shift = 64 - page->pmc_width;
+    value += (uint64_t)((int64_t)(((uint64_t)high << 32 | low) << shift)
+			>> shift);
+    __asm__ volatile("" ::: "memory");
+  }while(page->lock != seq);
+  *count = value;
+  return 1;
+#else
+  (void)page;
+  (void)count;
+  return 0;
+#endif
+}
+
+/**
+ * @brief Read all counters that rdpmc can read. Counters it cannot
+ * read any more are dropped from the phase measurements for good.
+ * @param counts - Receives the counts, by counter.
+ */
+void read_counts(uint64_t counts[N_COUNTERS]){
+  for(size_t c = 0; c < N_COUNTERS; c++){
+    if(counters[c].page && !read_rdpmc(counters[c].page, &counts[c])){
+      counters[c].page = NULL;
+    }
+  }
+}
+
+/**
+ * @brief Print one CSV row, averaged per operation.
+ * @param dist - Name of the key distribution.
+ * @param size - Size of the tree.
+ * @param op - Name of the operation.
+ * @param phase - Name of the phase.
+ * @param sample - The readings of the phase.
+ */
+void print_row(const char *dist, int size, const char *op, const char *phase,
+	       const Sample *sample){
+  double ops = sample->ops ? sample->ops : 1;
+  printf("%s,%d,%s,%s,%.1f", dist, size, op, phase, sample->ns / ops);
+  for(size_t c = 0; c < N_COUNTERS; c++){
+    if(sample->values[c] < 0) printf(",");
+    else printf(",%.3f", sample->values[c] / ops);
+  }
+  // Instructions per cycle.
+  if(sample->values[0] > 0 && sample->values[1] >= 0){
+    printf(",%.2f\n", sample->values[1] / sample->values[0]);
+  }else{
+    printf(",\n");
+  }
+}
+
+/**
+ * @brief Hook of the core (built with -DAVL_PROFILE): end the running
+ * phase and start the next one. Ignored unless phases.active is set.
+ * @param phase - The phase starting, AVL_PHASE_DONE at the end of
+ * an operation.
+ */
+void avl_profile_phase(int phase){
+  if(!phases.active) return;
+  uint64_t counts[N_COUNTERS] = {0};
+  read_counts(counts);
+  long long now = now_ns();
+  if(phases.current >= 0){
+    phases.ns[phases.current] += now - phases.last_ns;
+    for(size_t c = 0; c < N_COUNTERS; c++){
+      phases.counts[phases.current][c] += counts[c] - phases.last[c];
+    }
+    phases.marks[phases.current]++;
+  }
+  phases.current = (phase == AVL_PHASE_DONE) ? -1 : phase;
+  // The hook's own cost is left out of the next phase.
+  phases.last_ns = now_ns();
+  read_counts(phases.last);
+}
+
+/**
+ * @brief Clear the phase measurements and start recording the hooks,
+ * with the counter group running.
+ */
+void begin_phases(){
+  memset(phases.ns, 0, sizeof(phases.ns));
+  memset(phases.counts, 0, sizeof(phases.counts));
+  memset(phases.marks, 0, sizeof(phases.marks));
+  memset(phases.last, 0, sizeof(phases.last));
+  phases.current = -1;
+  if(group.leader >= 0){
+    ioctl(group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+  phases.active = 1;
+}
+
+/**
+ * @brief Stop recording the hooks and the counter group.
+ */
+void end_phases(){
+  phases.active = 0;
+  if(group.leader >= 0){
+    ioctl(group.leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+/**
+ * @brief Measure what one phase costs the hooks themselves: the time
+ * and the counts of an empty phase, to be taken off every phase
+ * measured.
+ * @param overhead - Receives the overhead per phase.
+ */
+void calibrate_phases(Sample *overhead){
+  begin_phases();
+  for(int i = 0; i < N_OPS; i++){
+    avl_profile_phase(AVL_PHASE_DESCENT);
+    avl_profile_phase(AVL_PHASE_DONE);
+  }
+  end_phases();
+  overhead->ns = (double)phases.ns[AVL_PHASE_DESCENT] / N_OPS;
+  for(size_t c = 0; c < N_COUNTERS; c++){
+    overhead->values[c] = (double)phases.counts[AVL_PHASE_DESCENT][c] / N_OPS;
+  }
+  overhead->ops = 1;
+}
+
+/**
+ * @brief Run a batch of operations with the phase hooks recorded,
+ * adding the time and the number of every phase to a sample.
+ * @param sample - Receives the phase times and counts, per phase.
+ * @param tree - The tree to operate on.
+ * @param keys - The keys of the batch.
+ * @param n - The number of keys.
+ * @param insert - Whether to insert the keys, or delete them.
+ */
+void run_phases(Sample sample[AVL_PHASES], AvlTree *tree, const int *keys,
+		int n, int insert){
+  begin_phases();
+  for(int i = 0; i < n; i++){
+    if(insert) key_insert_new(keys[i], tree);
+    else key_delete(keys[i], tree);
+  }
+  end_phases();
+  for(int p = 0; p < AVL_PHASES; p++){
+    sample[p].ns += phases.ns[p];
+    for(size_t c = 0; c < N_COUNTERS; c++){
+      // Counters rdpmc could not read stay unavailable.
+      if(counters[c].page == NULL) sample[p].values[c] = -1.0;
+      else if(sample[p].values[c] >= 0){
+	sample[p].values[c] += phases.counts[p][c];
+      }
+    }
+    sample[p].ops += phases.marks[p];
+  }
+}
+
+/**
+ * @brief Turn the phase measurements summed by run_phases in to
+ * values per operation, correcting for the hook overhead. Phases
+ * that come out negative (noise larger than the phase) are clamped
+ * to zero and reported on stderr.
+ * @param sample - The phase samples, corrected in place.
+ * @param ops - The number of operations run.
+ * @param overhead - The hook overhead per phase (calibrate_phases).
+ * @param what - Name of the operation, for the report.
+ */
+void finish_phases(Sample sample[AVL_PHASES], long ops,
+		   const Sample *overhead, const char *what){
+  for(int p = 0; p < AVL_PHASES; p++){
+    Sample *out = &sample[p];
+    out->ns -= overhead->ns * out->ops;
+    int clamped = out->ns < 0;
+    if(clamped) out->ns = 0;
+    for(size_t c = 0; c < N_COUNTERS; c++){
+      if(out->values[c] < 0) continue;
+      out->values[c] -= overhead->values[c] * out->ops;
+      if(out->values[c] < 0){
+	out->values[c] = 0;
+	clamped = 1;
+      }
+    }
+    if(clamped){
+      fprintf(stderr, "%s: phase %d below the hook overhead, clamped to 0.\n",
+	      what, p);
+    }
+    out->ops = ops;
+  }
+}
+
+/**
+ * @brief Draw a key of a distribution.
+ * @param dist - 0: uniform, 1: ascending, 2: clustered in 16 narrow
+ * ranges of 2^20 keys.
+ * @param next - Counter of the ascending distribution.
+ * @return The key.
+ */
+int draw_key(int dist, int *next){
+  switch(dist){
+  case 1:
+    return (*next)++;
+  case 2:
+    return (rand() % 16) * (1 << 26) + rand() % (1 << 20);
+  default:
+    return rand();
+  }
+}
+
+// Measure a loop over a batch, with counters and wall-clock time.
+#define MEASURE(sample, n, body)					\
+  do{									\
+    start_counters();							\
+    long long start_ = now_ns();					\
+    for(int i = 0; i < (n); i++){ body; }				\
+    (sample).ns += now_ns() - start_;					\
+    stop_counters(&(sample), (n));					\
+  }while(0)
+
+/**
+ * @brief Profile the operations on one tree size and distribution.
+ * Insertions and deletions run in batches of at most size / 16 keys,
+ * each batch inserted and then deleted again, so the tree stays
+ * within 1/16 of its nominal size. Every batch runs twice on the
+ * same tree: once with the counters for the totals, and once with
+ * the core's phase hooks for the split in to phases.
+ * @param dist - The key distribution (see draw_key).
+ * @param size - The number of keys in the tree.
+ * @param overhead - The hook overhead per phase (calibrate_phases).
+ */
+void profile_tree(int dist, int size, const Sample *overhead){
+  static const char *dist_names[] = {"uniform", "ascending", "clustered"};
+  const char *name = dist_names[dist];
+  int next = 0, batch = (size / 16 < N_OPS) ? size / 16 : N_OPS;
+
+  AvlTree *tree = make_tree_empty(), *drawn = make_tree_empty();
+  int *present = (int *)malloc(size * sizeof(int));
+  int *fresh = (int *)malloc(N_OPS * sizeof(int));
+  assert(tree != NULL && drawn != NULL && present != NULL && fresh != NULL);
+
+  int n_present = 0;
+  while(n_present < size){
+    int key = draw_key(dist, &next);
+    if(key_insert_new(key, tree)) present[n_present++] = key;
+  }
+  // Distinct absent keys to be inserted, drawn up front so that
+  // drawing them does not warm the caches for the measured batch.
+  for(int i = 0; i < N_OPS; i++){
+    Node *node = NULL;
+    do fresh[i] = draw_key(dist, &next);
+    while(search_by_key(fresh[i], tree, &node) ||
+	  !key_insert_new(fresh[i], drawn));
+  }
+  free_tree(drawn);
+
+  Node *node = NULL;
+  volatile long found = 0;
+  Sample search = {0, {0}, 0}, insert = {0, {0}, 0}, delete = {0, {0}, 0};
+  Sample insert_phases[AVL_PHASES], delete_phases[AVL_PHASES];
+  memset(insert_phases, 0, sizeof(insert_phases));
+  memset(delete_phases, 0, sizeof(delete_phases));
+
+  // Search: the descent only.
+  MEASURE(search, N_OPS, found += search_by_key(present[rand() % n_present],
+						tree, &node));
+  print_row(name, size, "search", "descent", &search);
+
+  for(int first = 0; first + batch <= N_OPS; first += batch){
+    const int *keys = fresh + first;
+    MEASURE(insert, batch, found += key_insert_new(keys[i], tree));
+    MEASURE(delete, batch, found += key_delete(keys[i], tree));
+    // The same batch again, split in to phases.
+    run_phases(insert_phases, tree, keys, batch, 1);
+    run_phases(delete_phases, tree, keys, batch, 0);
+  }
+
+  // Insertion: descent, allocation and linking with rebalancing.
+  finish_phases(insert_phases, insert.ops, overhead, "insert");
+  print_row(name, size, "insert", "descent",
+	    &insert_phases[AVL_PHASE_DESCENT]);
+  print_row(name, size, "insert", "allocation",
+	    &insert_phases[AVL_PHASE_ALLOC]);
+  print_row(name, size, "insert", "rebalance",
+	    &insert_phases[AVL_PHASE_REBALANCE]);
+  print_row(name, size, "insert", "total", &insert);
+
+  // Deletion: descent, unlinking with rebalancing and freeing.
+  finish_phases(delete_phases, delete.ops, overhead, "delete");
+  print_row(name, size, "delete", "descent",
+	    &delete_phases[AVL_PHASE_DESCENT]);
+  print_row(name, size, "delete", "rebalance",
+	    &delete_phases[AVL_PHASE_REBALANCE]);
+  print_row(name, size, "delete", "free", &delete_phases[AVL_PHASE_FREE]);
+  print_row(name, size, "delete", "total", &delete);
+
+  free_tree(tree);
+  free(present);
+  free(fresh);
+}
+
+/**
+ * @brief Profile all distributions and tree sizes, CSV on stdout.
+ */
+int main(int argc, char **argv){
+  static const int sizes[] = {1 << 10, 1 << 14, 1 << 17, 1 << 20};
+
+  open_counters();
+  Sample overhead;
+  calibrate_phases(&overhead);
+  fprintf(stderr, "Phase hook overhead: %.1f ns per phase.\n", overhead.ns);
+  printf("distribution,size,operation,phase,ns");
+  for(size_t c = 0; c < N_COUNTERS; c++) printf(",%s", counters[c].name);
+  printf(",ipc\n");
+
+  for(int dist = 0; dist < 3; dist++){
+    for(int s = 0; s < 4; s++){
+      srand(42);
+      profile_tree(dist, sizes[s], &overhead);
+    }
+  }
+  return 0;
+}
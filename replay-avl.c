@@ -0,0 +1,222 @@
+/* Basic AVL-Tree implementation - Trace replay */
+/*
+ * Author: Philipp Schaad
+ * Creation Date: 191026
+ *
+ * # ------------------------------------------- #
+ * # ---------------- COPYRIGHT ---------------- #
+ * # ------------------------------------------- #
+ * # This file is part of the AVL-Tree project.  #
+ * # Author of this project is Philipp Schaad.   #
+ * # For additional Licensing information see    #
+ * # the provided LICENSE file. For contact      #
+ * # information see the README.                 #
+ * # ------------------------------------------- #
+ *
+ * Description:
+ * Replays a trace recorded by the tracing module (avl_trace)
+ * against the current build. The keys present when the trace
+ * started are loaded first, untimed. The calls are then run
+ * twice on fresh trees: once back to back for the throughput,
+ * and once timing every call for the latency histograms, per
+ * operation, in power of two buckets. Results differing from
+ * the recorded ones are counted as divergences.
+ *
+ * Usage: avl_replay <trace file>
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "avl_core.h"
+#include "avl_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define N_OPS (AVL_TRACE_SEQ_SPLIT + 1) // Traced operations.
+#define N_BUCKETS 40 // Latency buckets: [2^b, 2^(b+1)) nanoseconds.
+
+static const char *op_names[N_OPS] = {
+  "search", "insert", "insert-hint", "delete", "pop-min", "pop-max",
+  "floor", "ceiling", "predecessor", "successor", "k-nearest",
+  "range-aggr", "augment-set", "seq-attach", "seq-insert", "seq-erase",
+  "seq-get", "seq-index", "seq-append", "seq-concat", "seq-split"
+};
+
+/**
+ * @brief Latencies of one operation.
+ */
+typedef struct {
+  long count;
+  double total_ns, max_ns;
+  long buckets[N_BUCKETS];
+} Latency;
+
+/**
+ * @brief Get a monotonic timestamp in seconds.
+ * @return The current time in seconds.
+ */
+double now_seconds(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief Read all records of a trace in to memory, so that the
+ * replay does not wait for the file.
+ * @param path - The trace file.
+ * @param n - Receives the number of records.
+ * @return The records, NULL if the trace could not be read.
+ */
+AvlTraceRecord * read_trace(const char *path, long *n){
+  int error = 0;
+  AvlTraceReader *reader = avl_trace_open(path, &error);
+  if(reader == NULL){
+    fprintf(stderr, "Cannot read trace %s (error %d).\n", path, error);
+    return NULL;
+  }
+
+  long capacity = 1 << 16;
+  AvlTraceRecord *records =
+    (AvlTraceRecord *)malloc(capacity * sizeof(AvlTraceRecord));
+  *n = 0;
+  int status = 0;
+  while(records && (status = avl_trace_next(reader, &records[*n])) == 1){
+    if(++*n == capacity){
+      capacity *= 2;
+      records = (AvlTraceRecord *)realloc(records,
+					  capacity * sizeof(AvlTraceRecord));
+    }
+  }
+  avl_trace_close(reader);
+
+  if(records == NULL){
+    // Memory allocation failed, report and exit.
+    printf("Memory allocation failed while reading a trace.\n");
+    exit(1); // Throw memory allocation error.
+  }
+  if(status < 0){
+    fprintf(stderr, "Trace %s is damaged (error %d), using %ld records.\n",
+	    path, status, *n);
+  }
+  return records;
+}
+
+/**
+ * @brief Create a tree holding the nodes present when the trace
+ * started, positional if the trace starts in positional mode.
+ * @param records - The records.
+ * @param n - The number of records.
+ * @param first - Receives the index of the first traced call.
+ * @return The tree.
+ */
+AvlTree * load_tree(const AvlTraceRecord *records, long n, long *first){
+  AvlTree *tree = make_tree_empty();
+  assert(tree != NULL);
+  long i = 0;
+  if(n > 0 && records[0].op == AVL_TRACE_SEQ_ATTACH){
+    avl_trace_apply(tree, &records[i++]);
+  }
+  while(i < n && records[i].op == AVL_TRACE_LOAD){
+    avl_trace_apply(tree, &records[i++]);
+  }
+  *first = i;
+  return tree;
+}
+
+/**
+ * @brief Print the latency histogram of an operation.
+ * @param name - The name of the operation.
+ * @param lat - Its latencies.
+ */
+void print_latency(const char *name, const Latency *lat){
+  // Percentiles at bucket resolution: the upper bound of the bucket.
+  long p50 = 0, p99 = 0, seen = 0;
+  for(int b = 0; b < N_BUCKETS; b++){
+    seen += lat->buckets[b];
+    if(!p50 && seen * 2 >= lat->count) p50 = 1L << (b + 1);
+    if(!p99 && seen * 100 >= lat->count * 99) p99 = 1L << (b + 1);
+  }
+  printf("%-12s %10ld calls  mean %8.1f ns  p50 < %6ld ns  p99 < %8ld ns"
+	 "  max %10.0f ns\n", name, lat->count, lat->total_ns / lat->count,
+	 p50, p99, lat->max_ns);
+
+  long peak = 1;
+  for(int b = 0; b < N_BUCKETS; b++){
+    if(lat->buckets[b] > peak) peak = lat->buckets[b];
+  }
+  for(int b = 0; b < N_BUCKETS; b++){
+    if(lat->buckets[b] == 0) continue;
+    char bar[41];
+    int width = (int)(40 * lat->buckets[b] / peak);
+    memset(bar, '#', width);
+    bar[width] = '\0';
+    printf("  [%9ld, %9ld) ns %10ld %s\n", 1L << b, 1L << (b + 1),
+	   lat->buckets[b], bar);
+  }
+}
+
+/**
+ * @brief Replay a trace, reporting throughput and latencies.
+ */
+int main(int argc, char **argv){
+  if(argc != 2){
+    fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+    return 2;
+  }
+
+  long n = 0, first = 0;
+  AvlTraceRecord *records = read_trace(argv[1], &n);
+  if(records == NULL) return 1;
+
+  // The recorded run, for comparison.
+  double recorded_ns = 0;
+  for(long i = 0; i < n; i++) recorded_ns += records[i].delta_ns;
+
+  // Throughput, calls back to back.
+  AvlTree *tree = load_tree(records, n, &first);
+  long calls = n - first, divergences = 0;
+  double start = now_seconds();
+  for(long i = first; i < n; i++){
+    divergences += avl_trace_apply(tree, &records[i]) != records[i].result;
+  }
+  double seconds = now_seconds() - start;
+  free_tree(tree);
+
+  printf("Trace %s: %ld keys loaded, %ld calls.\n", argv[1], first, calls);
+  printf("Recorded: %.3f s, replayed: %.3f s, %.0f calls/s.\n",
+	 recorded_ns * 1e-9, seconds, calls / (seconds > 0 ? seconds : 1e-9));
+  printf("Divergences from the recorded results: %ld\n", divergences);
+
+  // Latencies, every call timed on its own.
+  Latency latency[N_OPS];
+  memset(latency, 0, sizeof(latency));
+  tree = load_tree(records, n, &first);
+  for(long i = first; i < n; i++){
+    double begin = now_seconds();
+    avl_trace_apply(tree, &records[i]);
+    double ns = (now_seconds() - begin) * 1e9;
+
+    if(records[i].op < 0 || records[i].op >= N_OPS) continue;
+    Latency *lat = &latency[records[i].op];
+    int bucket = 0;
+    while(bucket < N_BUCKETS - 1 && ns >= (double)(1L << (bucket + 1))){
+      bucket++;
+    }
+    lat->buckets[bucket]++;
+    lat->count++;
+    lat->total_ns += ns;
+    if(ns > lat->max_ns) lat->max_ns = ns;
+  }
+  free_tree(tree);
+
+  for(int op = 0; op < N_OPS; op++){
+    if(latency[op].count) print_latency(op_names[op], &latency[op]);
+  }
+  free(records);
+  return divergences ? 3 : 0;
+}
@@ -1,61 +1,2136 @@
+// Needed by avl_core.c, included below for a custom instance.
+#define _POSIX_C_SOURCE 200112L
+
 #include "avl_core.h"
 #include "avl_visualizer.h"
+#include "avl_interval.h"
+#include "avl_typed.h"
+#include "avl_string.h"
+#include "avl_small.h"
+#include "avl_parallel.h"
+#include "avl_combining.h"
+#include "avl_stream.h"
+#include "avl_trace.h"
+#include "avl_range.h"
+#include "avl_merge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+#define N_INSERT 1000 // The number of values to insert.
+#define N_REMOVE 900 // The numver of values to delete. 
+
+int has(AvlTree *tree, int key){
+  Node *node = NULL;
+  return search_by_key(key, tree, &node);
+}
+
+/**
+ * @brief Generate a random number in a given range.
+ * @param min - The lower bound of the range.
+ * @param max - The upper bound of the range.
+ * @return A random number in the given range.
+ */
+int rand_in_range(int min, int max){
+  return min + rand() / (RAND_MAX / (max - min + 1) + 1);
+}
+
+/**
+ * @brief Recursively recalculate the height of every node.
+ * @param node - The currently looked at node.
+ * @return The height of the node currently looked at.
+ */
+int rec_height(Node *node){
+  if(!node) return -1;
+  node->height = get_int_max(
+			     rec_height(node->left_child),
+			     rec_height(node->right_child)) + 1;
+  return node->height;
+}
+
+/**
+ * @brief Recursively check if the tree holds the avl property.
+ * For this to give the correct result, the height of every node
+ * has to be correct in advance. It is recommended to run rec_height
+ * on the root, before executing the check_avl_property function.
+ * @param node - The currently looked at node. 
+ * @return 1 - If the avl property holds, 0 - otherwise.
+ */
+int check_avl_property(Node *node){
+  if(!node) return 1;
+  int l_height = -1;
+  int r_height = -1;
+  if(node->left_child) l_height = node->left_child->height;
+  if(node->right_child) r_height = node->right_child->height;
+  int bal = r_height - l_height;
+  int is_avl = ((bal >= -1) && (bal <= 1)) ? 1 : 0;
+  return is_avl
+    && check_avl_property(node->left_child)
+    && check_avl_property(node->right_child);
+}
+
+/**
+ * @brief Count the nodes of a subtree.
+ * @param node - The root of the subtree.
+ * @return The number of nodes.
+ */
+int count_nodes(Node *node){
+  if(!node) return 0;
+  return 1 + count_nodes(node->left_child) + count_nodes(node->right_child);
+}
+
+/**
+ * @brief Check the avl property and the number of nodes of a tree.
+ * @param tree - The tree to check.
+ * @param name - Name of the test, used for reporting.
+ * @return 1 - If the tree is consistent, 0 - otherwise.
+ */
+int check_tree(AvlTree *tree, const char *name){
+  rec_height(tree->root);
+  if(!check_avl_property(tree->root)){
+    printf("%s: AVL property violated.\n", name);
+    return 0;
+  }
+  int count = count_nodes(tree->root);
+  if(count != tree->number_of_nodes){
+    printf("%s: %d nodes linked, but %d counted.\n", name, count,
+	   tree->number_of_nodes);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Test hinted insertion on ascending, descending and
+ * nearly sorted keys, with and without explicit hints.
+ */
+void test_hinted_insertion(){
+  AvlTree *tree = make_tree_empty();
+
+  // Ascending keys, using the finger.
+  for(int i = 0; i < N_INSERT; i++){
+    avl_insert_hint(tree, i * 4, NULL);
+  }
+  // Descending keys in between, using the finger.
+  for(int i = N_INSERT - 1; i >= 0; i--){
+    avl_insert_hint(tree, i * 4 + 2, NULL);
+  }
+  // Keys close to an explicitly given node.
+  Node *hint = NULL;
+  search_by_key(N_INSERT * 2, tree, &hint);
+  for(int i = 0; i < N_INSERT; i++){
+    avl_insert_hint(tree, rand_in_range(0, N_INSERT * 4), hint);
+  }
+  // Duplicates must be rejected.
+  if(avl_insert_hint(tree, 8, NULL) || avl_insert_hint(tree, 8, hint)){
+    printf("Hinted insertion accepted a duplicate key!\n");
+  }
+
+  for(int i = 0; i < N_INSERT * 2; i++){
+    if(!has(tree, i * 2)){
+      printf("Did not find key %d despite having added it (hinted)!\n",
+	     i * 2);
+    }
+  }
+  if(check_tree(tree, "Hinted insertion")){
+    printf("Hinted insertion: AVL property satisfied.\n");
+  }
+  free_tree(tree);
+}
+
+/**
+ * @brief Test the cached minimum and maximum and using the tree
+ * as a double ended priority queue.
+ */
+void test_min_max(){
+  AvlTree *tree = make_tree_empty();
+
+  if(avl_min(tree) || avl_max(tree) || avl_pop_min(tree, NULL, NULL)){
+    printf("Empty tree reports a minimum or maximum!\n");
+  }
+
+  for(int i = 0; i < N_INSERT; i++){
+    key_insert_new(rand_in_range(1, 9999999), tree);
+  }
+
+  // Alternately pop from both ends, checking the order and the
+  // cached extremes against the spines of the tree.
+  int last_min = 0, last_max = 10000000, key = 0;
+  while(tree->number_of_nodes > 0){
+    Node *spine = tree->root;
+    while(spine->left_child) spine = spine->left_child;
+    if(avl_min(tree) != spine){
+      printf("Cached minimum is out of date!\n");
+    }
+    spine = tree->root;
+    while(spine->right_child) spine = spine->right_child;
+    if(avl_max(tree) != spine){
+      printf("Cached maximum is out of date!\n");
+    }
+
+    if(tree->number_of_nodes % 2){
+      avl_pop_min(tree, &key, NULL);
+      if(key <= last_min) printf("Popped minimum out of order!\n");
+      last_min = key;
+    }else{
+      avl_pop_max(tree, &key, NULL);
+      if(key >= last_max) printf("Popped maximum out of order!\n");
+      last_max = key;
+    }
+    // Mix in deletions of arbitrary keys.
+    if(tree->root && tree->number_of_nodes % 7 == 0){
+      key_delete(tree->root->key, tree);
+    }
+  }
+
+  if(tree->root == NULL && !avl_min(tree) && !avl_max(tree)){
+    printf("Priority queue: drained correctly.\n");
+  }
+  free_tree(tree);
+}
+
+/**
+ * @brief Non-commutative combine function for the augmentation test.
+ * Concatenates two polynomial hashes of (length, hash) pairs.
+ */
+void combine_poly_hash(void *out, const void *a, const void *b, void *ctx){
+  const unsigned long long *x = (const unsigned long long *)a;
+  const unsigned long long *y = (const unsigned long long *)b;
+  unsigned long long pow = 1;
+  for(unsigned long long i = 0; i < y[0]; i++) pow *= 31;
+  unsigned long long len = x[0] + y[0];
+  unsigned long long hash = x[1] * pow + y[1];
+  ((unsigned long long *)out)[0] = len;
+  ((unsigned long long *)out)[1] = hash;
+}
+
+/**
+ * @brief Test range aggregates of the built-in and a custom
+ * augmentation against a brute force computation.
+ */
+void test_augmentation(){
+  const AvlAugment *builtins[] = {
+    &avl_augment_sum_i64, &avl_augment_min_i64, &avl_augment_max_i64
+  };
+  AvlAugment poly = {AVL_AUG_CUSTOM, 2 * sizeof(unsigned long long),
+		     combine_poly_hash, NULL};
+  int range = N_INSERT * 4;
+  long long values[N_INSERT * 4 + 1];
+  int errors = 0;
+
+  for(int kind = 0; kind < 4; kind++){
+    AvlTree *tree = make_tree_empty();
+    avl_augment_attach(tree, kind < 3 ? builtins[kind] : &poly);
+    for(int i = 0; i <= range; i++) values[i] = -1;
+
+    // Insert, then delete some, then change some values in place.
+    for(int i = 0; i < N_INSERT; i++){
+      int key = rand_in_range(0, range);
+      long long value = rand_in_range(-1000, 1000);
+      unsigned long long pair[2] = {1, (unsigned long long)value};
+      if(kind < 3 ? avl_augment_insert(tree, key, &value)
+	 : avl_augment_insert(tree, key, pair)){
+	values[key] = value;
+      }
+    }
+    for(int i = 0; i < N_REMOVE / 2; i++){
+      int key = rand_in_range(0, range);
+      if(key_delete(key, tree)) values[key] = -1;
+    }
+    for(int i = 0; i < N_REMOVE / 2; i++){
+      Node *node = NULL;
+      int key = rand_in_range(0, range);
+      if(!search_by_key(key, tree, &node)) continue;
+      long long value = rand_in_range(-1000, 1000);
+      unsigned long long pair[2] = {1, (unsigned long long)value};
+      avl_augment_set(tree, node, kind < 3 ? (void *)&value : (void *)pair);
+      values[key] = value;
+    }
+
+    // Compare random ranges against brute force.
+    for(int q = 0; q < 200; q++){
+      // rand_in_range needs min < max.
+      int lo = rand_in_range(0, range), hi = lo;
+      if(lo < range) hi = lo + rand_in_range(0, range - lo);
+      long long expect = 0;
+      unsigned long long expect_pair[2] = {0, 0};
+      int any = 0;
+      for(int k = lo; k <= hi; k++){
+	if(values[k] == -1 && !has(tree, k)) continue;
+	long long v = values[k];
+	if(kind == 0) expect += v;
+	if(kind == 1) expect = any ? (v < expect ? v : expect) : v;
+	if(kind == 2) expect = any ? (v > expect ? v : expect) : v;
+	if(kind == 3){
+	  unsigned long long one[2] = {1, (unsigned long long)v};
+	  combine_poly_hash(expect_pair, expect_pair, one, NULL);
+	}
+	any = 1;
+      }
+      long long got = 0;
+      unsigned long long got_pair[2] = {0, 0};
+      int found = avl_range_aggregate(tree, lo, hi,
+				      kind < 3 ? (void *)&got : (void *)got_pair);
+      if(found != any) errors++;
+      if(any && kind < 3 && got != expect) errors++;
+      if(any && kind == 3 && (got_pair[0] != expect_pair[0]
+			      || got_pair[1] != expect_pair[1])) errors++;
+    }
+    if(!check_tree(tree, "Augmentation")) errors++;
+    free_tree(tree);
+  }
+
+  if(errors){
+    printf("Augmentation: %d range aggregates wrong!\n", errors);
+  }else{
+    printf("Augmentation: range aggregates correct.\n");
+  }
+}
+
+/**
+ * @brief Callback for the interval test, checks the reporting order.
+ */
+int check_interval_order(Interval *interval, void *ctx){
+  int *last_start = (int *)ctx;
+  if(interval->start < *last_start){
+    printf("Intervals reported out of order!\n");
+  }
+  *last_start = interval->start;
+  return 0;
+}
+
+/**
+ * @brief Test stabbing and overlap queries of the interval tree
+ * against a linear scan.
+ */
+void test_interval_tree(){
+  IntervalTree *itree = make_interval_tree();
+  Interval *handles[N_INSERT];
+  int live[N_INSERT];
+  int errors = 0;
+
+  // Many intervals share start points to exercise the chains.
+  for(int i = 0; i < N_INSERT; i++){
+    int start = rand_in_range(0, N_INSERT);
+    handles[i] = interval_insert(itree, start,
+				 start + rand_in_range(1, N_INSERT / 10), NULL);
+    live[i] = 1;
+  }
+  for(int i = 0; i < N_REMOVE / 2; i++){
+    int r = rand_in_range(0, N_INSERT - 1);
+    if(live[r]){
+      if(!interval_delete(itree, handles[r])) errors++;
+      live[r] = 0;
+    }
+  }
+
+  for(int q = 0; q < 200; q++){
+    int lo = rand_in_range(0, N_INSERT);
+    int hi = lo + rand_in_range(1, N_INSERT / 20);
+    int expect_overlap = 0, expect_stab = 0, last_start = -1;
+    for(int i = 0; i < N_INSERT; i++){
+      if(!live[i]) continue;
+      if(handles[i]->start < hi && handles[i]->end > lo) expect_overlap++;
+      if(handles[i]->start <= lo && handles[i]->end > lo) expect_stab++;
+    }
+    if(interval_overlap(itree, lo, hi, check_interval_order, &last_start)
+       != expect_overlap) errors++;
+    if(interval_stab(itree, lo, NULL, NULL) != expect_stab) errors++;
+  }
+  if(!check_tree(itree->tree, "Interval tree")) errors++;
+
+  if(errors){
+    printf("Interval tree: %d queries wrong!\n", errors);
+  }else{
+    printf("Interval tree: stabbing and overlap queries correct.\n");
+  }
+  free_interval_tree(itree);
+}
+
+/**
+ * @brief Test floor, ceiling, predecessor, successor and k-nearest
+ * queries against a brute force search over a presence array.
+ */
+void test_nearest_keys(){
+  AvlTree *tree = make_tree_empty();
+  int range = N_INSERT * 4;
+  char present[N_INSERT * 4 + 1] = {0};
+  int errors = 0;
+
+  for(int i = 0; i < N_INSERT; i++){
+    int key = rand_in_range(0, range);
+    key_insert_new(key, tree);
+    present[key] = 1;
+  }
+
+  for(int q = 0; q < 500; q++){
+    int key = rand_in_range(-2, range + 2);
+    int pred = -1, succ = -1;
+    for(int k = key - 1; k >= 0; k--) if(k <= range && present[k]){ pred = k; break; }
+    for(int k = key + 1; k <= range; k++) if(k >= 0 && present[k]){ succ = k; break; }
+    int here = key >= 0 && key <= range && present[key];
+    int floor_key = here ? key : pred, ceiling_key = here ? key : succ;
+
+    Node *node = avl_predecessor(tree, key);
+    if((node ? node->key : -1) != pred) errors++;
+    node = avl_successor(tree, key);
+    if((node ? node->key : -1) != succ) errors++;
+    node = avl_floor(tree, key);
+    if((node ? node->key : -1) != floor_key) errors++;
+    node = avl_ceiling(tree, key);
+    if((node ? node->key : -1) != ceiling_key) errors++;
+
+    // The k nearest keys, by increasing distance, ties to the smaller key.
+    Node *nearest[16];
+    int count = avl_k_nearest(tree, key, 16, nearest);
+    int lo = key, hi = key, found = 0;
+    if(here){
+      if(nearest[found++]->key != key) errors++;
+    }
+    while(found < count){
+      do lo--; while(lo >= 0 && !(lo <= range && present[lo]));
+      do hi++; while(hi <= range && !(hi >= 0 && present[hi]));
+      // Take the closer one, and put the other one back.
+      if(lo >= 0 && (hi > range || key - lo <= hi - key)){
+	if(nearest[found++]->key != lo) errors++;
+	hi--;
+      }else{
+	if(nearest[found++]->key != hi) errors++;
+	lo++;
+      }
+    }
+    if(count != 16) errors++;
+  }
+
+  if(errors){
+    printf("Nearest keys: %d queries wrong!\n", errors);
+  }else{
+    printf("Nearest keys: all queries correct.\n");
+  }
+  free_tree(tree);
+}
+
+// An instance of the core with a custom comparator, ordering keys
+// descending.
+#define AVL_PREFIX desc_i64
+#define AVL_KEY_T int64_t
+#include "avl_core.h"
+#define AVL_KEY_CMP(a, b) AVL_CMP_NUMERIC(b, a)
+#include "avl_core.c"
+#undef AVL_PREFIX
+#undef AVL_KEY_T
+#undef AVL_KEY_CMP
+
+/**
+ * @brief Recursively check heights and the avl property of an
+ * avl_i64 subtree.
+ * @param node - The currently looked at node.
+ * @return The height of the subtree, -2 if it is broken.
+ */
+int check_i64_subtree(avl_i64_node *node){
+  if(!node) return -1;
+  int l_height = check_i64_subtree(node->left_child);
+  int r_height = check_i64_subtree(node->right_child);
+  if(l_height == -2 || r_height == -2) return -2;
+  if(node->left_child && node->left_child->parent != node) return -2;
+  if(node->right_child && node->right_child->parent != node) return -2;
+  if(r_height - l_height > 1 || l_height - r_height > 1) return -2;
+  int height = get_int_max(l_height, r_height) + 1;
+  return (height == node->height) ? height : -2;
+}
+
+/**
+ * @brief Test the typed key specializations: 64 bit keys beyond
+ * the int range, double keys including NaN, and a custom comparator.
+ */
+void test_typed_keys(){
+  avl_i64_tree *tree = avl_i64_make_tree_empty();
+  int64_t keys[N_INSERT];
+  int errors = 0;
+
+  for(int i = 0; i < N_INSERT; i++){
+    keys[i] = ((int64_t)rand() << 32 | rand()) - ((int64_t)1 << 61);
+    avl_i64_key_insert_new(keys[i], tree);
+  }
+  for(int i = 0; i < N_REMOVE; i += 2){
+    avl_i64_key_delete(keys[i], tree);
+  }
+  for(int i = 0; i < N_INSERT; i++){
+    avl_i64_node *node = NULL;
+    if(avl_i64_search_by_key(keys[i], tree, &node) != (i >= N_REMOVE || i % 2)){
+      errors++;
+    }
+  }
+  // In-order iteration is strictly ascending.
+  int count = 0;
+  for(avl_i64_node *node = avl_i64_min(tree); node; node = avl_i64_next(node)){
+    avl_i64_node *next = avl_i64_next(node);
+    if(next && next->key <= node->key) errors++;
+    count++;
+  }
+  if(count != tree->number_of_nodes) errors++;
+  if(check_i64_subtree(tree->root) != tree->height) errors++;
+  avl_i64_free_tree(tree);
+
+  // Doubles, with NaN as a single key after all numbers.
+  avl_f64_tree *ftree = avl_f64_make_tree_empty();
+  for(int i = 0; i < N_INSERT; i++){
+    avl_f64_key_insert_new(rand() / (double)RAND_MAX - 0.5, ftree);
+  }
+  avl_f64_key_insert_new(0.0 / 0.0, ftree);
+  if(avl_f64_key_insert_new(0.0 / 0.0, ftree)) errors++;
+  avl_f64_node *last = avl_f64_max(ftree);
+  if(last->key == last->key) errors++;
+  avl_f64_node *floor = avl_f64_floor(ftree, 0.25);
+  avl_f64_node *ceiling = avl_f64_ceiling(ftree, 0.25);
+  if(floor && (floor->key > 0.25 || (avl_f64_next(floor) && avl_f64_next(floor)->key <= 0.25))) errors++;
+  if(ceiling && (ceiling->key < 0.25 || (avl_f64_prev(ceiling) && avl_f64_prev(ceiling)->key >= 0.25))) errors++;
+  avl_f64_free_tree(ftree);
+
+  // The custom comparator orders descending.
+  desc_i64_tree *dtree = desc_i64_make_tree_empty();
+  for(int i = 0; i < N_INSERT; i++){
+    desc_i64_key_insert_new(rand_in_range(0, 9999), dtree);
+  }
+  for(desc_i64_node *node = desc_i64_min(dtree); node;
+      node = desc_i64_next(node)){
+    if(desc_i64_next(node) && desc_i64_next(node)->key >= node->key) errors++;
+  }
+  desc_i64_free_tree(dtree);
+
+  // The instances share the core's features, e.g. augmentation.
+  avl_u64_tree *utree = avl_u64_make_tree_empty();
+  avl_u64_augment_attach(utree, &avl_augment_sum_i64);
+  long long one = 1, sum = 0;
+  uint64_t high = (uint64_t)1 << 63;
+  for(int i = 0; i < N_INSERT; i++){
+    uint64_t key = high + (uint64_t)rand_in_range(0, 9999);
+    avl_u64_augment_insert(utree, key, &one);
+  }
+  avl_u64_range_aggregate(utree, high, UINT64_MAX, &sum);
+  if(sum != utree->number_of_nodes) errors++;
+  uint64_t popped = 0;
+  avl_u64_node *lowest = avl_u64_min(utree);
+  if(lowest->key < high || !avl_u64_pop_min(utree, &popped, NULL)) errors++;
+  if(avl_u64_min(utree) && avl_u64_min(utree)->key <= popped) errors++;
+  avl_u64_free_tree(utree);
+
+  if(errors){
+    printf("Typed keys: %d checks failed!\n", errors);
+  }else{
+    printf("Typed keys: int64, uint64, double and custom comparator "
+	   "trees correct.\n");
+  }
+}
+
+/**
+ * @brief Byte order comparison of two strings with explicit lengths,
+ * the reference for the string tree test.
+ */
+int cmp_bytes(const char *a, size_t a_len, const char *b, size_t b_len){
+  int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+  if(cmp) return cmp;
+  return (a_len > b_len) - (a_len < b_len);
+}
+
+/**
+ * @brief Test the string tree: ordering of keys sharing long
+ * prefixes, short keys, embedded NUL bytes and interning.
+ */
+void test_string_keys(){
+  StringTree *stree = make_string_tree(1);
+  const char *stems[] = {"", "a", "user", "user:0000", "user:00001111"};
+  char buffer[32];
+  int errors = 0, inserted = 0;
+
+  for(int i = 0; i < N_INSERT; i++){
+    // A stem plus a few random bytes, NUL included.
+    const char *stem = stems[rand_in_range(0, 4)];
+    size_t len = strlen(stem);
+    memcpy(buffer, stem, len);
+    int extra = rand_in_range(0, 6);
+    for(int j = 0; j < extra; j++) buffer[len++] = (char)rand_in_range(0, 3);
+    inserted += string_insert(stree, buffer, len, NULL);
+    // The buffer is reused, so the tree has to keep its own copy.
+    memset(buffer, 'x', sizeof(buffer));
+  }
+
+  // Ascending in byte order, and every key found again.
+  int count = 0;
+  for(avl_str_node *node = avl_str_min(stree->tree); node;
+      node = avl_str_next(node)){
+    avl_str_node *next = avl_str_next(node), *found = NULL;
+    if(next && cmp_bytes(node->key.str, node->key.length,
+			 next->key.str, next->key.length) >= 0) errors++;
+    memcpy(buffer, node->key.str, node->key.length);
+    if(!string_search(stree, buffer, node->key.length, &found)
+       || found != node) errors++;
+    count++;
+  }
+  if(count != inserted || count != stree->tree->number_of_nodes) errors++;
+  if(string_insert(stree, "user", 4, NULL)) errors++;
+  if(string_delete(stree, "user", 4) != 1 || string_delete(stree, "user", 4)) errors++;
+
+  if(errors){
+    printf("String keys: %d checks failed!\n", errors);
+  }else{
+    printf("String keys: ordering, lookup and interning correct.\n");
+  }
+  free_string_tree(stree);
+}
+
+/**
+ * @brief Test inline node values, alone and sharing the node
+ * extension area with an augmentation.
+ */
+void test_inline_values(){
+  int errors = 0;
+
+  for(int augmented = 0; augmented < 2; augmented++){
+    AvlTree *tree = make_tree_with_values(3 * sizeof(long long));
+    if(augmented) avl_augment_attach(tree, &avl_augment_sum_i64);
+    int keys[N_INSERT];
+
+    // Distinct keys in random order, so every index has its own node.
+    for(int i = 0; i < N_INSERT; i++) keys[i] = i * 9973;
+    for(int i = N_INSERT - 1; i > 0; i--){
+      int j = rand_in_range(0, i), key = keys[i];
+      keys[i] = keys[j];
+      keys[j] = key;
+    }
+
+    for(int i = 0; i < N_INSERT; i++){
+      long long value[3] = {keys[i], -keys[i], i};
+      if(avl_insert_value(tree, keys[i], value) && augmented){
+	Node *node = NULL;
+	search_by_key(keys[i], tree, &node);
+	long long one = 1;
+	avl_augment_set(tree, node, &one);
+      }
+    }
+    for(int i = 0; i < N_REMOVE; i += 3) key_delete(keys[i], tree);
+
+    for(int i = 0; i < N_INSERT; i++){
+      long long *value = (long long *)avl_lookup_value(tree, keys[i]);
+      if((value != NULL) == (i < N_REMOVE && i % 3 == 0)) errors++;
+      if(value && (value[0] != keys[i] || value[1] != -keys[i])) errors++;
+    }
+    long long count = 0;
+    if(augmented){
+      avl_range_aggregate(tree, 0, 9999999, &count);
+      if(count != tree->number_of_nodes) errors++;
+    }
+    free_tree(tree);
+  }
+
+  if(errors){
+    printf("Inline values: %d checks failed!\n", errors);
+  }else{
+    printf("Inline values: stored and found correctly.\n");
+  }
+}
+
+int collect_keys(int key, void *data, void *ctx){
+  int *out = (int *)ctx;
+  out[++out[0]] = key;
+  return 0;
+}
+
+void test_small_tree(){
+  int errors = 0;
+  SmallTree *stree = make_small_tree();
+  long present[64] = {0};
+  int promoted = 0, demoted = 0;
+
+  // Random churn over few keys, crossing both thresholds many times.
+  for(int i = 0; i < 20 * N_INSERT; i++){
+    int key = rand_in_range(0, 63);
+    int was_tree = (stree->tree != NULL);
+    void *data = NULL;
+    int insert_rate = (i / 1000 % 2) ? 10 : 80;
+    if(rand_in_range(0, 99) < insert_rate){
+      int inserted = small_insert(stree, key, (void *)(long)(key + 1));
+      if(inserted == (present[key] != 0)) errors++;
+      present[key] = key + 1;
+    }else{
+      if(small_delete(stree, key, &data) != (present[key] != 0)) errors++;
+      if(present[key] && data != (void *)present[key]) errors++;
+      present[key] = 0;
+    }
+    if(!was_tree && stree->tree) promoted++;
+    if(was_tree && !stree->tree) demoted++;
+
+    int count = 0;
+    for(int k = 0; k < 64; k++) count += (present[k] != 0);
+    if(stree->number_of_keys != count) errors++;
+    if(stree->tree == NULL && count > SMALL_TREE_CAPACITY) errors++;
+    if(stree->tree && count <= SMALL_TREE_DEMOTE) errors++;
+  }
+  if(promoted == 0 || demoted == 0) errors++;
+
+  for(int k = 0; k < 64; k++){
+    void *data = NULL;
+    if(small_search(stree, k, &data) != (present[k] != 0)) errors++;
+    if(present[k] && data != (void *)present[k]) errors++;
+  }
+  int keys[65] = {0};
+  small_for_each(stree, collect_keys, keys);
+  for(int i = 2; i <= keys[0]; i++){
+    if(keys[i - 1] >= keys[i]) errors++;
+  }
+  free_small_tree(stree);
+
+  if(errors){
+    printf("Small tree: %d checks failed!\n", errors);
+  }else{
+    printf("Small tree: array and tree forms agree (%d promotions).\n",
+	   promoted);
+  }
+}
+
+/**
+ * @brief Recursively check the parent pointers of a subtree.
+ * @param node - The root of the subtree.
+ * @return The number of nodes with a wrong parent pointer.
+ */
+int check_parents(Node *node){
+  if(!node) return 0;
+  int errors = 0;
+  if(node->left_child && node->left_child->parent != node) errors++;
+  if(node->right_child && node->right_child->parent != node) errors++;
+  return errors + check_parents(node->left_child)
+    + check_parents(node->right_child);
+}
+
+/**
+ * @brief Check a tree after compaction or churn: structure, keys,
+ * inline values, the count aggregate and the cached extremes.
+ * @param tree - The tree, with inline int values equal to the keys
+ * and a sum augmentation counting the nodes.
+ * @param present - Which keys the tree should hold.
+ * @param n_keys - Size of present.
+ * @return The number of failed checks.
+ */
+int check_compacted(AvlTree *tree, const char *present, int n_keys){
+  int errors = 0;
+  if(!check_tree(tree, "Compaction")) errors++;
+  errors += check_parents(tree->root);
+  if(tree->root && tree->root->parent) errors++;
+
+  int count = 0;
+  for(int k = 0; k < n_keys; k++){
+    int *value = (int *)avl_lookup_value(tree, k);
+    if((value != NULL) != present[k]) errors++;
+    if(value && *value != k) errors++;
+    count += present[k];
+  }
+  long long sum = 0;
+  if(count) avl_range_aggregate(tree, 0, n_keys, &sum);
+  if(sum != count || tree->number_of_nodes != count) errors++;
+  if(count && (avl_min(tree) != avl_ceiling(tree, 0)
+	       || avl_max(tree) != avl_floor(tree, n_keys))) errors++;
+  return errors;
+}
+
+/**
+ * @brief Insert a key with its inline value and a count of one.
+ */
+void insert_counted(AvlTree *tree, int key){
+  if(avl_insert_value(tree, key, &key)){
+    long long one = 1;
+    avl_augment_set(tree, tree->finger, &one);
+  }
+}
+
+/**
+ * @brief Test full compaction in all layouts and incremental
+ * compaction interleaved with updates.
+ */
+void test_compaction(){
+  int errors = 0;
+  int n_keys = 4 * N_INSERT;
+  char *present = (char *)calloc(n_keys, 1);
+  assert(present != NULL);
+
+  AvlTree *tree = make_tree_with_values(sizeof(int));
+  avl_augment_attach(tree, &avl_augment_sum_i64);
+  for(int layout = AVL_LAYOUT_INORDER; layout <= AVL_LAYOUT_VEB; layout++){
+    // Churn, then compact.
+    for(int i = 0; i < 2 * N_INSERT; i++){
+      int key = rand_in_range(0, n_keys - 1);
+      if(present[key]){
+	key_delete(key, tree);
+      }else{
+	insert_counted(tree, key);
+      }
+      present[key] = !present[key];
+    }
+    int n = tree->number_of_nodes;
+    if(avl_compact(tree, (AvlLayout)layout) != n) errors++;
+    errors += check_compacted(tree, present, n_keys);
+
+    // All nodes have to fill one block now.
+    char *lowest = (char *)tree->root, *highest = (char *)tree->root;
+    for(Node *node = avl_min(tree); node; node = avl_next(node)){
+      if(!node->in_block) errors++;
+      if((char *)node < lowest) lowest = (char *)node;
+      if((char *)node > highest) highest = (char *)node;
+    }
+    if(highest != (char *)AVL_NODE_SLOT(tree, lowest, n - 1)) errors++;
+    if(layout == AVL_LAYOUT_INORDER && (char *)avl_min(tree) != lowest){
+      errors++;
+    }
+  }
+
+  // Incremental compaction, with updates between the steps.
+  avl_compact_begin(tree);
+  int steps = 0;
+  while(avl_compact_step(tree, 16)){
+    steps++;
+    for(int i = 0; i < 8; i++){
+      int key = rand_in_range(0, n_keys - 1);
+      if(present[key]){
+	key_delete(key, tree);
+      }else{
+	insert_counted(tree, key);
+      }
+      present[key] = !present[key];
+    }
+  }
+  if(steps == 0) errors++;
+  errors += check_compacted(tree, present, n_keys);
+
+  // Empty the tree, releasing the blocks node by node.
+  for(int k = 0; k < n_keys; k++){
+    if(present[k] && !key_delete(k, tree)) errors++;
+  }
+  if(tree->root != NULL || tree->memory.nodes != 0) errors++;
+  free_tree(tree);
+  free(present);
+
+  if(errors){
+    printf("Compaction: %d checks failed!\n", errors);
+  }else{
+    printf("Compaction: all layouts and incremental steps correct.\n");
+  }
+}
+
+/**
+ * @brief Test parallel bulk construction against insertion, with
+ * duplicate keys and different numbers of threads.
+ */
+void test_parallel_build(){
+  int errors = 0;
+  int n = 20 * N_INSERT;
+  int *keys = (int *)malloc(n * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < n; i++){
+    // Negative keys and plenty of duplicates.
+    keys[i] = rand_in_range(0, 4 * N_INSERT) - 2 * N_INSERT;
+  }
+  keys[0] = -2147483647 - 1;
+  keys[1] = 2147483647;
+
+  AvlTree *expected = make_tree_empty();
+  for(int i = 0; i < n; i++) key_insert_new(keys[i], expected);
+
+  for(int threads = 1; threads <= 5; threads++){
+    AvlTree *tree = avl_build_parallel(keys, n, threads);
+    if(!check_tree(tree, "Parallel build")) errors++;
+    errors += check_parents(tree->root);
+    if(tree->number_of_nodes != expected->number_of_nodes) errors++;
+    if(tree->height != tree->root->height) errors++;
+    Node *a = avl_min(tree), *b = avl_min(expected);
+    for(; a && b; a = avl_next(a), b = avl_next(b)){
+      if(a->key != b->key) errors++;
+    }
+    if(a || b) errors++;
+
+    // The tree has to behave like any other afterwards.
+    for(int i = 0; i < n; i += 2) key_delete(keys[i], tree);
+    for(int i = 0; i < n; i += 3) key_insert_new(keys[i], tree);
+    if(!check_tree(tree, "Parallel build")) errors++;
+    free_tree(tree);
+  }
+
+  // Building in to a prepared tree.
+  AvlTree *tree = make_tree_with_values(sizeof(long long));
+  avl_augment_attach(tree, &avl_augment_sum_i64);
+  if(!avl_build_parallel_into(tree, keys, 3, 0)) errors++;
+  if(avl_build_parallel_into(tree, keys, n, 0)) errors++;
+  if(tree->number_of_nodes != 3) errors++;
+  long long *value = (long long *)avl_lookup_value(tree, keys[2]);
+  if(value == NULL || *value != 0) errors++;
+  free_tree(tree);
+
+  free_tree(expected);
+  free(keys);
+
+  if(errors){
+    printf("Parallel build: %d checks failed!\n", errors);
+  }else{
+    printf("Parallel build: trees match sequential insertion.\n");
+  }
+}
+
+/**
+ * @brief Map function of the parallel reduction test: the
+ * polynomial hash of the key alone.
+ */
+void map_poly_hash(void *out, Node *node, void *ctx){
+  ((unsigned long long *)out)[0] = 1;
+  ((unsigned long long *)out)[1] = (unsigned long long)node->key;
+}
+
+/**
+ * @brief Visit function of the parallel for each test: count the
+ * visits of a node in its data.
+ */
+void count_visit(Node *node, void *ctx){
+  node->data = (char *)node->data + 1;
+}
+
+/**
+ * @brief Test the parallel reduction, with a non-commutative combine,
+ * and parallel for each against a sequential walk.
+ */
+void test_parallel_reduce(){
+  int errors = 0;
+  int n = 40 * N_INSERT;
+  int *keys = (int *)malloc(n * sizeof(int));
+  assert(keys != NULL);
+  for(int i = 0; i < n; i++) keys[i] = rand_in_range(0, 9999999);
+  AvlTree *tree = avl_build_parallel(keys, n, 0);
+
+  unsigned long long expect[2] = {0, 0};
+  for(Node *node = avl_min(tree); node; node = avl_next(node)){
+    unsigned long long one[2];
+    map_poly_hash(one, node, NULL);
+    combine_poly_hash(expect, expect, one, NULL);
+  }
+
+  for(int threads = 1; threads <= 4; threads++){
+    unsigned long long result[2] = {0, 0};
+    if(!avl_parallel_reduce(tree, map_poly_hash, combine_poly_hash,
+			    sizeof(result), result, NULL, threads)) errors++;
+    if(result[0] != expect[0] || result[1] != expect[1]) errors++;
+
+    avl_parallel_for_each(tree, count_visit, NULL, threads);
+  }
+  for(Node *node = avl_min(tree); node; node = avl_next(node)){
+    if(node->data != (void *)4) errors++;
+    node->data = NULL;
+  }
+
+  // An empty tree reduces to nothing.
+  AvlTree *empty = make_tree_empty();
+  unsigned long long result[2] = {7, 7};
+  if(avl_parallel_reduce(empty, map_poly_hash, combine_poly_hash,
+			 sizeof(result), result, NULL, 2)) errors++;
+  if(result[0] != 7) errors++;
+  free_tree(empty);
+  free_tree(tree);
+  free(keys);
+
+  if(errors){
+    printf("Parallel reduce: %d checks failed!\n", errors);
+  }else{
+    printf("Parallel reduce: results match sequential walk.\n");
+  }
+}
+
+/**
+ * @brief Thread body of the flat combining test. Every thread works
+ * on its own key range, so it can predict all of its results.
+ * @param arg - The flat combiner.
+ * @return The number of wrong results, cast to a pointer.
+ */
+void * combining_thread(void *arg){
+  FlatCombiner *fc = (FlatCombiner *)arg;
+  int slot = fc_register(fc);
+  long errors = (slot < 0);
+  char present[256] = {0};
+  unsigned seed = slot + 1;
+
+  for(int i = 0; i < 5 * N_INSERT && slot >= 0; i++){
+    // rand is not thread safe, use a private generator.
+    seed = seed * 1103515245 + 12345;
+    int k = (seed >> 16) % 256;
+    int key = slot * 256 + k;
+    int op = (seed >> 8) % 3;
+    int result = fc_apply(fc, slot, (FcOp)op, key, NULL);
+    if(op == FC_SEARCH) errors += (result != present[k]);
+    if(op == FC_INSERT) errors += (result == present[k]);
+    if(op == FC_DELETE) errors += (result != present[k]);
+    if(op != FC_SEARCH) present[k] = (op == FC_INSERT);
+  }
+  return (void *)errors;
+}
+
+/**
+ * @brief Test the flat combiner with several threads posting
+ * operations concurrently.
+ */
+void test_flat_combining(){
+  int errors = 0, threads = 4;
+  AvlTree *tree = make_tree_empty();
+  FlatCombiner *fc = make_flat_combiner(tree, threads);
+  pthread_t ids[4];
+
+  for(int t = 0; t < threads; t++){
+    pthread_create(&ids[t], NULL, combining_thread, fc);
+  }
+  for(int t = 0; t < threads; t++){
+    void *thread_errors;
+    pthread_join(ids[t], &thread_errors);
+    errors += (int)(long)thread_errors;
+  }
+  if(fc_register(fc) != -1) errors++;
+  if(fc->combined != (long)threads * 5 * N_INSERT) errors++;
+  if(!check_tree(tree, "Flat combining")) errors++;
+  errors += check_parents(tree->root);
+
+  free_flat_combiner(fc);
+  free_tree(tree);
+
+  if(errors){
+    printf("Flat combining: %d checks failed!\n", errors);
+  }else{
+    printf("Flat combining: all results correct.\n");
+  }
+}
+
+/**
+ * @brief State of a reader thread of the hot-key cache test.
+ */
+typedef struct {
+  AvlTree *tree;
+  int errors;
+} CacheReader;
+
+/**
+ * @brief Reader thread of the hot-key cache test: search the hot keys
+ * of a tree with a frozen cache.
+ */
+void * read_frozen_cache(void *arg){
+  CacheReader *reader = (CacheReader *)arg;
+  for(int i = 0; i < N_INSERT; i++){
+    Node *node = NULL;
+    int key = (i % 16) * 7;
+    int found = search_by_key(key, reader->tree, &node);
+    if(found && node->key != key) reader->errors++;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Test the hot-key cache on skewed lookups, with deletions
+ * and compaction invalidating cached nodes, and concurrent readers
+ * of a frozen cache.
+ */
+void test_hot_key_cache(){
+  int errors = 0, searches = 0;
+  int range = 4 * N_INSERT;
+  AvlTree *tree = make_tree_empty();
+  avl_cache_attach(tree, 64);
+  for(int i = 0; i < N_INSERT; i++){
+    key_insert_new(rand_in_range(0, range), tree);
+  }
+  for(int k = 0; k < 16; k++) key_insert_new(k * 7, tree);
+
+  for(int round = 0; round < 3; round++){
+    for(int i = 0; i < 10 * N_INSERT; i++){
+      // Mostly a few hot keys, sometimes any key.
+      int key = (i % 4) ? rand_in_range(0, 15) * 7
+	: rand_in_range(0, range);
+      Node *node = NULL;
+      int found = search_by_key(key, tree, &node);
+      searches++;
+      Node *expect = avl_floor(tree, key);
+      int exists = (expect != NULL && expect->key == key);
+      if(found != exists || (found && node != expect)) errors++;
+    }
+    // Delete some hot keys (searching them), then move every node.
+    for(int k = 0; k < 16; k += 3, searches++) key_delete(k * 7, tree);
+    for(int k = 0; k < 16; k += 5) key_insert_new(k * 7, tree);
+    avl_compact(tree, (AvlLayout)round);
+  }
+
+  AvlCacheStats stats = avl_cache_stats(tree);
+  if(stats.hits + stats.misses != searches) errors++;
+  if(stats.hits < searches / 4 || stats.evictions == 0) errors++;
+
+  // Readers of a frozen cache share the tree and leave it untouched.
+  avl_cache_freeze(tree, 1);
+  pthread_t threads[4];
+  CacheReader readers[4];
+  for(int t = 0; t < 4; t++){
+    readers[t].tree = tree;
+    readers[t].errors = 0;
+    pthread_create(&threads[t], NULL, read_frozen_cache, &readers[t]);
+  }
+  for(int t = 0; t < 4; t++){
+    pthread_join(threads[t], NULL);
+    errors += readers[t].errors;
+  }
+  AvlCacheStats frozen = avl_cache_stats(tree);
+  if(frozen.hits != stats.hits || frozen.misses != stats.misses) errors++;
+  avl_cache_freeze(tree, 0);
+  avl_cache_detach(tree);
+  if(tree->cache != NULL) errors++;
+  free_tree(tree);
+
+  if(errors){
+    printf("Hot-key cache: %d checks failed!\n", errors);
+  }else{
+    printf("Hot-key cache: lookups correct, %ld of %d hit.\n",
+	   stats.hits, searches);
+  }
+}
+
+/**
+ * @brief Test the negative lookup filter: no false negatives through
+ * growth, deletions and bulk construction, and a bounded rate of
+ * false positives.
+ */
+void test_negative_filter(){
+  int errors = 0;
+  int range = 40 * N_INSERT;
+  AvlTree *tree = make_tree_empty();
+  avl_filter_attach(tree, 100, 0.01);
+
+  for(int i = 0; i < 4 * N_INSERT; i++){
+    key_insert_new(rand_in_range(0, range), tree);
+  }
+  for(int i = 0; i < 2 * N_INSERT; i++){
+    key_delete(rand_in_range(0, range), tree);
+  }
+  for(int key = 0; key <= range; key++){
+    Node *node = NULL;
+    Node *expect = avl_floor(tree, key);
+    int exists = (expect != NULL && expect->key == key);
+    if(avl_contains(tree, key) != exists) errors++;
+    // Searches still report the would-be parent of absent keys.
+    if(search_by_key(key, tree, &node) != exists || node == NULL) errors++;
+  }
+  AvlFilterStats stats = avl_filter_stats(tree);
+  long absent = stats.rejected + stats.false_positives;
+  if(stats.rebuilds < 3 || stats.rejected == 0) errors++;
+  if(stats.false_positives > absent * 3 / 100) errors++;
+  free_tree(tree);
+
+  // Bulk construction fills the filter as well.
+  int keys[N_INSERT];
+  for(int i = 0; i < N_INSERT; i++) keys[i] = rand_in_range(0, range);
+  tree = make_tree_empty();
+  avl_filter_attach(tree, 0, 0.05);
+  avl_build_parallel_into(tree, keys, N_INSERT, 2);
+  for(int i = 0; i < N_INSERT; i++){
+    if(!avl_contains(tree, keys[i])) errors++;
+  }
+  free_tree(tree);
+
+  if(errors){
+    printf("Negative filter: %d checks failed!\n", errors);
+  }else{
+    printf("Negative filter: no false negatives, %.2f%% false positives.\n",
+	   100.0 * stats.false_positives / absent);
+  }
+}
+
+/**
+ * @brief Progress callback of the stream loading test: remember the
+ * last report.
+ */
+void record_progress(long long bytes, long long total, int keys, void *ctx){
+  long long *last = (long long *)ctx;
+  last[0] = bytes;
+  last[1] = total;
+  last[2] = keys;
+}
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-#include <assert.h>
+/**
+ * @brief Check that a tree holds exactly the given sorted keys.
+ * @return The number of mismatches.
+ */
+int check_sorted_keys(AvlTree *tree, const int *keys, int n){
+  int errors = 0, i = 0;
+  for(Node *node = avl_min(tree); node; node = avl_next(node), i++){
+    if(i >= n || node->key != keys[i]) errors++;
+  }
+  if(i != n) errors++;
+  return errors;
+}
 
-#define N_INSERT 1000 // The number of values to insert.
-#define N_REMOVE 900 // The numver of values to delete. 
+void test_stream_load(){
+  int errors = 0;
+  const char *bin_path = "out/stream-test.bin";
+  const char *text_path = "out/stream-test.txt";
 
-int has(AvlTree *tree, int key){
-  Node *node = NULL;
-  return search_by_key(key, tree, &node);
+  // Sorted keys with repeats, spanning several read buffers.
+  int n = 300 * N_INSERT, unique = 0;
+  int *keys = (int *)malloc(n * sizeof(int));
+  int *expected = (int *)malloc(n * sizeof(int));
+  assert(keys != NULL && expected != NULL);
+  int key = -2147483647 - 1;
+  for(int i = 0; i < n; i++){
+    keys[i] = key;
+    if(i == 0 || keys[i - 1] != key) expected[unique++] = key;
+    key += rand_in_range(0, 3);
+  }
+
+  FILE *bin = fopen(bin_path, "wb"), *text = fopen(text_path, "w");
+  assert(bin != NULL && text != NULL);
+  fwrite(keys, sizeof(int), n, bin);
+  for(int i = 0; i < n; i++){
+    fprintf(text, (i % 7 == 6) ? "%+d\n" : "%d \t", keys[i]);
+  }
+  fclose(bin);
+  fclose(text);
+
+  // Binary, with the count known from the file size.
+  long long last[3] = {0, 0, 0};
+  AvlTree *tree = make_tree_empty();
+  int loaded = avl_load_sorted_file(tree, bin_path, AVL_KEYS_BINARY,
+				    record_progress, last);
+  if(loaded != unique || !check_tree(tree, "Stream load")) errors++;
+  errors += check_parents(tree->root);
+  errors += check_sorted_keys(tree, expected, unique);
+  if(last[0] != (long long)n * sizeof(int) || last[1] != last[0]) errors++;
+  if(last[2] != unique) errors++;
+  if(avl_load_sorted_file(tree, bin_path, AVL_KEYS_BINARY, NULL, NULL)
+     != AVL_STREAM_NOT_EMPTY) errors++;
+
+  // The tree has to behave like any other afterwards.
+  for(int i = 0; i < n; i += 2) key_delete(keys[i], tree);
+  for(int i = 0; i < n; i += 3) key_insert_new(keys[i], tree);
+  if(!check_tree(tree, "Stream load")) errors++;
+  free_tree(tree);
+
+  // Text, with the count discovered, in to a tree with values.
+  tree = make_tree_with_values(sizeof(long long));
+  loaded = avl_load_sorted_file(tree, text_path, AVL_KEYS_TEXT, NULL, NULL);
+  if(loaded != unique || !check_tree(tree, "Stream load")) errors++;
+  errors += check_parents(tree->root);
+  errors += check_sorted_keys(tree, expected, unique);
+  long long *value = (long long *)avl_lookup_value(tree, expected[unique / 2]);
+  if(value == NULL || *value != 0) errors++;
+  free_tree(tree);
+
+  // Errors leave the keys before them in the tree.
+  text = fopen(text_path, "w");
+  assert(text != NULL);
+  fprintf(text, "1 2 3 2 4");
+  fclose(text);
+  tree = make_tree_empty();
+  if(avl_load_sorted_file(tree, text_path, AVL_KEYS_TEXT, NULL, NULL)
+     != AVL_STREAM_ERROR_ORDER || tree->number_of_nodes != 3) errors++;
+  free_tree(tree);
+
+  const char *malformed[] = {"1 2 x", "1 - 2", "1 2147483648", "1 2-3"};
+  for(int i = 0; i < 4; i++){
+    text = fopen(text_path, "w");
+    assert(text != NULL);
+    fprintf(text, "%s", malformed[i]);
+    fclose(text);
+    tree = make_tree_empty();
+    if(avl_load_sorted_file(tree, text_path, AVL_KEYS_TEXT, NULL, NULL)
+       != AVL_STREAM_ERROR_FORMAT) errors++;
+    free_tree(tree);
+  }
+
+  // Two distinct whole keys, then a partial one.
+  int truncated[3] = {1, 2, 3};
+  bin = fopen(bin_path, "wb");
+  assert(bin != NULL);
+  fwrite(truncated, 1, 2 * sizeof(int) + 1, bin);
+  fclose(bin);
+  tree = make_tree_empty();
+  if(avl_load_sorted_file(tree, bin_path, AVL_KEYS_BINARY, NULL, NULL)
+     != AVL_STREAM_ERROR_FORMAT || tree->number_of_nodes != 2) errors++;
+  free_tree(tree);
+
+  remove(bin_path);
+  remove(text_path);
+  tree = make_tree_empty();
+  if(avl_load_sorted_file(tree, text_path, AVL_KEYS_TEXT, NULL, NULL)
+     != AVL_STREAM_ERROR_IO || tree->root != NULL) errors++;
+  free_tree(tree);
+
+  free(keys);
+  free(expected);
+
+  if(errors){
+    printf("Stream load: %d checks failed!\n", errors);
+  }else{
+    printf("Stream load: binary and text files load balanced.\n");
+  }
 }
 
 /**
- * @brief Generate a random number in a given range.
- * @param min - The lower bound of the range.
- * @param max - The upper bound of the range.
- * @return A random number in the given range.
+ * @brief Diff callback of the Merkle test: record the kind of each
+ * difference by key, and check that they arrive in key order.
  */
-int rand_in_range(int min, int max){
-  return min + rand() / (RAND_MAX / (max - min + 1) + 1);
+void record_difference(int key, Node *a, Node *b, void *ctx){
+  int *seen = (int *)ctx; // seen[0]: last key + 1, then one slot per key.
+  if(key < seen[0]) seen[1]++;
+  seen[0] = key + 1;
+  seen[2 + key] = (a ? 1 : 0) + (b ? 2 : 0);
+}
+
+void test_merkle_diff(){
+  int errors = 0;
+  int n = 10 * N_INSERT;
+  int *keys = (int *)malloc(n * sizeof(int));
+  int *seen = (int *)calloc(n + 2, sizeof(int));
+  int *expected = (int *)calloc(n, sizeof(int));
+  assert(keys != NULL && seen != NULL && expected != NULL);
+  for(int i = 0; i < n; i++) keys[i] = i;
+
+  // The same keys in different orders give different shapes.
+  AvlTree *a = make_tree_empty(), *b = make_tree_empty();
+  avl_augment_attach(a, &avl_augment_merkle);
+  avl_augment_attach(b, &avl_augment_merkle);
+  for(int i = 0; i < n; i++) key_insert_new(i, a);
+  for(int i = n - 1; i > 0; i--){
+    int j = rand_in_range(0, i), t = keys[i];
+    keys[i] = keys[j];
+    keys[j] = t;
+  }
+  for(int i = 0; i < n; i++) key_insert_new(keys[i], b);
+  for(int i = 0; i < n; i += 3){
+    key_delete(keys[i], a);
+    key_delete(keys[i], b);
+  }
+  if(avl_merkle_range_hash(a, -1, n) != avl_merkle_range_hash(b, -1, n)){
+    errors++;
+  }
+  if(avl_diff(a, b, record_difference, seen) != 0) errors++;
+
+  // Differences of all three kinds.
+  int differences = 0;
+  for(int i = 1; i < n; i += 97){
+    int key = keys[i], kind = rand_in_range(1, 3);
+    Node *node = NULL;
+    if(kind == 1){
+      if(!key_delete(key, b)) continue;
+    }else if(kind == 2){
+      if(!key_delete(key, a)) continue;
+    }else{
+      if(!search_by_key(key, a, &node)) continue;
+      avl_merkle_set_payload(a, node, &i, sizeof(i));
+    }
+    expected[key] = kind;
+    differences++;
+  }
+  if(avl_merkle_range_hash(a, -1, n) == avl_merkle_range_hash(b, -1, n)){
+    errors++;
+  }
+  if(avl_diff(a, b, record_difference, seen) != differences) errors++;
+  if(seen[1] != 0) errors++;
+  for(int key = 0; key < n; key++){
+    if(seen[2 + key] != expected[key]) errors++;
+  }
+
+  // A bulk built replica matches an incrementally built one.
+  AvlTree *c = make_tree_empty();
+  avl_augment_attach(c, &avl_augment_merkle);
+  int m = 0;
+  for(Node *node = avl_min(b); node; node = avl_next(node)){
+    keys[m++] = node->key;
+  }
+  avl_build_parallel_into(c, keys, m, 2);
+  if(avl_diff(b, c, record_difference, seen) != 0) errors++;
+  if(!check_tree(a, "Merkle") || !check_tree(b, "Merkle")) errors++;
+
+  free_tree(a);
+  free_tree(b);
+  free_tree(c);
+  free(keys);
+  free(seen);
+  free(expected);
+
+  if(errors){
+    printf("Merkle diff: %d checks failed!\n", errors);
+  }else{
+    printf("Merkle diff: %d differences found across tree shapes.\n",
+	   differences);
+  }
 }
 
 /**
- * @brief Recursively recalculate the height of every node.
- * @param node - The currently looked at node.
- * @return The height of the node currently looked at.
+ * @brief Check the stored heights of a subtree without changing them.
+ * @return The height of the subtree, -2 if a stored height is wrong.
  */
-int rec_height(Node *node){
+int check_heights(Node *node){
   if(!node) return -1;
-  node->height = get_int_max(
-			     rec_height(node->left_child),
-			     rec_height(node->right_child)) + 1;
-  return node->height;
+  int l_height = check_heights(node->left_child);
+  int r_height = check_heights(node->right_child);
+  if(l_height == -2 || r_height == -2) return -2;
+  int height = get_int_max(l_height, r_height) + 1;
+  return (node->height == height) ? height : -2;
 }
 
 /**
- * @brief Recursively check if the tree holds the avl property.
- * For this to give the correct result, the height of every node
- * has to be correct in advance. It is recommended to run rec_height
- * on the root, before executing the check_avl_property function.
- * @param node - The currently looked at node. 
- * @return 1 - If the avl property holds, 0 - otherwise.
+ * @brief Run a burst of updates on a relaxed tree, checking searches
+ * and range sums against the expected keys after every update.
+ * @return The number of failed checks.
  */
-int check_avl_property(Node *node){
-  if(!node) return 1;
-  int l_height = -1;
-  int r_height = -1;
-  if(node->left_child) l_height = node->left_child->height;
-  if(node->right_child) r_height = node->right_child->height;
-  int bal = r_height - l_height;
-  int is_avl = ((bal >= -1) && (bal <= 1)) ? 1 : 0;
-  return is_avl
-    && check_avl_property(node->left_child)
-    && check_avl_property(node->right_child);
+int relaxed_burst(AvlTree *tree, char *present, int n_keys, int updates,
+		  int sorted){
+  int errors = 0;
+  for(int i = 0; i < updates; i++){
+    int key = sorted ? i % n_keys : rand_in_range(0, n_keys - 1);
+    long long value = key;
+    if(present[key] && rand_in_range(0, 2) == 0){
+      if(!key_delete(key, tree)) errors++;
+      present[key] = 0;
+    }else if(!present[key]){
+      if(!avl_augment_insert(tree, key, &value)) errors++;
+      present[key] = 1;
+    }
+
+    int probe = rand_in_range(0, n_keys - 1);
+    if(has(tree, probe) != present[probe]) errors++;
+  }
+
+  // Range sums are exact while the balance is relaxed.
+  for(int lo = 0; lo < n_keys; lo += n_keys / 8){
+    long long sum = 0, expected = 0;
+    for(int key = lo; key < lo + n_keys / 4 && key < n_keys; key++){
+      if(present[key]) expected += key;
+    }
+    avl_range_aggregate(tree, lo, lo + n_keys / 4 - 1, &sum);
+    if(sum != expected) errors++;
+  }
+  return errors;
+}
+
+void test_relaxed_balance(){
+  int errors = 0, n_keys = 4 * N_INSERT;
+  char *present = (char *)calloc(n_keys, 1);
+  assert(present != NULL);
+
+  AvlTree *tree = make_tree_empty();
+  avl_augment_attach(tree, &avl_augment_sum_i64);
+  for(int key = 0; key < n_keys; key += 2){
+    long long value = key;
+    avl_augment_insert(tree, key, &value);
+    present[key] = 1;
+  }
+
+  // Fully deferred, resolved in small steps.
+  avl_relaxed_begin(tree, 0);
+  errors += relaxed_burst(tree, present, n_keys, 2 * n_keys, 0);
+  if(tree->height != AVL_HEIGHT_DIRTY) errors++;
+  int steps = 0;
+  while(avl_rebalance_step(tree, 16)) steps++;
+  if(check_heights(tree->root) != tree->height) errors++;
+
+  // Steps interleaved with a sorted burst.
+  for(int round = 0; round < 8; round++){
+    errors += relaxed_burst(tree, present, n_keys, n_keys / 8, round & 1);
+    avl_rebalance_step(tree, 64);
+  }
+  avl_relaxed_end(tree);
+  if(check_heights(tree->root) != tree->height) errors++;
+
+  // Piggybacked steps keep up with a sorted burst.
+  avl_relaxed_begin(tree, 2);
+  errors += relaxed_burst(tree, present, n_keys, 2 * n_keys, 1);
+  avl_relaxed_end(tree);
+  if(tree->relaxed || check_heights(tree->root) != tree->height) errors++;
+  if(!check_tree(tree, "Relaxed balance")) errors++;
+  errors += check_parents(tree->root);
+
+  int count = 0;
+  for(int key = 0; key < n_keys; key++) count += present[key];
+  if(tree->number_of_nodes != count) errors++;
+  free_tree(tree);
+
+  // A deep relaxed tree is freed without recursion.
+  tree = make_tree_empty();
+  avl_relaxed_begin(tree, 0);
+  for(int key = 0; key < n_keys; key++) avl_insert_hint(tree, key, NULL);
+  free_tree(tree);
+  free(present);
+
+  if(errors){
+    printf("Relaxed balance: %d checks failed!\n", errors);
+  }else{
+    printf("Relaxed balance: rebalanced in %d steps, queries exact.\n",
+	   steps);
+  }
+}
+
+/**
+ * @brief Budget callback that evicts the smallest keys until the
+ * tree holds half of its budget.
+ */
+void evict_to_half(AvlTree *tree, size_t used, void *ctx){
+  (*(int *)ctx)++;
+  while(tree->memory.total > tree->budget / 2){
+    avl_pop_min(tree, NULL, NULL);
+  }
+}
+
+void test_memory_budget(){
+  int errors = 0, evictions = 0;
+  AvlTree *tree = make_tree_with_values(16);
+  size_t node_bytes = tree->node_size;
+  size_t base = avl_memory_stats(tree).total;
+  if(base != sizeof(AvlTree)) errors++;
+
+  // Every node is accounted for, split in to node and payload.
+  for(int key = 0; key < N_INSERT; key++) avl_insert_value(tree, key, NULL);
+  AvlMemoryStats stats = avl_memory_stats(tree);
+  if(stats.nodes != N_INSERT * sizeof(Node)) errors++;
+  if(stats.payload != N_INSERT * (node_bytes - sizeof(Node))) errors++;
+  if(stats.total != stats.nodes + stats.payload + stats.aux) errors++;
+
+  // Caches and filters count as auxiliary memory.
+  avl_cache_attach(tree, 64);
+  avl_filter_attach(tree, N_INSERT, 0.01);
+  if(avl_memory_stats(tree).aux <= stats.aux) errors++;
+  avl_cache_detach(tree);
+  avl_filter_detach(tree);
+  if(avl_memory_stats(tree).aux != stats.aux) errors++;
+
+  // The budget callback evicts, and fires again once re-armed.
+  size_t budget = base + 2 * N_INSERT * node_bytes;
+  avl_memory_budget(tree, budget, 0, evict_to_half, &evictions);
+  for(int key = N_INSERT; key < 8 * N_INSERT; key++){
+    if(avl_insert_value(tree, key, NULL) != 1) errors++;
+    if(tree->memory.total > budget) errors++;
+  }
+  if(evictions < 2) errors++;
+
+  // The hard limit refuses insertions, leaving the tree intact.
+  int count = tree->number_of_nodes, refused = 0;
+  avl_memory_budget(tree, 0, tree->memory.total + 10 * node_bytes, NULL,
+		    NULL);
+  for(int key = -1; key >= -20; key--){
+    int inserted = avl_insert_value(tree, key, NULL);
+    if(inserted == AVL_ERROR_NO_MEMORY) refused++;
+    else if(inserted != 1) errors++;
+  }
+  if(refused != 10 || tree->number_of_nodes != count + 10) errors++;
+  if(has(tree, -11) || !has(tree, -10)) errors++;
+  if(avl_insert_value(tree, -1, NULL) != 0) errors++;
+  if(key_insert_new(-21, tree) != AVL_ERROR_NO_MEMORY) errors++;
+  if(!check_tree(tree, "Memory budget")) errors++;
+
+  // Compacted and freed nodes are given back.
+  avl_memory_budget(tree, 0, 0, NULL, NULL);
+  avl_compact(tree, AVL_LAYOUT_INORDER);
+  while(avl_pop_min(tree, NULL, NULL));
+  stats = avl_memory_stats(tree);
+  if(stats.nodes || stats.payload || stats.total != base) errors++;
+
+  // A block too large to allocate is refused, not fatal.
+  Node *slots = avl_alloc_nodes(tree, INT_MAX);
+  if(slots) avl_release_slots(tree, slots, INT_MAX);
+  if(avl_memory_stats(tree).total != base) errors++;
+  free_tree(tree);
+
+  if(errors){
+    printf("Memory budget: %d checks failed!\n", errors);
+  }else{
+    printf("Memory budget: accounted exactly, %d evictions, limit held.\n",
+	   evictions);
+  }
+}
+
+/**
+ * @brief Run a random mix of traced calls on a tree.
+ * @return The number of calls made.
+ */
+int traced_calls(AvlTree *tree, int n_calls, int n_keys){
+  Node *node = NULL, *out[8];
+  for(int i = 0; i < n_calls; i++){
+    int key = rand_in_range(0, n_keys - 1);
+    switch(rand_in_range(0, 11)){
+    case 0: key_insert_new(key, tree); break;
+    case 1: avl_insert_hint(tree, key, NULL); break;
+    case 2: key_delete(key, tree); break;
+    case 3: avl_pop_min(tree, NULL, NULL); break;
+    case 4: avl_pop_max(tree, NULL, NULL); break;
+    case 5: avl_floor(tree, key); break;
+    case 6: avl_ceiling(tree, key); break;
+    case 7: avl_predecessor(tree, key); break;
+    case 8: avl_successor(tree, key); break;
+    case 9: avl_k_nearest(tree, key, rand_in_range(0, 8), out); break;
+    default: search_by_key(key, tree, &node); break;
+    }
+  }
+  return n_calls;
+}
+
+/**
+ * @brief Run a random mix of traced positional calls on a tree.
+ * @return The number of calls made.
+ */
+int traced_seq_calls(AvlTree *tree, int n_calls){
+  int calls = n_calls;
+  for(int i = 0; i < n_calls; i++){
+    // rand_in_range needs min < max.
+    int length = tree->number_of_nodes;
+    int index = length ? rand_in_range(0, length) : 0;
+    switch(rand_in_range(0, 6)){
+    case 0: avl_seq_insert_at(tree, index, NULL); break;
+    case 1: avl_seq_erase_at(tree, index, NULL); break;
+    case 2: avl_seq_get(tree, index); break;
+    case 3: {
+      // The lookup of the node is a call of its own.
+      Node *node = avl_seq_get(tree, length / 2);
+      if(node){
+	avl_seq_index(tree, node);
+	calls++;
+      }
+      break;
+    }
+    case 4: avl_seq_append(tree, NULL, rand_in_range(0, 4)); break;
+    case 5: {
+      AvlTree *right = make_tree_empty();
+      avl_seq_attach(right);
+      avl_seq_append(right, NULL, rand_in_range(0, 4));
+      avl_seq_concat(tree, right);
+      break;
+    }
+    default: {
+      int at = length ? rand_in_range(length / 2, length) : 0;
+      AvlTree *rest = avl_seq_split(tree, at);
+      if(rest) free_tree(rest);
+      break;
+    }
+    }
+  }
+  return calls;
+}
+
+void test_trace_replay(){
+  int errors = 0, n_keys = 4 * N_INSERT;
+  const char *path = "out/trace-test.bin";
+
+  AvlTree *tree = make_tree_empty();
+  for(int i = 0; i < N_INSERT / 2; i++){
+    key_insert_new(rand_in_range(0, n_keys - 1), tree);
+  }
+  int loaded = tree->number_of_nodes;
+
+  // Every public call is recorded exactly once.
+  AvlTrace *trace = avl_trace_start(tree, path);
+  if(trace == NULL){
+    printf("Trace replay: cannot create %s!\n", path);
+    free_tree(tree);
+    return;
+  }
+  int calls = traced_calls(tree, 16 * N_INSERT, n_keys);
+  if(avl_trace_stop(trace) != loaded + calls) errors++;
+  if(tree->trace != NULL) errors++;
+  traced_calls(tree, 16, n_keys); // Not recorded.
+
+  // The replay reproduces every result and the final tree.
+  AvlTree *replay = make_tree_empty();
+  AvlTraceReader *reader = avl_trace_open(path, NULL);
+  AvlTraceRecord record;
+  int records = 0, status;
+  while(reader && (status = avl_trace_next(reader, &record)) == 1){
+    if(avl_trace_apply(replay, &record) != record.result) errors++;
+    if((records < loaded) != (record.op == AVL_TRACE_LOAD)) errors++;
+    records++;
+  }
+  if(reader == NULL || status != 0 || records != loaded + calls) errors++;
+  if(reader) avl_trace_close(reader);
+  free_tree(tree);
+  tree = make_tree_empty();
+  reader = avl_trace_open(path, NULL);
+  while(reader && avl_trace_next(reader, &record) == 1){
+    avl_trace_apply(tree, &record);
+  }
+  if(reader) avl_trace_close(reader);
+  Node *a = avl_min(tree), *b = avl_min(replay);
+  while(a && b && a->key == b->key){
+    a = avl_next(a);
+    b = avl_next(b);
+  }
+  if(a || b || tree->number_of_nodes != replay->number_of_nodes) errors++;
+  free_tree(tree);
+  free_tree(replay);
+
+  // A positional tree is recorded and replayed in positional mode.
+  tree = make_tree_empty();
+  avl_seq_attach(tree);
+  avl_seq_append(tree, NULL, N_INSERT / 4);
+  trace = avl_trace_start(tree, path);
+  calls = trace ? traced_seq_calls(tree, 4 * N_INSERT) : 0;
+  if(trace == NULL || avl_trace_stop(trace) != 1 + N_INSERT / 4 + calls){
+    errors++;
+  }
+  replay = make_tree_empty();
+  reader = avl_trace_open(path, NULL);
+  while(reader && (status = avl_trace_next(reader, &record)) == 1){
+    if(avl_trace_apply(replay, &record) != record.result) errors++;
+  }
+  if(reader == NULL || status != 0) errors++;
+  if(reader) avl_trace_close(reader);
+  if(!avl_seq_attached(replay)
+     || replay->number_of_nodes != tree->number_of_nodes) errors++;
+  free_tree(tree);
+  free_tree(replay);
+
+  // Foreign files and partial records are rejected.
+  int error = 0;
+  FILE *file = fopen("out/trace-test.txt", "w");
+  if(file){
+    fputs("AVLTRACE is not a trace\n", file);
+    fclose(file);
+  }
+  if(avl_trace_open("out/trace-test.txt", &error) != NULL
+     || error != AVL_TRACE_ERROR_FORMAT) errors++;
+  remove("out/trace-test.txt");
+  file = fopen(path, "ab");
+  if(file){
+    fputc(0, file);
+    fclose(file);
+  }
+  reader = avl_trace_open(path, NULL);
+  records = 0;
+  while(reader && (status = avl_trace_next(reader, &record)) == 1) records++;
+  if(reader == NULL || status != AVL_TRACE_ERROR_FORMAT) errors++;
+  if(reader) avl_trace_close(reader);
+  remove(path);
+
+  if(errors){
+    printf("Trace replay: %d checks failed!\n", errors);
+  }else{
+    printf("Trace replay: %d records replayed identically.\n", records);
+  }
+}
+
+/**
+ * @brief Check a positional tree against the expected sequence:
+ * structure, order, positions and memory.
+ * @param tree - The positional tree, with the values as node data.
+ * @param values - The expected sequence.
+ * @param n - Its length.
+ * @return The number of failed checks.
+ */
+int check_sequence(AvlTree *tree, const int *values, int n){
+  int errors = 0;
+  if(tree->number_of_nodes != n) return 1;
+  if(check_heights(tree->root) != tree->height) errors++;
+  if(!check_avl_property(tree->root)) errors++;
+  errors += check_parents(tree->root);
+  if(tree->memory.nodes + tree->memory.payload != n * tree->node_size) errors++;
+
+  int i = 0;
+  for(Node *node = avl_min(tree); node; node = avl_next(node), i++){
+    if(i >= n || (int)(long)node->data != values[i]) return errors + 1;
+    if(avl_seq_index(tree, node) != i) errors++;
+  }
+  if(i != n || (n && avl_max(tree) != avl_seq_get(tree, n - 1))) errors++;
+  return errors;
+}
+
+/**
+ * @brief Test the positional mode against an array: insertion and
+ * deletion at random positions, bulk appends, splits and joins.
+ */
+void test_positional(){
+  int errors = 0, n = 0, capacity = 16 * N_INSERT;
+  int *values = (int *)malloc(capacity * sizeof(int));
+  void **batch = (void **)malloc(N_INSERT * sizeof(void *));
+  assert(values != NULL && batch != NULL);
+
+  AvlTree *tree = make_tree_empty();
+  if(!avl_seq_attach(tree) || avl_seq_attach(tree)) errors++;
+
+  for(int round = 0; round < 8; round++){
+    // Random edits, mostly insertions.
+    for(int op = 0; op < N_INSERT; op++){
+      // rand_in_range needs min < max.
+      int index = n ? rand_in_range(0, n) : 0;
+      if(n > 0 && rand() % 3 == 0){
+	index = (n > 1) ? rand_in_range(0, n - 1) : 0;
+	void *data = NULL;
+	if(avl_seq_erase_at(tree, index, &data) != 1) errors++;
+	if((int)(long)data != values[index]) errors++;
+	memmove(values + index, values + index + 1, (n - index - 1) * sizeof(int));
+	n--;
+      }else{
+	int value = round * N_INSERT + op;
+	Node *node = avl_seq_insert_at(tree, index, (void *)(long)value);
+	if(node == NULL || avl_seq_index(tree, node) != index) errors++;
+	memmove(values + index + 1, values + index, (n - index) * sizeof(int));
+	values[index] = value;
+	n++;
+      }
+    }
+    if(avl_seq_get(tree, n) || avl_seq_erase_at(tree, n, NULL)) errors++;
+
+    // A bulk append of a varying size.
+    int count = rand_in_range(1, N_INSERT / 4);
+    for(int i = 0; i < count; i++){
+      values[n + i] = -(round * N_INSERT + i);
+      batch[i] = (void *)(long)values[n + i];
+    }
+    if(avl_seq_append(tree, batch, count) != 1) errors++;
+    n += count;
+    errors += check_sequence(tree, values, n);
+
+    // Split anywhere, including the ends, and join again.
+    int at = (round == 0) ? 0 : (round == 1) ? n : rand_in_range(0, n);
+    AvlTree *rest = avl_seq_split(tree, at);
+    if(rest == NULL) errors++;
+    errors += check_sequence(tree, values, at);
+    errors += check_sequence(rest, values + at, n - at);
+    avl_seq_concat(tree, rest);
+    errors += check_sequence(tree, values, n);
+    if(tree->memory.aux != sizeof(AvlTree)) errors++;
+  }
+
+  // Trees holding node blocks split too, and share the blocks:
+  // the part split off outlives the tree it came from.
+  avl_compact(tree, AVL_LAYOUT_INORDER);
+  errors += check_sequence(tree, values, n);
+  int half = n / 2;
+  AvlTree *rest = avl_seq_split(tree, half);
+  if(rest == NULL) errors++;
+  errors += check_sequence(tree, values, half);
+  errors += check_sequence(rest, values + half, n - half);
+  free_tree(tree);
+  tree = rest;
+  if(avl_seq_erase_at(tree, 0, NULL) != 1) errors++;
+  n -= half + 1;
+  memmove(values, values + half + 1, n * sizeof(int));
+  errors += check_sequence(tree, values, n);
+  if(tree->memory.nodes != n * sizeof(Node)) errors++;
+
+  // The limit holds for appends, which leave the tree unchanged.
+  avl_memory_budget(tree, 0, tree->memory.total + 8 * tree->node_size,
+		    NULL, NULL);
+  if(avl_seq_append(tree, batch, 16) != AVL_ERROR_NO_MEMORY) errors++;
+  if(tree->number_of_nodes != n) errors++;
+  free_tree(tree);
+  free(values);
+  free(batch);
+
+  if(errors){
+    printf("Positional mode: %d checks failed!\n", errors);
+  }else{
+    printf("Positional mode: %d elements edited, split and joined.\n", n);
+  }
+}
+
+/**
+ * @brief Expected deadlines and the checks of an expiry run.
+ */
+typedef struct {
+  long long *deadlines, now, last;
+  int expired, errors;
+} ExpiryCheck;
+
+/**
+ * @brief Check an expired node: it is due, in deadline order.
+ */
+void check_expired(Node *node, void *ctx){
+  ExpiryCheck *check = (ExpiryCheck *)ctx;
+  long long deadline = check->deadlines[node->key];
+  if(deadline > check->now || deadline < check->last) check->errors++;
+  check->last = deadline;
+  check->deadlines[node->key] = -1; // Deleted.
+  check->expired++;
+}
+
+/**
+ * @brief Expire up to a time and check that exactly the due nodes
+ * went, and that lookups see the rest.
+ * @return The number of failed checks.
+ */
+int expire_until(AvlTree *tree, ExpiryCheck *check, int n_keys, long long now){
+  int due = 0;
+  for(int key = 0; key < n_keys; key++){
+    long long deadline = check->deadlines[key];
+    due += deadline >= 0 && deadline <= now;
+  }
+
+  check->now = now;
+  check->last = check->expired = 0;
+  int errors = (avl_expire(tree, now, check_expired, check) != due);
+  errors += (check->expired != due);
+  for(int key = 0; key < n_keys; key++){
+    if(has(tree, key) != (check->deadlines[key] >= 0)) errors++;
+  }
+  return errors;
+}
+
+/**
+ * @brief Test expiring trees: hidden lookups, bulk expiration in
+ * deadline order, changed and cleared deadlines, deletions and
+ * compaction moving the nodes.
+ */
+void test_expiry(){
+  int n_keys = 4 * N_INSERT, errors = 0;
+  long long *deadlines = (long long *)malloc(n_keys * sizeof(long long));
+  assert(deadlines != NULL);
+  ExpiryCheck check = {deadlines, 0, 0, 0, 0};
+
+  AvlTree *tree = make_tree_empty();
+  if(!avl_expiry_attach(tree, 1) || avl_expiry_attach(tree, 0)) errors++;
+  for(int key = 0; key < n_keys; key++){
+    deadlines[key] = (key % 5 == 0) ? AVL_NO_DEADLINE : rand_in_range(1, 999);
+    if(avl_insert_expiring(tree, key, deadlines[key]) != 1) errors++;
+  }
+  if(avl_insert_expiring(tree, 1, 0) != 0) errors++;
+
+  // Change a third of the deadlines, clear some and delete some.
+  for(int key = 1; key < n_keys; key += 3){
+    Node *node = NULL;
+    search_by_key(key, tree, &node);
+    deadlines[key] = (key % 7 == 0) ? AVL_NO_DEADLINE : rand_in_range(1, 999);
+    avl_expiry_set(tree, node, deadlines[key]);
+    if(avl_expiry_deadline(tree, node) != deadlines[key]) errors++;
+  }
+  for(int key = 2; key < n_keys; key += 11){
+    key_delete(key, tree);
+    deadlines[key] = -1;
+  }
+
+  // Expired nodes are hidden before they are deleted.
+  int live = tree->number_of_nodes, hidden = 0;
+  avl_expiry_now(tree, 300);
+  for(int key = 0; key < n_keys; key++){
+    if(deadlines[key] < 0) continue;
+    int expired = deadlines[key] <= 300;
+    hidden += expired;
+    if(has(tree, key) == expired) errors++;
+  }
+  if(tree->number_of_nodes != live) errors++;
+
+  errors += expire_until(tree, &check, n_keys, 300);
+  avl_compact(tree, AVL_LAYOUT_BFS);
+  errors += expire_until(tree, &check, n_keys, 600);
+  errors += expire_until(tree, &check, n_keys, 1000);
+  if(!check_tree(tree, "Expiry")) errors++;
+  errors += check_parents(tree->root);
+  errors += check.errors;
+
+  // Only the nodes without a deadline remain.
+  for(Node *node = avl_min(tree); node; node = avl_next(node)){
+    if(avl_expiry_deadline(tree, node) != AVL_NO_DEADLINE) errors++;
+  }
+  free_tree(tree);
+  free(deadlines);
+
+  if(errors){
+    printf("Expiry: %d checks failed!\n", errors);
+  }else{
+    printf("Expiry: %d of %d entries hidden, then expired in order.\n",
+	   hidden, live);
+  }
+}
+
+/**
+ * @brief State of the range tree test's report callback.
+ */
+typedef struct {
+  int x_lo, x_hi, y_lo, y_hi;
+  int *seen, *ids;
+  int stop_after, reported, errors;
+} RangeCheck;
+
+/**
+ * @brief Callback for the range tree test, checks that a point lies
+ * in the query and is reported once.
+ */
+int check_range_point(const RangePoint *point, void *ctx){
+  RangeCheck *check = (RangeCheck *)ctx;
+  int id = (int)((int *)point->data - check->ids);
+  if(point->x < check->x_lo || point->x > check->x_hi ||
+     point->y < check->y_lo || point->y > check->y_hi) check->errors++;
+  if(check->seen[id]++) check->errors++;
+  return ++check->reported == check->stop_after;
+}
+
+/**
+ * @brief Test range counting and reporting of the 2-D range tree
+ * against a brute force scan, with many shared coordinates.
+ */
+void test_range_tree(){
+  int n = 4 * N_INSERT, errors = 0;
+  RangePoint *points = (RangePoint *)malloc(n * sizeof(RangePoint));
+  int *ids = (int *)malloc(n * sizeof(int));
+  int *seen = (int *)malloc(n * sizeof(int));
+  assert(points != NULL && ids != NULL && seen != NULL);
+  for(int i = 0; i < n; i++){
+    ids[i] = i;
+    points[i].x = rand_in_range(-N_INSERT / 2, N_INSERT / 2);
+    points[i].y = rand_in_range(0, N_INSERT / 4);
+    points[i].data = &ids[i];
+  }
+
+  RangeTree *rtree = make_range_tree(points, n);
+  if(!check_tree(rtree->tree, "Range tree")) errors++;
+  errors += check_parents(rtree->tree->root);
+  if(rtree->number_of_points != n) errors++;
+  if(range_count(rtree, -N_INSERT, N_INSERT, 0, N_INSERT) != n) errors++;
+
+  for(int q = 0; q < 300; q++){
+    RangeCheck check = {0, 0, 0, 0, seen, ids, 0, 0, 0};
+    check.x_lo = rand_in_range(-N_INSERT / 2 - 10, N_INSERT / 2);
+    check.x_hi = check.x_lo + rand_in_range(-5, N_INSERT / 3);
+    check.y_lo = rand_in_range(-10, N_INSERT / 4);
+    check.y_hi = check.y_lo + rand_in_range(-5, N_INSERT / 8);
+    int expect = 0;
+    for(int i = 0; i < n; i++){
+      expect += points[i].x >= check.x_lo && points[i].x <= check.x_hi &&
+	points[i].y >= check.y_lo && points[i].y <= check.y_hi;
+    }
+    if(range_count(rtree, check.x_lo, check.x_hi, check.y_lo, check.y_hi)
+       != expect) errors++;
+
+    // Every third query stops early.
+    memset(seen, 0, n * sizeof(int));
+    if(q % 3 == 0) check.stop_after = 5;
+    int reported = range_report(rtree, check.x_lo, check.x_hi, check.y_lo,
+				check.y_hi, check_range_point, &check);
+    int wanted = (check.stop_after && expect > 5) ? 5 : expect;
+    if(reported != wanted || check.reported != wanted) errors++;
+    errors += check.errors;
+  }
+  free_range_tree(rtree);
+
+  // Degenerate inputs.
+  rtree = make_range_tree(NULL, 0);
+  if(range_count(rtree, 0, 10, 0, 10) != 0) errors++;
+  free_range_tree(rtree);
+  rtree = make_range_tree(points, 1);
+  if(range_report(rtree, points[0].x, points[0].x, points[0].y, points[0].y,
+		  NULL, NULL) != 1) errors++;
+  free_range_tree(rtree);
+  free(points);
+  free(ids);
+  free(seen);
+
+  if(errors){
+    printf("Range tree: %d checks failed!\n", errors);
+  }else{
+    printf("Range tree: counting and reporting queries correct.\n");
+  }
+}
+
+#define MERGE_TREES 6 // Trees merged by the merge test.
+
+/**
+ * @brief Callback for the merge test, stops after a number of nodes.
+ */
+int count_merged(Node *node, int tree, void *ctx){
+  int *left = (int *)ctx;
+  return --*left == 0;
+}
+
+/**
+ * @brief Test the k-way merge under all three policies, with seeks
+ * and bounded visits, against presence arrays of the merged trees.
+ */
+void test_merge_iterator(){
+  int range = 4 * N_INSERT, errors = 0;
+  char *present = (char *)calloc(MERGE_TREES * range, 1);
+  assert(present != NULL);
+  AvlTree *trees[MERGE_TREES];
+
+  // Overlapping trees of different sizes, the last one empty.
+  long total = 0;
+  for(int t = 0; t < MERGE_TREES; t++){
+    trees[t] = make_tree_empty();
+    for(int i = 0; i < (MERGE_TREES - 1 - t) * N_INSERT / 2; i++){
+      int key = rand_in_range(0, range - 1);
+      if(key_insert_new(key, trees[t])){
+	present[t * range + key] = 1;
+	total++;
+      }
+    }
+  }
+
+  for(int policy = AVL_MERGE_ALL; policy <= AVL_MERGE_LAST; policy++){
+    AvlMerge *merge = make_avl_merge(trees, MERGE_TREES, policy);
+    long count = 0;
+    int last_key = -1, last_tree = -1, tree = 0;
+    for(Node *node; (node = avl_merge_next(merge, &tree)); count++){
+      if(!present[tree * range + node->key]) errors++;
+      if(node->key < last_key) errors++;
+      if(node->key == last_key && (policy != AVL_MERGE_ALL ||
+				   tree <= last_tree)) errors++;
+
+      // The first or last tree holding the key reports it.
+      for(int t = 0; t < MERGE_TREES && policy != AVL_MERGE_ALL; t++){
+	if(present[t * range + node->key] &&
+	   ((policy == AVL_MERGE_FIRST && t < tree) ||
+	    (policy == AVL_MERGE_LAST && t > tree))) errors++;
+      }
+      last_key = node->key;
+      last_tree = tree;
+    }
+    if(avl_merge_peek(merge) != NULL) errors++;
+
+    long expect = total;
+    if(policy != AVL_MERGE_ALL){
+      expect = 0;
+      for(int key = 0; key < range; key++){
+	int any = 0;
+	for(int t = 0; t < MERGE_TREES; t++) any |= present[t * range + key];
+	expect += any;
+      }
+    }
+    if(count != expect) errors++;
+
+    // Seek in both directions, then visit a bounded range in steps.
+    for(int q = 0; q < 100; q++){
+      int lo = rand_in_range(-10, range), hi = lo + rand_in_range(0, 200);
+      avl_merge_seek(merge, lo);
+      int first = lo < 0 ? 0 : lo;
+      while(first < range){
+	int any = 0;
+	for(int t = 0; t < MERGE_TREES; t++) any |= present[t * range + first];
+	if(any) break;
+	first++;
+      }
+      Node *peek = avl_merge_peek(merge);
+      if(peek ? peek->key != first : first < range) errors++;
+
+      int stop = 10;
+      long visited = avl_merge_visit(merge, hi, count_merged, &stop);
+      stop = 0;
+      visited += avl_merge_visit(merge, hi, count_merged, &stop);
+      Node *next = avl_merge_peek(merge);
+      if(next && next->key <= hi) errors++;
+
+      long in_range = 0;
+      for(int key = first; key <= hi && key < range; key++){
+	int holders = 0;
+	for(int t = 0; t < MERGE_TREES; t++) holders += present[t * range + key];
+	in_range += (policy == AVL_MERGE_ALL) ? holders : holders > 0;
+      }
+      if(visited != in_range) errors++;
+    }
+    free_avl_merge(merge);
+  }
+
+  for(int t = 0; t < MERGE_TREES; t++) free_tree(trees[t]);
+  free(present);
+
+  if(errors){
+    printf("Merge iterator: %d checks failed!\n", errors);
+  }else{
+    printf("Merge iterator: %ld nodes of %d trees merged in order.\n",
+	   total, MERGE_TREES);
+  }
 }
 
 int main(int argc, char **argv){
@@ -136,6 +2211,37 @@ int main(int argc, char **argv){
   // Remove the tree.
   free(tree);
   tree = NULL;
+
+  /*
+   * ----------------------
+   * -- Extended tests.  --
+   * ----------------------
+   */
+
+  test_hinted_insertion();
+  test_min_max();
+  test_augmentation();
+  test_interval_tree();
+  test_nearest_keys();
+  test_typed_keys();
+  test_string_keys();
+  test_inline_values();
+  test_small_tree();
+  test_compaction();
+  test_parallel_build();
+  test_parallel_reduce();
+  test_flat_combining();
+  test_hot_key_cache();
+  test_negative_filter();
+  test_stream_load();
+  test_merkle_diff();
+  test_relaxed_balance();
+  test_memory_budget();
+  test_trace_replay();
+  test_positional();
+  test_expiry();
+  test_range_tree();
+  test_merge_iterator();
   
   return 0;
 }